@@ -130,15 +130,18 @@ void Fiber::Resume() {
         int flag = swapcontext(&(fiber_info::t_main_fiber->m_ctx), &m_ctx);
         WTSCLWQ_ASSERT(flag == 0, "swapcontext()错误");
     }
+    // 回到这里时协程的上下文已经保存完毕，此后才允许其他线程resume它
+    if (m_state == EXEC) {
+        m_state = READY;
+    }
 }
 
 void Fiber::Yield() {
     // 两种情况：1.协程运行结束，将自身状态设置为TERM  2.协程主动让出CPU，状态为EXEC
     WTSCLWQ_ASSERT(m_state == TERM || m_state == EXEC,
                    "无法yield早就处于READY状态的协程");
-    if (m_state != TERM) {
-        m_state = READY;
-    }
+    // 状态保持EXEC，由Resume()在swapcontext返回后改为READY：
+    // 如果在这里就改为READY，其他线程可能在上下文保存完成前resume这个协程
     if (m_running_in_scheduler) {
         SetCurFiber(Scheduler::GetScheduleFiber());
         int flag = swapcontext(&m_ctx, &(Scheduler::GetScheduleFiber()->m_ctx));
@@ -62,6 +62,16 @@ auto Scheduler::HasIdleThread() const -> bool {
     return m_idle_thread_count > 0;
 }
 
+auto Scheduler::GetPoolThreadIds() const -> std::vector<pid_t> {
+    ScopedLock<MutexType> lock(m_mutex);
+    std::vector<pid_t> ids;
+    ids.reserve(m_threads_vec.size());
+    for (const auto& thread : m_threads_vec) {
+        ids.push_back(thread->GetId());
+    }
+    return ids;
+}
+
 auto Scheduler::GetThisThreadScheduler() -> Scheduler* { return t_scheduler; }
 
 auto Scheduler::GetScheduleFiber() -> Fiber* { return t_schedule_fiber; }
@@ -214,9 +224,14 @@ void Scheduler::Run() {
 auto Scheduler::OnStop() -> bool {
     ScopedLock<MutexType> lock(m_mutex);
     // m_is_auto_stop是防止调度器空闲状态下自动关闭的关键
-    return m_is_stop && m_task_list.empty() && m_active_thread_count == 0;
+    return m_is_stop && m_task_list.empty() && m_active_thread_count == 0 &&
+           m_external_pending_count == 0;
 }
 
+void Scheduler::AddExternalPending() { ++m_external_pending_count; }
+
+void Scheduler::RemoveExternalPending() { --m_external_pending_count; }
+
 void Scheduler::OnIdle() {
     // 每次从Run回到这里，都会判断是否可以Stop,只有满足了所有的stop条件，才能顺利让idle_fiber成为而term状态
     // 从而保证如果先执行start,再加入任务时，不会出现所有线程都已经结束，没有人做任务的情况
@@ -10,6 +10,7 @@
 #include <sys/ucontext.h>
 #include <ucontext.h>
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
@@ -69,7 +70,7 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
 
     /**
      * @brief 将this协程上下文存储起来，然后加载调度协程或者主协程上下文，
-     * 前者READY,后者EXEC
+     * 前者在切换完成后由Resume()置为READY,后者EXEC
      */
     void Yield();
 
@@ -120,7 +121,7 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
     uint64_t m_id;                      // 协程ID
     uint32_t m_stack_size;              // 协程栈空间大小
     void *m_stack;                      // 协程栈空间指针
-    State m_state;                      // 协程运行状态
+    std::atomic<State> m_state;         // 协程运行状态
     ucontext_t m_ctx{};                 // 用户态上下文
     std::function<void()> m_call_back;  // 回调函数
     bool m_running_in_scheduler;        // 是否由调度器支配
@@ -74,6 +74,22 @@ class Scheduler {
      */
     auto HasIdleThread() const -> bool;
 
+    /**
+     * @brief 线程池中各线程的id，不包括只在Stop()中参与调度的创建者线程
+     */
+    auto GetPoolThreadIds() const -> std::vector<pid_t>;
+
+    /**
+     * @brief 登记一个挂起在调度器之外(如卸载线程池中)、之后会被重新调度的协程，
+     * 存在这样的协程时调度器不会停止
+     */
+    void AddExternalPending();
+
+    /**
+     * @brief 注销AddExternalPending()登记的协程，必须在协程重新Schedule之后调用
+     */
+    void RemoveExternalPending();
+
     /**
      * @description: 添加任务 thread-safe
      * @param {Executable} & 模板对象,可以是fiber和fubction,用来构建Task
@@ -173,6 +189,7 @@ class Scheduler {
     size_t m_thread_count{0};                     // 线程池总线程数
     std::atomic_size_t m_active_thread_count{0};  // 活跃线程数
     std::atomic_size_t m_idle_thread_count{0};    // 空闲线程数
+    std::atomic_size_t m_external_pending_count{0};  // 调度器外挂起的协程数
     bool m_is_stop{true};                         // 是否处于停止状态
     bool m_is_auto_stop{false};                   // 是否自动停止
     int m_root_thread_id{0};                      // 调度器创建者线程id
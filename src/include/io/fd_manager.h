@@ -4,7 +4,9 @@
  */
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 
 #include "../concurrency/lock.h"
 #include "../util/singleton.h"
@@ -25,6 +27,10 @@ class FileDescriptor : public std::enable_shared_from_this<FileDescriptor> {
     auto Init() -> bool;
     [[maybe_unused]] auto IsInit() const -> bool;
     auto IsSocket() const -> bool;
+    /**
+     * @brief 是否是普通文件或块设备，这类fd的阻塞io由卸载线程池执行
+     */
+    auto IsFile() const -> bool;
     auto IsClosed() const -> bool;
 
     void SetUserNonBlock(bool val);
@@ -39,6 +45,7 @@ class FileDescriptor : public std::enable_shared_from_this<FileDescriptor> {
   private:
     bool m_is_init : 1;           // 是否初始化
     bool m_is_socket : 1;         // 是不是socket fd
+    bool m_is_file : 1;           // 是不是普通文件或块设备 fd
     bool m_system_non_block : 1;  // 是否内核非阻塞
     bool m_user_non_block : 1;    // 是否用户非阻塞
     bool m_is_closed : 1;         // 是否关闭
@@ -48,12 +55,36 @@ class FileDescriptor : public std::enable_shared_from_this<FileDescriptor> {
     wtsclwq::IOManager *m_iom;
 };
 
+/**
+ * @brief 读取FileDescriptorManagerImpl::GetRaw()返回的裸指针时所需的临界区，
+ * 基于epoch的回收保证临界区内被Remove()的FileDescriptor不会被释放
+ * @attention 临界区内不能让出协程，协程可能在其他线程上恢复
+ */
+class FdEpochGuard {
+  public:
+    FdEpochGuard(const FdEpochGuard &) = delete;
+    FdEpochGuard(FdEpochGuard &&) = delete;
+    auto operator=(const FdEpochGuard &) -> FdEpochGuard & = delete;
+    auto operator=(FdEpochGuard &&) -> FdEpochGuard & = delete;
+
+    FdEpochGuard();
+    ~FdEpochGuard();
+};
+
 /**
  * @brief FileDescriptorManagerImpl 文件描述符管理类
  */
 class FileDescriptorManagerImpl {
   public:
+    FileDescriptorManagerImpl(const FileDescriptorManagerImpl &) = delete;
+    FileDescriptorManagerImpl(FileDescriptorManagerImpl &&) = delete;
+    auto operator=(const FileDescriptorManagerImpl &)
+        -> FileDescriptorManagerImpl & = delete;
+    auto operator=(FileDescriptorManagerImpl &&)
+        -> FileDescriptorManagerImpl & = delete;
+
     FileDescriptorManagerImpl();
+    ~FileDescriptorManagerImpl();
 
     /**
      * @brief 获取文件描述符 fd 对应的包装对象，若指定参数 auto_create 为 true,
@@ -64,14 +95,48 @@ class FileDescriptorManagerImpl {
      */
     auto Get(int filedesc, bool auto_create = false) -> FileDescriptor::ptr;
 
+    /**
+     * @brief 无锁、无引用计数地获取文件描述符 fd 对应的包装对象，供hook的快速路径使用
+     * @return 不存在时返回 nullptr
+     * @pre 调用者必须处于FdEpochGuard的作用域内，且只在作用域内使用返回值
+     */
+    auto GetRaw(int filedesc) const -> FileDescriptor *;
+
+    /**
+     * @brief 为刚由内核分配的 fd 重新创建包装对象。fd 若曾被未经hook的close
+     * 关闭，管理类中会残留旧的包装对象(类型、超时、非阻塞标志都已过时)，先将其删除
+     */
+    auto Reset(int filedesc) -> FileDescriptor::ptr;
+
     /**
      * @brief 将一个文件描述符从管理类中删除
      */
     void Remove(int filedesc);
 
   private:
+    static const size_t CHUNK_SIZE = 1024;  // 每个分段的槽位数
+    static const size_t CHUNK_COUNT = 1024;  // 分段数,可管理的fd上限为二者之积
+    using Chunk = std::atomic<FileDescriptor *>[CHUNK_SIZE];
+
+    /**
+     * @brief 被删除但可能仍在读者临界区中使用的FileDescriptor
+     */
+    struct Retired {
+        FileDescriptor::ptr fdp{};  // 管理类持有的引用
+        uint64_t epoch{0};          // 删除时的epoch
+    };
+
+    /**
+     * @brief 回收所有不再被任何读者临界区引用的FileDescriptor
+     * @pre 持有m_retire_mutex
+     */
+    void Reclaim();
+
     RWLock m_lock{};
-    std::vector<FileDescriptor::ptr> m_data;
+    std::vector<FileDescriptor::ptr> m_data;  // 持有所有权,由m_lock保护
+    std::atomic<Chunk *> m_chunks[CHUNK_COUNT]{};  // NOLINT 无锁读取的裸指针镜像
+    std::mutex m_retire_mutex;
+    std::vector<Retired> m_retired{};
 };
 
 using FileDescriptorManager = SingletonPtr<FileDescriptorManagerImpl>;
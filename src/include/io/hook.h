@@ -2,7 +2,11 @@
 #define SERVER_FRAMEWORK_HOOK_H
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/uio.h>
@@ -66,6 +70,16 @@ extern sendto_func sendto_f;
 using sendmsg_func = ssize_t (*)(int, const struct msghdr *, int);
 extern sendmsg_func sendmsg_f;
 
+using accept4_func = int (*)(int, struct sockaddr *, socklen_t *, int);
+extern accept4_func accept4_f;
+
+using recvmmsg_func = int (*)(int, struct mmsghdr *, unsigned int, int,
+                              struct timespec *);
+extern recvmmsg_func recvmmsg_f;
+
+using sendmmsg_func = int (*)(int, struct mmsghdr *, unsigned int, int);
+extern sendmmsg_func sendmmsg_f;
+
 using getsockopt_func = int (*)(int, int, int, void *, socklen_t *);
 extern getsockopt_func getsockopt_f;
 
@@ -85,6 +99,18 @@ extern write_func write_f;
 using close_func = int (*)(int);
 extern close_func close_f;
 
+using pread_func = ssize_t (*)(int, void *, size_t, off_t);
+extern pread_func pread_f;
+
+using pwrite_func = ssize_t (*)(int, const void *, size_t, off_t);
+extern pwrite_func pwrite_f;
+
+using fsync_func = int (*)(int);
+extern fsync_func fsync_f;
+
+using fdatasync_func = int (*)(int);
+extern fdatasync_func fdatasync_f;
+
 //////// sys/uio.h
 using readv_func = ssize_t (*)(int, const struct iovec *, int);
 extern readv_func readv_f;
@@ -92,10 +118,49 @@ extern readv_func readv_f;
 using writev_func = ssize_t (*)(int, const struct iovec *, int);
 extern writev_func writev_f;
 
+using preadv2_func = ssize_t (*)(int, const struct iovec *, int, off_t, int);
+extern preadv2_func preadv2_f;
+
+using pwritev2_func = ssize_t (*)(int, const struct iovec *, int, off_t, int);
+extern pwritev2_func pwritev2_f;
+
+using preadv_func = ssize_t (*)(int, const struct iovec *, int, off_t);
+extern preadv_func preadv_f;
+
+using pwritev_func = ssize_t (*)(int, const struct iovec *, int, off_t);
+extern pwritev_func pwritev_f;
+
+//////// sys/sendfile.h
+using sendfile_func = ssize_t (*)(int, int, off_t *, size_t);
+extern sendfile_func sendfile_f;
+
 //////// fcntl.h
 using fcntl_func = int (*)(int, int, ...);
 extern fcntl_func fcntl_f;
 
+using open_func = int (*)(const char *, int, ...);
+extern open_func open_f;
+
+using openat_func = int (*)(int, const char *, int, ...);
+extern openat_func openat_f;
+
+using splice_func = ssize_t (*)(int, loff_t *, int, loff_t *, size_t,
+                                unsigned int);
+extern splice_func splice_f;
+
+//////// poll.h
+using poll_func = int (*)(struct pollfd *, nfds_t, int);
+extern poll_func poll_f;
+
+//////// sys/select.h
+using select_func = int (*)(int, fd_set *, fd_set *, fd_set *,
+                            struct timeval *);
+extern select_func select_f;
+
+//////// sys/epoll.h
+using epoll_wait_func = int (*)(int, struct epoll_event *, int, int);
+extern epoll_wait_func epoll_wait_f;
+
 //////// sys/ioctl.h
 using ioctl_func = int (*)(int, uint64_t, ...);
 extern ioctl_func ioctl_f;
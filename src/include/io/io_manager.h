@@ -9,6 +9,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -38,6 +39,9 @@ class IOManager : public Scheduler, public TimerManager {
             Scheduler *scheduler{nullptr};     // 用来调度事件的scheduler
             Fiber::ptr fiber{};                // 执行事件的协程
             std::function<void()> callback{};  // 事件回调函数
+            uint64_t deadline_seq{0};          // 每次注册事件递增
+            size_t deadline_index{std::numeric_limits<size_t>::max()};  // 在超时堆中的下标
+            int *timeout_result{nullptr};  // 超时后写入ETIMEDOUT
         };
         auto GetEventHandler(EventType event) -> EventHandler &;
         static void ResetEventHandler(EventHandler &handler);
@@ -49,6 +53,16 @@ class IOManager : public Scheduler, public TimerManager {
         MutexType mutex;
     };
 
+    /**
+     * @brief 超时堆中的节点，记录某个fd上某个事件的等待时限
+     */
+    struct DeadlineEntry {
+        uint64_t deadline{0};        // 超时的绝对时间戳(ms)
+        uint64_t seq{0};             // 对应EventHandler::deadline_seq
+        FdContext *fd_ctx{nullptr};  // 对应的fd上下文
+        EventType event{NONE};       // 对应的事件
+    };
+
   public:
     explicit IOManager(size_t thread_num = 1, bool use_caller = true,
                        std::string name = "");
@@ -60,6 +74,17 @@ class IOManager : public Scheduler, public TimerManager {
      */
     auto AddEvent(int filedsc, EventType new_event,
                   std::function<void()> callback = nullptr) -> int;
+
+    /**
+     * @brief 注册事件并为本次等待设置超时时限,超时直接由事件循环检查,
+     * 不需要创建定时器,等待期间没有堆内存分配
+     * @param[in] timeout_ms 超时时长(ms)
+     * @param[out] timeout_result 超时时被写入ETIMEDOUT,
+     * 必须在协程被唤醒前保持有效(一般是等待协程栈上的变量)
+     * @return 0 success, -1 error
+     */
+    auto AddTimedEvent(int filedsc, EventType new_event, uint64_t timeout_ms,
+                       int *timeout_result) -> int;
     [[maybe_unused]] [[maybe_unused]] auto DelEvent(int filedesc, EventType event) -> bool;
     auto CancelEvent(int filedesc, EventType event) -> bool;
     auto CancelAll(int filedesc) -> bool;
@@ -73,11 +98,38 @@ class IOManager : public Scheduler, public TimerManager {
     void OnIdle() override;
     void OnTimerInsertedFront() override;
     void ContextVecResize(size_t size);
+    auto AddEventImpl(int filedsc, EventType new_event,
+                      std::function<void()> callback, uint64_t timeout_ms,
+                      int *timeout_result) -> int;
+
+    /**
+     * @brief 将handler从超时堆中移除，需持有fd_ctx的锁
+     */
+    void DisarmDeadline(FdContext::EventHandler &handler);
+
+    /**
+     * @brief 返回[距离]最近的io超时的时间，没有则返回UINT64_MAX
+     */
+    auto GetNextDeadline() -> uint64_t;
+
+    /**
+     * @brief 取消所有已经超时的事件，并唤醒对应的协程
+     */
+    void ProcessExpiredDeadlines();
+
+    // 以下超时堆操作需持有m_deadline_mutex
+    void DeadlineHeapSet(size_t index, const DeadlineEntry &entry);
+    void DeadlineHeapSiftUp(size_t index);
+    void DeadlineHeapSiftDown(size_t index);
+    void DeadlineHeapRemove(size_t index);
+
     int m_epfd{0};                                 // epoll实例文件描述符
     int m_tickle_fds[2]{};                         // 通信管道 NOLINT
     std::atomic<size_t> m_pending_event_count{0};  // 等待执行的事件的数量
     std::vector<FdContext::ptr> m_fd_contexts_vec{};  // vec[i].fd=下标
     RWLock m_rwlock;
+    std::vector<DeadlineEntry> m_deadline_heap{};  // 按deadline排列的小顶堆
+    std::mutex m_deadline_mutex;                   // 保护m_deadline_heap
 };
 
 }  // namespace wtsclwq
\ No newline at end of file
@@ -0,0 +1,102 @@
+/*
+ * @Description: 阻塞调用卸载线程池
+ */
+#pragma once
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../concurrency/fiber.h"
+#include "../concurrency/scheduler.h"
+#include "../concurrency/thread.h"
+
+namespace wtsclwq {
+/**
+ * @brief 阻塞调用卸载线程池。
+ * 普通文件的读写无法用epoll等待，直接在调度线程上执行会阻塞该线程上的所有协程，
+ * hook层把这类调用交给本线程池执行，调用协程挂起，完成后再由原调度器恢复
+ */
+class OffloadPool {
+  public:
+    OffloadPool(const OffloadPool &) = delete;
+    OffloadPool(OffloadPool &&) = delete;
+    auto operator=(const OffloadPool &) -> OffloadPool & = delete;
+    auto operator=(OffloadPool &&) -> OffloadPool & = delete;
+
+    using ptr = std::shared_ptr<OffloadPool>;
+    using MutexType = std::mutex;
+
+    /**
+     * @param thread_num 工作线程数
+     * @param name 线程名前缀
+     */
+    explicit OffloadPool(size_t thread_num, std::string name = "offload");
+    ~OffloadPool();
+
+    /**
+     * @brief 获取全局的卸载线程池，线程数由配置 io.offload.thread_num 决定
+     * @return 线程数为0(不启用卸载)时返回 nullptr
+     */
+    static auto GetInstance() -> OffloadPool *;
+
+    /**
+     * @brief 在工作线程中执行func，当前协程挂起直到执行完成
+     * @return func的返回值，errno被设置为func执行后工作线程上的errno
+     * @pre 当前处于调度器的任务协程中，func引用的对象在返回前一直有效
+     */
+    template <typename Func>
+    auto Execute(Func &&func) -> ssize_t;
+
+    auto GetThreadNum() const -> size_t;
+
+  private:
+    /**
+     * @brief 一次卸载请求，分配在调用协程的栈上，协程挂起期间一直有效
+     */
+    struct Job {
+        ssize_t (*invoke)(void *){nullptr};  // 类型擦除后的调用入口
+        void *arg{nullptr};                  // 调用对象
+        ssize_t result{0};                   // 返回值
+        int error{0};                        // 执行后的errno
+        Fiber::ptr fiber{};                  // 挂起的协程
+        Scheduler *scheduler{nullptr};       // 恢复协程的调度器
+        pid_t thread_id{-1};                 // 发起请求的线程
+        Job *next{nullptr};                  // 队列中的下一个请求
+    };
+
+    /**
+     * @brief 入队并挂起当前协程，恢复后返回执行结果
+     */
+    auto Submit(Job &job) -> ssize_t;
+
+    /**
+     * @brief 工作线程的主循环
+     */
+    void Run();
+
+    std::vector<Thread::ptr> m_threads{};  // 工作线程
+    Job *m_head{nullptr};                  // 待执行队列头
+    Job *m_tail{nullptr};                  // 待执行队列尾
+    bool m_is_stop{false};                 // 是否停止
+    MutexType m_mutex{};
+    std::condition_variable m_cond{};
+};
+
+template <typename Func>
+auto OffloadPool::Execute(Func &&func) -> ssize_t {
+    using FuncType = std::remove_reference_t<Func>;
+    Job job;
+    job.invoke = [](void *arg) -> ssize_t {
+        return (*static_cast<FuncType *>(arg))();
+    };
+    job.arg = const_cast<void *>(static_cast<const void *>(&func));
+    return Submit(job);
+}
+}  // namespace wtsclwq
@@ -0,0 +1,57 @@
+//
+// 数组的批量编解码：定长数据的字节序转换、varint的编解码，
+// 按CPU支持的指令集在运行时选择SIMD实现或标量实现
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wtsclwq {
+
+/**
+ * 数组编解码使用的指令集
+ */
+class SimdLevel {
+  public:
+    enum Level { SCALAR = 0, SSE4_1 = 1, AVX2 = 2 };
+    static auto ToString(SimdLevel::Level level) -> const char *;
+};
+
+/**
+ * @brief 当前使用的指令集，默认是CPU支持的最高级别
+ */
+auto GetSimdLevel() -> SimdLevel::Level;
+
+/**
+ * @brief 指定使用的指令集，超过CPU支持的级别时使用CPU支持的最高级别
+ */
+void SetSimdLevel(SimdLevel::Level level);
+
+/**
+ * @brief 把src中count个宽度为width(2/4/8)字节的值逐个转换字节序后写到dst，
+ * dst和src可以相同，但不能部分重叠
+ */
+void ByteSwapArray(void *dst, const void *src, size_t count, size_t width);
+
+/**
+ * @brief 把count个值编码成varint写到dst，
+ * dst至少有count*5(32位)或count*10(64位)字节
+ * @return 写入后的位置
+ */
+auto EncodeVarintArray(const uint32_t *src, size_t count, uint8_t *dst)
+    -> uint8_t *;
+auto EncodeVarintArray(const uint64_t *src, size_t count, uint8_t *dst)
+    -> uint8_t *;
+
+/**
+ * @brief 从src的size字节中解码最多count个varint，遇到不完整的值时停止，
+ * 超长的值和ByteArray::ReadUint32()/ReadUint64()一样截断
+ * @param[out] decoded 解码出的值的个数
+ * @return 消耗的字节数
+ */
+auto DecodeVarintArray(const uint8_t *src, size_t size, uint32_t *dst,
+                       size_t count, size_t &decoded) -> size_t;
+auto DecodeVarintArray(const uint8_t *src, size_t size, uint64_t *dst,
+                       size_t count, size_t &decoded) -> size_t;
+}  // namespace wtsclwq
@@ -7,25 +7,38 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "../util/net_util.h"
+
 namespace wtsclwq {
 
+/**
+ * @brief 引用计数的内存块，定义在byte_array.cpp中
+ */
+struct ByteArrayChunk;
+
+/**
+ * @brief 二进制序列化的缓冲区。
+ * 数据按顺序分成若干节点，每个节点引用一个内存块中的一段。
+ * 自己写入的数据保存在大小都是base_size的内存块中，第i块保存[i*base_size,
+ * (i+1)*base_size)的数据，按下标直接定位；Slice()/Append()产生的节点长度不一，
+ * 按节点起始位置二分查找。
+ * 内存块带引用计数，切片、拼接和克隆只增加引用不复制数据，
+ * 写入被共享的内存块前先复制一份(写时复制)。
+ * 内存块来自每个线程的内存块池，释放后留给本线程下一次使用。
+ * 定长和varint的读写在头文件中内联：值整个落在当前内存块内时直接读写，
+ * 只有跨越内存块边界时才走通用的Write()/Read()
+ */
 class ByteArray {
   public:
     using ptr = std::shared_ptr<ByteArray>;
 
-    struct Node {
-        Node() = default;
-        explicit Node(size_t size);
-        ~Node();
-        char* ptr{nullptr};   // 内存块地址指针
-        Node* next{nullptr};  // 下一个内存块地址
-        size_t size{0};       // 内存块大小
-    };
     ByteArray(const ByteArray& other) = delete;
     ByteArray(ByteArray&& other) = delete;
     auto operator=(const ByteArray& other) -> ByteArray = delete;
@@ -324,6 +337,88 @@ class ByteArray {
      */
     auto ReadStringVint64() -> std::string;
 
+    /**
+     * @brief 批量写入count个定长数据(大端/小端)，需要转换字节序时用SIMD批量转换，
+     * 结果和逐个调用WriteFixedXxx()相同
+     * @post m_position += count * sizeof(value)
+     *       如果m_position > m_size 则 m_size = m_position
+     */
+    void WriteFixedInt16Array(const int16_t* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+    void WriteFixedUint16Array(const uint16_t* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+    void WriteFixedInt32Array(const int32_t* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+    void WriteFixedUint32Array(const uint32_t* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+    void WriteFixedInt64Array(const int64_t* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+    void WriteFixedUint64Array(const uint64_t* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+    void WriteFixedFloatArray(const float* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+    void WriteFixedDoubleArray(const double* values, size_t count) {
+        WriteFixedArray(values, count, sizeof(*values));
+    }
+
+    /**
+     * @brief 批量写入count个varint(有符号的用zigzag编码)，
+     * 结果和逐个调用WriteXxx()相同
+     */
+    void WriteInt32Array(const int32_t* values, size_t count);
+    void WriteUint32Array(const uint32_t* values, size_t count);
+    void WriteInt64Array(const int64_t* values, size_t count);
+    void WriteUint64Array(const uint64_t* values, size_t count);
+
+    /**
+     * @brief 批量读取count个定长数据(大端/小端)
+     * @post m_position += count * sizeof(value)
+     * @exception 如果getReadSize() < count * sizeof(value) 抛出
+     * std::out_of_range，此时不读取任何数据
+     */
+    void ReadFixedInt16Array(int16_t* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+    void ReadFixedUint16Array(uint16_t* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+    void ReadFixedInt32Array(int32_t* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+    void ReadFixedUint32Array(uint32_t* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+    void ReadFixedInt64Array(int64_t* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+    void ReadFixedUint64Array(uint64_t* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+    void ReadFixedFloatArray(float* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+    void ReadFixedDoubleArray(double* values, size_t count) {
+        ReadFixedArray(values, count, sizeof(*values));
+    }
+
+    /**
+     * @brief 批量读取count个varint(有符号的用zigzag解码)
+     * @post m_position += count个varint实际占用内存
+     * @exception 数据不足count个值时抛出std::out_of_range，和逐个读取一样，
+     * 之前读出的值已经写入values
+     */
+    void ReadInt32Array(int32_t* values, size_t count);
+    void ReadUint32Array(uint32_t* values, size_t count);
+    void ReadInt64Array(int64_t* values, size_t count);
+    void ReadUint64Array(uint64_t* values, size_t count);
+
     /**
      * @brief 清空ByteArray
      * @post m_position = 0, m_size = 0
@@ -376,11 +471,21 @@ class ByteArray {
     bool WriteToFile(const std::string& name) const;
 
     /**
-     * @brief 从文件中读取数据
+     * @brief 从文件中读取数据，从当前位置开始写入
      * @param[in] name 文件名
+     * @post m_position += 文件大小
      */
     bool ReadFromFile(const std::string& name);
 
+    /**
+     * @brief 把文件映射成只读的节点接在数据末尾，不复制文件内容，当前位置不变。
+     * 映射随最后一个引用它的ByteArray释放；写入映射的部分时先复制被写的节点。
+     * 映射期间文件被其他进程截短时，访问被截掉的部分会收到SIGBUS
+     * @param[in] name 文件名
+     * @post m_size += 文件大小
+     */
+    auto MapFile(const std::string& name) -> bool;
+
     /**
      * @brief 返回内存块的大小
      */
@@ -443,12 +548,95 @@ class ByteArray {
      */
     auto GetWriteBuffers(std::vector<iovec>& buffers, size_t len) -> size_t;
 
+    /**
+     * @brief 保证从当前位置开始至少还能写入size字节，不改变位置和数据
+     */
+    void Reserve(size_t size);
+
+    /**
+     * @brief 从当前位置开始能在当前内存块内原地连续写入size字节时，
+     * 返回写入的地址，否则返回nullptr。直接写入后用CommitWrite(size)前进
+     */
+    auto GetContiguousWriteBuffer(size_t size) -> char* {
+        return GetWriteSpace() >= size ? m_cursor : nullptr;
+    }
+
+    /**
+     * @brief 确认直接写入了GetContiguousWriteBuffer()返回的size字节
+     * @post m_position += size
+     */
+    void CommitWrite(size_t size) { AdvanceCursor(size); }
+
     /**
      * @brief 返回数据的长度
      */
     auto GetSize() const -> size_t;
 
+    /**
+     * @brief 返回共享[offset, offset + len)数据的ByteArray，不复制数据，
+     * 位置为0，字节序与当前相同。之后任何一方写入共享的部分都会先复制
+     * @exception 如果offset + len > m_size 则抛出 std::out_of_range
+     */
+    auto Slice(size_t offset, size_t len) const -> ByteArray::ptr;
+
+    /**
+     * @brief 返回共享全部数据的ByteArray，位置与当前相同
+     */
+    auto Clone() const -> ByteArray::ptr;
+
+    /**
+     * @brief 把other的数据接在当前数据的末尾，只移动节点不复制数据，
+     * other变为空。当前位置不变
+     * @post m_size += other.m_size
+     */
+    void Append(ByteArray&& other);
+
   private:
+    /**
+     * @brief 构造没有节点的ByteArray，用于Slice()
+     */
+    ByteArray(size_t base_size, uint16_t endian);
+
+    /**
+     * @brief 数据的一段，引用内存块中从data开始的size字节
+     */
+    struct Node {
+        ByteArrayChunk* chunk{nullptr};
+        char* data{nullptr};
+        size_t size{0};
+    };
+
+    /**
+     * @brief 在末尾追加一个新的base_size内存块
+     */
+    void AppendBlock();
+
+    /**
+     * @brief 在末尾追加节点，接管节点对内存块的引用
+     */
+    void PushNode(const Node& node);
+
+    /**
+     * @brief 返回position所在的节点下标
+     * @pre position < m_capacity
+     */
+    auto FindNode(size_t position) const -> size_t;
+
+    /**
+     * @brief 节点的内存块被共享或者只读时，换成独占的副本
+     */
+    void MakeWritable(size_t index);
+
+    /**
+     * @brief 释放m_size之后的容量，最后一个节点截短到m_size
+     */
+    void TrimToSize();
+
+    /**
+     * @brief 重新判断是否所有节点都是完整的base_size内存块
+     */
+    void UpdateUniform();
+
     /**
      * @brief
      * 扩容ByteArray,使其可以容纳size个数据(如果原本可以可以容纳,则不扩容)
@@ -460,13 +648,316 @@ class ByteArray {
      */
     auto GetWritableCapacity() const -> size_t;
 
+    /**
+     * @brief 按m_position更新当前内存块内的读写窗口
+     */
+    void UpdateCursor();
+
+    /**
+     * @brief 当前节点内从m_position开始还能连续读取的字节数(不考虑m_size)
+     */
+    auto GetReadSpace() const -> size_t {
+        return static_cast<size_t>(m_cursor_end - m_cursor);
+    }
+
+    /**
+     * @brief 当前节点内从m_position开始还能原地写入的字节数，
+     * 节点的内存块被共享或者只读时为0。
+     * Slice()是const的，不改动当前对象，所以共享与否在这里按引用计数检查
+     */
+    auto GetWriteSpace() const -> size_t {
+        if (m_write_end <= m_cursor ||
+            m_cursor_refs->load(std::memory_order_acquire) != 1) {
+            return 0;
+        }
+        return static_cast<size_t>(m_write_end - m_cursor);
+    }
+
+    /**
+     * @brief 在当前内存块内前进size字节
+     */
+    void AdvanceCursor(size_t size) {
+        m_cursor += size;
+        m_position += size;
+        if (m_position > m_size) {
+            m_size = m_position;
+        }
+    }
+
+    /**
+     * @brief 批量读写宽度为width字节的定长数据
+     */
+    void WriteFixedArray(const void* values, size_t count, size_t width);
+    void ReadFixedArray(void* values, size_t count, size_t width);
+
+    /**
+     * @brief 批量读写varint，T是uint32_t或uint64_t，只在byte_array.cpp中实例化
+     */
+    template <class T>
+    void WriteVarintArray(const T* values, size_t count);
+    template <class T>
+    void ReadVarintArray(T* values, size_t count);
+
+    template <class T>
+    void WriteFixed(T value);
+
+    template <class T>
+    auto ReadFixed() -> T;
+
+    /**
+     * @brief 从position开始复制size字节到buf，不检查范围
+     */
+    void CopyOut(void* buf, size_t size, size_t position) const;
+
+    /**
+     * @brief 释放第from个及之后的节点
+     */
+    void ReleaseNodes(size_t from);
+
   private:
     size_t m_base_size{};  // 内存块的大小
     size_t m_position{0};  // 当前操作位置（读写从此处开始）
     size_t m_capacity{};   // 数据写入的上限
     size_t m_size{0};      // 当前数据的大小
     uint16_t m_endian{};   // 字节序,默认大端
-    Node* m_root{};        // 第一个内存块指针
-    Node* m_cur{};         // 当前操作的内存块指针
+    std::vector<Node> m_nodes{};      // 按顺序保存数据的节点
+    std::vector<size_t> m_offsets{};  // 每个节点的起始位置
+    bool m_uniform{true};  // 所有节点都是完整的base_size内存块，下标是位置/m_base_size
+    char* m_cursor{nullptr};      // m_position在当前节点中的地址
+    char* m_cursor_end{nullptr};  // 当前节点的末尾，m_position在末尾时两者都为空
+    // 当前节点可以原地写入的末尾，只读的映射节点不超过m_cursor
+    char* m_write_end{nullptr};
+    // 当前节点内存块的引用计数，写入前检查是否被共享
+    const std::atomic_uint32_t* m_cursor_refs{nullptr};
 };
+
+// varint最多占用的字节数
+static constexpr size_t kMaxVarint32Size = 5;
+static constexpr size_t kMaxVarint64Size = 10;
+
+inline auto ZigZagEncode32(int32_t n) -> uint32_t {
+    // Note:  the right-shift must be arithmetic
+    return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+}
+
+inline auto ZigZagDecode32(uint32_t n) -> int32_t {
+    return static_cast<int32_t>((n >> 1) ^ -(n & 1));
+}
+
+inline auto ZigZagEncode64(int64_t n) -> uint64_t {
+    // Note:  the right-shift must be arithmetic
+    return (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63);
+}
+
+inline auto ZigZagDecode64(uint64_t n) -> int64_t {
+    return static_cast<int64_t>((n >> 1) ^ -(n & 1));
+}
+
+/**
+ * @brief 把value编码成varint写到ptr，ptr处至少有kMaxVarint64Size字节
+ * @return 写入后的位置
+ */
+inline auto EncodeVarint(uint8_t* ptr, uint64_t value) -> uint8_t* {
+    // 如果数据大于一个字节(127是一个字节最大数据),那么继续,即需要在最高位加上1
+    while (value > 127) {
+        *ptr++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    *ptr++ = static_cast<uint8_t>(value);
+    return ptr;
+}
+
+/**
+ * @brief 从ptr解码最多MaxSize字节的varint，调用者保证ptr处有MaxSize字节可读。
+ * 超过MaxSize字节还没结束的数据被截断，和逐字节读取的结果一致
+ * @return 读取后的位置
+ */
+template <class T, size_t MaxSize>
+inline auto DecodeVarint(const uint8_t* ptr, T& value) -> const uint8_t* {
+    T result = 0;
+    for (size_t i = 0; i < MaxSize; ++i) {
+        T byte = ptr[i];
+        result |= (byte & 0x7F) << (7 * i);
+        if (byte < 128) {
+            value = result;
+            return ptr + i + 1;
+        }
+    }
+    value = result;
+    return ptr + MaxSize;
+}
+
+template <class T>
+inline void ByteArray::WriteFixed(T value) {
+    if constexpr (sizeof(T) > 1) {
+        if (m_endian != BYTE_ORDER) {
+            value = ByteSwap(value);
+        }
+    }
+    if (GetWriteSpace() >= sizeof(T)) {
+        memcpy(m_cursor, &value, sizeof(T));
+        AdvanceCursor(sizeof(T));
+        return;
+    }
+    Write(&value, sizeof(T));
+}
+
+template <class T>
+inline auto ByteArray::ReadFixed() -> T {
+    T value;
+    if (GetReadSpace() >= sizeof(T) && m_size - m_position >= sizeof(T)) {
+        memcpy(&value, m_cursor, sizeof(T));
+        AdvanceCursor(sizeof(T));
+    } else {
+        Read(&value, sizeof(T));
+    }
+    if constexpr (sizeof(T) > 1) {
+        if (m_endian != BYTE_ORDER) {
+            return ByteSwap(value);
+        }
+    }
+    return value;
+}
+
+inline void ByteArray::WriteFixedInt8(int8_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedUint8(uint8_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedInt16(int16_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedUint16(uint16_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedInt32(int32_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedUint32(uint32_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedInt64(int64_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedUint64(uint64_t value) { WriteFixed(value); }
+
+inline void ByteArray::WriteFixedFloat(float value) {
+    uint32_t val;
+    memcpy(&val, &value, sizeof(value));
+    WriteFixed(val);
+}
+
+inline void ByteArray::WriteFixedDouble(double value) {
+    uint64_t val;
+    memcpy(&val, &value, sizeof(value));
+    WriteFixed(val);
+}
+
+inline void ByteArray::WriteInt32(int32_t value) {
+    WriteUint32(ZigZagEncode32(value));
+}
+
+inline void ByteArray::WriteUint32(uint32_t value) { WriteUint64(value); }
+
+inline void ByteArray::WriteInt64(int64_t value) {
+    WriteUint64(ZigZagEncode64(value));
+}
+
+inline void ByteArray::WriteUint64(uint64_t value) {
+    if (GetWriteSpace() >= kMaxVarint64Size) {
+        auto* begin = reinterpret_cast<uint8_t*>(m_cursor);
+        AdvanceCursor(EncodeVarint(begin, value) - begin);
+        return;
+    }
+    uint8_t temp[kMaxVarint64Size];
+    Write(temp, EncodeVarint(temp, value) - temp);
+}
+
+inline auto ByteArray::ReadFixedInt8() -> int8_t { return ReadFixed<int8_t>(); }
+
+inline auto ByteArray::ReadFixedUint8() -> uint8_t {
+    return ReadFixed<uint8_t>();
+}
+
+inline auto ByteArray::ReadFixedInt16() -> int16_t {
+    return ReadFixed<int16_t>();
+}
+
+inline auto ByteArray::ReadFixedUint16() -> uint16_t {
+    return ReadFixed<uint16_t>();
+}
+
+inline auto ByteArray::ReadFixedInt32() -> int32_t {
+    return ReadFixed<int32_t>();
+}
+
+inline auto ByteArray::ReadFixedUint32() -> uint32_t {
+    return ReadFixed<uint32_t>();
+}
+
+inline auto ByteArray::ReadFixedInt64() -> int64_t {
+    return ReadFixed<int64_t>();
+}
+
+inline auto ByteArray::ReadFixedUint64() -> uint64_t {
+    return ReadFixed<uint64_t>();
+}
+
+inline auto ByteArray::ReadFixedFloat() -> float {
+    uint32_t val = ReadFixed<uint32_t>();
+    float value;
+    memcpy(&value, &val, sizeof(val));
+    return value;
+}
+
+inline auto ByteArray::ReadFixedDouble() -> double {
+    uint64_t val = ReadFixed<uint64_t>();
+    double value;
+    memcpy(&value, &val, sizeof(val));
+    return value;
+}
+
+inline auto ByteArray::ReadInt32() -> int32_t {
+    return ZigZagDecode32(ReadUint32());
+}
+
+inline auto ByteArray::ReadUint32() -> uint32_t {
+    uint32_t result;
+    // 当前内存块内剩余的数据足够最长的varint时只检查一次边界
+    if (GetReadSpace() >= kMaxVarint32Size &&
+        m_size - m_position >= kMaxVarint32Size) {
+        auto* begin = reinterpret_cast<const uint8_t*>(m_cursor);
+        AdvanceCursor(DecodeVarint<uint32_t, kMaxVarint32Size>(begin, result) -
+                      begin);
+        return result;
+    }
+    result = 0;
+    for (size_t i = 0; i < kMaxVarint32Size; ++i) {
+        uint32_t byte = ReadFixedUint8();
+        // 读取字节内的低7位，最高标志位丢弃
+        result |= (byte & 0x7F) << (7 * i);
+        if (byte < 128) {
+            break;
+        }
+    }
+    return result;
+}
+
+inline auto ByteArray::ReadInt64() -> int64_t {
+    return ZigZagDecode64(ReadUint64());
+}
+
+inline auto ByteArray::ReadUint64() -> uint64_t {
+    uint64_t result;
+    if (GetReadSpace() >= kMaxVarint64Size &&
+        m_size - m_position >= kMaxVarint64Size) {
+        auto* begin = reinterpret_cast<const uint8_t*>(m_cursor);
+        AdvanceCursor(DecodeVarint<uint64_t, kMaxVarint64Size>(begin, result) -
+                      begin);
+        return result;
+    }
+    result = 0;
+    for (size_t i = 0; i < kMaxVarint64Size; ++i) {
+        uint64_t byte = ReadFixedUint8();
+        result |= (byte & 0x7F) << (7 * i);
+        if (byte < 128) {
+            break;
+        }
+    }
+    return result;
+}
 }  // namespace wtsclwq
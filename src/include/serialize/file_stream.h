@@ -0,0 +1,84 @@
+//
+// 文件流：用pread/pwrite在自己维护的偏移上读写文件，
+// ByteArray的数据直接用preadv/pwritev读写，不经过临时缓冲区
+//
+
+#pragma once
+#include <sys/types.h>
+
+#include <string>
+
+#include "stream.h"
+
+namespace wtsclwq {
+
+class FileStream : public Stream {
+  public:
+    using ptr = std::shared_ptr<FileStream>;
+
+    FileStream(const FileStream& other) = delete;
+    FileStream(FileStream&& other) = delete;
+    auto operator=(const FileStream& other) = delete;
+    auto operator=(FileStream&& other) = delete;
+    FileStream() = delete;
+
+    /**
+     * @param[in] name 文件名
+     * @param[in] flags open()的标志，比如O_WRONLY | O_CREAT | O_TRUNC
+     * @param[in] mode 创建文件时的权限
+     */
+    FileStream(const std::string& name, int flags, mode_t mode = 0644);
+
+    ~FileStream() override;
+
+    /**
+     * @brief 从当前偏移读取数据到buffer
+     * @return
+     * @retval > 0 实际读取的数据大小
+     * @retval = 0 到达文件末尾
+     * @retval < 0 出错
+     */
+    auto ReadToBuf(void* buffer, size_t length) -> int override;
+
+    /**
+     * @brief 从当前偏移读取数据到ByteArray的写入缓存
+     * @return
+     * @retval > 0 实际读取的数据大小
+     * @retval = 0 到达文件末尾
+     * @retval < 0 出错
+     */
+    auto ReadToArray(ByteArray::ptr byte_array, size_t length) -> int override;
+
+    /**
+     * @brief 把buffer中的数据写到当前偏移
+     * @return
+     *      @retval >0 返回写入的数据的实际大小
+     *      @retval <0 出错
+     */
+    auto WriteFromBuf(const void* buffer, size_t length) -> int override;
+
+    /**
+     * @brief 把ByteArray的可读数据直接交给pwritev写到当前偏移
+     * @return
+     *      @retval >0 返回写入的数据的实际大小
+     *      @retval <0 出错
+     */
+    auto WriteFromArray(ByteArray::ptr byte_array, size_t length) -> int override;
+
+    void Close() override;
+
+    auto IsOpen() const -> bool { return m_fd >= 0; }
+
+    /**
+     * @brief 下一次读写的文件偏移
+     */
+    auto GetOffset() const -> off_t { return m_offset; }
+
+    void SetOffset(off_t offset) { m_offset = offset; }
+
+  private:
+    int m_fd;        // 文件描述符
+    off_t m_offset;  // 下一次读写的偏移
+};
+
+}  // namespace wtsclwq
@@ -0,0 +1,652 @@
+//
+// 编译期反射的二进制序列化：结构体用WTSCLWQ_SERIALIZE_FIELDS声明一次字段，
+// 编解码代码由模板展开。先算出编码后的大小，只预留一次容量，再顺序写入
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "array_codec.h"
+#include "byte_array.h"
+
+namespace wtsclwq {
+
+/**
+ * @brief 字段的编码方式，作用于字段中所有的数值，包括容器的元素、map的键和值
+ * DEFAULT: 32/64位整数用varint(有符号的先ZigZag)，8/16位整数、bool和浮点数定长
+ * VARINT: 整数都用varint
+ * FIXED: 数值都用定长，字节序和ByteArray一致
+ * 字符串和容器的长度总是varint，嵌套的结构体按自己声明的方式编码
+ */
+enum class FieldEncoding { DEFAULT = 0, VARINT = 1, FIXED = 2 };
+
+/**
+ * @brief 字段的描述：成员指针和编码方式
+ */
+template <class Class, class T, FieldEncoding Encoding>
+struct FieldDescriptor {
+    using ValueType = T;
+    static constexpr FieldEncoding kEncoding = Encoding;
+    T Class::*member;
+};
+
+template <class Class, class T>
+constexpr auto Field(T Class::*member)
+    -> FieldDescriptor<Class, T, FieldEncoding::DEFAULT> {
+    return {member};
+}
+
+template <class Class, class T>
+constexpr auto VarintField(T Class::*member)
+    -> FieldDescriptor<Class, T, FieldEncoding::VARINT> {
+    return {member};
+}
+
+template <class Class, class T>
+constexpr auto FixedField(T Class::*member)
+    -> FieldDescriptor<Class, T, FieldEncoding::FIXED> {
+    return {member};
+}
+
+/**
+ * @brief 在结构体内按编码顺序声明字段，例如
+ * WTSCLWQ_SERIALIZE_FIELDS(wtsclwq::FixedField(&Order::id),
+ *                          wtsclwq::Field(&Order::items))
+ */
+#define WTSCLWQ_SERIALIZE_FIELDS(...)         \
+    static constexpr auto SerializeFields() { \
+        return std::make_tuple(__VA_ARGS__);  \
+    }
+
+/**
+ * @brief 类型是否用WTSCLWQ_SERIALIZE_FIELDS声明了字段
+ */
+template <class T, class = void>
+struct HasSerializeFields : std::false_type {};
+
+template <class T>
+struct HasSerializeFields<T, std::void_t<decltype(T::SerializeFields())>>
+    : std::true_type {};
+
+/**
+ * @brief value编码成varint的字节数
+ */
+constexpr auto VarintSize(uint64_t value) -> size_t {
+    // 有效位数 * 9 / 64 向上取整，即每7位一个字节
+    return static_cast<size_t>(((63 - __builtin_clzll(value | 1)) * 9 + 73) /
+                               64);
+}
+
+/**
+ * @brief 宽度为Size字节的无符号整数
+ */
+template <size_t Size>
+struct UnsignedOfSize;
+template <>
+struct UnsignedOfSize<1> {
+    using Type = uint8_t;
+};
+template <>
+struct UnsignedOfSize<2> {
+    using Type = uint16_t;
+};
+template <>
+struct UnsignedOfSize<4> {
+    using Type = uint32_t;
+};
+template <>
+struct UnsignedOfSize<8> {
+    using Type = uint64_t;
+};
+
+/**
+ * @brief 枚举的底层整数类型，其他类型不变
+ */
+template <class T, bool = std::is_enum_v<T>>
+struct UnderlyingOf {
+    using Type = T;
+};
+template <class T>
+struct UnderlyingOf<T, true> {
+    using Type = std::underlying_type_t<T>;
+};
+
+/**
+ * @brief 数组元素能否按内存批量编解码：float/double，
+ * 以及和同宽度的定长整数只差符号的整数(不含bool)
+ */
+template <class T, class = void>
+struct IsPlainNumber : std::false_type {};
+template <class T>
+struct IsPlainNumber<
+    T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    : std::is_same<std::make_unsigned_t<T>,
+                   typename UnsignedOfSize<sizeof(T)>::Type> {};
+template <>
+struct IsPlainNumber<float> : std::true_type {};
+template <>
+struct IsPlainNumber<double> : std::true_type {};
+
+/**
+ * @brief 写入ByteArray，走ByteArray内联的读写窗口
+ */
+class ByteArrayWriter {
+  public:
+    explicit ByteArrayWriter(ByteArray &ba) : m_ba(ba) {}
+
+    /**
+     * @brief 写入定长的无符号整数，按ByteArray的字节序
+     */
+    template <class U>
+    void WriteFixed(U bits) {
+        if constexpr (sizeof(U) == 1) {
+            m_ba.WriteFixedUint8(bits);
+        } else if constexpr (sizeof(U) == 2) {
+            m_ba.WriteFixedUint16(bits);
+        } else if constexpr (sizeof(U) == 4) {
+            m_ba.WriteFixedUint32(bits);
+        } else {
+            m_ba.WriteFixedUint64(bits);
+        }
+    }
+
+    void WriteVarint(uint64_t value) { m_ba.WriteUint64(value); }
+
+    void WriteBytes(const void *buf, size_t size) { m_ba.Write(buf, size); }
+
+    /**
+     * @brief 批量写入定长数值，T是宽度为1/2/4/8字节的整数或浮点数
+     */
+    template <class T>
+    void WriteFixedArray(const T *values, size_t count) {
+        if constexpr (sizeof(T) == 1) {
+            m_ba.Write(values, count);
+        } else if constexpr (std::is_same_v<T, float>) {
+            m_ba.WriteFixedFloatArray(values, count);
+        } else if constexpr (std::is_same_v<T, double>) {
+            m_ba.WriteFixedDoubleArray(values, count);
+        } else if constexpr (sizeof(T) == 2) {
+            m_ba.WriteFixedUint16Array(
+                reinterpret_cast<const uint16_t *>(values), count);
+        } else if constexpr (sizeof(T) == 4) {
+            m_ba.WriteFixedUint32Array(
+                reinterpret_cast<const uint32_t *>(values), count);
+        } else {
+            m_ba.WriteFixedUint64Array(
+                reinterpret_cast<const uint64_t *>(values), count);
+        }
+    }
+
+    /**
+     * @brief 批量写入varint，T是int32_t/uint32_t/int64_t/uint64_t
+     */
+    template <class T>
+    void WriteVarintArray(const T *values, size_t count) {
+        if constexpr (std::is_same_v<T, int32_t>) {
+            m_ba.WriteInt32Array(values, count);
+        } else if constexpr (std::is_same_v<T, uint32_t>) {
+            m_ba.WriteUint32Array(values, count);
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+            m_ba.WriteInt64Array(values, count);
+        } else {
+            m_ba.WriteUint64Array(values, count);
+        }
+    }
+
+  private:
+    ByteArray &m_ba;
+};
+
+/**
+ * @brief 直接写入一段已知足够大的连续内存，不检查边界
+ */
+class PointerWriter {
+  public:
+    /**
+     * @param[in] ptr 写入的起始地址
+     * @param[in] end 内存的末尾，编码后的数据正好写到这里
+     * @param[in] swap 是否转换定长数据的字节序
+     */
+    PointerWriter(uint8_t *ptr, uint8_t *end, bool swap)
+        : m_ptr(ptr), m_end(end), m_swap(swap) {}
+
+    template <class U>
+    void WriteFixed(U bits) {
+        if constexpr (sizeof(U) > 1) {
+            if (m_swap) {
+                bits = ByteSwap(bits);
+            }
+        }
+        memcpy(m_ptr, &bits, sizeof(U));
+        m_ptr += sizeof(U);
+    }
+
+    void WriteVarint(uint64_t value) { m_ptr = EncodeVarint(m_ptr, value); }
+
+    void WriteBytes(const void *buf, size_t size) {
+        memcpy(m_ptr, buf, size);
+        m_ptr += size;
+    }
+
+    template <class T>
+    void WriteFixedArray(const T *values, size_t count) {
+        // 空数组的data()可能是空指针
+        if (count == 0) {
+            return;
+        }
+        if (sizeof(T) > 1 && m_swap) {
+            ByteSwapArray(m_ptr, values, count, sizeof(T));
+        } else {
+            memcpy(m_ptr, values, count * sizeof(T));
+        }
+        m_ptr += count * sizeof(T);
+    }
+
+    template <class T>
+    void WriteVarintArray(const T *values, size_t count) {
+        constexpr size_t max_size =
+            sizeof(T) == 4 ? kMaxVarint32Size : kMaxVarint64Size;
+        // EncodeVarintArray()要求按最长编码留足空间，剩余的内存不够时逐个编码
+        if constexpr (std::is_unsigned_v<T>) {
+            if (static_cast<size_t>(m_end - m_ptr) >= count * max_size) {
+                m_ptr = EncodeVarintArray(values, count, m_ptr);
+                return;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if constexpr (std::is_same_v<T, int32_t>) {
+                m_ptr = EncodeVarint(m_ptr, ZigZagEncode32(values[i]));
+            } else if constexpr (std::is_same_v<T, int64_t>) {
+                m_ptr = EncodeVarint(m_ptr, ZigZagEncode64(values[i]));
+            } else {
+                m_ptr = EncodeVarint(m_ptr, values[i]);
+            }
+        }
+    }
+
+    auto GetPosition() const -> uint8_t * { return m_ptr; }
+
+  private:
+    uint8_t *m_ptr;
+    uint8_t *m_end;
+    bool m_swap;
+};
+
+/**
+ * @brief 类型T按编码方式E的编解码，按类型偏特化：
+ * Size()返回编码后的字节数，Write()写入Writer，Read()从ByteArray读取。
+ * 读取的数据不足时ByteArray抛出std::out_of_range
+ */
+template <class T, FieldEncoding E = FieldEncoding::DEFAULT, class = void>
+class BinaryCodec;
+
+/**
+ * @brief 数值和枚举
+ */
+template <class T, FieldEncoding E>
+class BinaryCodec<
+    T, E, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>> {
+  public:
+    using ValueType = typename UnderlyingOf<T>::Type;
+    using Bits = typename UnsignedOfSize<sizeof(T)>::Type;
+
+    static constexpr bool kFixed =
+        E == FieldEncoding::FIXED || std::is_floating_point_v<ValueType> ||
+        std::is_same_v<ValueType, bool> ||
+        (E == FieldEncoding::DEFAULT && sizeof(T) <= 2);
+    static_assert(E != FieldEncoding::VARINT ||
+                      (std::is_integral_v<ValueType> &&
+                       !std::is_same_v<ValueType, bool>),
+                  "varint encoding needs an integer");
+
+    static auto Size(const T &value) -> size_t {
+        if constexpr (kFixed) {
+            return sizeof(T);
+        } else {
+            return VarintSize(ToVarint(value));
+        }
+    }
+
+    template <class Writer>
+    static void Write(Writer &writer, const T &value) {
+        if constexpr (kFixed) {
+            Bits bits;
+            memcpy(&bits, &value, sizeof(T));
+            writer.WriteFixed(bits);
+        } else {
+            writer.WriteVarint(ToVarint(value));
+        }
+    }
+
+    static void Read(ByteArray &ba, T &value) {
+        if constexpr (std::is_same_v<ValueType, bool>) {
+            value = ba.ReadFixedUint8() != 0;
+        } else if constexpr (kFixed) {
+            Bits bits;
+            if constexpr (sizeof(T) == 1) {
+                bits = ba.ReadFixedUint8();
+            } else if constexpr (sizeof(T) == 2) {
+                bits = ba.ReadFixedUint16();
+            } else if constexpr (sizeof(T) == 4) {
+                bits = ba.ReadFixedUint32();
+            } else {
+                bits = ba.ReadFixedUint64();
+            }
+            memcpy(&value, &bits, sizeof(T));
+        } else if constexpr (sizeof(T) == 8) {
+            uint64_t bits = ba.ReadUint64();
+            if constexpr (std::is_signed_v<ValueType>) {
+                value = static_cast<T>(ZigZagDecode64(bits));
+            } else {
+                value = static_cast<T>(bits);
+            }
+        } else {
+            uint32_t bits = ba.ReadUint32();
+            if constexpr (std::is_signed_v<ValueType>) {
+                value = static_cast<T>(ZigZagDecode32(bits));
+            } else {
+                value = static_cast<T>(bits);
+            }
+        }
+    }
+
+  private:
+    static auto ToVarint(const T &value) -> uint64_t {
+        auto v = static_cast<ValueType>(value);
+        if constexpr (!std::is_signed_v<ValueType>) {
+            return v;
+        } else if constexpr (sizeof(T) == 8) {
+            return ZigZagEncode64(v);
+        } else {
+            return ZigZagEncode32(v);
+        }
+    }
+};
+
+/**
+ * @brief 字符串：varint长度 + 内容
+ */
+template <FieldEncoding E>
+class BinaryCodec<std::string, E> {
+  public:
+    static auto Size(const std::string &value) -> size_t {
+        return VarintSize(value.size()) + value.size();
+    }
+
+    template <class Writer>
+    static void Write(Writer &writer, const std::string &value) {
+        writer.WriteVarint(value.size());
+        writer.WriteBytes(value.data(), value.size());
+    }
+
+    static void Read(ByteArray &ba, std::string &value) {
+        uint64_t size = ba.ReadUint64();
+        if (size > ba.GetReadableSize()) {
+            throw std::out_of_range("not enough len");
+        }
+        value.resize(size);
+        ba.Read(&value[0], size);
+    }
+};
+
+/**
+ * @brief 数组：varint个数 + 元素。
+ * 定长数值和32/64位整数的varint走ByteArray的批量接口
+ */
+template <class T, class Alloc, FieldEncoding E>
+class BinaryCodec<std::vector<T, Alloc>, E> {
+  public:
+    using ElementCodec = BinaryCodec<T, E>;
+
+    static auto Size(const std::vector<T, Alloc> &value) -> size_t {
+        size_t size = VarintSize(value.size());
+        if constexpr (kFixedBulk) {
+            size += value.size() * sizeof(T);
+        } else {
+            for (const T &element : value) {
+                size += ElementCodec::Size(element);
+            }
+        }
+        return size;
+    }
+
+    template <class Writer>
+    static void Write(Writer &writer, const std::vector<T, Alloc> &value) {
+        writer.WriteVarint(value.size());
+        if constexpr (kFixedBulk) {
+            writer.WriteFixedArray(value.data(), value.size());
+        } else if constexpr (kVarintBulk) {
+            writer.WriteVarintArray(value.data(), value.size());
+        } else {
+            for (const T &element : value) {
+                ElementCodec::Write(writer, element);
+            }
+        }
+    }
+
+    static void Read(ByteArray &ba, std::vector<T, Alloc> &value) {
+        uint64_t count = ba.ReadUint64();
+        value.clear();
+        if constexpr (kFixedBulk || kVarintBulk) {
+            // 每个元素至少一个字节，先检查再分配
+            if (count > ba.GetReadableSize()) {
+                throw std::out_of_range("not enough len");
+            }
+            value.resize(count);
+            if constexpr (kFixedBulk) {
+                ReadFixedArray(ba, value.data(), count);
+            } else {
+                ReadVarintArray(ba, value.data(), count);
+            }
+        } else {
+            value.reserve(std::min<uint64_t>(count, ba.GetReadableSize()));
+            for (uint64_t i = 0; i < count; ++i) {
+                T element{};
+                ElementCodec::Read(ba, element);
+                value.push_back(std::move(element));
+            }
+        }
+    }
+
+  private:
+    struct IsFixed : std::bool_constant<ElementCodec::kFixed> {};
+
+    // 定长的元素整块复制(需要时转换字节序)，32/64位整数的varint批量编解码
+    static constexpr bool kFixedBulk =
+        std::conjunction_v<IsPlainNumber<T>, IsFixed>;
+    static constexpr bool kVarintBulk =
+        !kFixedBulk && IsPlainNumber<T>::value && sizeof(T) >= 4;
+
+    static void ReadFixedArray(ByteArray &ba, T *values, size_t count) {
+        if constexpr (sizeof(T) == 1) {
+            ba.Read(values, count);
+        } else if constexpr (std::is_same_v<T, float>) {
+            ba.ReadFixedFloatArray(values, count);
+        } else if constexpr (std::is_same_v<T, double>) {
+            ba.ReadFixedDoubleArray(values, count);
+        } else if constexpr (sizeof(T) == 2) {
+            ba.ReadFixedUint16Array(reinterpret_cast<uint16_t *>(values),
+                                    count);
+        } else if constexpr (sizeof(T) == 4) {
+            ba.ReadFixedUint32Array(reinterpret_cast<uint32_t *>(values),
+                                    count);
+        } else {
+            ba.ReadFixedUint64Array(reinterpret_cast<uint64_t *>(values),
+                                    count);
+        }
+    }
+
+    static void ReadVarintArray(ByteArray &ba, T *values, size_t count) {
+        if constexpr (std::is_same_v<T, int32_t>) {
+            ba.ReadInt32Array(values, count);
+        } else if constexpr (std::is_same_v<T, uint32_t>) {
+            ba.ReadUint32Array(values, count);
+        } else if constexpr (std::is_same_v<T, int64_t>) {
+            ba.ReadInt64Array(values, count);
+        } else {
+            ba.ReadUint64Array(values, count);
+        }
+    }
+};
+
+/**
+ * @brief 有序map：varint个数 + 按键的顺序排列的键值对
+ */
+template <class K, class V, class Compare, class Alloc, FieldEncoding E>
+class BinaryCodec<std::map<K, V, Compare, Alloc>, E> {
+  public:
+    using MapType = std::map<K, V, Compare, Alloc>;
+    using KeyCodec = BinaryCodec<K, E>;
+    using MappedCodec = BinaryCodec<V, E>;
+
+    static auto Size(const MapType &value) -> size_t {
+        size_t size = VarintSize(value.size());
+        for (const auto &[key, mapped] : value) {
+            size += KeyCodec::Size(key) + MappedCodec::Size(mapped);
+        }
+        return size;
+    }
+
+    template <class Writer>
+    static void Write(Writer &writer, const MapType &value) {
+        writer.WriteVarint(value.size());
+        for (const auto &[key, mapped] : value) {
+            KeyCodec::Write(writer, key);
+            MappedCodec::Write(writer, mapped);
+        }
+    }
+
+    static void Read(ByteArray &ba, MapType &value) {
+        uint64_t count = ba.ReadUint64();
+        value.clear();
+        for (uint64_t i = 0; i < count; ++i) {
+            K key{};
+            V mapped{};
+            KeyCodec::Read(ba, key);
+            MappedCodec::Read(ba, mapped);
+            value.emplace_hint(value.end(), std::move(key), std::move(mapped));
+        }
+    }
+};
+
+/**
+ * @brief 可选值：一个字节的标记，有值时接着是值
+ */
+template <class T, FieldEncoding E>
+class BinaryCodec<std::optional<T>, E> {
+  public:
+    using ValueCodec = BinaryCodec<T, E>;
+
+    static auto Size(const std::optional<T> &value) -> size_t {
+        return value.has_value() ? 1 + ValueCodec::Size(*value) : 1;
+    }
+
+    template <class Writer>
+    static void Write(Writer &writer, const std::optional<T> &value) {
+        writer.WriteFixed(static_cast<uint8_t>(value.has_value()));
+        if (value.has_value()) {
+            ValueCodec::Write(writer, *value);
+        }
+    }
+
+    static void Read(ByteArray &ba, std::optional<T> &value) {
+        if (ba.ReadFixedUint8() == 0) {
+            value.reset();
+            return;
+        }
+        ValueCodec::Read(ba, value.emplace());
+    }
+};
+
+/**
+ * @brief 声明了字段的结构体：按声明的顺序编码各个字段，没有额外的头部。
+ * 字段展开成折叠表达式，编译后是一串顺序的读写
+ */
+template <class T, FieldEncoding E>
+class BinaryCodec<T, E, std::enable_if_t<HasSerializeFields<T>::value>> {
+  public:
+    static auto Size(const T &value) -> size_t {
+        return std::apply(
+            [&value](const auto &...fields) {
+                return (size_t{0} + ... + FieldCodec<decltype(fields)>::Size(
+                                              value.*(fields.member)));
+            },
+            T::SerializeFields());
+    }
+
+    template <class Writer>
+    static void Write(Writer &writer, const T &value) {
+        std::apply(
+            [&writer, &value](const auto &...fields) {
+                (FieldCodec<decltype(fields)>::Write(writer,
+                                                     value.*(fields.member)),
+                 ...);
+            },
+            T::SerializeFields());
+    }
+
+    static void Read(ByteArray &ba, T &value) {
+        std::apply(
+            [&ba, &value](const auto &...fields) {
+                (FieldCodec<decltype(fields)>::Read(ba, value.*(fields.member)),
+                 ...);
+            },
+            T::SerializeFields());
+    }
+
+  private:
+    template <class Descriptor>
+    using FieldCodec =
+        BinaryCodec<typename std::decay_t<Descriptor>::ValueType,
+                    std::decay_t<Descriptor>::kEncoding>;
+};
+
+/**
+ * @brief value编码后的字节数
+ */
+template <class T>
+auto SerializedSize(const T &value) -> size_t {
+    return BinaryCodec<T>::Size(value);
+}
+
+/**
+ * @brief 把value编码后写到ba的当前位置。先算出编码后的大小并一次预留容量；
+ * 当前内存块放得下时直接写内存，否则走ByteArray的内联写入
+ * @post ba的位置 += SerializedSize(value)
+ */
+template <class T>
+void Serialize(ByteArray &ba, const T &value) {
+    size_t size = BinaryCodec<T>::Size(value);
+    ba.Reserve(size);
+    auto *ptr = reinterpret_cast<uint8_t *>(ba.GetContiguousWriteBuffer(size));
+    if (ptr != nullptr) {
+        bool swap = ba.IsLittleEndian() != (BYTE_ORDER == LITTLE_ENDIAN);
+        PointerWriter writer(ptr, ptr + size, swap);
+        BinaryCodec<T>::Write(writer, value);
+        ba.CommitWrite(size);
+        return;
+    }
+    ByteArrayWriter writer(ba);
+    BinaryCodec<T>::Write(writer, value);
+}
+
+/**
+ * @brief 从ba的当前位置解码到value
+ * @exception 数据不足时抛出std::out_of_range
+ */
+template <class T>
+void Deserialize(ByteArray &ba, T &value) {
+    BinaryCodec<T>::Read(ba, value);
+}
+}  // namespace wtsclwq
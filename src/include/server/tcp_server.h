@@ -3,11 +3,21 @@
 //
 
 #pragma once
+#include <atomic>
 #include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "../io/io_manager.h"
 #include "../socket/socket.h"
+#include "../socket/socket_profile.h"
+#include "../socket/ssl_session.h"
+#include "../socket/ssl_socket.h"
+#include "../timer/timing_wheel.h"
 
 namespace wtsclwq {
 
@@ -24,6 +34,14 @@ class TcpServer : public std::enable_shared_from_this<TcpServer> {
 
     TcpServer(IOManager *worker, IOManager *acceptor);
 
+    /**
+     * @brief 使用多个worker调度器处理连接
+     * @param[in] workers worker调度器，新连接交给当前连接数最少的那个，
+     * 之后该连接上的所有IO都留在这个调度器上
+     * @param[in] acceptor 接受连接的调度器
+     */
+    TcpServer(const std::vector<IOManager *> &workers, IOManager *acceptor);
+
     ~TcpServer();
 
     /**
@@ -34,7 +52,10 @@ class TcpServer : public std::enable_shared_from_this<TcpServer> {
     virtual auto Bind(const Address::ptr &address) -> bool;
 
     /**
-     * @brief 绑定多个地址
+     * @brief 绑定多个地址。
+     * 监听数大于1时，每个地址打开多个设置了SO_REUSEPORT的监听socket，
+     * 由内核把新连接分散到各个socket上，每个socket各有一个accept协程，
+     * 这些协程不绑定线程，由acceptor的空闲线程同时执行
      * @param[in] address_vec 需要绑定的地址数组
      * @param[out] fails_vec 绑定失败的地址数组
      * @return 是否成功
@@ -49,10 +70,28 @@ class TcpServer : public std::enable_shared_from_this<TcpServer> {
     virtual auto Start() -> bool;
 
     /**
-     * @brief 停止服务
+     * @brief 停止服务：关闭监听socket，已有连接继续处理直到结束，
+     * 超过排空时限仍未结束的连接会被shutdown
      */
     virtual void Stop();
 
+    /**
+     * @brief 热重启(旧进程)：在Unix socket路径上等待新进程连接，
+     * 把所有监听socket的fd传给它；新进程开始accept后本服务器Stop()并排空连接。
+     * 监听socket在交接期间一直打开，backlog中的连接由新进程继续accept
+     * @param[in] path Unix socket路径
+     * @pre 必须Bind()成功
+     */
+    auto ServeHotRestart(const std::string &path) -> bool;
+
+    /**
+     * @brief 热重启(新进程)：连接旧进程的Unix socket，接收它的监听socket，
+     * 代替Bind()；Start()后通知旧进程开始排空
+     * @param[in] path 旧进程ServeHotRestart()的路径
+     * @return 没有旧进程或接收失败时返回false，此时应该正常Bind()
+     */
+    auto InheritListeners(const std::string &path) -> bool;
+
     /**
      * @brief 返回可读字符串
      * @param prefix 前缀
@@ -75,6 +114,84 @@ class TcpServer : public std::enable_shared_from_this<TcpServer> {
 
     void SetRecvTimeout(uint64_t m_recv_timeout);
 
+    auto GetWorkerCount() const -> size_t;
+
+    /**
+     * @brief 第index个worker上正在处理的连接数
+     */
+    auto GetWorkerConnections(size_t index) const -> size_t;
+
+    auto GetMaxConnections() const -> size_t;
+
+    /**
+     * @brief 设置总连接数上限，达到上限时暂停accept，新连接留在内核的backlog中
+     * @param[in] count 0表示不限制
+     */
+    void SetMaxConnections(size_t count);
+
+    auto GetMaxConnectionsPerIp() const -> size_t;
+
+    /**
+     * @brief 设置单个客户端IP的连接数上限，超过上限的连接accept后立即关闭
+     * @param[in] count 0表示不限制
+     */
+    void SetMaxConnectionsPerIp(size_t count);
+
+    auto GetDrainTimeout() const -> uint64_t;
+
+    /**
+     * @brief 设置Stop()后等待已有连接结束的时限(ms)，0表示立即shutdown所有连接
+     */
+    void SetDrainTimeout(uint64_t timeout);
+
+    auto GetIdleTimeout() const -> uint64_t;
+
+    /**
+     * @brief 设置连接的空闲超时(ms)，超过这么久没有收发数据的连接会被shutdown。
+     * 每个worker用一个时间轮检测，开启后不再给连接设置每次读的超时
+     * @param[in] timeout 0表示不回收空闲连接
+     * @pre 在Start()之前调用
+     */
+    void SetIdleTimeout(uint64_t timeout);
+
+    /**
+     * @brief 正在处理的连接数
+     */
+    auto GetActiveConnections() -> size_t;
+
+    auto GetProfile() const -> const std::string &;
+
+    /**
+     * @brief 选择socket.profiles中的一套socket选项，用于监听socket和accept得到的连接
+     * @pre 在Bind()之前调用
+     */
+    void SetProfile(const std::string &name);
+
+    /**
+     * @brief 开启TLS：加载证书和私钥，之后Bind()得到的监听socket都是SslSocket，
+     * 共享同一个SSL上下文。握手在连接所在worker的协程上完成，不阻塞accept
+     * @pre 在Bind()之前调用
+     */
+    auto LoadCertificates(const std::string &cert_file,
+                          const std::string &key_file) -> bool;
+
+    auto IsSsl() const -> bool;
+
+    /**
+     * @brief TLS握手和会话复用的统计，未开启TLS时全为0
+     */
+    auto GetSslSessionStats() const -> SslSessionStats;
+
+    auto GetReusePortListeners() const -> size_t;
+
+    /**
+     * @brief 设置每个地址的SO_REUSEPORT监听socket数
+     * @param[in] count 0表示acceptor线程池中每个线程一个，
+     * 1表示每个地址只有一个普通的监听socket
+     * @pre 在Bind()之前调用
+     */
+    void SetReusePortListeners(size_t count);
+
   protected:
     /**
      * @brief 处理新建立的客户端socket
@@ -88,13 +205,107 @@ class TcpServer : public std::enable_shared_from_this<TcpServer> {
      */
     virtual void StartAccept(const Socket::ptr &socket);
 
+    /**
+     * @brief 选出当前连接数最少的worker，连接数相同时轮流选择
+     * @return worker的下标
+     */
+    auto SelectWorker() -> size_t;
+
   private:
+    using MutexType = std::mutex;
+
+    /**
+     * @brief 因连接数达到上限而挂起的accept协程
+     */
+    struct AcceptWaiter {
+        Fiber::ptr fiber{};             // 挂起的协程
+        Scheduler *scheduler{nullptr};  // 恢复协程的调度器
+        pid_t thread_id{-1};            // 挂起协程所在的线程
+    };
+
+    /**
+     * @brief 为下一个连接占用一个名额，没有名额时挂起当前accept协程
+     * @return 服务器已经停止时返回false
+     */
+    auto AcquireSlot() -> bool;
+
+    /**
+     * @brief 归还名额，唤醒一个等待名额的accept协程
+     */
+    void ReleaseSlot();
+
+    /**
+     * @brief 一个连接的登记信息
+     */
+    struct ConnectionInfo {
+        std::string ip{};                       // 对端IP
+        TimingWheel::Entry::ptr idle_entry{};  // 空闲检测任务
+    };
+
+    /**
+     * @brief 登记新连接并加入worker的空闲检测时间轮，
+     * 超过单IP上限时返回false，名额由调用者归还
+     */
+    auto AddConnection(const Socket::ptr &client, size_t worker) -> bool;
+
+    /**
+     * @brief 注销连接并归还名额
+     */
+    void RemoveConnection(const Socket::ptr &client);
+
+    /**
+     * @brief 停止后等待已有连接结束，超时后shutdown剩余连接
+     */
+    void StartDrain();
+
+    /**
+     * @brief shutdown所有还在处理的连接，使阻塞在它们上的协程尽快返回
+     */
+    void ShutdownConnections();
+
+    /**
+     * @brief 接受新进程的连接并交出监听socket，运行在acceptor上
+     */
+    void HandleHotRestart(const Socket::ptr &listener);
+
+    /**
+     * @brief TLS连接完成握手，非TLS连接直接返回true，运行在worker上
+     */
+    auto Handshake(const Socket::ptr &client) -> bool;
+
+    /**
+     * @brief 关闭热重启的Unix监听socket并删除路径，以便新进程在同一路径上监听
+     */
+    void CloseHotRestartListener();
+
     std::string m_name;     // 服务器名称
     std::string m_type;     // 服务器类型
     bool m_is_stop;         // 服务器是否停止
-    IOManager *m_worker;    // 用来处理新建socket连接的调度器
+    IOManager *m_worker;    // 用来处理新建socket连接的调度器(第一个worker)
     IOManager *m_acceptor;  // 用来处理服务端socket的连接请求的接收
     uint64_t m_recv_timeout;             // 接受超时时限
+    size_t m_reuseport_listeners;        // 每个地址的SO_REUSEPORT监听socket数
+    std::string m_profile_name;          // socket选项配置的名称
+    SocketProfile m_profile;             // socket选项配置
+    std::vector<IOManager *> m_workers;  // 所有worker调度器
+    std::unique_ptr<std::atomic_size_t[]> m_worker_connections;  // 各worker的连接数
+    std::atomic_size_t m_next_worker{0};  // 连接数相同时开始比较的worker
+    size_t m_max_connections;             // 总连接数上限
+    size_t m_max_connections_per_ip;      // 单IP连接数上限
+    uint64_t m_drain_timeout;             // 停止后等待连接结束的时限
+    uint64_t m_idle_timeout;              // 连接的空闲超时
+    size_t m_slot_count{0};               // 已占用的名额(包括正在accept的)
+    std::vector<TimingWheel::ptr> m_idle_wheels{};  // 各worker的空闲检测时间轮
+    std::unordered_map<Socket::ptr, ConnectionInfo> m_clients{};  // 连接信息
+    std::unordered_map<std::string, size_t> m_ip_connections{};  // IP -> 连接数
+    std::list<AcceptWaiter> m_accept_waiters{};  // 等待名额的accept协程
+    Timer::ptr m_drain_timer{};                  // 排空超时定时器
+    std::shared_ptr<SSL_CTX> m_ssl_ctx{};  // TLS的SSL上下文，为空表示不开启TLS
+    uint64_t m_ssl_handshake_timeout;      // TLS握手超时
+    Socket::ptr m_restart_listener{};  // 热重启时等待新进程连接的Unix socket
+    std::string m_restart_path{};      // 热重启的Unix socket路径
+    Socket::ptr m_predecessor{};       // 和旧进程的连接，Start()后通知它排空
+    MutexType m_mutex{};
     std::vector<Socket::ptr> m_sockets;  // 被监听的socket数组
 };
 
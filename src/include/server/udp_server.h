@@ -0,0 +1,171 @@
+//
+// 批量收发的UDP服务器
+//
+#pragma once
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../io/io_manager.h"
+#include "../socket/address.h"
+#include "../socket/socket.h"
+
+namespace wtsclwq {
+
+/**
+ * @brief 收到的一个数据报
+ */
+struct Datagram {
+    const char *data{nullptr};   // 数据，在HandleDatagram()返回后失效
+    size_t length{0};            // 数据长度
+    const sockaddr *peer{nullptr};  // 对端地址
+    socklen_t peer_len{0};          // 对端地址长度
+};
+
+/**
+ * @brief UDP服务器。
+ * 接收协程用recvmmsg一次读入一批数据报(缓冲区来自池)，整批交给worker上的一个协程处理，
+ * 处理产生的回复用sendmmsg批量发出；发往同一对端、长度相同的连续回复
+ * 在内核支持时合并成一条UDP_SEGMENT(GSO)消息
+ */
+class UdpServer : public std::enable_shared_from_this<UdpServer> {
+  public:
+    UdpServer(const UdpServer &) = delete;
+    UdpServer(UdpServer &&) = delete;
+    auto operator=(const UdpServer &) -> UdpServer & = delete;
+    auto operator=(UdpServer &&) -> UdpServer & = delete;
+
+    using ptr = std::shared_ptr<UdpServer>;
+    using MutexType = std::mutex;
+
+    /**
+     * @param[in] worker 处理数据报的调度器
+     * @param[in] receiver 运行接收协程的调度器
+     */
+    UdpServer(IOManager *worker, IOManager *receiver);
+
+    virtual ~UdpServer();
+
+    /**
+     * @brief 绑定地址
+     */
+    virtual auto Bind(const Address::ptr &address) -> bool;
+
+    /**
+     * @brief 启动接收协程
+     * @pre 必须Bind()成功
+     */
+    virtual auto Start() -> bool;
+
+    /**
+     * @brief 停止接收并关闭socket
+     */
+    virtual void Stop();
+
+    auto GetSocket() const -> Socket::ptr;
+
+    auto IsGsoEnabled() const -> bool;
+
+    /**
+     * @brief 收到的数据报总数
+     */
+    auto GetRecvCount() const -> uint64_t;
+
+    /**
+     * @brief 发出的回复总数(一条GSO消息按分段数计)
+     */
+    auto GetSendCount() const -> uint64_t;
+
+  protected:
+    /**
+     * @brief 处理一个数据报，在worker的协程中调用
+     * @param[in] request 收到的数据报
+     * @param[out] reply 回复的内容
+     * @return 是否需要回复
+     */
+    virtual auto HandleDatagram(const Datagram &request, std::string &reply)
+        -> bool;
+
+  private:
+    /**
+     * @brief 一条待发送的回复
+     */
+    struct Reply {
+        std::string data{};      // 回复的内容，复用时保留容量
+        const sockaddr *peer{nullptr};  // 指向Batch中的对端地址
+        socklen_t peer_len{0};
+    };
+
+    /**
+     * @brief UDP_SEGMENT控制消息的缓冲区
+     */
+    struct GsoControl {
+        alignas(cmsghdr) char buf[CMSG_SPACE(sizeof(uint16_t))];
+    };
+
+    /**
+     * @brief 一批数据报的收发缓冲区，处理完后回到池中复用，
+     * 稳定运行时收发路径上没有内存分配
+     */
+    struct Batch {
+        using ptr = std::shared_ptr<Batch>;
+        std::unique_ptr<char[]> buffer{};       // batch_size * max_size 字节
+        std::vector<mmsghdr> recv_msgs{};       // recvmmsg的参数
+        std::vector<iovec> recv_iovs{};         // 每个数据报一个iovec
+        std::vector<sockaddr_storage> peers{};  // 每个数据报的对端地址
+        size_t count{0};                        // 实际收到的数据报数
+        std::vector<Reply> replies{};           // 处理产生的回复
+        size_t reply_count{0};                  // 有效的回复数
+        std::vector<mmsghdr> send_msgs{};       // sendmmsg的参数
+        std::vector<iovec> send_iovs{};         // 每个回复一个iovec
+        std::vector<GsoControl> controls{};     // 每条消息的GSO控制消息
+        std::vector<size_t> first_reply{};      // 每条消息的第一个回复
+    };
+
+    /**
+     * @brief 接收循环，运行在receiver上
+     */
+    void RecvLoop();
+
+    /**
+     * @brief 处理一批数据报并发送回复，运行在worker上
+     */
+    void HandleBatch(const Batch::ptr &batch);
+
+    /**
+     * @brief 用sendmmsg发出回复
+     */
+    void SendReplies(Batch &batch);
+
+    /**
+     * @brief 从第from个回复开始组装sendmmsg的消息，写到第offset条消息之后，
+     * gso为true时发往同一对端的连续回复合并成一条消息
+     * @return 组装的消息数
+     */
+    auto BuildMessages(Batch &batch, size_t from, bool gso, size_t offset = 0)
+        -> size_t;
+
+    auto AcquireBatch() -> Batch::ptr;
+
+    void ReleaseBatch(Batch::ptr batch);
+
+    IOManager *m_worker;
+    IOManager *m_receiver;
+    Socket::ptr m_socket{};
+    size_t m_batch_size;      // 一次recvmmsg最多读入的数据报数
+    size_t m_max_size;        // 单个数据报的最大长度
+    std::atomic_bool m_gso{false};  // 是否用UDP_SEGMENT合并回复
+    std::atomic_bool m_is_stop{true};
+    std::atomic_uint64_t m_recv_count{0};
+    std::atomic_uint64_t m_send_count{0};
+    std::vector<Batch::ptr> m_free_batches{};  // 空闲的缓冲区
+    MutexType m_mutex{};
+};
+}  // namespace wtsclwq
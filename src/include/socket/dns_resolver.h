@@ -0,0 +1,130 @@
+//
+// 协程友好的DNS解析器
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../util/singleton.h"
+#include "ip_address.h"
+
+namespace wtsclwq {
+
+/**
+ * @brief 协程友好的DNS解析器。
+ * 通过hook后的UDP socket向nameserver查询A/AAAA记录，等待应答时只挂起当前协程，
+ * 不会像getaddrinfo那样阻塞整个调度线程；结果按TTL缓存在分片的正/负缓存中
+ */
+class DnsResolverImpl {
+  public:
+    DnsResolverImpl(const DnsResolverImpl &) = delete;
+    DnsResolverImpl(DnsResolverImpl &&) = delete;
+    auto operator=(const DnsResolverImpl &) -> DnsResolverImpl & = delete;
+    auto operator=(DnsResolverImpl &&) -> DnsResolverImpl & = delete;
+
+    /**
+     * @brief 解析结果
+     */
+    enum class Status {
+        OK,         // 解析成功
+        NOT_FOUND,  // 域名不存在或没有对应类型的记录(可能来自负缓存)
+        FAILED,     // 无法由本解析器完成(超时、服务器错误、应答被截断等)
+    };
+
+    /**
+     * @brief 读取/etc/hosts和/etc/resolv.conf
+     */
+    DnsResolverImpl();
+    ~DnsResolverImpl() = default;
+
+    /**
+     * @brief 解析域名
+     * @param[out] result 解析得到的地址，端口为0，每次返回新的对象
+     * @param[in] name 域名
+     * @param[in] family AF_INET、AF_INET6 或 AF_UNSPEC
+     * @return 解析状态，FAILED时调用者可以退回getaddrinfo
+     */
+    auto Resolve(std::vector<IPAddress::ptr> &result, const std::string &name,
+                 int family) -> Status;
+
+    /**
+     * @brief 清空正/负缓存
+     */
+    void ClearCache();
+
+    /**
+     * @brief 缓存中的记录数(包括已过期但未清理的)
+     */
+    auto GetCacheSize() -> size_t;
+
+  private:
+    static const size_t SHARD_COUNT = 16;  // 缓存分片数
+
+    /**
+     * @brief 一条缓存记录，addrs为空表示负缓存
+     */
+    struct CacheEntry {
+        std::vector<IPAddress::ptr> addrs{};
+        uint64_t expire_ms{0};  // 过期的绝对时间
+    };
+
+    /**
+     * @brief 缓存分片，按域名哈希分散锁竞争
+     */
+    struct CacheShard {
+        std::mutex mutex{};
+        std::unordered_map<std::string, CacheEntry> entries{};
+    };
+
+    /**
+     * @brief 一次查询中的一个问题(A或AAAA)
+     */
+    struct Question {
+        uint16_t qtype{0};
+        uint16_t id{0};
+        bool answered{false};
+        Status status{Status::FAILED};
+        std::vector<IPAddress::ptr> addrs{};
+        uint32_t ttl{0};
+    };
+
+    /**
+     * @brief 查找缓存
+     * @return 命中返回true，result中为命中的地址(负缓存命中时不追加)
+     */
+    auto LookupCache(const std::string &key, std::vector<IPAddress::ptr> &result,
+                     Status &status) -> bool;
+
+    void InsertCache(const std::string &key, const Question &question);
+
+    /**
+     * @brief 向nameserver依次发送问题，直到全部得到确定的应答
+     */
+    void Query(const std::string &name, std::vector<Question> &questions);
+
+    /**
+     * @brief 通过一个UDP socket向server同时发出所有未应答的问题并等待应答
+     */
+    void QueryServer(const IPAddress::ptr &server, const std::string &name,
+                     std::vector<Question> &questions);
+
+    auto GetNameServers() -> std::vector<IPAddress::ptr>;
+
+    auto GetShard(const std::string &key) -> CacheShard &;
+
+    void LoadHosts(const std::string &path);
+
+    void LoadResolvConf(const std::string &path);
+
+    std::unordered_multimap<std::string, IPAddress::ptr> m_hosts{};  // hosts文件
+    std::vector<IPAddress::ptr> m_system_servers{};  // resolv.conf中的nameserver
+    CacheShard m_shards[SHARD_COUNT];
+};
+
+using DnsResolver = SingletonPtr<DnsResolverImpl>;
+}  // namespace wtsclwq
@@ -7,6 +7,7 @@
 #include <sys/types.h>
 
 #include <memory>
+#include <vector>
 
 #include "address.h"
 namespace wtsclwq {
@@ -58,6 +59,12 @@ class Socket : public std::enable_shared_from_this<Socket> {
      */
     static auto CreateIpv6TcpSocket() -> Socket::ptr;
 
+    /**
+     * @brief 静态方法：包装一个已经在监听的socket fd，比如热重启时从旧进程接收的fd
+     * @return fd不是socket时返回nullptr
+     */
+    static auto CreateFromListenFd(int fd) -> Socket::ptr;
+
     /**
      * @brief 静态方法：创建IPV6的UDP Socket
      */
@@ -117,6 +124,20 @@ class Socket : public std::enable_shared_from_this<Socket> {
     auto SetOptionWithLen(int level, int option, const void* result,
                           socklen_t socklen) -> bool;
 
+    /**
+     * @brief 成员方法：创建底层的socket fd(如果还没有创建)，
+     * 用于在Bind()/Connect()之前设置socket选项
+     * @return fd是否有效
+     */
+    auto Open() -> bool;
+
+    /**
+     * @brief 成员方法：设置SO_REUSEPORT，多个设置了该选项的socket可以绑定同一个地址，
+     * 由内核在它们之间分配新连接
+     * @pre 在Bind()之前调用，socket尚未创建时会先创建
+     */
+    auto SetReusePort(bool enable) -> bool;
+
     /**
      * @brief 虚成员方法：绑定Socket和Address @see man bind()
      * @prama[in] 要绑定到this的地址信息
@@ -184,6 +205,43 @@ class Socket : public std::enable_shared_from_this<Socket> {
      */
     virtual auto SendIovec(iovec* buffers, size_t length, int flags) -> ssize_t;
 
+    /**
+     * @brief 虚成员函数：把文件的一段直接发送给this（TCP，sendfile）
+     * @param[in] file_fd 文件描述符
+     * @param[in] offset 文件中的起始偏移
+     * @param[in] count 最多发送的字节数
+     * @return
+     *      @retval >0 发送成功[对应大小]的数据
+     *      @retval =0 已到文件末尾
+     *      @retval <0 this socket错误
+     */
+    virtual auto SendFile(int file_fd, off_t offset, size_t count) -> ssize_t;
+
+    /**
+     * @brief 成员函数：通过Unix socket把一组fd(SCM_RIGHTS)传给对端进程
+     * @param[in] fds 要传递的fd，本进程中的fd保持打开
+     * @return 是否发送成功
+     */
+    auto SendFds(const std::vector<int>& fds) -> bool;
+
+    /**
+     * @brief 成员函数：接收对端用SendFds()传来的fd
+     * @param[out] fds 接收到的fd，已设置FD_CLOEXEC
+     * @param[in] max_count 最多接收的fd数
+     * @return 是否接收到fd，fd数超过max_count时全部关闭并返回false
+     */
+    auto RecvFds(std::vector<int>& fds, size_t max_count) -> bool;
+
+    /**
+     * @brief 成员函数：开启/关闭MSG_ZEROCOPY发送(TCP)。
+     * 开启后不小于socket.zerocopy.threshold字节的Send()/SendIovec()以MSG_ZEROCOPY发送，
+     * 并在返回前等待内核的完成通知，返回时缓冲区已经可以复用或释放
+     * @return 内核不支持SO_ZEROCOPY时返回false
+     */
+    auto SetZeroCopy(bool enable) -> bool;
+
+    auto IsZeroCopy() const -> bool;
+
     /**
      * @brief 虚成员函数：向目标地址发送数据（UDP）
      * @param[in] buffer 待发送数据
@@ -356,6 +414,34 @@ class Socket : public std::enable_shared_from_this<Socket> {
      */
     virtual auto Init(int sock) -> bool;
 
+    /**
+     * @brief 成员函数：接管一个已经在监听的socket fd，从fd读出协议簇、类型和协议
+     */
+    auto InitListenFd(int fd) -> bool;
+
+    /**
+     * @brief 成员函数：以MSG_ZEROCOPY发送，并等待这次发送的完成通知
+     */
+    auto SendZeroCopy(const msghdr* msg, int flags) -> ssize_t;
+
+    /**
+     * @brief 成员函数：读出错误队列中的零拷贝完成通知
+     * @return 读到的通知数，队列为空时返回-1且errno为EAGAIN
+     */
+    auto ReadZeroCopyCompletions() -> int;
+
+    /**
+     * @brief 成员函数：返回只在错误队列有数据时可读的epoll fd，第一次调用时创建。
+     * 零拷贝发送在它上面等待完成通知，不和读协程争用socket的读事件
+     * @return 创建失败时返回-1
+     */
+    auto GetZeroCopyWaitFd() -> int;
+
+    /**
+     * @brief 成员函数：取消零拷贝等待fd上的事件并关闭它
+     */
+    void CloseZeroCopyWaitFd();
+
   protected:
     int m_socket{-1};                 // socket fd
     int m_family{};                   // 协议簇
@@ -364,6 +450,10 @@ class Socket : public std::enable_shared_from_this<Socket> {
     bool m_is_connected{false};       // 是否已连接
     Address::ptr m_local_address{};   // 本地地址
     Address::ptr m_remote_address{};  // 远端地址
+    bool m_is_zerocopy{false};        // 是否使用MSG_ZEROCOPY发送
+    uint32_t m_zerocopy_sent{0};      // 零拷贝发送的次数
+    uint32_t m_zerocopy_done{0};      // 已经完成的零拷贝发送次数
+    int m_zerocopy_wait_fd{-1};       // 等待零拷贝完成通知的epoll fd
 };
 
 template <class T>
@@ -0,0 +1,134 @@
+//
+// 客户端连接池
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "../concurrency/fiber.h"
+#include "../io/io_manager.h"
+#include "address.h"
+#include "socket.h"
+
+namespace wtsclwq {
+/**
+ * @brief 按远端地址分组的TCP连接池。
+ * 每个地址有空闲连接数和总连接数上限；空闲连接在取出时做健康检查，
+ * 并由定时器定期淘汰空闲过久的连接；总连接数达到上限时挂起当前协程，
+ * 等待其他协程归还连接
+ * @attention 池中有定时器，IOManager停止前需要先Close()或者析构连接池
+ */
+class SocketPool : public std::enable_shared_from_this<SocketPool> {
+  public:
+    SocketPool(const SocketPool &) = delete;
+    SocketPool(SocketPool &&) = delete;
+    auto operator=(const SocketPool &) -> SocketPool & = delete;
+    auto operator=(SocketPool &&) -> SocketPool & = delete;
+
+    using ptr = std::shared_ptr<SocketPool>;
+    using MutexType = std::mutex;
+
+    /**
+     * @param[in] max_idle_per_host 每个地址最多保留的空闲连接数
+     * @param[in] max_per_host 每个地址的总连接数上限(借出的+空闲的)
+     * @param[in] idle_timeout_ms 空闲连接的最长保留时间
+     * @param[in] connect_timeout_ms 建立新连接的超时时间
+     */
+    SocketPool(size_t max_idle_per_host, size_t max_per_host,
+               uint64_t idle_timeout_ms, uint64_t connect_timeout_ms);
+    ~SocketPool();
+
+    /**
+     * @brief 创建连接池，并在iom上启动淘汰空闲连接的定时器
+     */
+    static auto Create(size_t max_idle_per_host = 8, size_t max_per_host = 64,
+                       uint64_t idle_timeout_ms = 30000,
+                       uint64_t connect_timeout_ms = 3000,
+                       IOManager *iom = IOManager::GetThisThreadIOManager())
+        -> SocketPool::ptr;
+
+    /**
+     * @brief 获取一个到address的连接，优先复用最近归还的空闲连接，
+     * 没有空闲连接且未达上限时新建连接，达到上限时挂起当前协程等待
+     * @param[in] wait_timeout_ms 达到上限时的最长等待时间，0表示不等待
+     * @return 失败或等待超时返回nullptr
+     */
+    auto Acquire(const Address::ptr &address,
+                 uint64_t wait_timeout_ms = UINT64_MAX) -> Socket::ptr;
+
+    /**
+     * @brief 归还连接
+     * @param[in] sock Acquire()得到的连接
+     * @param[in] reusable 连接是否还能复用，协议出错等情况应传false让池关闭它
+     */
+    void Release(const Socket::ptr &sock, bool reusable = true);
+
+    /**
+     * @brief 停止定时器并关闭所有空闲连接，之后归还的连接直接关闭
+     */
+    void Close();
+
+    /**
+     * @brief 淘汰空闲超时或已经失效的连接，由定时器周期调用
+     */
+    void EvictIdle();
+
+    auto GetIdleCount() -> size_t;
+    auto GetActiveCount() -> size_t;
+
+  private:
+    /**
+     * @brief 因连接数达到上限而挂起的协程
+     */
+    struct Waiter {
+        using ptr = std::shared_ptr<Waiter>;
+        Fiber::ptr fiber{};             // 挂起的协程
+        Scheduler *scheduler{nullptr};  // 恢复协程的调度器
+        pid_t thread_id{-1};            // 挂起协程所在的线程
+        bool done{false};               // 是否已经被唤醒
+        bool timed_out{false};          // 是否等待超时
+        Socket::ptr sock{};             // 直接转交的连接，为空时表示转交了名额
+    };
+
+    /**
+     * @brief 一个远端地址上的连接
+     */
+    struct HostPool {
+        struct IdleSocket {
+            Socket::ptr sock{};
+            uint64_t idle_since{0};  // 归还的时间
+        };
+        std::deque<IdleSocket> idle{};     // 空闲连接，尾部是最近归还的
+        size_t active{0};                  // 借出和正在建立的连接数
+        std::list<Waiter::ptr> waiters{};  // 等待连接的协程
+    };
+
+    /**
+     * @brief 唤醒一个等待者，交给它连接sock，sock为空时交给它一个新建连接的名额
+     * @pre 持有m_mutex且host.waiters非空
+     */
+    static void WakeWaiter(HostPool &host, const Socket::ptr &sock);
+
+    /**
+     * @brief 新建连接，失败时归还名额
+     */
+    auto Connect(const Address::ptr &address, const std::string &key)
+        -> Socket::ptr;
+
+    size_t m_max_idle_per_host;
+    size_t m_max_per_host;
+    uint64_t m_idle_timeout_ms;
+    uint64_t m_connect_timeout_ms;
+    bool m_is_closed{false};
+    Timer::ptr m_evict_timer{};
+    std::unordered_map<std::string, HostPool> m_hosts{};  // 地址 -> 连接
+    MutexType m_mutex{};
+};
+}  // namespace wtsclwq
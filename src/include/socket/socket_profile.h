@@ -0,0 +1,107 @@
+//
+// socket调优配置
+//
+#pragma once
+
+#include <string>
+
+#include "../util/cast_util.h"
+#include "socket.h"
+
+namespace wtsclwq {
+
+/**
+ * @brief 一组TCP socket选项，在配置socket.profiles中按名称定义，
+ * 值为0(incoming_cpu为-1)或false的选项不设置，保持系统默认
+ */
+struct SocketProfile {
+    int fastopen{0};               // 监听socket的TCP_FASTOPEN队列长度
+    bool fastopen_connect{false};  // 客户端TCP_FASTOPEN_CONNECT
+    int defer_accept{0};           // TCP_DEFER_ACCEPT，收到数据后才完成accept(秒)
+    int busy_poll{0};              // SO_BUSY_POLL，读阻塞前忙等的时间(微秒)
+    bool quickack{false};          // TCP_QUICKACK，连接建立时关闭延迟确认
+    int notsent_lowat{0};          // TCP_NOTSENT_LOWAT，未发送数据的可写水位(字节)
+    int sndbuf{0};                 // SO_SNDBUF(字节)
+    int rcvbuf{0};                 // SO_RCVBUF(字节)
+    int incoming_cpu{-1};          // 监听socket的SO_INCOMING_CPU
+
+    auto operator==(const SocketProfile &other) const -> bool {
+        return fastopen == other.fastopen &&
+               fastopen_connect == other.fastopen_connect &&
+               defer_accept == other.defer_accept &&
+               busy_poll == other.busy_poll && quickack == other.quickack &&
+               notsent_lowat == other.notsent_lowat &&
+               sndbuf == other.sndbuf && rcvbuf == other.rcvbuf &&
+               incoming_cpu == other.incoming_cpu;
+    }
+
+    /**
+     * @brief 按名称查找配置，找不到时返回不设置任何选项的配置
+     */
+    static auto Get(const std::string &name) -> SocketProfile;
+
+    /**
+     * @brief 设置监听socket的选项，缓冲区大小会被accept得到的连接继承
+     * @pre 在Bind()之后、Listen()之前调用
+     * @return 所有选项是否都设置成功
+     */
+    auto ApplyToListener(const Socket::ptr &sock) const -> bool;
+
+    /**
+     * @brief 设置accept得到的连接的选项
+     */
+    auto ApplyToConnection(const Socket::ptr &sock) const -> bool;
+
+    /**
+     * @brief 设置客户端socket的选项
+     * @pre 在Connect()之前调用
+     */
+    auto ApplyToClient(const Socket::ptr &sock) const -> bool;
+};
+
+template <>
+class LexicalCast<std::string, SocketProfile> {
+  public:
+    auto operator()(const std::string &val_str) -> SocketProfile {
+        YAML::Node node = YAML::Load(val_str);
+        SocketProfile profile;
+        if (!node.IsMap()) {
+            return profile;
+        }
+        profile.fastopen = node["fastopen"].as<int>(profile.fastopen);
+        profile.fastopen_connect =
+            node["fastopen_connect"].as<bool>(profile.fastopen_connect);
+        profile.defer_accept =
+            node["defer_accept"].as<int>(profile.defer_accept);
+        profile.busy_poll = node["busy_poll"].as<int>(profile.busy_poll);
+        profile.quickack = node["quickack"].as<bool>(profile.quickack);
+        profile.notsent_lowat =
+            node["notsent_lowat"].as<int>(profile.notsent_lowat);
+        profile.sndbuf = node["sndbuf"].as<int>(profile.sndbuf);
+        profile.rcvbuf = node["rcvbuf"].as<int>(profile.rcvbuf);
+        profile.incoming_cpu =
+            node["incoming_cpu"].as<int>(profile.incoming_cpu);
+        return profile;
+    }
+};
+
+template <>
+class LexicalCast<SocketProfile, std::string> {
+  public:
+    auto operator()(const SocketProfile &profile) -> std::string {
+        YAML::Node node;
+        node["fastopen"] = profile.fastopen;
+        node["fastopen_connect"] = profile.fastopen_connect;
+        node["defer_accept"] = profile.defer_accept;
+        node["busy_poll"] = profile.busy_poll;
+        node["quickack"] = profile.quickack;
+        node["notsent_lowat"] = profile.notsent_lowat;
+        node["sndbuf"] = profile.sndbuf;
+        node["rcvbuf"] = profile.rcvbuf;
+        node["incoming_cpu"] = profile.incoming_cpu;
+        std::stringstream sstream;
+        sstream << node;
+        return sstream.str();
+    }
+};
+}  // namespace wtsclwq
@@ -0,0 +1,203 @@
+//
+// TLS会话复用：服务端的分片会话缓存和轮换的会话票据密钥，客户端按目标地址保存会话
+//
+#pragma once
+
+#include <openssl/ssl.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../concurrency/lock.h"
+
+namespace wtsclwq {
+
+/**
+ * @brief 服务端会话复用的统计
+ */
+struct SslSessionStats {
+    uint64_t handshakes{0};      // 完成的握手数
+    uint64_t resumed{0};         // 其中复用会话的握手数
+    uint64_t cache_hits{0};      // 会话缓存命中数
+    uint64_t cache_misses{0};    // 会话缓存未命中数
+    uint64_t ticket_renewed{0};  // 用旧密钥解密、需要换发的票据数
+
+    /**
+     * @brief 复用率
+     */
+    auto GetResumptionRate() const -> double {
+        return handshakes == 0 ? 0.0
+                               : static_cast<double>(resumed) / handshakes;
+    }
+};
+
+/**
+ * @brief 服务端的会话缓存，按会话ID分片，每个分片一把锁，
+ * 代替OpenSSL内部只有一把锁的缓存
+ */
+class SslSessionCache {
+  public:
+    SslSessionCache(const SslSessionCache &) = delete;
+    SslSessionCache(SslSessionCache &&) = delete;
+    auto operator=(const SslSessionCache &) -> SslSessionCache & = delete;
+    auto operator=(SslSessionCache &&) -> SslSessionCache & = delete;
+
+    /**
+     * @param[in] shard_count 分片数
+     * @param[in] capacity 总容量，超过时每个分片淘汰最早加入的会话
+     */
+    SslSessionCache(size_t shard_count, size_t capacity);
+
+    ~SslSessionCache();
+
+    /**
+     * @brief 加入会话，缓存持有session的一个引用
+     */
+    void Add(SSL_SESSION *session);
+
+    /**
+     * @brief 按会话ID查找未过期的会话
+     * @return 找不到时返回nullptr，返回的会话已经增加了一个引用，
+     * 调用者负责释放
+     */
+    auto Get(const unsigned char *id, size_t len) -> SSL_SESSION *;
+
+    void Remove(SSL_SESSION *session);
+
+    auto GetSize() -> size_t;
+
+  private:
+    using MutexType = std::mutex;
+
+    struct Shard {
+        std::unordered_map<std::string, SSL_SESSION *> sessions{};
+        std::deque<std::string> order{};  // 加入顺序，用于淘汰
+        MutexType mutex{};
+    };
+
+    auto GetShard(const std::string &id) -> Shard &;
+
+    std::vector<Shard> m_shards;
+    size_t m_shard_capacity;  // 每个分片的容量
+};
+
+/**
+ * @brief 会话票据(session ticket)的密钥环。
+ * 第一个密钥用于加密新票据，定期轮换；旧密钥保留若干代，只用于解密，
+ * 用旧密钥解密的票据会被换发
+ */
+class SslTicketKeyRing {
+  public:
+    SslTicketKeyRing(const SslTicketKeyRing &) = delete;
+    SslTicketKeyRing(SslTicketKeyRing &&) = delete;
+    auto operator=(const SslTicketKeyRing &) -> SslTicketKeyRing & = delete;
+    auto operator=(SslTicketKeyRing &&) -> SslTicketKeyRing & = delete;
+
+    /**
+     * @param[in] rotation 轮换间隔(ms)
+     * @param[in] key_count 保留的密钥数(包括当前密钥)
+     */
+    SslTicketKeyRing(uint64_t rotation, size_t key_count);
+
+    /**
+     * @brief 供SSL_CTX_set_tlsext_ticket_key_evp_cb使用
+     * @return 1成功，2成功但需要换发票据，0找不到密钥，-1出错
+     */
+    auto Process(unsigned char *key_name, unsigned char *iv,
+                 EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx, bool encrypt)
+        -> int;
+
+    /**
+     * @brief 立即轮换一次
+     */
+    void Rotate();
+
+  private:
+    struct Key {
+        unsigned char name[16];
+        unsigned char aes_key[32];
+        unsigned char hmac_key[32];
+        uint64_t created{0};
+    };
+
+    uint64_t m_rotation;
+    size_t m_key_count;
+    std::deque<Key> m_keys{};  // 第一个是当前密钥
+    RWLock m_rwlock{};
+};
+
+/**
+ * @brief 服务端SSL上下文的会话复用状态，随SSL_CTX一起释放
+ */
+class SslSessionManager {
+  public:
+    SslSessionManager(const SslSessionManager &) = delete;
+    SslSessionManager(SslSessionManager &&) = delete;
+    auto operator=(const SslSessionManager &) -> SslSessionManager & = delete;
+    auto operator=(SslSessionManager &&) -> SslSessionManager & = delete;
+
+    SslSessionManager();
+
+    /**
+     * @brief 给服务端SSL上下文开启分片会话缓存和会话票据(按配置ssl.*)
+     */
+    static void Install(SSL_CTX *ctx);
+
+    /**
+     * @return ctx没有Install()过时返回nullptr
+     */
+    static auto Get(SSL_CTX *ctx) -> SslSessionManager *;
+
+    /**
+     * @brief 记录一次完成的握手
+     */
+    void OnHandshake(bool resumed);
+
+    void OnCacheLookup(bool hit);
+
+    void OnTicketRenewed();
+
+    auto GetStats() const -> SslSessionStats;
+
+    auto GetCache() -> SslSessionCache & { return m_cache; }
+
+    auto GetTicketKeys() -> SslTicketKeyRing & { return m_ticket_keys; }
+
+  private:
+    SslSessionCache m_cache;
+    SslTicketKeyRing m_ticket_keys;
+    std::atomic_uint64_t m_handshakes{0};
+    std::atomic_uint64_t m_resumed{0};
+    std::atomic_uint64_t m_cache_hits{0};
+    std::atomic_uint64_t m_cache_misses{0};
+    std::atomic_uint64_t m_ticket_renewed{0};
+};
+
+/**
+ * @brief 客户端按目标(地址或主机名)保存最近一次的会话，下次连接同一目标时复用
+ */
+class SslClientSessions {
+  public:
+    /**
+     * @brief 给客户端SSL上下文注册保存会话的回调
+     */
+    static void Install(SSL_CTX *ctx);
+
+    /**
+     * @brief 连接前调用：记录ssl对应的目标，有保存的会话时设置给ssl
+     */
+    static void Apply(SSL *ssl, const std::string &target);
+
+    /**
+     * @brief 删除目标保存的会话，比如复用失败时
+     */
+    static void Remove(const std::string &target);
+};
+}  // namespace wtsclwq
@@ -38,6 +38,22 @@ class SslSocket : public Socket {
      */
     static auto CreateIpv6TcpSslSocket() -> SslSocket::ptr;
 
+    /**
+     * @brief 包装一个已经在监听的socket fd(热重启时从旧进程接收)
+     * @param[in] ctx accept得到的连接使用的SSL上下文
+     */
+    static auto CreateFromListenFd(int fd, std::shared_ptr<SSL_CTX> ctx)
+        -> SslSocket::ptr;
+
+    /**
+     * @brief 加载证书和私钥，创建服务端SSL上下文，可以被多个监听socket共享，
+     * 上下文开启分片会话缓存和会话票据(见SslSessionManager)
+     * @return 失败时返回nullptr
+     */
+    static auto CreateServerContext(const std::string &cert_file,
+                                    const std::string &key_file)
+        -> std::shared_ptr<SSL_CTX>;
+
     auto Bind(const Address::ptr &address) -> bool override;
 
     auto Listen(int backlog) -> bool override;
@@ -53,9 +69,20 @@ class SslSocket : public Socket {
 
     auto Send(const void *buffer, size_t length, int flags) -> ssize_t override;
 
+    /**
+     * @brief 发送一组缓冲区，连续的iovec拼成满的TLS记录后再加密，
+     * 头部加正文这样的写法不会拆成多个小记录
+     */
     auto SendIovec(iovec *buffers, size_t length, int flags)
         -> ssize_t override;
 
+    /**
+     * @brief 发送文件的一段。
+     * 开启了kTLS时用SSL_sendfile由内核直接加密页缓存中的数据，
+     * 否则读到用户态，每次最多发送一个TLS记录(16KB)
+     */
+    auto SendFile(int file_fd, off_t offset, size_t count) -> ssize_t override;
+
     auto SendTo(const void *buffer, size_t length, const Address::ptr &to,
                 int flags) -> ssize_t override;
 
@@ -80,11 +107,56 @@ class SslSocket : public Socket {
     auto LoadCertificates(const std::string &cert_file,
                           const std::string &key_file) -> bool;
 
+    auto GetContext() const -> std::shared_ptr<SSL_CTX>;
+
+    /**
+     * @brief 设置监听socket的SSL上下文，accept得到的连接共享这个上下文
+     */
+    void SetContext(std::shared_ptr<SSL_CTX> ctx);
+
+    /**
+     * @brief 完成TLS握手。
+     * 握手按SSL_ERROR_WANT_READ/WANT_WRITE显式推进，需要等待时在IOManager上
+     * 挂起当前协程，不占用线程；accept得到的socket不在Accept()中握手，
+     * 由处理连接的协程调用(不调用时在第一次Send/Recv中完成握手)
+     * @param[in] timeout 整个握手的超时时间(ms)，-1表示不超时
+     * @return 是否握手成功，超时时errno为ETIMEDOUT
+     */
+    auto Handshake(uint64_t timeout) -> bool;
+
+    /**
+     * @brief 发送方向是否由内核加密(kTLS)，配置ssl.ktls开启且握手后内核接管时为true。
+     * 为true时SendIovec()和SendFile()直接交给内核，不在用户态复制和加密
+     */
+    auto IsKtlsSend() const -> bool;
+
+    /**
+     * @brief 接收方向是否由内核解密(kTLS)
+     */
+    auto IsKtlsRecv() const -> bool;
+
+    /**
+     * @brief 握手是否复用了之前的会话(会话缓存或会话票据)
+     */
+    auto IsSessionReused() const -> bool;
+
   protected:
     auto Init(int sock) -> bool override;
 
   private:
+    /**
+     * @brief 处理SSL调用的返回值，需要读写时等待socket就绪
+     * @param[in] ret SSL调用的返回值
+     * @param[in] timeout 等待的超时时间(ms)，-1表示不超时
+     * @return 等到了就绪、应该重试时返回true
+     */
+    auto WaitForRetry(int ret, uint64_t timeout) -> bool;
+
+    // 一个TLS记录的最大明文长度
+    static constexpr size_t kMaxRecordSize = 16 * 1024;
+
     std::shared_ptr<SSL_CTX> m_ctx;  // SSL上下文
     std::shared_ptr<SSL> m_ssl;      // SSL
+    std::unique_ptr<char[]> m_record_buffer{};  // 拼接记录的缓冲区，第一次使用时分配
 };
 }  // namespace wtsclwq
\ No newline at end of file
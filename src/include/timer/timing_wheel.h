@@ -0,0 +1,104 @@
+//
+// 粗粒度时间轮
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "timer.h"
+
+namespace wtsclwq {
+/**
+ * @brief 粗粒度时间轮，适合大量超时时间相近、很少真正到期的任务(比如空闲连接检测)。
+ * 整个时间轮只占用TimerManager中的一个周期定时器，加入和取消任务都是O(1)，
+ * 不会产生定时器的创建和删除；到期时间精确到一个tick
+ */
+class TimingWheel : public std::enable_shared_from_this<TimingWheel> {
+  public:
+    TimingWheel(const TimingWheel &) = delete;
+    TimingWheel(TimingWheel &&) = delete;
+    auto operator=(const TimingWheel &) -> TimingWheel & = delete;
+    auto operator=(TimingWheel &&) -> TimingWheel & = delete;
+
+    using ptr = std::shared_ptr<TimingWheel>;
+    using MutexType = std::mutex;
+
+    /**
+     * @brief 到期回调，返回0表示结束，返回正数表示过这么多毫秒后再回调一次
+     */
+    using Callback = std::function<uint64_t()>;
+
+    /**
+     * @brief 时间轮中的一项任务
+     */
+    class Entry {
+        friend class TimingWheel;
+
+      public:
+        using ptr = std::shared_ptr<Entry>;
+
+        explicit Entry(Callback callback) : m_callback(std::move(callback)) {}
+
+        /**
+         * @brief 取消任务，任务在所在的槽到期时被丢弃
+         */
+        void Cancel() { m_is_cancelled = true; }
+
+        auto IsCancelled() const -> bool { return m_is_cancelled; }
+
+      private:
+        Callback m_callback;
+        std::atomic_bool m_is_cancelled{false};
+    };
+
+    /**
+     * @param[in] tick_ms 每个槽的时间跨度
+     * @param[in] slot_count 槽数，超过tick_ms*slot_count的延迟会被截断，
+     * 由回调的返回值继续延后
+     */
+    TimingWheel(uint64_t tick_ms, size_t slot_count);
+
+    ~TimingWheel();
+
+    /**
+     * @brief 在manager上启动推进时间轮的周期定时器
+     */
+    void Start(TimerManager *manager);
+
+    /**
+     * @brief 停止定时器，未到期的任务不再回调
+     */
+    void Stop();
+
+    /**
+     * @brief 加入一个delay_ms之后到期的任务
+     */
+    auto Add(uint64_t delay_ms, Callback callback) -> Entry::ptr;
+
+    /**
+     * @brief 时间轮中的任务数(包括已取消但还没到期的)
+     */
+    auto GetSize() -> size_t;
+
+  private:
+    /**
+     * @brief 推进一格，执行到期槽中的任务
+     */
+    void Tick();
+
+    void AddEntry(uint64_t delay_ms, Entry::ptr entry);
+
+    uint64_t m_tick_ms;
+    std::vector<std::vector<Entry::ptr>> m_slots;  // 各个槽中的任务
+    size_t m_current{0};                           // 当前指向的槽
+    size_t m_size{0};                              // 任务数
+    Timer::ptr m_timer{};                          // 推进时间轮的定时器
+    MutexType m_mutex{};
+};
+}  // namespace wtsclwq
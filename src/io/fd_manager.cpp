@@ -12,7 +12,8 @@
 namespace wtsclwq {
 
 FileDescriptor::FileDescriptor(int filedesc)
-    : m_is_init(false), m_is_socket(false), m_system_non_block(false),
+    : m_is_init(false), m_is_socket(false), m_is_file(false),
+      m_system_non_block(false),
       m_user_non_block(false), m_is_closed(false), m_fd(filedesc),
       m_recv_timeout(UINT64_MAX), m_send_timeout(UINT64_MAX), m_iom(nullptr) {
     Init();
@@ -28,9 +29,12 @@ auto FileDescriptor::Init() -> bool {
     if (fstat(m_fd, &fd_stat) == -1) {
         m_is_init = false;
         m_is_socket = false;
+        m_is_file = false;
     } else {
         m_is_init = true;
         m_is_socket = S_ISSOCK(fd_stat.st_mode);  // NOLINT
+        m_is_file = S_ISREG(fd_stat.st_mode) ||   // NOLINT
+                    S_ISBLK(fd_stat.st_mode);     // NOLINT
     }
     if (m_is_socket) {
         int flags = fcntl_f(m_fd, F_GETFL, 0);
@@ -48,6 +52,7 @@ auto FileDescriptor::Init() -> bool {
 
 [[maybe_unused]] auto FileDescriptor::IsInit() const -> bool { return m_is_init; }
 auto FileDescriptor::IsSocket() const -> bool { return m_is_socket; }
+auto FileDescriptor::IsFile() const -> bool { return m_is_file; }
 auto FileDescriptor::IsClosed() const -> bool { return m_is_closed; }
 
 void FileDescriptor::SetUserNonBlock(bool val) { m_user_non_block = val; }
@@ -73,11 +78,95 @@ auto FileDescriptor::GetTimeout(int type) const -> uint64_t {
     return m_send_timeout;
 }
 
+namespace {
+/**
+ * @brief 每个线程的epoch记录，epoch为0表示不在读者临界区中
+ */
+struct EpochRecord {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> in_use{false};
+    EpochRecord *next{nullptr};
+};
+
+std::atomic<uint64_t> g_global_epoch{1};
+// 所有线程的记录组成的链表，只增不删，线程退出后记录可以被新线程复用
+std::atomic<EpochRecord *> g_epoch_records{nullptr};
+
+struct ThreadEpoch {
+    ThreadEpoch(const ThreadEpoch &) = delete;
+    ThreadEpoch(ThreadEpoch &&) = delete;
+    auto operator=(const ThreadEpoch &) -> ThreadEpoch & = delete;
+    auto operator=(ThreadEpoch &&) -> ThreadEpoch & = delete;
+
+    ThreadEpoch() {
+        for (EpochRecord *rec = g_epoch_records.load(std::memory_order_acquire);
+             rec != nullptr; rec = rec->next) {
+            bool expected = false;
+            if (rec->in_use.compare_exchange_strong(expected, true)) {
+                record = rec;
+                return;
+            }
+        }
+        record = new EpochRecord();
+        record->in_use = true;
+        record->next = g_epoch_records.load(std::memory_order_relaxed);
+        while (!g_epoch_records.compare_exchange_weak(record->next, record)) {
+        }
+    }
+    ~ThreadEpoch() {
+        record->epoch.store(0);
+        record->in_use.store(false);
+    }
+
+    EpochRecord *record{nullptr};
+    int depth{0};  // 支持嵌套的临界区
+};
+
+thread_local ThreadEpoch t_epoch;
+
+/**
+ * @brief 返回所有处于临界区中的线程的最小epoch，没有则返回UINT64_MAX
+ */
+auto MinActiveEpoch() -> uint64_t {
+    uint64_t min_epoch = UINT64_MAX;
+    for (EpochRecord *rec = g_epoch_records.load(std::memory_order_acquire);
+         rec != nullptr; rec = rec->next) {
+        uint64_t epoch = rec->epoch.load();
+        if (epoch != 0 && epoch < min_epoch) {
+            min_epoch = epoch;
+        }
+    }
+    return min_epoch;
+}
+}  // namespace
+
+FdEpochGuard::FdEpochGuard() {
+    ThreadEpoch &local = t_epoch;
+    if (local.depth++ == 0) {
+        local.record->epoch.store(g_global_epoch.load());
+        // 保证之后读取槽位不会被重排到发布epoch之前
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+FdEpochGuard::~FdEpochGuard() {
+    ThreadEpoch &local = t_epoch;
+    if (--local.depth == 0) {
+        local.record->epoch.store(0, std::memory_order_release);
+    }
+}
+
 FileDescriptorManagerImpl::FileDescriptorManagerImpl() {
     const int manager_size = 64;
     m_data.resize(manager_size);
 }
 
+FileDescriptorManagerImpl::~FileDescriptorManagerImpl() {
+    for (auto &chunk : m_chunks) {
+        delete[] chunk.load();
+    }
+}
+
 auto FileDescriptorManagerImpl::Get(int filedesc, bool auto_create)
     -> FileDescriptor::ptr {
     if (filedesc == -1) {
@@ -95,24 +184,98 @@ auto FileDescriptorManagerImpl::Get(int filedesc, bool auto_create)
             }
         }
     }
+    size_t chunk_index = filedesc / CHUNK_SIZE;
+    if (chunk_index >= CHUNK_COUNT) {
+        return nullptr;
+    }
     ScopedWriteLock lock(m_lock);
-    FileDescriptor::ptr fdp(new FileDescriptor(filedesc));
     if (filedesc >= static_cast<int>(m_data.size())) {
         m_data.resize(filedesc * 1.5);  // NOLINT
     }
+    // 可能有其他线程在加写锁之前已经创建了
+    if (m_data[filedesc]) {
+        return m_data[filedesc];
+    }
+    FileDescriptor::ptr fdp(new FileDescriptor(filedesc));
     m_data[filedesc] = fdp;
+    // 分段一旦创建就不会移动，无锁的读者不会看到被释放的内存
+    Chunk *chunk = m_chunks[chunk_index].load(std::memory_order_relaxed);
+    if (chunk == nullptr) {
+        chunk = new Chunk[1];
+        for (auto &slot : *chunk) {
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+        m_chunks[chunk_index].store(chunk, std::memory_order_release);
+    }
+    (*chunk)[filedesc % CHUNK_SIZE].store(fdp.get(), std::memory_order_release);
     return fdp;
 }
 
+auto FileDescriptorManagerImpl::GetRaw(int filedesc) const
+    -> FileDescriptor * {
+    if (filedesc < 0) {
+        return nullptr;
+    }
+    size_t chunk_index = filedesc / CHUNK_SIZE;
+    if (chunk_index >= CHUNK_COUNT) {
+        return nullptr;
+    }
+    Chunk *chunk = m_chunks[chunk_index].load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        return nullptr;
+    }
+    return (*chunk)[filedesc % CHUNK_SIZE].load(std::memory_order_acquire);
+}
+
+auto FileDescriptorManagerImpl::Reset(int filedesc) -> FileDescriptor::ptr {
+    bool is_stale = false;
+    {
+        FdEpochGuard guard;
+        is_stale = GetRaw(filedesc) != nullptr;
+    }
+    if (is_stale) {
+        Remove(filedesc);
+    }
+    return Get(filedesc, true);
+}
+
 /**
  * @brief 将一个文件描述符从管理类中删除
  */
 void FileDescriptorManagerImpl::Remove(int filedesc) {
-    ScopedWriteLock lock(m_lock);
-    if (static_cast<int>(m_data.size()) <= filedesc) {
-        return;
+    FileDescriptor::ptr removed;
+    {
+        ScopedWriteLock lock(m_lock);
+        if (filedesc < 0 || static_cast<int>(m_data.size()) <= filedesc) {
+            return;
+        }
+        removed.swap(m_data[filedesc]);
+        if (removed == nullptr) {
+            return;
+        }
+        Chunk *chunk = m_chunks[filedesc / CHUNK_SIZE].load();
+        (*chunk)[filedesc % CHUNK_SIZE].store(nullptr);
+    }
+    // 槽位清空之后才推进epoch，之后进入临界区的读者不可能再拿到该指针
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t epoch = g_global_epoch.fetch_add(1);
+    ScopedLock<std::mutex> lock(m_retire_mutex);
+    m_retired.push_back({std::move(removed), epoch});
+    Reclaim();
+}
+
+void FileDescriptorManagerImpl::Reclaim() {
+    uint64_t min_epoch = MinActiveEpoch();
+    auto iter = m_retired.begin();
+    while (iter != m_retired.end()) {
+        // 删除时仍在临界区中的读者都已离开，可以释放管理类持有的引用
+        if (iter->epoch < min_epoch) {
+            *iter = std::move(m_retired.back());
+            m_retired.pop_back();
+        } else {
+            ++iter;
+        }
     }
-    m_data[filedesc].reset();
 }
 
 }  // namespace wtsclwq
\ No newline at end of file
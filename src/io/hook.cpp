@@ -6,11 +6,16 @@
 #include <dlfcn.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstdarg>
+#include <utility>
+#include <vector>
 
 #include "../include/config/config.h"
 #include "../include/io/fd_manager.h"
+#include "../include/io/offload_pool.h"
 #include "../include/log/log_manager.h"
 #include "../include/util/macro.h"
 #include "../include/util/time_util.h"
@@ -45,7 +50,25 @@ static wtsclwq::ConfigVar<int>::ptr g_tcp_connect_timeout =
     DO(readv)                      \
     DO(writev)                     \
     DO(fcntl)                      \
-    DO(ioctl)
+    DO(ioctl)                      \
+    DO(accept4)                    \
+    DO(recvmmsg)                   \
+    DO(sendmmsg)                   \
+    DO(sendfile)                   \
+    DO(splice)                     \
+    DO(preadv2)                    \
+    DO(pwritev2)                   \
+    DO(open)                       \
+    DO(openat)                     \
+    DO(pread)                      \
+    DO(pwrite)                     \
+    DO(preadv)                     \
+    DO(pwritev)                    \
+    DO(fsync)                      \
+    DO(fdatasync)                  \
+    DO(poll)                       \
+    DO(select)                     \
+    DO(epoll_wait)
 
 void HookInit() {
     static bool is_inited = false;
@@ -76,15 +99,40 @@ struct HookIniter {
 };
 [[maybe_unused]] static HookIniter s_hook_initer;
 
+// 避免每次hook调用都经过单例的静态局部变量检查和shared_ptr拷贝
+static FileDescriptorManagerImpl *s_fd_manager =
+    FileDescriptorManager::GetInstancePtr().get();
+
 auto IsHookEnabled() -> bool { return t_hook_enabled; }
 
 void SetHookEnable(bool flag) { t_hook_enabled = flag; }
 
 }  // namespace wtsclwq
 
-struct TimerInfo {
-    int cancelled = 0;
-};
+/**
+ * @brief 把阻塞的文件io交给卸载线程池执行，挂起当前协程直到完成。
+ * 未启用卸载或者当前处于调度协程(没有可挂起的任务协程)时直接执行
+ */
+template <typename Func>
+static auto OffloadIO(Func &&func) -> ssize_t {
+    auto *pool = wtsclwq::OffloadPool::GetInstance();
+    if (pool == nullptr ||
+        wtsclwq::Scheduler::GetThisThreadScheduler() == nullptr ||
+        wtsclwq::Fiber::GetCurFiber().get() ==
+            wtsclwq::Scheduler::GetScheduleFiber()) {
+        return func();
+    }
+    return pool->Execute(func);
+}
+
+/**
+ * @brief fd是否已经被hook的close()注销，注销时等待它的协程不能再重新等待
+ */
+static auto IsFdRemoved(int fd) -> bool {
+    wtsclwq::FdEpochGuard guard;
+    wtsclwq::FileDescriptor *fdp = wtsclwq::s_fd_manager->GetRaw(fd);
+    return fdp == nullptr || fdp->IsClosed();
+}
 
 template <typename OriginFunc, typename... Args>
 static auto DoIO(int fd, OriginFunc func, const char *hook_func_name,  // NOLINT
@@ -94,25 +142,36 @@ static auto DoIO(int fd, OriginFunc func, const char *hook_func_name,  // NOLINT
         return func(fd, std::forward<Args>(args)...);
     }
 
-    wtsclwq::FileDescriptor::ptr fdp =
-        wtsclwq::FileDescriptorManager::GetInstancePtr()->Get(fd);
-    if (fdp == nullptr) {
-        return func(fd, std::forward<Args>(args)...);
-    }
-    if (fdp->IsClosed()) {
-        errno = EBADF;
-        return -1;
+    uint64_t timeout = 0;
+    bool is_file = false;
+    bool pass_through = false;
+    {
+        // 无锁、无引用计数地读取fd的状态，临界区内不能让出协程，也不能做可能阻塞的系统调用：
+        // 阻塞期间本线程的epoch一直有效，所有被Remove()的FileDescriptor都无法回收
+        wtsclwq::FdEpochGuard guard;
+        wtsclwq::FileDescriptor *fdp = wtsclwq::s_fd_manager->GetRaw(fd);
+        if (fdp == nullptr) {
+            pass_through = true;
+        } else if (fdp->IsClosed()) {
+            errno = EBADF;
+            return -1;
+        } else {
+            // 普通文件无法用epoll等待，在临界区外交给卸载线程池
+            is_file = fdp->IsFile();
+            // 其余只hook socket上的io,并且如果用户自己设置了非阻塞，可能是有自己的用途
+            pass_through =
+                !is_file && (!fdp->IsSocket() || fdp->GetUserNonBlock());
+            timeout = fdp->GetTimeout(fd_timeout_type);
+        }
     }
-    // 只hook socket上的io,并且如果用户自己设置了非阻塞，可能是有自己的用途
-    if (!fdp->IsSocket() || fdp->GetUserNonBlock()) {
+    if (pass_through) {
         return func(fd, std::forward<Args>(args)...);
     }
-
-    uint64_t timeout = fdp->GetTimeout(fd_timeout_type);
-    // 条件的智能指针,智能指针被释放说明条件取消了
-    auto timer_info = std::make_shared<TimerInfo>();
+    if (is_file) {
+        return OffloadIO([&] { return func(fd, args...); });
+    }
 RETRY:
-    int flag = func(fd, std::forward<Args>(args)...);
+    ssize_t flag = func(fd, std::forward<Args>(args)...);
     // 出现错误 EINTR，是因为系统 API 在阻塞等待状态下被其他的系统信号中断执行
     // 此处的解决办法就是重新调用这次系统 API
     while (flag == -1 && errno == EINTR) {
@@ -121,54 +180,47 @@ RETRY:
     // 出现错误 EAGAIN，是因为长时间未读到数据或者无法写入数据，
     // 说明在阻塞状态,直接把这个fd 丢到 IOManager 里监听对应事件,
     // 等到事件触发后再返回当前协程上下文继续尝试
-    if (flag == -1 && errno == EAGAIN) {
+    // 开启TCP_FASTOPEN_CONNECT且没有cookie时，第一次写只发出SYN并返回EINPROGRESS，
+    // 同样等连接建立、可写之后重试
+    if (flag == -1 &&
+        (errno == EAGAIN ||
+         (errno == EINPROGRESS && event == wtsclwq::EventType::WRITE))) {
         auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
-        wtsclwq::Timer::ptr timer;
-        std::weak_ptr<TimerInfo> timer_info_wp(timer_info);
-        // 如果设置了超时时间，在指定时间后取消掉该 fd 的事件监听
+        // 超时后由IOManager写入ETIMEDOUT,协程挂起期间这个栈上变量一直有效
+        int timeout_result = 0;
+        int ret;
+        // 如果设置了超时时间，由IOManager在事件循环中检查超时并取消该 fd 的事件监听
+        // 如果事件触发就回到这里,因为没有设置回调,事件的回调默认是回到添加事件的协程
         if (timeout != static_cast<uint64_t>(-1)) {
-            // 添加一个定时器,定时器的触发时间是该FileDescriptor的对应的event的超时时间
-            //  如果这个定时器触发了,说明这次在该fd上执行的hook函数超时了
-            timer = iom->AddConditionTimer(
-                timeout,
-                [timer_info_wp, fd, iom, event]() {
-                    // 这个函数会被封装到OnTimer中,进而被调度器执行,
-                    // 执行一次后,条件就会被设置为超时,然后取消并且[触发]对fd上event的监听,
-                    //  确保后续的事件监听能够正确的被添加
-                    // 当循环到第二次添加这个timer的时候,就不会执行if后面的语句了
-                    auto time_condition = timer_info_wp.lock();
-                    if (!time_condition || time_condition->cancelled != 0) {
-                        return;
-                    }
-                    // 当定时器任务执行到这里时，说明io已经超时了，将条件变量设置为ETIMEDOUT
-                    time_condition->cancelled = ETIMEDOUT;
-                    iom->CancelEvent(fd,
-                                     static_cast<wtsclwq::EventType>(event));
-                },
-                timer_info_wp);
-        }
-        //
-        // 如果事件触发就回到这里,因为第三个参数不设置的话,事件的回调默认是回到添加事件的协程
-        int ret = iom->AddEvent(fd, static_cast<wtsclwq::EventType>(event));
+            ret = iom->AddTimedEvent(fd, static_cast<wtsclwq::EventType>(event),
+                                     timeout, &timeout_result);
+        } else {
+            ret = iom->AddEvent(fd, static_cast<wtsclwq::EventType>(event));
+        }
         if (ret == -1) {
             LOG_CUSTOM_ERROR(wtsclwq::sys_logger, "%s addEventListener(%d, %u)",
                              hook_func_name, fd, event);
-            if (timer) {
-                timer->Cancel();
-            }
             return -1;
         }
-        // 添加定时器和事件监听后，让出CPU还给调度协程，等待回到此处
+        // close()先注销fd再取消事件：注销之后才添加的事件close()可能看不到，
+        // 由这里自己删除；删除失败说明事件已经被取消，协程已在调度队列中
+        if (IsFdRemoved(fd) &&
+            iom->DelEvent(fd, static_cast<wtsclwq::EventType>(event))) {
+            errno = EBADF;
+            return -1;
+        }
+        // 添加事件监听后，让出CPU还给调度协程，等待回到此处
         wtsclwq::Fiber::GetCurFiber()->Yield();
-        // 有两种情况可以回到这里:
+        // 有三种情况可以回到这里:
         // 1.iomanager.OnIdle()中监听到事件, 正常完成回调==>正常
-        // 2.定时器任务执行完,在定时器中执行事件的Cancel,然后强制事件回调==>超时==>报错
-        if (timer) {
-            timer->Cancel();
+        // 2.iomanager.OnIdle()中发现等待超时,取消事件并强制事件回调==>超时==>报错
+        if (timeout_result != 0) {
+            errno = timeout_result;
+            return -1;
         }
-        // 上述情况2
-        if (timer_info->cancelled != 0) {
-            errno = timer_info->cancelled;
+        // 3.close()取消了事件，fd即将关闭，重试可能在关闭前再次等待
+        if (IsFdRemoved(fd)) {
+            errno = EBADF;
             return -1;
         }
         goto RETRY;
@@ -176,6 +228,138 @@ RETRY:
     return flag;
 }
 
+// 无法交给epoll等待时，非阻塞poll的重试间隔(ms)，从最小值开始逐次翻倍
+static constexpr uint64_t kPollRetryMinMs = 1;
+static constexpr uint64_t kPollRetryMaxMs = 16;
+
+/**
+ * @brief 当前协程挂起ms毫秒，由定时器恢复，不阻塞线程
+ */
+static void YieldFor(wtsclwq::IOManager *iom, uint64_t ms) {
+    wtsclwq::Fiber::ptr fiber = wtsclwq::Fiber::GetCurFiber();
+    iom->AddTimer(ms, [iom, fiber]() { iom->Schedule(fiber); });
+    wtsclwq::Fiber::GetCurFiber()->Yield();
+}
+
+/**
+ * @brief PollWait()无法用epoll等待时的退路：没有有效fd时只等定时器，
+ * 否则按逐次加长的间隔挂起协程，醒来后做一次非阻塞的poll
+ * @param deadline 截止时间(ms)，UINT64_MAX表示一直等待
+ */
+static auto PollRetry(wtsclwq::IOManager *iom, struct pollfd *fds,
+                      nfds_t nfds, uint64_t deadline) -> int {
+    bool has_fd = std::any_of(fds, fds + nfds,
+                              [](const pollfd &pfd) { return pfd.fd >= 0; });
+    uint64_t interval = kPollRetryMinMs;
+    while (true) {
+        uint64_t now = wtsclwq::GetCurrentMS();
+        if (now >= deadline) {
+            return 0;
+        }
+        uint64_t remaining = deadline - now;
+        if (!has_fd) {
+            // 没有fd可以就绪，一直等待时定时器分段挂起，永远不会返回
+            YieldFor(iom, std::min<uint64_t>(remaining, UINT32_MAX));
+            continue;
+        }
+        YieldFor(iom, std::min(interval, remaining));
+        interval = std::min(interval * 2, kPollRetryMaxMs);
+        int ret = poll_f(fds, nfds, 0);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+}
+
+/**
+ * @brief 在IOManager上等待pollfd数组中任意一个fd就绪，或者超时。
+ * 为每个fd注册带回调的读/写事件和一个超时定时器，第一个触发者恢复协程，
+ * 恢复后注销剩余的事件，再用非阻塞的poll取得准确的就绪结果。
+ * 没有有效fd时只等待定时器(select当作sleep用)；有fd不能交给epoll等待时
+ * (普通文件，或者其他协程已经在等待它的同一事件)，由定时器驱动重复非阻塞的poll。
+ * 两种情况都不阻塞线程上的其他协程
+ * @param timeout_ms 超时时长(ms)，负数表示一直等待
+ * @return 同poll
+ */
+static auto PollWait(struct pollfd *fds, nfds_t nfds, int timeout_ms) -> int {
+    int ret = poll_f(fds, nfds, 0);
+    if (ret != 0 || timeout_ms == 0) {
+        return ret;
+    }
+    auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
+    if (iom == nullptr || wtsclwq::Fiber::GetCurFiber().get() ==
+                              wtsclwq::Scheduler::GetScheduleFiber()) {
+        return poll_f(fds, nfds, timeout_ms);
+    }
+    uint64_t deadline = timeout_ms < 0 ? UINT64_MAX
+                                       : wtsclwq::GetCurrentMS() + timeout_ms;
+    // 多个事件和定时器可能先后触发，只有第一个恢复协程
+    struct PollWaiter {
+        wtsclwq::Fiber::ptr fiber{};
+        std::atomic<bool> woken{false};
+    };
+    std::vector<std::pair<int, wtsclwq::EventType>> registered;
+    while (true) {
+        auto waiter = std::make_shared<PollWaiter>();
+        waiter->fiber = wtsclwq::Fiber::GetCurFiber();
+        auto wake = [iom, waiter]() {
+            if (!waiter->woken.exchange(true)) {
+                iom->Schedule(waiter->fiber);
+            }
+        };
+        registered.clear();
+        bool all_added = true;
+        for (nfds_t i = 0; i < nfds && all_added; ++i) {
+            if (fds[i].fd < 0) {
+                continue;
+            }
+            for (auto event : {wtsclwq::EventType::READ, wtsclwq::EventType::WRITE}) {
+                short mask = event == wtsclwq::EventType::READ  // NOLINT
+                                 ? POLLIN | POLLPRI | POLLRDHUP
+                                 : POLLOUT;
+                if ((fds[i].events & mask) == 0) {
+                    continue;
+                }
+                // 同一个fd可能在数组中出现多次
+                std::pair<int, wtsclwq::EventType> key{fds[i].fd, event};
+                if (std::find(registered.begin(), registered.end(), key) !=
+                    registered.end()) {
+                    continue;
+                }
+                if (iom->AddEvent(fds[i].fd, event, wake) != 0) {
+                    all_added = false;
+                    break;
+                }
+                registered.push_back(key);
+            }
+        }
+        uint64_t now = wtsclwq::GetCurrentMS();
+        uint64_t remaining = deadline > now ? deadline - now : 0;
+        if (!all_added || registered.empty()) {
+            for (auto &[fd, event] : registered) {
+                iom->DelEvent(fd, event);
+            }
+            return PollRetry(iom, fds, nfds, deadline);
+        }
+        wtsclwq::Timer::ptr timer{};
+        if (deadline != UINT64_MAX) {
+            timer = iom->AddTimer(remaining, wake);
+        }
+        wtsclwq::Fiber::GetCurFiber()->Yield();
+        if (timer) {
+            timer->Cancel();
+        }
+        for (auto &[fd, event] : registered) {
+            iom->DelEvent(fd, event);
+        }
+        ret = poll_f(fds, nfds, 0);
+        // 事件触发但是已经被其他人消费，继续等待剩余的时间
+        if (ret != 0 || wtsclwq::GetCurrentMS() >= deadline) {
+            return ret;
+        }
+    }
+}
+
 extern "C" {
 #define DEF_FUNC_NAME(name) name##_func name##_f = nullptr;  // NOLINT
 // 定义系统 api 的函数指针的变量
@@ -241,7 +425,7 @@ auto socket(int domain, int type, int protocol) -> int {
     if (filedesc == -1) {
         return filedesc;
     }
-    wtsclwq::FileDescriptorManager::GetInstancePtr()->Get(filedesc, true);
+    wtsclwq::FileDescriptorManager::GetInstancePtr()->Reset(filedesc);
     return filedesc;
 }
 
@@ -279,39 +463,22 @@ auto ConnectWithTimeout(int sockfd, const struct sockaddr *addr,  // NOLINT
      * 事件监听，当连接成功后会触发该事件。
      */
     auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
-    wtsclwq::Timer::ptr timer;
-    auto timer_info = std::make_shared<TimerInfo>();
-    std::weak_ptr<TimerInfo> weak_timer_info(timer_info);
-
+    int timeout_result = 0;
+    int ret;
     if (timeout_ms != static_cast<uint64_t>(-1)) {
-        timer = iom->AddConditionTimer(
-            timeout_ms,
-            [weak_timer_info, sockfd, iom]() {
-                auto time_condition = weak_timer_info.lock();
-                if (!time_condition || (time_condition->cancelled != 0)) {
-                    return;
-                }
-                time_condition->cancelled = ETIMEDOUT;
-                iom->CancelEvent(sockfd, wtsclwq::EventType::WRITE);
-            },
-            weak_timer_info);
+        ret = iom->AddTimedEvent(sockfd, wtsclwq::EventType::WRITE, timeout_ms,
+                                 &timeout_result);
+    } else {
+        ret = iom->AddEvent(sockfd, wtsclwq::EventType::WRITE);
     }
-
-    int ret = iom->AddEvent(sockfd, wtsclwq::EventType::WRITE);
     if (ret == 0) {
         wtsclwq::Fiber::GetCurFiber()->Yield();
-        if (timer) {
-            timer->Cancel();
-        }
-        if (timer_info->cancelled != 0) {
-            errno = timer_info->cancelled;
+        if (timeout_result != 0) {
+            errno = timeout_result;
             return -1;
         }
     }
     if (ret == -1) {
-        if (timer) {
-            timer->Cancel();
-        }
         LOG_CUSTOM_ERROR(wtsclwq::sys_logger,
                          "connectWithTimeout addEventListener(%d, write) error",
                          sockfd);
@@ -338,7 +505,21 @@ auto accept(int fd, struct sockaddr *addr, socklen_t *len) -> int {
     ssize_t flag = DoIO(fd, accept_f, "accept", wtsclwq::EventType::READ,
                         SO_RCVTIMEO, addr, len);
     if (flag >= 0) {
-        wtsclwq::FileDescriptorManager::GetInstancePtr()->Get(flag, true);
+        wtsclwq::FileDescriptorManager::GetInstancePtr()->Reset(flag);
+    }
+    return static_cast<int>(flag);
+}
+
+auto accept4(int fd, struct sockaddr *addr, socklen_t *len, int flags) -> int {
+    ssize_t flag = DoIO(fd, accept4_f, "accept4", wtsclwq::EventType::READ,
+                        SO_RCVTIMEO, addr, len, flags);
+    if (flag >= 0) {
+        auto fdp =
+            wtsclwq::FileDescriptorManager::GetInstancePtr()->Reset(flag);
+        // 用户通过SOCK_NONBLOCK要求非阻塞，则不再由hook代为等待
+        if (fdp && (flags & SOCK_NONBLOCK) != 0) {
+            fdp->SetUserNonBlock(true);
+        }
     }
     return static_cast<int>(flag);
 }
@@ -369,6 +550,19 @@ auto recvmsg(int fd, struct msghdr *message, int flags) -> ssize_t {
                 SO_RCVTIMEO, message, flags);
 }
 
+auto recvmmsg(int fd, struct mmsghdr *vmessages, unsigned int vlen, int flags,
+              struct timespec *tmo) -> int {
+    return static_cast<int>(DoIO(fd, recvmmsg_f, "recvmmsg",
+                                 wtsclwq::EventType::READ, SO_RCVTIMEO,
+                                 vmessages, vlen, flags, tmo));
+}
+
+auto preadv2(int fd, const struct iovec *iovec, int count, off_t offset,
+             int flags) -> ssize_t {
+    return DoIO(fd, preadv2_f, "preadv2", wtsclwq::EventType::READ,
+                SO_RCVTIMEO, iovec, count, offset, flags);
+}
+
 auto write(int fd, const void *buf, size_t n) -> ssize_t {
     return DoIO(fd, write_f, "write", wtsclwq::EventType::WRITE, SO_SNDTIMEO,
                 buf, n);
@@ -395,6 +589,301 @@ auto sendmsg(int fd, const struct msghdr *message, int flags) -> ssize_t {
                 SO_SNDTIMEO, message, flags);
 }
 
+auto sendmmsg(int fd, struct mmsghdr *vmessages, unsigned int vlen, int flags)
+    -> int {
+    return static_cast<int>(DoIO(fd, sendmmsg_f, "sendmmsg",
+                                 wtsclwq::EventType::WRITE, SO_SNDTIMEO,
+                                 vmessages, vlen, flags));
+}
+
+auto pwritev2(int fd, const struct iovec *iovec, int count, off_t offset,
+              int flags) -> ssize_t {
+    return DoIO(fd, pwritev2_f, "pwritev2", wtsclwq::EventType::WRITE,
+                SO_SNDTIMEO, iovec, count, offset, flags);
+}
+
+/**
+ * @brief hook 处理后的 sendfile，out_fd 为socket时在其不可写时让出协程
+ */
+auto sendfile(int out_fd, int in_fd, off_t *offset, size_t count) -> ssize_t {
+    return DoIO(out_fd, sendfile_f, "sendfile", wtsclwq::EventType::WRITE,
+                SO_SNDTIMEO, in_fd, offset, count);
+}
+
+/**
+ * @brief hook 处理后的 splice。两端必有一端是管道，另一端是被hook的阻塞socket时，
+ * 加上SPLICE_F_NONBLOCK执行，这样满的或空的管道也不会阻塞线程；
+ * EAGAIN可能来自任意一端，所以只等待没有就绪的那一端，超时按socket一端的设置
+ */
+auto splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out,
+            size_t len, unsigned int flags) -> ssize_t {
+    if (!wtsclwq::IsHookEnabled() || (flags & SPLICE_F_NONBLOCK) != 0) {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    bool hooked = false;
+    uint64_t timeout = 0;
+    {
+        wtsclwq::FdEpochGuard guard;
+        for (int fd : {fd_in, fd_out}) {
+            wtsclwq::FileDescriptor *fdp = wtsclwq::s_fd_manager->GetRaw(fd);
+            if (fdp != nullptr && !fdp->IsClosed() && fdp->IsSocket() &&
+                !fdp->GetUserNonBlock()) {
+                hooked = true;
+                timeout =
+                    fdp->GetTimeout(fd == fd_in ? SO_RCVTIMEO : SO_SNDTIMEO);
+                break;
+            }
+        }
+    }
+    if (!hooked) {
+        return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+    }
+    uint64_t deadline = timeout == static_cast<uint64_t>(-1)
+                            ? UINT64_MAX
+                            : wtsclwq::GetCurrentMS() + timeout;
+    // 数据从fd_in流向fd_out：等待fd_in可读、fd_out可写
+    pollfd ends[2] = {{fd_in, POLLIN, 0}, {fd_out, POLLOUT, 0}};
+    while (true) {
+        ssize_t ret = splice_f(fd_in, off_in, fd_out, off_out, len,
+                               flags | SPLICE_F_NONBLOCK);
+        if (ret >= 0 || (errno != EAGAIN && errno != EINTR)) {
+            return ret;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        ends[0].revents = 0;
+        ends[1].revents = 0;
+        poll_f(ends, 2, 0);
+        pollfd waits[2];
+        nfds_t count = 0;
+        for (auto &end : ends) {
+            if (end.revents == 0) {
+                waits[count++] = {end.fd, end.events, 0};
+            }
+        }
+        // 两端都已就绪，是检查之间状态变了，直接重试
+        if (count == 0) {
+            continue;
+        }
+        uint64_t now = wtsclwq::GetCurrentMS();
+        if (now >= deadline) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        int wait_ms = deadline == UINT64_MAX
+                          ? -1
+                          : static_cast<int>(std::min<uint64_t>(
+                                deadline - now, INT32_MAX));
+        int ready = PollWait(waits, count, wait_ms);
+        if (ready < 0) {
+            return -1;
+        }
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+}
+
+auto pread(int fd, void *buf, size_t nbytes, off_t offset) -> ssize_t {
+    return DoIO(fd, pread_f, "pread", wtsclwq::EventType::READ, SO_RCVTIMEO,
+                buf, nbytes, offset);
+}
+
+auto pwrite(int fd, const void *buf, size_t n, off_t offset) -> ssize_t {
+    return DoIO(fd, pwrite_f, "pwrite", wtsclwq::EventType::WRITE, SO_SNDTIMEO,
+                buf, n, offset);
+}
+
+auto preadv(int fd, const struct iovec *iovec, int count, off_t offset)
+    -> ssize_t {
+    return DoIO(fd, preadv_f, "preadv", wtsclwq::EventType::READ, SO_RCVTIMEO,
+                iovec, count, offset);
+}
+
+auto pwritev(int fd, const struct iovec *iovec, int count, off_t offset)
+    -> ssize_t {
+    return DoIO(fd, pwritev_f, "pwritev", wtsclwq::EventType::WRITE,
+                SO_SNDTIMEO, iovec, count, offset);
+}
+
+auto fsync(int fd) -> int {
+    return static_cast<int>(DoIO(fd, fsync_f, "fsync",
+                                 wtsclwq::EventType::WRITE, SO_SNDTIMEO));
+}
+
+auto fdatasync(int fd) -> int {
+    return static_cast<int>(DoIO(fd, fdatasync_f, "fdatasync",
+                                 wtsclwq::EventType::WRITE, SO_SNDTIMEO));
+}
+
+/**
+ * @brief 文件打开时需要用mode参数的flag组合
+ */
+static auto OpenNeedsMode(int oflag) -> bool {
+    return (oflag & O_CREAT) != 0 || (oflag & O_TMPFILE) == O_TMPFILE;
+}
+
+/**
+ * @brief hook 处理后的 open，协程中打开的普通文件会被登记，
+ * 之后在它上面的阻塞io交给卸载线程池执行
+ */
+auto open(const char *file, int oflag, ...) -> int {
+    mode_t mode = 0;
+    if (OpenNeedsMode(oflag)) {
+        va_list va;
+        va_start(va, oflag);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+    int filedesc = open_f(file, oflag, mode);
+    if (filedesc >= 0 && wtsclwq::IsHookEnabled()) {
+        wtsclwq::FileDescriptorManager::GetInstancePtr()->Reset(filedesc);
+    }
+    return filedesc;
+}
+
+auto openat(int dirfd, const char *file, int oflag, ...) -> int {
+    mode_t mode = 0;
+    if (OpenNeedsMode(oflag)) {
+        va_list va;
+        va_start(va, oflag);
+        mode = va_arg(va, mode_t);
+        va_end(va);
+    }
+    int filedesc = openat_f(dirfd, file, oflag, mode);
+    if (filedesc >= 0 && wtsclwq::IsHookEnabled()) {
+        wtsclwq::FileDescriptorManager::GetInstancePtr()->Reset(filedesc);
+    }
+    return filedesc;
+}
+
+//////// poll.h
+auto poll(struct pollfd *fds, nfds_t nfds, int timeout) -> int {
+    if (!wtsclwq::IsHookEnabled()) {
+        return poll_f(fds, nfds, timeout);
+    }
+    return PollWait(fds, nfds, timeout);
+}
+
+//////// sys/select.h
+/**
+ * @brief hook 处理后的 select，转换成pollfd数组后按poll等待，再写回fd_set
+ */
+auto select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+            struct timeval *timeout) -> int {
+    if (!wtsclwq::IsHookEnabled()) {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
+    std::vector<struct pollfd> poll_fds;
+    for (int fd = 0; fd < nfds; ++fd) {
+        short events = 0;  // NOLINT
+        if (readfds != nullptr && FD_ISSET(fd, readfds)) {
+            events |= POLLIN;
+        }
+        if (writefds != nullptr && FD_ISSET(fd, writefds)) {
+            events |= POLLOUT;
+        }
+        if (exceptfds != nullptr && FD_ISSET(fd, exceptfds)) {
+            events |= POLLPRI;
+        }
+        if (events != 0) {
+            poll_fds.push_back({fd, events, 0});
+        }
+    }
+    int timeout_ms = -1;
+    uint64_t begin = wtsclwq::GetCurrentMS();
+    if (timeout != nullptr) {
+        // 向上取整，避免不足1ms的超时变成不等待
+        timeout_ms = static_cast<int>(timeout->tv_sec * BASE_NUMBER_OF_SECONDS +
+                                      (timeout->tv_usec + 999) / 1000);
+    }
+    int ret = PollWait(poll_fds.data(), poll_fds.size(), timeout_ms);
+    if (ret < 0) {
+        return ret;
+    }
+    for (auto &pfd : poll_fds) {
+        if ((pfd.revents & POLLNVAL) != 0) {
+            errno = EBADF;
+            return -1;
+        }
+    }
+    if (readfds != nullptr) {
+        FD_ZERO(readfds);
+    }
+    if (writefds != nullptr) {
+        FD_ZERO(writefds);
+    }
+    if (exceptfds != nullptr) {
+        FD_ZERO(exceptfds);
+    }
+    int count = 0;
+    for (auto &pfd : poll_fds) {
+        if ((pfd.events & POLLIN) != 0 &&
+            (pfd.revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+            FD_SET(pfd.fd, readfds);
+            ++count;
+        }
+        if ((pfd.events & POLLOUT) != 0 &&
+            (pfd.revents & (POLLOUT | POLLERR)) != 0) {
+            FD_SET(pfd.fd, writefds);
+            ++count;
+        }
+        if ((pfd.events & POLLPRI) != 0 && (pfd.revents & POLLPRI) != 0) {
+            FD_SET(pfd.fd, exceptfds);
+            ++count;
+        }
+    }
+    // 与Linux的select一致，把剩余的等待时间写回timeout
+    if (timeout != nullptr && timeout_ms > 0) {
+        uint64_t cost = wtsclwq::GetCurrentMS() - begin;
+        uint64_t left = cost >= static_cast<uint64_t>(timeout_ms)
+                            ? 0
+                            : static_cast<uint64_t>(timeout_ms) - cost;
+        timeout->tv_sec = static_cast<time_t>(left / BASE_NUMBER_OF_SECONDS);
+        timeout->tv_usec =
+            static_cast<suseconds_t>(left % BASE_NUMBER_OF_SECONDS * 1000);
+    }
+    return count;
+}
+
+//////// sys/epoll.h
+/**
+ * @brief hook 处理后的 epoll_wait，epoll fd 本身可被 epoll 监听，
+ * 在它可读时再非阻塞地取出就绪事件
+ */
+auto epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+                int timeout) -> int {
+    if (!wtsclwq::IsHookEnabled()) {
+        return epoll_wait_f(epfd, events, maxevents, timeout);
+    }
+    int ret = epoll_wait_f(epfd, events, maxevents, 0);
+    if (ret != 0 || timeout == 0) {
+        return ret;
+    }
+    uint64_t deadline =
+        timeout < 0 ? UINT64_MAX : wtsclwq::GetCurrentMS() + timeout;
+    while (true) {
+        uint64_t now = wtsclwq::GetCurrentMS();
+        int wait_ms = deadline == UINT64_MAX
+                          ? -1
+                          : static_cast<int>(deadline > now ? deadline - now : 0);
+        struct pollfd pfd {
+            epfd, POLLIN, 0
+        };
+        ret = PollWait(&pfd, 1, wait_ms);
+        if (ret <= 0) {
+            return ret;
+        }
+        // 就绪事件可能已经被其他等待者取走，继续等待剩余的时间
+        ret = epoll_wait_f(epfd, events, maxevents, 0);
+        if (ret != 0 || wait_ms == 0) {
+            return ret;
+        }
+    }
+}
+
 auto close(int fd) -> int {
     if (!wtsclwq::IsHookEnabled()) {
         return close_f(fd);
@@ -402,11 +891,12 @@ auto close(int fd) -> int {
     wtsclwq::FileDescriptor::ptr fdp =
         wtsclwq::FileDescriptorManager::GetInstancePtr()->Get(fd);
     if (fdp) {
+        // 先注销再取消事件，被唤醒的协程据此放弃重试，不会在关闭前重新等待
+        wtsclwq::FileDescriptorManager::GetInstancePtr()->Remove(fd);
         auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
         if (iom != nullptr) {
             iom->CancelAll(fd);
         }
-        wtsclwq::FileDescriptorManager::GetInstancePtr()->Remove(fd);
     }
     return close_f(fd);
 }
@@ -499,7 +989,7 @@ auto ioctl(int fd, unsigned long request, ...) -> int {  // NOLINT
         }
         fdp->SetUserNonBlock(user_nonblock);
     }
-    return ioctl(fd, request, arg);
+    return ioctl_f(fd, request, arg);
 }
 
 auto getsockopt(int fd, int level, int optname, void *optval, socklen_t *optlen)
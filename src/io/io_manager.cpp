@@ -17,8 +17,10 @@
 #include <memory>
 #include <vector>
 
+#include "../include/io/hook.h"
 #include "../include/log/log_manager.h"
 #include "../include/util/macro.h"
+#include "../include/util/time_util.h"
 
 namespace wtsclwq {
 static Logger::ptr sys_logger{GET_LOGGER_BY_NAME("system")};
@@ -39,6 +41,7 @@ void IOManager::FdContext::ResetEventHandler(EventHandler& handler) {
     handler.scheduler = nullptr;
     handler.callback = nullptr;
     handler.fiber.reset();
+    handler.timeout_result = nullptr;
 }
 
 void IOManager::FdContext::TriggerEvent(EventType event) {
@@ -74,6 +77,7 @@ IOManager::IOManager(size_t thread_num, bool use_caller, std::string name)
 
     const size_t context_vec_size = 64;
     ContextVecResize(context_vec_size);
+    m_deadline_heap.reserve(context_vec_size);
 
     this->Start();
 }
@@ -86,6 +90,20 @@ IOManager::~IOManager() {
 
 auto IOManager::AddEvent(int filedsc, EventType new_event,
                          std::function<void()> callback) -> int {
+    return AddEventImpl(filedsc, new_event, std::move(callback), UINT64_MAX,
+                        nullptr);
+}
+
+auto IOManager::AddTimedEvent(int filedsc, EventType new_event,
+                              uint64_t timeout_ms, int* timeout_result)
+    -> int {
+    return AddEventImpl(filedsc, new_event, nullptr, timeout_ms,
+                        timeout_result);
+}
+
+auto IOManager::AddEventImpl(int filedsc, EventType new_event,
+                             std::function<void()> callback,
+                             uint64_t timeout_ms, int* timeout_result) -> int {
     m_rwlock.ReadLock();
     FdContext::ptr fd_ctx{};
     if (filedsc < m_fd_contexts_vec.size()) {
@@ -141,6 +159,27 @@ auto IOManager::AddEvent(int filedsc, EventType new_event,
         WTSCLWQ_ASSERT(event_handler.fiber->GetState() == Fiber::EXEC,
                        "event_cxt.fiber is not running");
     }
+    // 每次等待都换一个序号，使出堆后尚未处理的旧超时项无法匹配新的(包括不限时的)等待
+    uint64_t seq = ++event_handler.deadline_seq;
+    if (timeout_ms == UINT64_MAX) {
+        return 0;
+    }
+    // 设置本次等待的超时时限，由OnIdle()检查，无需创建定时器
+    event_handler.timeout_result = timeout_result;
+    bool at_front{false};
+    {
+        ScopedLock<std::mutex> deadline_lock(m_deadline_mutex);
+        DeadlineEntry entry{GetCurrentMS() + timeout_ms, seq, fd_ctx.get(),
+                            new_event};
+        m_deadline_heap.push_back(entry);
+        DeadlineHeapSet(m_deadline_heap.size() - 1, entry);
+        DeadlineHeapSiftUp(m_deadline_heap.size() - 1);
+        at_front = event_handler.deadline_index == 0;
+    }
+    // 新的超时时限排在最前面，epoll_wait的等待时间可能失效
+    if (at_front) {
+        Tickle();
+    }
     return 0;
 }
 
@@ -180,6 +219,7 @@ auto IOManager::AddEvent(int filedsc, EventType new_event,
     fd_ctx->events = new_events;
     // 重置fd_ctx欲删除事件的handler
     FdContext::EventHandler& event_handler = fd_ctx->GetEventHandler(event);
+    DisarmDeadline(event_handler);
     fd_ctx->ResetEventHandler(event_handler);
     return true;
 }
@@ -213,6 +253,7 @@ auto IOManager::CancelEvent(int filedesc, EventType event) -> bool {
         return false;
     }
     // 删除事件监听会触发事件回调
+    DisarmDeadline(fd_ctx->GetEventHandler(event));
     fd_ctx->TriggerEvent(event);
     // 待执行的事件数-1
     --m_pending_event_count;
@@ -248,10 +289,12 @@ auto IOManager::CancelAll(int filedesc) -> bool {
     }
     // 触发读写事件
     if ((fd_ctx->events & READ) != NONE) {
+        DisarmDeadline(fd_ctx->read_handler);
         fd_ctx->TriggerEvent(READ);
         --m_pending_event_count;
     }
     if ((fd_ctx->events & WRITE) != NONE) {
+        DisarmDeadline(fd_ctx->write_handler);
         fd_ctx->TriggerEvent(WRITE);
         --m_pending_event_count;
     }
@@ -302,6 +345,8 @@ void IOManager::OnIdle() {
                 break;
             }
         }
+        // 最近的io超时也需要唤醒epoll_wait
+        next_timeout = std::min(next_timeout, GetNextDeadline());
         int nums;
         while (true) {
             static const uint64_t max_timeout = 5000;
@@ -311,8 +356,9 @@ void IOManager::OnIdle() {
             } else {
                 next_timeout = max_timeout;
             }
-            nums = epoll_wait(m_epfd, event_list_ptr.get(), max_events,
-                              static_cast<int>(next_timeout));
+            // 空闲协程本身不能被hook挂起，直接调用原始的epoll_wait
+            nums = epoll_wait_f(m_epfd, event_list_ptr.get(), max_events,
+                                static_cast<int>(next_timeout));
             if (nums >= 0) {
                 break;
             }
@@ -329,6 +375,8 @@ void IOManager::OnIdle() {
             Schedule(function_vec.begin(), function_vec.end());
             function_vec.clear();
         }
+        // 处理超时的io事件
+        ProcessExpiredDeadlines();
 
         for (int i = 0; i < nums; ++i) {
             epoll_event& ep_event = event_list_ptr[i];
@@ -374,10 +422,12 @@ void IOManager::OnIdle() {
                 continue;
             }
             if ((real_events & READ) != NONE) {
+                DisarmDeadline(fd_ctx->read_handler);
                 fd_ctx->TriggerEvent(READ);
                 --m_pending_event_count;
             }
             if ((real_events & WRITE) != NONE) {
+                DisarmDeadline(fd_ctx->write_handler);
                 fd_ctx->TriggerEvent(WRITE);
                 --m_pending_event_count;
             }
@@ -391,5 +441,126 @@ void IOManager::OnIdle() {
 
 void IOManager::OnTimerInsertedFront() { Tickle(); }
 
+void IOManager::DisarmDeadline(FdContext::EventHandler& handler) {
+    handler.timeout_result = nullptr;
+    ScopedLock<std::mutex> lock(m_deadline_mutex);
+    if (handler.deadline_index != std::numeric_limits<size_t>::max()) {
+        DeadlineHeapRemove(handler.deadline_index);
+    }
+}
+
+auto IOManager::GetNextDeadline() -> uint64_t {
+    ScopedLock<std::mutex> lock(m_deadline_mutex);
+    if (m_deadline_heap.empty()) {
+        return UINT64_MAX;
+    }
+    uint64_t now_ms = GetCurrentMS();
+    uint64_t deadline = m_deadline_heap.front().deadline;
+    return deadline <= now_ms ? 0 : deadline - now_ms;
+}
+
+void IOManager::ProcessExpiredDeadlines() {
+    static const size_t batch_size = 64;
+    DeadlineEntry expired[batch_size];  // NOLINT
+    size_t count = batch_size;
+    while (count == batch_size) {
+        count = 0;
+        {
+            ScopedLock<std::mutex> lock(m_deadline_mutex);
+            uint64_t now_ms = GetCurrentMS();
+            while (count < batch_size && !m_deadline_heap.empty() &&
+                   m_deadline_heap.front().deadline <= now_ms) {
+                expired[count++] = m_deadline_heap.front();
+                DeadlineHeapRemove(0);
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            FdContext* fd_ctx = expired[i].fd_ctx;
+            EventType event = expired[i].event;
+            ScopedLock<FdContext::MutexType> lock(fd_ctx->mutex);
+            FdContext::EventHandler& handler = fd_ctx->GetEventHandler(event);
+            // 出堆之后、加锁之前事件可能已经触发，并且又开始了新的等待
+            if ((fd_ctx->events & event) == NONE ||
+                handler.deadline_seq != expired[i].seq) {
+                continue;
+            }
+            auto left_events = static_cast<EventType>(
+                fd_ctx->events & static_cast<EventType>(~event));
+            int op_type =
+                (left_events != NONE) ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+            epoll_event ep_event{};
+            ep_event.events = EPOLLET | left_events;  // NOLINT
+            ep_event.data.ptr = fd_ctx;
+            if (epoll_ctl(m_epfd, op_type, fd_ctx->filedesc, &ep_event) ==
+                -1) {
+                LOG_CUSTOM_ERROR(
+                    sys_logger,
+                    "epoll_ctl()错误, m_epfd = %d, op_type = %d, filedesc "
+                    "= %d, fd_ctx.events = %d, errno = %d",
+                    m_epfd, op_type, fd_ctx->filedesc, fd_ctx->events, errno);
+            }
+            if (handler.timeout_result != nullptr) {
+                *handler.timeout_result = ETIMEDOUT;
+            }
+            fd_ctx->TriggerEvent(event);
+            --m_pending_event_count;
+        }
+    }
+}
+
+void IOManager::DeadlineHeapSet(size_t index, const DeadlineEntry& entry) {
+    m_deadline_heap[index] = entry;
+    entry.fd_ctx->GetEventHandler(entry.event).deadline_index = index;
+}
+
+void IOManager::DeadlineHeapSiftUp(size_t index) {
+    DeadlineEntry entry = m_deadline_heap[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (m_deadline_heap[parent].deadline <= entry.deadline) {
+            break;
+        }
+        DeadlineHeapSet(index, m_deadline_heap[parent]);
+        index = parent;
+    }
+    DeadlineHeapSet(index, entry);
+}
+
+void IOManager::DeadlineHeapSiftDown(size_t index) {
+    DeadlineEntry entry = m_deadline_heap[index];
+    size_t size = m_deadline_heap.size();
+    while (true) {
+        size_t child = index * 2 + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && m_deadline_heap[child + 1].deadline <
+                                    m_deadline_heap[child].deadline) {
+            ++child;
+        }
+        if (entry.deadline <= m_deadline_heap[child].deadline) {
+            break;
+        }
+        DeadlineHeapSet(index, m_deadline_heap[child]);
+        index = child;
+    }
+    DeadlineHeapSet(index, entry);
+}
+
+void IOManager::DeadlineHeapRemove(size_t index) {
+    const DeadlineEntry& removed = m_deadline_heap[index];
+    removed.fd_ctx->GetEventHandler(removed.event).deadline_index =
+        std::numeric_limits<size_t>::max();
+    size_t last = m_deadline_heap.size() - 1;
+    if (index != last) {
+        DeadlineHeapSet(index, m_deadline_heap[last]);
+    }
+    m_deadline_heap.pop_back();
+    if (index < m_deadline_heap.size()) {
+        DeadlineHeapSiftDown(index);
+        DeadlineHeapSiftUp(index);
+    }
+}
+
 }  // namespace wtsclwq
 #pragma clang diagnostic pop
\ No newline at end of file
@@ -0,0 +1,104 @@
+/*
+ * @Description: 阻塞调用卸载线程池
+ */
+#include "../include/io/offload_pool.h"
+
+#include <cerrno>
+#include <utility>
+
+#include "../include/config/config.h"
+#include "../include/log/log_manager.h"
+#include "../include/util/macro.h"
+#include "../include/util/thread_util.h"
+
+namespace wtsclwq {
+
+static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<int>::ptr g_offload_thread_num = Config::Lookup(
+    "io.offload.thread_num", 4, "hook文件io的卸载线程数,0表示在调度线程上直接执行");
+
+OffloadPool::OffloadPool(size_t thread_num, std::string name) {
+    m_threads.reserve(thread_num);
+    for (size_t i = 0; i < thread_num; ++i) {
+        m_threads.emplace_back(std::make_shared<Thread>(
+            [this] { Run(); }, name + "_" + std::to_string(i)));
+    }
+}
+
+OffloadPool::~OffloadPool() {
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        m_is_stop = true;
+    }
+    m_cond.notify_all();
+    for (auto &thread : m_threads) {
+        thread->Join();
+    }
+}
+
+auto OffloadPool::GetInstance() -> OffloadPool * {
+    // 第一次使用时才创建，此时配置已经加载完毕
+    static OffloadPool::ptr s_pool = []() -> OffloadPool::ptr {
+        int thread_num = g_offload_thread_num->GetValue();
+        if (thread_num <= 0) {
+            return nullptr;
+        }
+        LOG_CUSTOM_INFO(sys_logger, "offload pool start, thread_num = %d",
+                        thread_num);
+        return std::make_shared<OffloadPool>(static_cast<size_t>(thread_num));
+    }();
+    return s_pool.get();
+}
+
+auto OffloadPool::GetThreadNum() const -> size_t { return m_threads.size(); }
+
+auto OffloadPool::Submit(Job &job) -> ssize_t {
+    job.scheduler = Scheduler::GetThisThreadScheduler();
+    WTSCLWQ_ASSERT(job.scheduler != nullptr, "卸载调用必须在调度器中发起");
+    job.fiber = Fiber::GetCurFiber();
+    job.thread_id = GetThreadId();
+    job.scheduler->AddExternalPending();
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        if (m_tail == nullptr) {
+            m_head = &job;
+        } else {
+            m_tail->next = &job;
+        }
+        m_tail = &job;
+    }
+    m_cond.notify_one();
+    // 挂起，由工作线程执行完成后重新加入调度
+    Fiber::GetCurFiber()->Yield();
+    errno = job.error;
+    return job.result;
+}
+
+void OffloadPool::Run() {
+    while (true) {
+        Job *job = nullptr;
+        {
+            std::unique_lock<MutexType> lock(m_mutex);
+            m_cond.wait(lock, [this] { return m_is_stop || m_head != nullptr; });
+            if (m_head == nullptr) {
+                return;
+            }
+            job = m_head;
+            m_head = job->next;
+            if (m_head == nullptr) {
+                m_tail = nullptr;
+            }
+        }
+        job->result = job->invoke(job->arg);
+        job->error = errno;
+        // Schedule之后协程可能立刻恢复，job所在的栈随之失效，先把需要的成员取出
+        Fiber::ptr fiber = std::move(job->fiber);
+        Scheduler *scheduler = job->scheduler;
+        pid_t thread_id = job->thread_id;
+        // 绑定回发起线程恢复：该线程能取到任务时，协程的Yield必然已经完成
+        scheduler->Schedule(std::move(fiber), thread_id);
+        scheduler->RemoveExternalPending();
+    }
+}
+}  // namespace wtsclwq
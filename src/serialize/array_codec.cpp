@@ -0,0 +1,529 @@
+//
+// 数组的批量编解码
+//
+#include "../include/serialize/array_codec.h"
+
+#include <atomic>
+#include <cstring>
+
+#include "../include/serialize/byte_array.h"
+#include "../include/util/net_util.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WTSCLWQ_SIMD_X86
+// 单个函数按指定指令集编译，整个库仍按基础指令集编译，运行时再选择
+#define WTSCLWQ_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace wtsclwq {
+
+auto SimdLevel::ToString(SimdLevel::Level level) -> const char * {
+    switch (level) {
+        case SimdLevel::AVX2:
+            return "avx2";
+        case SimdLevel::SSE4_1:
+            return "sse4.1";
+        default:
+            return "scalar";
+    }
+}
+
+static auto DetectSimdLevel() -> SimdLevel::Level {
+#ifdef WTSCLWQ_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SimdLevel::SSE4_1;
+    }
+#endif
+    return SimdLevel::SCALAR;
+}
+
+static auto GetCpuSimdLevel() -> SimdLevel::Level {
+    static const SimdLevel::Level level = DetectSimdLevel();
+    return level;
+}
+
+static auto GetSimdLevelVar() -> std::atomic<SimdLevel::Level> & {
+    static std::atomic<SimdLevel::Level> level{GetCpuSimdLevel()};
+    return level;
+}
+
+auto GetSimdLevel() -> SimdLevel::Level {
+    return GetSimdLevelVar().load(std::memory_order_relaxed);
+}
+
+void SetSimdLevel(SimdLevel::Level level) {
+    if (level > GetCpuSimdLevel()) {
+        level = GetCpuSimdLevel();
+    }
+    GetSimdLevelVar().store(level, std::memory_order_relaxed);
+}
+
+template <class T>
+static void ByteSwapScalar(uint8_t *dst, const uint8_t *src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        T value;
+        memcpy(&value, src + i * sizeof(T), sizeof(T));
+        value = ByteSwap(value);
+        memcpy(dst + i * sizeof(T), &value, sizeof(T));
+    }
+}
+
+template <class T>
+static auto EncodeScalar(const T *src, size_t count, uint8_t *dst)
+    -> uint8_t * {
+    for (size_t i = 0; i < count; ++i) {
+        dst = EncodeVarint(dst, src[i]);
+    }
+    return dst;
+}
+
+/**
+ * @brief 从[ptr, end)解码一个值
+ * @return 解码后的位置，数据不完整时返回nullptr
+ */
+template <class T, size_t MaxSize>
+static inline auto DecodeOne(const uint8_t *ptr, const uint8_t *end, T &value)
+    -> const uint8_t * {
+    if (static_cast<size_t>(end - ptr) >= MaxSize) {
+        return DecodeVarint<T, MaxSize>(ptr, value);
+    }
+    // 剩余不足MaxSize字节时逐字节确认值的结尾
+    T result = 0;
+    for (size_t i = 0; ptr + i < end; ++i) {
+        T byte = ptr[i];
+        result |= (byte & 0x7F) << (7 * i);
+        if (byte < 128) {
+            value = result;
+            return ptr + i + 1;
+        }
+    }
+    return nullptr;
+}
+
+template <class T, size_t MaxSize>
+static auto DecodeScalar(const uint8_t *src, const uint8_t *end, T *dst,
+                         size_t count, size_t &decoded) -> const uint8_t * {
+    size_t i = 0;
+    for (; i < count; ++i) {
+        const uint8_t *next = DecodeOne<T, MaxSize>(src, end, dst[i]);
+        if (next == nullptr) {
+            break;
+        }
+        src = next;
+    }
+    decoded = i;
+    return src;
+}
+
+#ifdef WTSCLWQ_SIMD_X86
+// 16字节内按值的宽度反转字节的pshufb掩码
+alignas(16) static const uint8_t kSwapMask16[16] = {
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+alignas(16) static const uint8_t kSwapMask32[16] = {
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+alignas(16) static const uint8_t kSwapMask64[16] = {
+    7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8};
+
+/**
+ * @return 处理的字节数，剩余不足16字节的部分留给标量实现
+ */
+WTSCLWQ_TARGET("sse4.1")
+static auto ByteSwapSse(uint8_t *dst, const uint8_t *src, size_t bytes,
+                        const uint8_t *mask) -> size_t {
+    __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(mask));
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_shuffle_epi8(v, shuffle));
+    }
+    return i;
+}
+
+WTSCLWQ_TARGET("avx2")
+static auto ByteSwapAvx2(uint8_t *dst, const uint8_t *src, size_t bytes,
+                         const uint8_t *mask) -> size_t {
+    __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i *>(mask));
+    __m256i shuffle2 = _mm256_broadcastsi128_si256(shuffle);
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_shuffle_epi8(v, shuffle2));
+    }
+    if (i + 16 <= bytes) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_shuffle_epi8(v, shuffle));
+        i += 16;
+    }
+    return i;
+}
+
+/**
+ * @brief 4个32位的值都小于2^7，或者都在[2^7, 2^14)时一次写出
+ * @return 写入的字节数，长短混合时返回0
+ */
+WTSCLWQ_TARGET("sse4.1")
+static inline auto EncodeGroupSse(__m128i v, uint8_t *dst) -> size_t {
+    if (_mm_testz_si128(v, _mm_set1_epi32(~0x7F)) != 0) {
+        __m128i words = _mm_packus_epi32(v, v);
+        int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+        memcpy(dst, &bytes, sizeof(bytes));
+        return 4;
+    }
+    __m128i large = _mm_cmpgt_epi32(v, _mm_set1_epi32(0x7F));
+    if (_mm_testz_si128(v, _mm_set1_epi32(~0x3FFF)) != 0 &&
+        _mm_movemask_ps(_mm_castsi128_ps(large)) == 0xF) {
+        // 低字节是带后续标志的低7位，高字节是高7位
+        __m128i low = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi32(0x7F)),
+                                   _mm_set1_epi32(0x80));
+        __m128i high = _mm_slli_epi32(_mm_srli_epi32(v, 7), 8);
+        __m128i words = _mm_packus_epi32(_mm_or_si128(low, high), v);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), words);
+        return 8;
+    }
+    return 0;
+}
+
+/**
+ * @brief 8个32位的值，同EncodeGroupSse()
+ */
+WTSCLWQ_TARGET("avx2")
+static inline auto EncodeGroupAvx2(__m256i v, uint8_t *dst) -> size_t {
+    if (_mm256_testz_si256(v, _mm256_set1_epi32(~0x7F)) != 0) {
+        __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v),
+                                         _mm256_extracti128_si256(v, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst),
+                         _mm_packus_epi16(words, words));
+        return 8;
+    }
+    __m256i large = _mm256_cmpgt_epi32(v, _mm256_set1_epi32(0x7F));
+    if (_mm256_testz_si256(v, _mm256_set1_epi32(~0x3FFF)) != 0 &&
+        _mm256_movemask_ps(_mm256_castsi256_ps(large)) == 0xFF) {
+        __m256i low =
+            _mm256_or_si256(_mm256_and_si256(v, _mm256_set1_epi32(0x7F)),
+                            _mm256_set1_epi32(0x80));
+        __m256i high = _mm256_slli_epi32(_mm256_srli_epi32(v, 7), 8);
+        __m256i pairs = _mm256_or_si256(low, high);
+        __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(pairs),
+                                         _mm256_extracti128_si256(pairs, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), words);
+        return 16;
+    }
+    return 0;
+}
+
+WTSCLWQ_TARGET("sse4.1")
+static auto EncodeSse(const uint32_t *src, size_t count, uint8_t *dst)
+    -> uint8_t * {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        size_t len = EncodeGroupSse(v, dst);
+        dst = len != 0 ? dst + len : EncodeScalar(src + i, 4, dst);
+    }
+    return EncodeScalar(src + i, count - i, dst);
+}
+
+WTSCLWQ_TARGET("sse4.1")
+static auto EncodeSse(const uint64_t *src, size_t count, uint8_t *dst)
+    -> uint8_t * {
+    const __m128i high_mask = _mm_set1_epi64x(
+        static_cast<int64_t>(0xFFFFFFFF00000000ULL));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i b =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 2));
+        size_t len = 0;
+        if (_mm_testz_si128(_mm_or_si128(a, b), high_mask) != 0) {
+            // 高32位都是0，取低32位按32位的值编码
+            __m128i v = _mm_castps_si128(
+                _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                               _MM_SHUFFLE(2, 0, 2, 0)));
+            len = EncodeGroupSse(v, dst);
+        }
+        dst = len != 0 ? dst + len : EncodeScalar(src + i, 4, dst);
+    }
+    return EncodeScalar(src + i, count - i, dst);
+}
+
+WTSCLWQ_TARGET("avx2")
+static auto EncodeAvx2(const uint32_t *src, size_t count, uint8_t *dst)
+    -> uint8_t * {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        size_t len = EncodeGroupAvx2(v, dst);
+        dst = len != 0 ? dst + len : EncodeScalar(src + i, 8, dst);
+    }
+    return EncodeScalar(src + i, count - i, dst);
+}
+
+WTSCLWQ_TARGET("avx2")
+static auto EncodeAvx2(const uint64_t *src, size_t count, uint8_t *dst)
+    -> uint8_t * {
+    const __m256i high_mask = _mm256_set1_epi64x(
+        static_cast<int64_t>(0xFFFFFFFF00000000ULL));
+    // 把每个64位值的低32位收拢到低128位
+    const __m256i narrow = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i b =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 4));
+        size_t len = 0;
+        if (_mm256_testz_si256(_mm256_or_si256(a, b), high_mask) != 0) {
+            __m256i v = _mm256_permute2x128_si256(
+                _mm256_permutevar8x32_epi32(a, narrow),
+                _mm256_permutevar8x32_epi32(b, narrow), 0x20);
+            len = EncodeGroupAvx2(v, dst);
+        }
+        dst = len != 0 ? dst + len : EncodeScalar(src + i, 8, dst);
+    }
+    return EncodeScalar(src + i, count - i, dst);
+}
+
+/**
+ * @brief 把8个16位的值扩展后写到dst
+ */
+WTSCLWQ_TARGET("sse4.1")
+static inline void StoreWordsSse(uint32_t *dst, __m128i words) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm_cvtepu16_epi32(words));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4),
+                     _mm_cvtepu16_epi32(_mm_srli_si128(words, 8)));
+}
+
+WTSCLWQ_TARGET("sse4.1")
+static inline void StoreWordsSse(uint64_t *dst, __m128i words) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                     _mm_cvtepu16_epi64(words));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2),
+                     _mm_cvtepu16_epi64(_mm_srli_si128(words, 4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4),
+                     _mm_cvtepu16_epi64(_mm_srli_si128(words, 8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 6),
+                     _mm_cvtepu16_epi64(_mm_srli_si128(words, 12)));
+}
+
+WTSCLWQ_TARGET("avx2")
+static inline void StoreWordsAvx2(uint32_t *dst, __m128i words) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+                        _mm256_cvtepu16_epi32(words));
+}
+
+WTSCLWQ_TARGET("avx2")
+static inline void StoreWordsAvx2(uint64_t *dst, __m128i words) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst),
+                        _mm256_cvtepu16_epi64(words));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 4),
+                        _mm256_cvtepu16_epi64(_mm_srli_si128(words, 8)));
+}
+
+/**
+ * @brief 16字节中每个16位是一个双字节的varint时，解出8个值
+ */
+WTSCLWQ_TARGET("sse4.1")
+static inline auto DecodeWordsSse(__m128i bytes) -> __m128i {
+    __m128i low = _mm_and_si128(bytes, _mm_set1_epi16(0x7F));
+    __m128i high = _mm_and_si128(bytes, _mm_set1_epi16(0x7F00));
+    return _mm_or_si128(low, _mm_srli_epi16(high, 1));
+}
+
+/**
+ * @brief 每次看16字节的后续标志：全是单字节或全是双字节的值时整组解码，
+ * 否则用标量解码越过前8字节
+ */
+template <class T, size_t MaxSize>
+WTSCLWQ_TARGET("sse4.1")
+static auto DecodeSse(const uint8_t *src, const uint8_t *end, T *dst,
+                      size_t count, size_t &decoded) -> const uint8_t * {
+    size_t i = 0;
+    // 留出标量解码越过8字节后可能多读的MaxSize字节
+    while (end - src >= static_cast<ptrdiff_t>(16 + MaxSize) &&
+           count - i >= 8) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+        int mask = _mm_movemask_epi8(bytes);
+        if ((mask & 0xFF) == 0) {
+            StoreWordsSse(dst + i, _mm_cvtepu8_epi16(bytes));
+            src += 8;
+            i += 8;
+            continue;
+        }
+        if (mask == 0x5555) {
+            StoreWordsSse(dst + i, DecodeWordsSse(bytes));
+            src += 16;
+            i += 8;
+            continue;
+        }
+        const uint8_t *stop = src + 8;
+        while (src < stop) {
+            src = DecodeVarint<T, MaxSize>(src, dst[i++]);
+        }
+    }
+    size_t rest = 0;
+    src = DecodeScalar<T, MaxSize>(src, end, dst + i, count - i, rest);
+    decoded = i + rest;
+    return src;
+}
+
+/**
+ * @brief 每次看32字节，同DecodeSse()
+ */
+template <class T, size_t MaxSize>
+WTSCLWQ_TARGET("avx2")
+static auto DecodeAvx2(const uint8_t *src, const uint8_t *end, T *dst,
+                       size_t count, size_t &decoded) -> const uint8_t * {
+    size_t i = 0;
+    while (end - src >= static_cast<ptrdiff_t>(32 + MaxSize) &&
+           count - i >= 16) {
+        __m256i bytes =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(bytes));
+        if ((mask & 0xFFFF) == 0) {
+            __m128i low = _mm256_castsi256_si128(bytes);
+            StoreWordsAvx2(dst + i, _mm_cvtepu8_epi16(low));
+            StoreWordsAvx2(dst + i + 8,
+                           _mm_cvtepu8_epi16(_mm_srli_si128(low, 8)));
+            src += 16;
+            i += 16;
+            continue;
+        }
+        if (mask == 0x55555555) {
+            __m256i low = _mm256_and_si256(bytes, _mm256_set1_epi16(0x7F));
+            __m256i high = _mm256_and_si256(bytes, _mm256_set1_epi16(0x7F00));
+            __m256i words = _mm256_or_si256(low, _mm256_srli_epi16(high, 1));
+            StoreWordsAvx2(dst + i, _mm256_castsi256_si128(words));
+            StoreWordsAvx2(dst + i + 8, _mm256_extracti128_si256(words, 1));
+            src += 32;
+            i += 16;
+            continue;
+        }
+        const uint8_t *stop = src + 16;
+        while (src < stop) {
+            src = DecodeVarint<T, MaxSize>(src, dst[i++]);
+        }
+    }
+    size_t rest = 0;
+    src = DecodeScalar<T, MaxSize>(src, end, dst + i, count - i, rest);
+    decoded = i + rest;
+    return src;
+}
+#endif
+
+void ByteSwapArray(void *dst, const void *src, size_t count, size_t width) {
+    auto *out = static_cast<uint8_t *>(dst);
+    const auto *in = static_cast<const uint8_t *>(src);
+    if (width == 1) {
+        if (out != in) {
+            memcpy(out, in, count);
+        }
+        return;
+    }
+    size_t done = 0;
+#ifdef WTSCLWQ_SIMD_X86
+    const uint8_t *mask = width == 2   ? kSwapMask16
+                          : width == 4 ? kSwapMask32
+                                       : kSwapMask64;
+    switch (GetSimdLevel()) {
+        case SimdLevel::AVX2:
+            done = ByteSwapAvx2(out, in, count * width, mask);
+            break;
+        case SimdLevel::SSE4_1:
+            done = ByteSwapSse(out, in, count * width, mask);
+            break;
+        default:
+            break;
+    }
+#endif
+    out += done;
+    in += done;
+    count -= done / width;
+    switch (width) {
+        case 2:
+            ByteSwapScalar<uint16_t>(out, in, count);
+            break;
+        case 4:
+            ByteSwapScalar<uint32_t>(out, in, count);
+            break;
+        case 8:
+            ByteSwapScalar<uint64_t>(out, in, count);
+            break;
+        default:
+            break;
+    }
+}
+
+auto EncodeVarintArray(const uint32_t *src, size_t count, uint8_t *dst)
+    -> uint8_t * {
+#ifdef WTSCLWQ_SIMD_X86
+    switch (GetSimdLevel()) {
+        case SimdLevel::AVX2:
+            return EncodeAvx2(src, count, dst);
+        case SimdLevel::SSE4_1:
+            return EncodeSse(src, count, dst);
+        default:
+            break;
+    }
+#endif
+    return EncodeScalar(src, count, dst);
+}
+
+auto EncodeVarintArray(const uint64_t *src, size_t count, uint8_t *dst)
+    -> uint8_t * {
+#ifdef WTSCLWQ_SIMD_X86
+    switch (GetSimdLevel()) {
+        case SimdLevel::AVX2:
+            return EncodeAvx2(src, count, dst);
+        case SimdLevel::SSE4_1:
+            return EncodeSse(src, count, dst);
+        default:
+            break;
+    }
+#endif
+    return EncodeScalar(src, count, dst);
+}
+
+template <class T, size_t MaxSize>
+static auto DecodeArray(const uint8_t *src, size_t size, T *dst, size_t count,
+                        size_t &decoded) -> size_t {
+    const uint8_t *end = src + size;
+    const uint8_t *next = nullptr;
+    switch (GetSimdLevel()) {
+#ifdef WTSCLWQ_SIMD_X86
+        case SimdLevel::AVX2:
+            next = DecodeAvx2<T, MaxSize>(src, end, dst, count, decoded);
+            break;
+        case SimdLevel::SSE4_1:
+            next = DecodeSse<T, MaxSize>(src, end, dst, count, decoded);
+            break;
+#endif
+        default:
+            next = DecodeScalar<T, MaxSize>(src, end, dst, count, decoded);
+            break;
+    }
+    return static_cast<size_t>(next - src);
+}
+
+auto DecodeVarintArray(const uint8_t *src, size_t size, uint32_t *dst,
+                       size_t count, size_t &decoded) -> size_t {
+    return DecodeArray<uint32_t, kMaxVarint32Size>(src, size, dst, count,
+                                                   decoded);
+}
+
+auto DecodeVarintArray(const uint8_t *src, size_t size, uint64_t *dst,
+                       size_t count, size_t &decoded) -> size_t {
+    return DecodeArray<uint64_t, kMaxVarint64Size>(src, size, dst, count,
+                                                   decoded);
+}
+}  // namespace wtsclwq
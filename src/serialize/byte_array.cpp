@@ -4,150 +4,349 @@
 
 #include "../include/serialize/byte_array.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
 #include <cstring>
-#include <fstream>
+#include <new>
 #include <stdexcept>
 
+#include "../include/config/config.h"
 #include "../include/log/log_manager.h"
+#include "../include/serialize/array_codec.h"
 #include "../include/util/net_util.h"
 namespace wtsclwq {
 static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+static ConfigVar<size_t>::ptr g_byte_array_pool_size =
+    Config::Lookup("byte_array.pool_size", (size_t)(16 * 1024 * 1024),
+                   "bytes of free byte array blocks each thread keeps");
+
+namespace {
+/**
+ * @brief 归还给其他线程的空闲块，复用块本身的内存串成链表
+ */
+struct FreeBlock {
+    FreeBlock *next{nullptr};
+    size_t size{0};
+};
+
+// 池所在线程已退出的标记，之后归还的块直接释放
+FreeBlock g_owner_exited;
+
+/**
+ * @brief 块的归属记录，在其他线程释放的块经它回到分配块的线程。
+ * 记录只增不删，线程退出后可以被新线程的池复用，所以块里保存的指针一直有效
+ */
+struct PoolOwner {
+    std::atomic<FreeBlock *> remote{nullptr};  // 其他线程归还的块
+    std::atomic<size_t> remote_bytes{0};       // remote中的字节数
+    std::atomic<bool> in_use{false};
+    std::atomic<size_t> limit{0};              // remote中最多的字节数
+    PoolOwner *next{nullptr};
+
+    /**
+     * @brief 其他线程归还块，超过上限或者池已退出时直接释放
+     */
+    void Push(char *block, size_t size) {
+        if (remote_bytes.fetch_add(size, std::memory_order_relaxed) + size >
+            limit.load(std::memory_order_relaxed)) {
+            remote_bytes.fetch_sub(size, std::memory_order_relaxed);
+            delete[] block;
+            return;
+        }
+        auto *node = new (block) FreeBlock();
+        node->size = size;
+        FreeBlock *head = remote.load(std::memory_order_relaxed);
+        do {
+            if (head == &g_owner_exited) {
+                remote_bytes.fetch_sub(size, std::memory_order_relaxed);
+                delete[] block;
+                return;
+            }
+            node->next = head;
+        } while (!remote.compare_exchange_weak(head, node,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+    }
 
-ByteArray::Node::Node(size_t size) : size(size), ptr(new char[size]) {}
-
-ByteArray::Node::~Node() { delete[] ptr; }
-
-ByteArray::ByteArray()
-    : m_base_size(4096), m_capacity(4096), m_endian(BIG_ENDIAN),
-      m_root(new Node(4096)), m_cur(m_root) {}
+    /**
+     * @brief 取走全部归还的块
+     * @param[in] closing 池所在线程退出，之后归还的块不再入链
+     */
+    auto TakeAll(bool closing) -> FreeBlock * {
+        FreeBlock *head = remote.exchange(closing ? &g_owner_exited : nullptr,
+                                          std::memory_order_acquire);
+        size_t bytes = 0;
+        for (FreeBlock *node = head; node != nullptr; node = node->next) {
+            bytes += node->size;
+        }
+        remote_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        return head;
+    }
+};
 
-ByteArray::ByteArray(size_t base_size)
-    : m_base_size(base_size), m_capacity(base_size), m_endian(BIG_ENDIAN),
-      m_root(new Node(base_size)), m_cur(m_root) {}
+std::atomic<PoolOwner *> g_pool_owners{nullptr};
 
-ByteArray::~ByteArray() {
-    Node *temp = m_root;
-    while (temp != nullptr) {
-        m_cur = temp;
-        temp = temp->next;
-        delete m_cur;
+auto AcquirePoolOwner() -> PoolOwner * {
+    for (PoolOwner *owner = g_pool_owners.load(std::memory_order_acquire);
+         owner != nullptr; owner = owner->next) {
+        bool expected = false;
+        if (owner->in_use.compare_exchange_strong(expected, true)) {
+            owner->remote.store(nullptr, std::memory_order_relaxed);
+            return owner;
+        }
+    }
+    auto *owner = new PoolOwner();
+    owner->in_use = true;
+    owner->next = g_pool_owners.load(std::memory_order_relaxed);
+    while (!g_pool_owners.compare_exchange_weak(owner->next, owner)) {
     }
+    return owner;
 }
+}  // namespace
+
+/**
+ * @brief 每个线程一个的内存块池，按块大小缓存释放的块，总量不超过byte_array.pool_size。
+ * ByteArray会随协程换线程，块记着分配它的线程，在其他线程释放时归还过去，
+ * 分配线程在本地缓存用完时再取回，避免生产者线程总是向系统申请、消费者线程囤积块。
+ * 每块仍单独向系统申请而不是从大块中切分，一个存活的块不会拖住整个大块
+ */
+class BlockPool {
+  public:
+    BlockPool(const BlockPool &) = delete;
+    BlockPool(BlockPool &&) = delete;
+    auto operator=(const BlockPool &) -> BlockPool & = delete;
+    auto operator=(BlockPool &&) -> BlockPool & = delete;
+
+    BlockPool()
+        : m_limit(g_byte_array_pool_size->GetValue()),
+          m_owner(AcquirePoolOwner()) {
+        m_owner->limit.store(m_limit, std::memory_order_relaxed);
+    }
 
-void ByteArray::WriteFixedInt8(int8_t value) { Write(&value, sizeof(value)); }
-
-void ByteArray::WriteFixedUint8(uint8_t value) { Write(&value, sizeof(value)); }
+    ~BlockPool() {
+        for (auto &list : m_lists) {
+            for (char *block : list.blocks) {
+                delete[] block;
+            }
+        }
+        FreeBlock *node = m_owner->TakeAll(true);
+        while (node != nullptr) {
+            FreeBlock *next = node->next;
+            delete[] reinterpret_cast<char *>(node);
+            node = next;
+        }
+        m_owner->in_use.store(false, std::memory_order_release);
+        s_exited = true;
+    }
 
-void ByteArray::WriteFixedInt16(int16_t value) {
-    if (m_endian != BYTE_ORDER) {
-        value = ByteSwap(value);
+    /**
+     * @return 当前线程的池，线程退出过程中池已经析构时返回nullptr
+     */
+    static auto GetThreadPool() -> BlockPool * {
+        if (s_exited) {
+            return nullptr;
+        }
+        thread_local BlockPool pool;
+        return &pool;
     }
-    Write(&value, sizeof(value));
-}
 
-void ByteArray::WriteFixedUint16(uint16_t value) {
-    if (m_endian != BYTE_ORDER) {
-        value = ByteSwap(value);
+    auto GetOwner() const -> PoolOwner * { return m_owner; }
+
+    auto Allocate(size_t size) -> char * {
+        FreeList *list = Find(size);
+        if ((list == nullptr || list->blocks.empty()) &&
+            m_owner->remote.load(std::memory_order_relaxed) != nullptr) {
+            Reclaim();
+            list = Find(size);
+        }
+        if (list == nullptr || list->blocks.empty()) {
+            return new char[size];
+        }
+        char *block = list->blocks.back();
+        list->blocks.pop_back();
+        m_cached -= size;
+        return block;
     }
-    Write(&value, sizeof(value));
-}
 
-void ByteArray::WriteFixedInt32(int32_t value) {
-    if (m_endian != BYTE_ORDER) {
-        value = ByteSwap(value);
+    /**
+     * @param[in] owner 分配该块的线程的记录
+     */
+    void Deallocate(char *block, size_t size, PoolOwner *owner) {
+        if (owner != m_owner) {
+            owner->Push(block, size);
+            return;
+        }
+        Cache(block, size);
     }
-    Write(&value, sizeof(value));
-}
 
-void ByteArray::WriteFixedUint32(uint32_t value) {
-    if (m_endian != BYTE_ORDER) {
-        value = ByteSwap(value);
+  private:
+    struct FreeList {
+        size_t size{0};
+        std::vector<char *> blocks{};
+    };
+
+    // 同时使用的块大小通常只有一两种，顺序查找即可
+    auto Find(size_t size) -> FreeList * {
+        for (auto &list : m_lists) {
+            if (list.size == size) {
+                return &list;
+            }
+        }
+        return nullptr;
     }
-    Write(&value, sizeof(value));
-}
 
-void ByteArray::WriteFixedInt64(int64_t value) {
-    if (m_endian != BYTE_ORDER) {
-        value = ByteSwap(value);
+    void Cache(char *block, size_t size) {
+        if (m_cached + size > m_limit) {
+            delete[] block;
+            return;
+        }
+        FreeList *list = Find(size);
+        if (list == nullptr) {
+            list = &m_lists.emplace_back();
+            list->size = size;
+        }
+        list->blocks.push_back(block);
+        m_cached += size;
     }
-    Write(&value, sizeof(value));
-}
 
-void ByteArray::WriteFixedUint64(uint64_t value) {
-    if (m_endian != BYTE_ORDER) {
-        value = ByteSwap(value);
+    /**
+     * @brief 取回其他线程归还的块
+     */
+    void Reclaim() {
+        FreeBlock *node = m_owner->TakeAll(false);
+        while (node != nullptr) {
+            FreeBlock *next = node->next;
+            size_t size = node->size;
+            node->~FreeBlock();
+            Cache(reinterpret_cast<char *>(node), size);
+            node = next;
+        }
     }
-    Write(&value, sizeof(value));
-}
 
-void ByteArray::WriteFixedFloat(float value) {
-    uint32_t val;
-    memcpy(&val, &value, sizeof(value));
-    WriteFixedUint32(val);
-}
+    static thread_local bool s_exited;
 
-void ByteArray::WriteFixedDouble(double value) {
-    uint64_t val;
-    memcpy(&val, &value, sizeof(value));
-    WriteFixedUint32(val);
-}
+    size_t m_limit;      // 最多缓存的字节数
+    size_t m_cached{0};  // 已缓存的字节数
+    PoolOwner *m_owner;  // 本线程的归属记录
+    std::vector<FreeList> m_lists{};
+};
+
+thread_local bool BlockPool::s_exited = false;
 
-inline auto ZigZagEncode32(int32_t n) -> uint32_t {
-    // Note:  the right-shift must be arithmetic
-    return (n << 1) ^ (n >> 31);
+// 批量读写时一次处理的值的个数
+static constexpr size_t kArrayChunkSize = 256;
+
+/**
+ * @param[out] owner 块归属的记录，线程退出过程中分配的块没有归属
+ */
+static auto AllocateBlock(size_t size, PoolOwner **owner) -> char * {
+    BlockPool *pool = BlockPool::GetThreadPool();
+    if (pool == nullptr) {
+        *owner = nullptr;
+        return new char[size];
+    }
+    *owner = pool->GetOwner();
+    return pool->Allocate(size);
 }
 
-inline auto ZigZagDecode32(uint32_t n) -> int32_t {
-    return (n >> 1) ^ -static_cast<int32_t>(n & 1);
+static void DeallocateBlock(char *block, size_t size, PoolOwner *owner) {
+    BlockPool *pool = BlockPool::GetThreadPool();
+    if (pool != nullptr && owner != nullptr) {
+        pool->Deallocate(block, size, owner);
+    } else if (owner != nullptr) {
+        owner->Push(block, size);
+    } else {
+        delete[] block;
+    }
 }
 
-inline auto ZigZagEncode64(int64_t n) -> uint64_t {
-    // Note:  the right-shift must be arithmetic
-    return (n << 1) ^ (n >> 63);
+/**
+ * @brief 引用计数的内存块。
+ * 分配的内存块数据紧跟在头部之后；映射的文件是只读的，由多个节点分段引用
+ */
+struct ByteArrayChunk {
+    enum Kind { POOLED = 0, HEAP = 1, MAPPED = 2 };
+    std::atomic_uint32_t refs{1};
+    size_t size{0};         // 数据的大小
+    Kind kind{HEAP};        // 内存的来源，决定怎样释放
+    void *mapping{nullptr};  // MAPPED时映射的地址
+    PoolOwner *owner{nullptr};  // POOLED时分配块的线程
+};
+
+// 映射的文件按这个大小分成节点，写入时只需要复制被写的一段
+static constexpr size_t kMappedNodeSize = 1024 * 1024;
+
+static auto GetChunkData(ByteArrayChunk *chunk) -> char * {
+    return reinterpret_cast<char *>(chunk + 1);
 }
 
-inline auto ZigZagDecode64(uint64_t n) -> int64_t {
-    return (n >> 1) ^ -static_cast<int64_t>(n & 1);
+/**
+ * @param[in] pooled 只有base_size的块放回池中，其他大小的块直接释放
+ */
+static auto NewChunk(size_t size, bool pooled) -> ByteArrayChunk * {
+    size_t total = sizeof(ByteArrayChunk) + size;
+    PoolOwner *owner = nullptr;
+    char *block = pooled ? AllocateBlock(total, &owner) : new char[total];
+    auto *chunk = new (block) ByteArrayChunk();
+    chunk->size = size;
+    chunk->owner = owner;
+    chunk->kind = pooled ? ByteArrayChunk::POOLED : ByteArrayChunk::HEAP;
+    return chunk;
 }
 
-void ByteArray::WriteInt32(int32_t value) {
-    WriteUint32(ZigZagEncode32(value));
+static void RetainChunk(ByteArrayChunk *chunk) {
+    chunk->refs.fetch_add(1, std::memory_order_relaxed);
 }
 
-void ByteArray::WriteUint32(uint32_t value) {
-    // 最多5个字节(40bit)，32/7 = 4...4
-    uint8_t temp[5];
-    uint8_t i;
-    // 如果数据大于一个字节(127是一个字节最大数据),那么继续,即需要在最高位加上1
-    for (i = 0; value > 127; ++i) {
-        // value&0x7F表示取出下7bit数据, 0x80表示在最高位加上1
-        temp[i] = (value & 0x7F) | 0x80;
-        value >>= 7;
+static void ReleaseChunk(ByteArrayChunk *chunk) {
+    if (chunk->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (chunk->kind == ByteArrayChunk::MAPPED) {
+        munmap(chunk->mapping, chunk->size);
+        delete chunk;
+        return;
+    }
+    size_t total = sizeof(ByteArrayChunk) + chunk->size;
+    bool pooled = chunk->kind == ByteArrayChunk::POOLED;
+    PoolOwner *owner = chunk->owner;
+    chunk->~ByteArrayChunk();
+    auto *block = reinterpret_cast<char *>(chunk);
+    if (pooled) {
+        DeallocateBlock(block, total, owner);
+    } else {
+        delete[] block;
     }
-    temp[i] = value;
-    i++;
-    Write(temp, i);
 }
 
-void ByteArray::WriteInt64(int64_t value) {
-    WriteUint64(ZigZagEncode64(value));
+/**
+ * @brief 只有一个引用的分配内存块才能原地写入
+ */
+static auto IsExclusive(ByteArrayChunk *chunk) -> bool {
+    return chunk->kind != ByteArrayChunk::MAPPED &&
+           chunk->refs.load(std::memory_order_acquire) == 1;
 }
 
-void ByteArray::WriteUint64(uint64_t value) {
-    // 最多10个字节（80bit），64/7 = 9...1
-    uint8_t temp[10];
-    uint8_t i;
-    // 如果数据大于一个字节(127是一个字节最大数据),那么继续,即需要在最高位加上1
-    for (i = 0; value > 127; ++i) {
-        // value&0x7F表示取出下7bit数据, 0x80表示在最高位加上1
-        temp[i] = (value & 0x7F) | 0x80;
-        value >>= 7;
-    }
-    temp[i] = static_cast<uint8_t>(value);
-    i++;
-    Write(temp, i);
+ByteArray::ByteArray() : ByteArray(4096) {}
+
+ByteArray::ByteArray(size_t base_size)
+    : m_base_size(base_size), m_capacity(0), m_endian(BIG_ENDIAN) {
+    AppendBlock();
+    UpdateCursor();
 }
 
+ByteArray::ByteArray(size_t base_size, uint16_t endian)
+    : m_base_size(base_size), m_capacity(0), m_endian(endian) {}
+
+ByteArray::~ByteArray() { ReleaseNodes(0); }
+
 void ByteArray::WriteStringFixedUint16(const std::string &value) {
     WriteFixedUint16(value.size());
     Write(value.c_str(), value.size());
@@ -172,161 +371,329 @@ void ByteArray::WriteStringWithoutLength(const std::string &value) {
     Write(value.c_str(), value.size());
 }
 
-auto ByteArray::ReadFixedInt8() -> int8_t {
-    int8_t value;
-    Read(&value, sizeof(value));
-    return value;
+auto ByteArray::ReadStringFixedUint16() -> std::string {
+    uint16_t len = ReadFixedUint16();
+    std::string buffer;
+    buffer.resize(len);
+    Read(buffer.data(), len);
+    return buffer;
 }
 
-auto ByteArray::ReadFixedUint8() -> uint8_t {
-    uint8_t value;
-    Read(&value, sizeof(value));
-    return value;
+auto ByteArray::ReadStringFixedUint32() -> std::string {
+    uint32_t len = ReadFixedUint32();
+    std::string buffer;
+    buffer.resize(len);
+    Read(buffer.data(), len);
+    return buffer;
 }
 
-auto ByteArray::ReadFixedInt16() -> int16_t {
-    int16_t value;
-    Read(&value, sizeof(value));
-    if (m_endian == BYTE_ORDER) {
-        return value;
+auto ByteArray::ReadStringFixedUint64() -> std::string {
+    uint64_t len = ReadFixedUint64();
+    std::string buffer;
+    buffer.resize(len);
+    Read(buffer.data(), len);
+    return buffer;
+}
+
+auto ByteArray::ReadStringVint64() -> std::string {
+    uint64_t len = ReadUint64();
+    std::string buffer;
+    buffer.resize(len);
+    Read(buffer.data(), len);
+    return buffer;
+}
+
+void ByteArray::WriteInt32Array(const int32_t *values, size_t count) {
+    uint32_t temp[kArrayChunkSize];
+    while (count > 0) {
+        size_t len = std::min(count, kArrayChunkSize);
+        for (size_t i = 0; i < len; ++i) {
+            temp[i] = ZigZagEncode32(values[i]);
+        }
+        WriteVarintArray(temp, len);
+        values += len;
+        count -= len;
     }
-    return ByteSwap(value);
 }
 
-auto ByteArray::ReadFixedUint16() -> uint16_t {
-    uint16_t value;
-    Read(&value, sizeof(value));
-    if (m_endian == BYTE_ORDER) {
-        return value;
+void ByteArray::WriteUint32Array(const uint32_t *values, size_t count) {
+    WriteVarintArray(values, count);
+}
+
+void ByteArray::WriteInt64Array(const int64_t *values, size_t count) {
+    uint64_t temp[kArrayChunkSize];
+    while (count > 0) {
+        size_t len = std::min(count, kArrayChunkSize);
+        for (size_t i = 0; i < len; ++i) {
+            temp[i] = ZigZagEncode64(values[i]);
+        }
+        WriteVarintArray(temp, len);
+        values += len;
+        count -= len;
     }
-    return ByteSwap(value);
 }
 
-auto ByteArray::ReadFixedInt32() -> int32_t {
-    int32_t value;
-    Read(&value, sizeof(value));
-    if (m_endian == BYTE_ORDER) {
-        return value;
+void ByteArray::WriteUint64Array(const uint64_t *values, size_t count) {
+    WriteVarintArray(values, count);
+}
+
+void ByteArray::ReadInt32Array(int32_t *values, size_t count) {
+    // 先按无符号读到原位，再原地做zigzag解码
+    auto *raw = reinterpret_cast<uint32_t *>(values);
+    ReadVarintArray(raw, count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = ZigZagDecode32(raw[i]);
     }
-    return ByteSwap(value);
 }
 
-auto ByteArray::ReadFixedUint32() -> uint32_t {
-    uint32_t value;
-    Read(&value, sizeof(value));
-    if (m_endian == BYTE_ORDER) {
-        return value;
+void ByteArray::ReadUint32Array(uint32_t *values, size_t count) {
+    ReadVarintArray(values, count);
+}
+
+void ByteArray::ReadInt64Array(int64_t *values, size_t count) {
+    auto *raw = reinterpret_cast<uint64_t *>(values);
+    ReadVarintArray(raw, count);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = ZigZagDecode64(raw[i]);
     }
-    return ByteSwap(value);
 }
-auto ByteArray::ReadFixedInt64() -> int64_t {
-    int64_t value;
-    Read(&value, sizeof(value));
-    if (m_endian == BYTE_ORDER) {
-        return value;
+
+void ByteArray::ReadUint64Array(uint64_t *values, size_t count) {
+    ReadVarintArray(values, count);
+}
+
+void ByteArray::WriteFixedArray(const void *values, size_t count,
+                                size_t width) {
+    if (width == 1 || m_endian == BYTE_ORDER) {
+        Write(values, count * width);
+        return;
+    }
+    AddWritableCapacity(count * width);
+    const auto *src = static_cast<const char *>(values);
+    while (count > 0) {
+        size_t len = std::min(count, GetWriteSpace() / width);
+        if (len == 0) {
+            // 值跨越内存块边界
+            char temp[sizeof(uint64_t)];
+            ByteSwapArray(temp, src, 1, width);
+            Write(temp, width);
+            src += width;
+            --count;
+            continue;
+        }
+        ByteSwapArray(m_cursor, src, len, width);
+        AdvanceCursor(len * width);
+        if (m_cursor == m_cursor_end) {
+            UpdateCursor();
+        }
+        src += len * width;
+        count -= len;
     }
-    return ByteSwap(value);
 }
 
-auto ByteArray::ReadFixedUint64() -> uint64_t {
-    uint64_t value;
-    Read(&value, sizeof(value));
-    if (m_endian == BYTE_ORDER) {
-        return value;
+void ByteArray::ReadFixedArray(void *values, size_t count, size_t width) {
+    if (count * width > GetReadableSize()) {
+        throw std::out_of_range("not enough len");
+    }
+    if (width == 1 || m_endian == BYTE_ORDER) {
+        Read(values, count * width);
+        return;
+    }
+    auto *dst = static_cast<char *>(values);
+    while (count > 0) {
+        size_t len = std::min(count, GetReadSpace() / width);
+        if (len == 0) {
+            Read(dst, width);
+            ByteSwapArray(dst, dst, 1, width);
+            dst += width;
+            --count;
+            continue;
+        }
+        ByteSwapArray(dst, m_cursor, len, width);
+        AdvanceCursor(len * width);
+        if (m_cursor == m_cursor_end) {
+            UpdateCursor();
+        }
+        dst += len * width;
+        count -= len;
     }
-    return ByteSwap(value);
 }
 
-auto ByteArray::ReadFixedFloat() -> float {
-    uint32_t val = ReadFixedUint32();
-    float value;
-    memcpy(&value, &val, sizeof(val));
-    return value;
+template <class T>
+void ByteArray::WriteVarintArray(const T *values, size_t count) {
+    constexpr size_t max_size =
+        sizeof(T) == sizeof(uint32_t) ? kMaxVarint32Size : kMaxVarint64Size;
+    while (count > 0) {
+        size_t len = std::min(count, kArrayChunkSize);
+        if (GetWriteSpace() >= len * max_size) {
+            // 当前内存块放得下最长的编码，直接编码到内存块里
+            auto *begin = reinterpret_cast<uint8_t *>(m_cursor);
+            AdvanceCursor(EncodeVarintArray(values, len, begin) - begin);
+        } else {
+            uint8_t temp[kArrayChunkSize * kMaxVarint64Size];
+            Write(temp, EncodeVarintArray(values, len, temp) - temp);
+        }
+        values += len;
+        count -= len;
+    }
 }
 
-auto ByteArray::ReadFixedDouble() -> double {
-    uint64_t val = ReadFixedUint32();
-    double value;
-    memcpy(&value, &val, sizeof(val));
-    return value;
+template <class T>
+void ByteArray::ReadVarintArray(T *values, size_t count) {
+    while (count > 0) {
+        size_t window = std::min(GetReadSpace(), m_size - m_position);
+        size_t decoded = 0;
+        size_t used =
+            DecodeVarintArray(reinterpret_cast<const uint8_t *>(m_cursor),
+                              window, values, count, decoded);
+        if (decoded == 0) {
+            // 值跨越内存块边界或者数据不足，逐个读取，数据不足时抛出异常
+            if constexpr (sizeof(T) == sizeof(uint32_t)) {
+                *values = ReadUint32();
+            } else {
+                *values = ReadUint64();
+            }
+            decoded = 1;
+        } else {
+            AdvanceCursor(used);
+            if (m_cursor == m_cursor_end) {
+                UpdateCursor();
+            }
+        }
+        values += decoded;
+        count -= decoded;
+    }
 }
 
-auto ByteArray::ReadInt32() -> int32_t { return ZigZagDecode32(ReadUint32()); }
+void ByteArray::Clear() {
+    m_size = 0;
+    m_position = 0;
+    // 第一个节点是独占的完整内存块时留下复用
+    size_t keep = 0;
+    if (!m_nodes.empty() && m_nodes[0].size == m_base_size &&
+        IsExclusive(m_nodes[0].chunk)) {
+        keep = 1;
+    }
+    ReleaseNodes(keep);
+    if (m_nodes.empty()) {
+        AppendBlock();
+    }
+    m_uniform = true;
+    UpdateCursor();
+}
 
-auto ByteArray::ReadUint32() -> uint32_t {
-    uint32_t result = 0;
-    for (int i = 0; i < 32; i += 7) {
-        uint8_t byte = ReadFixedUint8();
-        if (byte < 128) {
-            result |= (static_cast<uint32_t>(byte) << i);
-            break;
-        }
-        // 读取字节内的低7位，最高标志位丢弃
-        result |= (static_cast<uint32_t>(byte & 0x7F) << i);
+void ByteArray::ReleaseNodes(size_t from) {
+    if (from >= m_nodes.size()) {
+        return;
     }
-    return result;
+    for (size_t i = from; i < m_nodes.size(); ++i) {
+        ReleaseChunk(m_nodes[i].chunk);
+    }
+    m_capacity = m_offsets[from];
+    m_nodes.resize(from);
+    m_offsets.resize(from);
+}
+
+void ByteArray::AppendBlock() {
+    ByteArrayChunk *chunk = NewChunk(m_base_size, true);
+    PushNode({chunk, GetChunkData(chunk), m_base_size});
 }
 
-auto ByteArray::ReadInt64() -> int64_t { return ZigZagDecode64(ReadUint64()); }
+void ByteArray::PushNode(const Node &node) {
+    m_offsets.push_back(m_capacity);
+    m_nodes.push_back(node);
+    m_capacity += node.size;
+}
 
-auto ByteArray::ReadUint64() -> uint64_t {
-    uint64_t result = 0;
-    for (int i = 0; i < 64; i += 7) {
-        uint8_t byte = ReadFixedUint8();
-        if (byte < 128) {
-            result |= (static_cast<uint64_t>(byte) << i);
-            break;
-        }
-        // 读取字节内的低7位，最高标志位丢弃
-        result |= (static_cast<uint64_t>(byte & 0x7F) << i);
+auto ByteArray::FindNode(size_t position) const -> size_t {
+    if (m_uniform) {
+        return position / m_base_size;
     }
-    return result;
+    auto it = std::upper_bound(m_offsets.begin(), m_offsets.end(), position);
+    return static_cast<size_t>(it - m_offsets.begin()) - 1;
 }
 
-auto ByteArray::ReadStringFixedUint16() -> std::string {
-    uint16_t len = ReadFixedUint16();
-    std::string buffer;
-    buffer.resize(len);
-    Read(buffer.data(), len);
-    return buffer;
+void ByteArray::MakeWritable(size_t index) {
+    Node &node = m_nodes[index];
+    if (IsExclusive(node.chunk)) {
+        return;
+    }
+    ByteArrayChunk *chunk = NewChunk(node.size, node.size == m_base_size);
+    memcpy(GetChunkData(chunk), node.data, node.size);
+    ReleaseChunk(node.chunk);
+    node.chunk = chunk;
+    node.data = GetChunkData(chunk);
 }
 
-auto ByteArray::ReadStringFixedUint32() -> std::string {
-    uint32_t len = ReadFixedUint16();
-    std::string buffer;
-    buffer.resize(len);
-    Read(buffer.data(), len);
-    return buffer;
+void ByteArray::TrimToSize() {
+    if (m_size == m_capacity) {
+        return;
+    }
+    if (m_size == 0) {
+        ReleaseNodes(0);
+        return;
+    }
+    size_t last = FindNode(m_size - 1);
+    ReleaseNodes(last + 1);
+    m_nodes[last].size = m_size - m_offsets[last];
+    m_capacity = m_size;
 }
 
-auto ByteArray::ReadStringFixedUint64() -> std::string {
-    uint64_t len = ReadFixedUint16();
-    std::string buffer;
-    buffer.resize(len);
-    Read(buffer.data(), len);
-    return buffer;
+void ByteArray::UpdateUniform() {
+    m_uniform = std::all_of(m_nodes.begin(), m_nodes.end(),
+                            [this](const Node &node) {
+                                return node.size == m_base_size;
+                            });
 }
 
-auto ByteArray::ReadStringVint64() -> std::string {
-    uint64_t len = ReadUint64();
-    std::string buffer;
-    buffer.resize(len);
-    Read(buffer.data(), len);
-    return buffer;
+auto ByteArray::Slice(size_t offset, size_t len) const -> ByteArray::ptr {
+    if (offset > m_size || len > m_size - offset) {
+        throw std::out_of_range("Slice out of range");
+    }
+    ByteArray::ptr slice(new ByteArray(m_base_size, m_endian));
+    if (len != 0) {
+        size_t index = FindNode(offset);
+        size_t node_pos = offset - m_offsets[index];
+        size_t rest = len;
+        while (rest > 0) {
+            const Node &node = m_nodes[index];
+            size_t size = std::min(rest, node.size - node_pos);
+            RetainChunk(node.chunk);
+            slice->PushNode({node.chunk, node.data + node_pos, size});
+            rest -= size;
+            ++index;
+            node_pos = 0;
+        }
+    }
+    slice->m_size = len;
+    slice->UpdateUniform();
+    slice->UpdateCursor();
+    return slice;
 }
 
-void ByteArray::Clear() {
-    m_size = 0;
-    m_position = 0;
-    m_capacity = m_base_size;
-    Node *temp = m_root->next;
-    while (temp != nullptr) {
-        m_cur = temp;
-        temp = temp->next;
-        delete m_cur;
+auto ByteArray::Clone() const -> ByteArray::ptr {
+    ByteArray::ptr clone = Slice(0, m_size);
+    clone->SetPosition(m_position);
+    return clone;
+}
+
+void ByteArray::Append(ByteArray &&other) {
+    if (&other == this) {
+        return;
     }
-    m_cur = m_root;
-    m_root->next = nullptr;
+    // 丢掉两边m_size之后的容量，other的节点直接接在数据末尾
+    TrimToSize();
+    other.TrimToSize();
+    for (const Node &node : other.m_nodes) {
+        PushNode(node);
+    }
+    m_size = m_capacity;
+    other.m_nodes.clear();
+    other.m_offsets.clear();
+    other.m_capacity = 0;
+    other.Clear();
+    UpdateUniform();
+    UpdateCursor();
 }
 
 void ByteArray::Write(const void *buf, size_t size) {
@@ -334,107 +701,59 @@ void ByteArray::Write(const void *buf, size_t size) {
         return;
     }
     AddWritableCapacity(size);
-    size_t cur_node_pos = m_position % m_base_size;  // 当前节点可以写入的位置
-    size_t cur_node_cap = m_cur->size - cur_node_pos;  // 当前节点的剩余容量
-    size_t buf_position = 0;                           // buffer起始位置
+    const char *src = static_cast<const char *>(buf);
+    size_t index = FindNode(m_position);              // 当前节点
+    size_t node_pos = m_position - m_offsets[index];  // 当前节点可以写入的位置
     while (size > 0) {
-        // 如果剩余容量能够存下buf
-        if (cur_node_cap >= size) {
-            memcpy(m_cur->ptr + cur_node_pos,
-                   reinterpret_cast<const char *>(buf) + buf_position, size);
-            // 如果当前node的剩余容量刚好用完
-            if (m_cur->size == (cur_node_pos + size)) {
-                m_cur = m_cur->next;
-            }
-            m_position += size;
-            size = 0;
-        } else {
-            // 用完当前node的剩余容量
-            memcpy(m_cur->ptr + cur_node_pos,
-                   reinterpret_cast<const char *>(buf) + buf_position,
-                   cur_node_cap);
-            m_position += cur_node_cap;    // 将总位置向后移动
-            buf_position += cur_node_cap;  // 更新buffer起始位置
-            size -= cur_node_cap;          // 更新buffer剩余数据量
-            m_cur = m_cur->next;           // 当前节点已满，向后移动
-            cur_node_cap = m_cur->size;    // 新的当前节点为空
-            cur_node_pos = 0;  // 新的当前节点可写入的位置
-        }
+        MakeWritable(index);
+        const Node &node = m_nodes[index];
+        size_t len = std::min(size, node.size - node_pos);
+        memcpy(node.data + node_pos, src, len);
+        src += len;
+        size -= len;
+        m_position += len;
+        // 当前节点已满，写入下一个节点的开头
+        ++index;
+        node_pos = 0;
     }
     // 更新总数据量
     if (m_position > m_size) {
         m_size = m_position;
     }
+    UpdateCursor();
 }
 
 void ByteArray::Read(void *buf, size_t size) {
     if (size > GetReadableSize()) {
         throw std::out_of_range("not enough len");
     }
-    size_t cur_node_pos = m_position % m_base_size;  // 当前节点可以读取的位置
-    size_t cur_node_cap = m_cur->size - cur_node_pos;  // 当前节点的可读容量
-    size_t buf_position = 0;                           // buffer起始位置
-    while (size > 0) {
-        // 如果当前节点的可读容量能够满足buf的需求
-        if (cur_node_cap >= size) {
-            memcpy(reinterpret_cast<char *>(buf) + buf_position,
-                   m_cur->ptr + cur_node_pos, size);
-            // 如果当前node的可读容量刚好用完
-            if (m_cur->size == (cur_node_pos + size)) {
-                m_cur = m_cur->next;
-            }
-            m_position += size;
-            size = 0;
-        } else {
-            // 用完当前node的可读容量
-            memcpy(reinterpret_cast<char *>(buf) + buf_position,
-                   m_cur->ptr + cur_node_pos, cur_node_cap);
-            m_position += cur_node_cap;    // 将总位置向后移动
-            buf_position += cur_node_cap;  // 更新buffer起始位置
-            size -= cur_node_cap;          // 更新buffer剩余需求量
-            m_cur = m_cur->next;           // 当前节点已满，向后移动
-            cur_node_cap = m_cur->size;    // 新的当前节点为空
-            cur_node_pos = 0;              // 新的当前节点可读的位置
-        }
-    }
+    CopyOut(buf, size, m_position);
+    m_position += size;
+    UpdateCursor();
 }
 
 void ByteArray::Read(void *buf, size_t size, size_t position) const {
-    if (size > (m_size - position)) {
+    if (position > m_size || size > (m_size - position)) {
         throw std::out_of_range("not enough len");
     }
-    Node *cur = m_cur;
-    size_t buf_position = 0;
-    size_t cur_node_pos = position % m_base_size;  // 当前节点可以读取的位置
-    size_t count = position / m_base_size;
-    while (count > 0) {
-        cur = cur->next;
-        --count;
+    CopyOut(buf, size, position);
+}
+
+void ByteArray::CopyOut(void *buf, size_t size, size_t position) const {
+    if (size == 0) {
+        return;
     }
-    size_t cur_node_cap = cur->size - cur_node_pos;  // 当前节点的可读容量
-    // buffer起始位置
+    char *dst = static_cast<char *>(buf);
+    size_t index = FindNode(position);              // 当前节点
+    size_t node_pos = position - m_offsets[index];  // 当前节点可以读取的位置
     while (size > 0) {
-        // 如果当前节点的可读容量能够满足buf的需求
-        if (cur_node_cap >= size) {
-            memcpy(reinterpret_cast<char *>(buf) + buf_position,
-                   cur->ptr + cur_node_pos, size);
-            // 如果当前node的可读容量刚好用完
-            if (cur->size == (cur_node_pos + size)) {
-                cur = cur->next;
-            }
-            position += size;
-            size = 0;
-        } else {
-            // 用完当前node的可读容量
-            memcpy(reinterpret_cast<char *>(buf) + buf_position,
-                   cur->ptr + cur_node_pos, cur_node_cap);
-            position += cur_node_cap;      // 将总位置向后移动
-            buf_position += cur_node_cap;  // 更新buffer起始位置
-            size -= cur_node_cap;          // 更新buffer剩余需求量
-            cur = cur->next;               // 当前节点已满，向后移动
-            cur_node_cap = cur->size;      // 新的当前节点为空
-            cur_node_pos = 0;              // 新的当前节点可读的位置
-        }
+        const Node &node = m_nodes[index];
+        size_t len = std::min(size, node.size - node_pos);
+        memcpy(dst, node.data + node_pos, len);
+        dst += len;
+        size -= len;
+        ++index;
+        node_pos = 0;
     }
 }
 
@@ -448,59 +767,158 @@ void ByteArray::SetPosition(size_t value) {
     if (m_position > m_size) {
         m_size = m_position;
     }
-    m_cur = m_root;
-    while (value > m_cur->size) {
-        value -= m_cur->size;
-        m_cur = m_cur->next;
-    }
-    if (value == m_cur->size) {
-        m_cur = m_cur->next;
+    UpdateCursor();
+}
+
+void ByteArray::UpdateCursor() {
+    if (m_position < m_capacity) {
+        size_t index = FindNode(m_position);
+        const Node &node = m_nodes[index];
+        m_cursor = node.data + (m_position - m_offsets[index]);
+        m_cursor_end = node.data + node.size;
+        m_write_end = node.chunk->kind == ByteArrayChunk::MAPPED
+                          ? node.data
+                          : m_cursor_end;
+        m_cursor_refs = &node.chunk->refs;
+    } else {
+        m_cursor = nullptr;
+        m_cursor_end = nullptr;
+        m_write_end = nullptr;
+        m_cursor_refs = nullptr;
     }
 }
 
 auto ByteArray::WriteToFile(const std::string &name) const -> bool {
-    std::ofstream ofs;
-    ofs.open(name, std::ios::trunc | std::ios::binary);
-    if (!ofs) {
+    int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
         LOG_CUSTOM_ERROR(sys_logger,
                          "WriteToFile name = %s,error, errno = %d, errstr = %s",
                          name.c_str(), errno, strerror(errno))
         return false;
     }
-    int64_t read_size = GetReadableSize();
-    int64_t pos = m_position;
-    Node *cur = m_cur;
-
-    while (read_size > 0) {
-        int diff = pos % m_base_size;
-        int64_t len =
-            (read_size > static_cast<int64_t>(m_base_size) ? m_base_size
-                                                           : read_size) -
-            diff;
-        ofs.write(cur->ptr + diff, len);
-        cur = cur->next;
-        pos += len;
-        read_size -= len;
+    // 直接把内存块交给pwritev，每次最多IOV_MAX块，写了一部分时从断点继续
+    std::vector<iovec> buffers;
+    GetReadBuffers(buffers);
+    iovec *iov = buffers.data();
+    size_t count = buffers.size();
+    off_t offset = 0;
+    while (count > 0) {
+        ssize_t len =
+            pwritev(fd, iov, static_cast<int>(std::min<size_t>(count, IOV_MAX)),
+                    offset);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_CUSTOM_ERROR(sys_logger,
+                             "WriteToFile name = %s,error, errno = %d, "
+                             "errstr = %s",
+                             name.c_str(), errno, strerror(errno))
+            close(fd);
+            return false;
+        }
+        offset += len;
+        auto left = static_cast<size_t>(len);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
     }
+    close(fd);
     return true;
 }
 
 auto ByteArray::ReadFromFile(const std::string &name) -> bool {
-    std::ifstream ifs;
-    ifs.open(name, std::ios::binary);
-    if (!ifs) {
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0) {
         LOG_CUSTOM_ERROR(
             sys_logger, "ReadFromFile name = %s,error, errno = %d, errstr = %s",
             name.c_str(), errno, strerror(errno))
+        if (fd >= 0) {
+            close(fd);
+        }
         return false;
     }
+    // 直接读进写入缓存，不经过临时缓冲区。按文件大小准备缓存，
+    // 每次最多IOV_MAX块；大小未知(比如/proc下的文件)时按内存块读到文件末尾
+    auto remaining = static_cast<size_t>(st.st_size);
+    std::vector<iovec> buffers;
+    while (true) {
+        buffers.clear();
+        GetWriteBuffers(buffers, std::min(std::max(remaining, m_base_size),
+                                          IOV_MAX * m_base_size));
+        ssize_t len = readv(
+            fd, buffers.data(),
+            static_cast<int>(std::min<size_t>(buffers.size(), IOV_MAX)));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_CUSTOM_ERROR(sys_logger,
+                             "ReadFromFile name = %s,error, errno = %d, "
+                             "errstr = %s",
+                             name.c_str(), errno, strerror(errno))
+            close(fd);
+            return false;
+        }
+        if (len == 0) {
+            break;
+        }
+        SetPosition(m_position + len);
+        remaining -= std::min(remaining, static_cast<size_t>(len));
+    }
+    close(fd);
+    return true;
+}
 
-    std::shared_ptr<char> buff(new char[m_base_size],
-                               [](const char *ptr) { delete[] ptr; });
-    while (!ifs.eof()) {
-        ifs.read(buff.get(), m_base_size);
-        Write(buff.get(), ifs.gcount());
+auto ByteArray::MapFile(const std::string &name) -> bool {
+    int fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st {};
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        LOG_CUSTOM_ERROR(sys_logger,
+                         "MapFile name = %s,error, errno = %d, errstr = %s",
+                         name.c_str(), errno, strerror(errno))
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
     }
+    auto size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后就不再需要文件描述符
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LOG_CUSTOM_ERROR(sys_logger,
+                         "MapFile name = %s mmap error, errno = %d, errstr = %s",
+                         name.c_str(), errno, strerror(errno))
+        return false;
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    auto *chunk = new ByteArrayChunk();
+    chunk->size = size;
+    chunk->kind = ByteArrayChunk::MAPPED;
+    chunk->mapping = addr;
+    TrimToSize();
+    auto *data = static_cast<char *>(addr);
+    for (size_t offset = 0; offset < size; offset += kMappedNodeSize) {
+        if (offset != 0) {
+            RetainChunk(chunk);
+        }
+        PushNode({chunk, data + offset, std::min(kMappedNodeSize, size - offset)});
+    }
+    m_size = m_capacity;
+    UpdateUniform();
+    UpdateCursor();
     return true;
 }
 
@@ -541,62 +959,25 @@ auto ByteArray::ToHexString() const -> std::string {
 
 auto ByteArray::GetReadBuffers(std::vector<iovec> &buffers, size_t len) const
     -> size_t {
-    len = len > GetReadableSize() ? GetReadableSize() : len;
-    if (len == 0) {
-        return 0;
-    }
-    Node *cur = m_cur;
-    size_t size = len;
-    size_t cur_node_pos = m_position % m_base_size;
-    size_t cur_node_cap = cur->size - cur_node_pos;
-    struct iovec iov;
-    while (len != 0) {
-        if (cur_node_cap >= len) {
-            iov.iov_base = cur->ptr + cur_node_pos;
-            iov.iov_len = len;
-            len = 0;
-        } else {
-            iov.iov_base = cur->ptr + cur_node_pos;
-            iov.iov_len = cur_node_cap;
-            len -= cur_node_cap;
-            cur = cur->next;
-            cur_node_cap = cur->size;
-            cur_node_pos = 0;
-        }
-        buffers.push_back(iov);
-    }
-    return size;
+    return GetReadBuffers(buffers, len, m_position);
 }
+
 auto ByteArray::GetReadBuffers(std::vector<iovec> &buffers, size_t len,
                                size_t position) const -> size_t {
-    len = len > GetReadableSize() ? GetReadableSize() : len;
-    if (len == 0) {
+    if (position >= m_size) {
         return 0;
     }
-    uint64_t size = len;
-    size_t cur_node_pos = position % m_base_size;
-    size_t count = position / m_base_size;
-    Node *cur = m_root;
-    while (count > 0) {
-        cur = cur->next;
-        --count;
-    }
-    size_t cur_node_cap = cur->size - cur_node_pos;
-    struct iovec iov;
+    len = std::min(len, m_size - position);
+    size_t size = len;
+    size_t index = FindNode(position);
+    size_t node_pos = position - m_offsets[index];
     while (len > 0) {
-        if (cur_node_cap >= len) {
-            iov.iov_base = cur->ptr + cur_node_pos;
-            iov.iov_len = len;
-            len = 0;
-        } else {
-            iov.iov_base = cur->ptr + cur_node_pos;
-            iov.iov_len = cur_node_cap;
-            len -= cur_node_cap;
-            cur = cur->next;
-            cur_node_cap = cur->size;
-            cur_node_pos = 0;
-        }
-        buffers.push_back(iov);
+        const Node &node = m_nodes[index];
+        size_t iov_len = std::min(len, node.size - node_pos);
+        buffers.push_back({node.data + node_pos, iov_len});
+        len -= iov_len;
+        ++index;
+        node_pos = 0;
     }
     return size;
 }
@@ -607,32 +988,27 @@ auto ByteArray::GetWriteBuffers(std::vector<iovec> &buffers, size_t len)
         return 0;
     }
     AddWritableCapacity(len);
-    uint64_t size = len;
-
-    size_t cur_node_pos = m_position % m_base_size;
-    size_t cur_node_cap = m_cur->size - cur_node_pos;
-    struct iovec iov;
-    Node *cur = m_cur;
+    size_t size = len;
+    size_t index = FindNode(m_position);
+    size_t node_pos = m_position - m_offsets[index];
     while (len > 0) {
-        if (cur_node_cap >= len) {
-            iov.iov_base = cur->ptr + cur_node_pos;
-            iov.iov_len = len;
-            len = 0;
-        } else {
-            iov.iov_base = cur->ptr + cur_node_pos;
-            iov.iov_len = cur_node_cap;
-
-            len -= cur_node_cap;
-            cur = cur->next;
-            cur_node_cap = cur->size;
-            cur_node_pos = 0;
-        }
-        buffers.push_back(iov);
+        MakeWritable(index);
+        const Node &node = m_nodes[index];
+        size_t iov_len = std::min(len, node.size - node_pos);
+        buffers.push_back({node.data + node_pos, iov_len});
+        len -= iov_len;
+        ++index;
+        node_pos = 0;
     }
+    // 当前节点可能刚被复制
+    UpdateCursor();
     return size;
 }
+
 auto ByteArray::GetSize() const -> size_t { return m_size; }
 
+void ByteArray::Reserve(size_t size) { AddWritableCapacity(size); }
+
 void ByteArray::AddWritableCapacity(size_t size) {
     if (size == 0) {
         return;
@@ -643,23 +1019,12 @@ void ByteArray::AddWritableCapacity(size_t size) {
     }
 
     size = size - old_cap;
-    size_t count = ceil(1.0 * size / m_base_size);
-    Node *temp = m_root;
-    while (temp->next != nullptr) {
-        temp = temp->next;
-    }
-    Node *first = nullptr;
-    for (auto i = 0; i < count; ++i) {
-        temp->next = new Node(m_base_size);
-        if (first == nullptr) {
-            first = temp->next;
-        }
-        temp = temp->next;
-        m_capacity += m_base_size;
-    }
-    if (old_cap == 0) {
-        m_cur = first;
+    size_t count = (size + m_base_size - 1) / m_base_size;
+    // 新节点直接追加到下标的末尾，不需要遍历找尾节点
+    for (size_t i = 0; i < count; ++i) {
+        AppendBlock();
     }
+    UpdateCursor();
 }
 
 auto ByteArray::GetWritableCapacity() const -> size_t {
@@ -0,0 +1,107 @@
+//
+// 文件流
+//
+
+#include "../include/serialize/file_stream.h"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <vector>
+
+#include "../include/log/log_manager.h"
+
+namespace wtsclwq {
+static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+
+FileStream::FileStream(const std::string &name, int flags, mode_t mode)
+    : m_fd(open(name.c_str(), flags | O_CLOEXEC, mode)), m_offset(0) {
+    if (m_fd < 0) {
+        LOG_CUSTOM_ERROR(sys_logger,
+                         "FileStream open name = %s error, errno = %d, "
+                         "errstr = %s",
+                         name.c_str(), errno, strerror(errno))
+    }
+}
+
+FileStream::~FileStream() { Close(); }
+
+auto FileStream::ReadToBuf(void *buffer, size_t length) -> int {
+    if (!IsOpen()) {
+        return -1;
+    }
+    ssize_t len = 0;
+    do {
+        len = pread(m_fd, buffer, length, m_offset);
+    } while (len < 0 && errno == EINTR);
+    if (len > 0) {
+        m_offset += len;
+    }
+    return static_cast<int>(len);
+}
+
+auto FileStream::ReadToArray(ByteArray::ptr byte_array, size_t length) -> int {
+    if (!IsOpen()) {
+        return -1;
+    }
+    std::vector<iovec> iovs;
+    byte_array->GetWriteBuffers(iovs, length);
+    ssize_t len = 0;
+    do {
+        len = preadv(m_fd, iovs.data(),
+                     static_cast<int>(std::min<size_t>(iovs.size(), IOV_MAX)),
+                     m_offset);
+    } while (len < 0 && errno == EINTR);
+    if (len > 0) {
+        m_offset += len;
+        byte_array->SetPosition(byte_array->GetPosition() + len);
+    }
+    return static_cast<int>(len);
+}
+
+auto FileStream::WriteFromBuf(const void *buffer, size_t length) -> int {
+    if (!IsOpen()) {
+        return -1;
+    }
+    ssize_t len = 0;
+    do {
+        len = pwrite(m_fd, buffer, length, m_offset);
+    } while (len < 0 && errno == EINTR);
+    if (len > 0) {
+        m_offset += len;
+    }
+    return static_cast<int>(len);
+}
+
+auto FileStream::WriteFromArray(ByteArray::ptr byte_array, size_t length)
+    -> int {
+    if (!IsOpen()) {
+        return -1;
+    }
+    std::vector<iovec> iovs;
+    byte_array->GetReadBuffers(iovs, length);
+    ssize_t len = 0;
+    do {
+        len = pwritev(m_fd, iovs.data(),
+                      static_cast<int>(std::min<size_t>(iovs.size(), IOV_MAX)),
+                      m_offset);
+    } while (len < 0 && errno == EINTR);
+    if (len > 0) {
+        m_offset += len;
+        byte_array->SetPosition(byte_array->GetPosition() + len);
+    }
+    return static_cast<int>(len);
+}
+
+void FileStream::Close() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+}  // namespace wtsclwq
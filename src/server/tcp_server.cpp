@@ -4,23 +4,123 @@
 
 #include "../include/server/tcp_server.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "../include/config/config.h"
+#include "../include/io/fd_manager.h"
 #include "../include/log/log_manager.h"
+#include "../include/socket/unix_address.h"
+#include "../include/util/fs_util.h"
+#include "../include/util/thread_util.h"
 
 namespace wtsclwq {
 static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
 static ConfigVar<uint64_t>::ptr g_tcp_server_read_timeout =
     Config::Lookup("tcp_server.read_timeout", (uint64_t)(60 * 1000 * 2),
                    "tcp server read timeout");
+static ConfigVar<size_t>::ptr g_tcp_server_reuseport_listeners =
+    Config::Lookup("tcp_server.reuseport_listeners", (size_t)0,
+                   "tcp server SO_REUSEPORT listeners per address, 0 for one "
+                   "per acceptor thread, 1 to disable");
+static ConfigVar<std::string>::ptr g_tcp_server_profile =
+    Config::Lookup("tcp_server.profile", std::string("default"),
+                   "tcp server socket option profile in socket.profiles");
+static ConfigVar<size_t>::ptr g_tcp_server_max_connections =
+    Config::Lookup("tcp_server.max_connections", (size_t)0,
+                   "tcp server max connections, 0 means unlimited");
+static ConfigVar<size_t>::ptr g_tcp_server_max_connections_per_ip =
+    Config::Lookup("tcp_server.max_connections_per_ip", (size_t)0,
+                   "tcp server max connections per client ip, 0 means "
+                   "unlimited");
+static ConfigVar<uint64_t>::ptr g_tcp_server_idle_timeout =
+    Config::Lookup("tcp_server.idle_timeout", (uint64_t)0,
+                   "tcp server idle connection timeout, 0 to disable");
+static ConfigVar<uint64_t>::ptr g_tcp_server_idle_check_interval =
+    Config::Lookup("tcp_server.idle_check_interval", (uint64_t)1000,
+                   "tcp server idle timing wheel tick");
+static ConfigVar<uint64_t>::ptr g_tcp_server_ssl_handshake_timeout =
+    Config::Lookup("tcp_server.ssl_handshake_timeout", (uint64_t)(10 * 1000),
+                   "tcp server tls handshake timeout");
+static ConfigVar<uint64_t>::ptr g_tcp_server_hot_restart_timeout =
+    Config::Lookup("tcp_server.hot_restart_timeout", (uint64_t)(10 * 1000),
+                   "tcp server wait time for the new process to take over "
+                   "the listeners");
+static ConfigVar<uint64_t>::ptr g_tcp_server_drain_timeout =
+    Config::Lookup("tcp_server.drain_timeout", (uint64_t)(30 * 1000),
+                   "tcp server wait time for live connections after stop");
+
+// 一条SCM_RIGHTS消息最多携带的fd数(内核的SCM_MAX_FD)
+static constexpr size_t kMaxHandoffFds = 253;
+
+// 新进程开始accept后发给旧进程的确认
+static constexpr char kHandoffReady = 'R';
+
+/**
+ * @brief 连接上最后一次收发数据距今的时间，取自内核的TCP_INFO，
+ * 不需要在每次读写时记录；非TCP连接返回0，即永不回收
+ */
+static auto GetIdleTime(const Socket::ptr &client) -> uint64_t {
+    tcp_info info{};
+    socklen_t len = sizeof(info);
+    if (getsockopt(client->GetSocket(), IPPROTO_TCP, TCP_INFO, &info, &len) !=
+        0) {
+        return 0;
+    }
+    return std::min(info.tcpi_last_data_recv, info.tcpi_last_data_sent);
+}
+
+/**
+ * @brief 对端的IP(不含端口)，用于单IP连接数限制
+ */
+static auto PeerIp(const Socket::ptr &client) -> std::string {
+    Address::ptr remote = client->GetRemoteAddress();
+    if (remote == nullptr) {
+        return "";
+    }
+    char buf[INET6_ADDRSTRLEN] = {0};
+    const sockaddr *addr = remote->GetConstAddr();
+    if (addr->sa_family == AF_INET) {
+        inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in *>(addr)->sin_addr,
+                  buf, sizeof(buf));
+    } else if (addr->sa_family == AF_INET6) {
+        inet_ntop(AF_INET6,
+                  &reinterpret_cast<const sockaddr_in6 *>(addr)->sin6_addr, buf,
+                  sizeof(buf));
+    } else {
+        return remote->ToString();
+    }
+    return buf;
+}
 
 TcpServer::TcpServer()
-    : m_name("wtsclwq/1.0"), m_type("TCP"), m_is_stop(true), m_recv_timeout(),
-      m_worker(IOManager::GetThisThreadIOManager()),
-      m_acceptor(IOManager::GetThisThreadIOManager()) {}
+    : TcpServer(IOManager::GetThisThreadIOManager(),
+                IOManager::GetThisThreadIOManager()) {}
 
 TcpServer::TcpServer(IOManager *worker, IOManager *acceptor)
-    : m_name("wtsclwq/1.0"), m_type("TCP"), m_is_stop(true), m_recv_timeout(),
-      m_worker(worker), m_acceptor(acceptor) {}
+    : TcpServer(std::vector<IOManager *>{worker}, acceptor) {}
+
+TcpServer::TcpServer(const std::vector<IOManager *> &workers,
+                     IOManager *acceptor)
+    : m_name("wtsclwq/1.0"), m_type("TCP"), m_is_stop(true),
+      m_worker(workers.front()), m_acceptor(acceptor),
+      m_recv_timeout(g_tcp_server_read_timeout->GetValue()),
+      m_reuseport_listeners(g_tcp_server_reuseport_listeners->GetValue()),
+      m_profile_name(g_tcp_server_profile->GetValue()),
+      m_profile(SocketProfile::Get(m_profile_name)),
+      m_workers(workers),
+      m_worker_connections(
+          std::make_unique<std::atomic_size_t[]>(workers.size())),
+      m_max_connections(g_tcp_server_max_connections->GetValue()),
+      m_max_connections_per_ip(g_tcp_server_max_connections_per_ip->GetValue()),
+      m_drain_timeout(g_tcp_server_drain_timeout->GetValue()),
+      m_idle_timeout(g_tcp_server_idle_timeout->GetValue()),
+      m_ssl_handshake_timeout(g_tcp_server_ssl_handshake_timeout->GetValue()) {}
 
 TcpServer::~TcpServer() {
     for (auto &i : m_sockets) {
@@ -38,25 +138,50 @@ auto TcpServer::Bind(const Address::ptr &address) -> bool {
 
 auto TcpServer::BindVec(const std::vector<Address::ptr> &address_vec,
                         std::vector<Address::ptr> &fails_vec) -> bool {
+    size_t listeners = m_reuseport_listeners;
+    if (listeners == 0) {
+        listeners = std::max<size_t>(m_acceptor->GetPoolThreadIds().size(), 1);
+    }
+    bool reuseport = listeners > 1;
     for (auto &addr : address_vec) {
-        // 服务端socket，用来监听连接
-        Socket::ptr socket = Socket::CreateTcpSocket(addr);
-        if (!socket->Bind(addr)) {
-            LOG_CUSTOM_ERROR(sys_logger,
-                             "bind fail errno = %d, errstr = %s, addr = [%s]",
-                             errno, strerror(errno), addr->ToString().c_str())
-            fails_vec.push_back(addr);
-            continue;
-        }
-        if (!socket->Listen(SOMAXCONN)) {
-            LOG_CUSTOM_ERROR(sys_logger,
-                             "listen fail errno = %d, errstr = %s, addr = [%s]",
-                             errno, strerror(errno), addr->ToString().c_str())
-            fails_vec.push_back(addr);
-            continue;
+        // 绑定端口0时由第一个socket拿到实际端口，其余socket绑定同一个端口
+        Address::ptr bind_addr = addr;
+        for (size_t i = 0; i < listeners; ++i) {
+            // 服务端socket，用来监听连接
+            Socket::ptr socket = Socket::CreateTcpSocket(bind_addr);
+            if (m_ssl_ctx) {
+                SslSocket::ptr ssl_socket =
+                    SslSocket::CreateTcpSslSocket(bind_addr);
+                ssl_socket->SetContext(m_ssl_ctx);
+                socket = ssl_socket;
+            }
+            if ((reuseport && !socket->SetReusePort(true)) ||
+                !socket->Bind(bind_addr)) {
+                LOG_CUSTOM_ERROR(
+                    sys_logger, "bind fail errno = %d, errstr = %s, addr = [%s]",
+                    errno, strerror(errno), bind_addr->ToString().c_str())
+                fails_vec.push_back(addr);
+                break;
+            }
+            m_profile.ApplyToListener(socket);
+            if (!socket->Listen(SOMAXCONN)) {
+                LOG_CUSTOM_ERROR(
+                    sys_logger,
+                    "listen fail errno = %d, errstr = %s, addr = [%s]", errno,
+                    strerror(errno), bind_addr->ToString().c_str())
+                fails_vec.push_back(addr);
+                break;
+            }
+            // 在未开启hook的线程上(比如main)创建的socket不在fd管理器中，
+            // acceptor上的accept会直接阻塞线程，这里补登记
+            FileDescriptorManager::GetInstancePtr()->Get(socket->GetSocket(),
+                                                         true);
+            if (i == 0 && reuseport) {
+                bind_addr = socket->GetLocalAddress();
+            }
+            // 没有错误的socket可以被加入到监听列表中
+            m_sockets.push_back(socket);
         }
-        // 没有错误的socket可以被加入到监听列表中
-        m_sockets.push_back(socket);
     }
     // 如果有失败的地址，认为此次bind全部失败
     if (!fails_vec.empty()) {
@@ -77,27 +202,208 @@ auto TcpServer::Start() -> bool {
         return true;
     }
     m_is_stop = false;
+    if (m_idle_timeout != 0 && m_idle_wheels.empty()) {
+        // 每个worker一个时间轮，空闲检测的回调在连接所在的worker上执行
+        uint64_t tick = g_tcp_server_idle_check_interval->GetValue();
+        for (auto *worker : m_workers) {
+            auto wheel = std::make_shared<TimingWheel>(
+                tick, static_cast<size_t>(m_idle_timeout / tick + 1));
+            wheel->Start(worker);
+            m_idle_wheels.push_back(std::move(wheel));
+        }
+    }
+    // accept协程不绑定线程：IO事件就绪后协程由acceptor的任意空闲线程恢复，
+    // 而调度器唤醒的也是任意一个线程，绑定线程的任务要在线程间来回转交，
+    // 实测多个监听socket时每秒连接数下降两个数量级。
+    // 每个监听socket一个accept协程，它们本身就能在不同线程上同时accept
     for (auto &socket : m_sockets) {
         m_acceptor->Schedule([capture0 = shared_from_this(), socket] {
             capture0->StartAccept(socket);
         });
     }
+    if (m_predecessor) {
+        // 监听socket已经交给accept协程，旧进程可以停止accept并排空了
+        m_predecessor->Send(&kHandoffReady, 1, 0);
+        m_predecessor->Close();
+        m_predecessor.reset();
+    }
+    return true;
+}
+
+auto TcpServer::ServeHotRestart(const std::string &path) -> bool {
+    auto address = std::make_shared<UnixAddress>(path);
+    Socket::ptr listener = Socket::CreateUnixTcpSocket();
+    if (!listener->Bind(address) || !listener->Listen(1)) {
+        LOG_CUSTOM_ERROR(sys_logger,
+                         "hot restart listen fail errno = %d, errstr = %s, "
+                         "path = %s",
+                         errno, strerror(errno), path.c_str())
+        return false;
+    }
+    FileDescriptorManager::GetInstancePtr()->Get(listener->GetSocket(), true);
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        m_restart_listener = listener;
+        m_restart_path = path;
+    }
+    m_acceptor->Schedule([capture0 = shared_from_this(), listener] {
+        capture0->HandleHotRestart(listener);
+    });
+    return true;
+}
+
+void TcpServer::HandleHotRestart(const Socket::ptr &listener) {
+    Socket::ptr successor = listener->Accept();
+    if (successor == nullptr) {
+        return;
+    }
+    // 路径让给新进程，它接管后还要在同一路径上等待下一次重启
+    CloseHotRestartListener();
+    std::vector<int> fds;
+    for (auto &socket : m_sockets) {
+        fds.push_back(socket->GetSocket());
+    }
+    successor->SetRecvTimeout(g_tcp_server_hot_restart_timeout->GetValue());
+    char ready = 0;
+    if (fds.size() > kMaxHandoffFds || !successor->SendFds(fds) ||
+        successor->Recv(&ready, 1, 0) != 1 || ready != kHandoffReady) {
+        // 新进程没能接管，继续服务并等待下一次重启
+        LOG_CUSTOM_ERROR(sys_logger,
+                         "hot restart handoff of %zu listeners failed, errno "
+                         "= %d, keep serving",
+                         fds.size(), errno)
+        successor->Close();
+        if (!m_is_stop) {
+            ServeHotRestart(m_restart_path);
+        }
+        return;
+    }
+    successor->Close();
+    LOG_CUSTOM_INFO(sys_logger,
+                    "server %s handed %zu listeners to the new process, "
+                    "draining",
+                    m_name.c_str(), fds.size())
+    Stop();
+}
+
+void TcpServer::CloseHotRestartListener() {
+    Socket::ptr listener{};
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        listener = std::move(m_restart_listener);
+    }
+    if (listener) {
+        listener->CancelAll();
+        listener->Close();
+        FsUtil::Unlink(m_restart_path, true);
+    }
+}
+
+auto TcpServer::InheritListeners(const std::string &path) -> bool {
+    auto address = std::make_shared<UnixAddress>(path);
+    Socket::ptr predecessor = Socket::CreateUnixTcpSocket();
+    uint64_t timeout = g_tcp_server_hot_restart_timeout->GetValue();
+    if (!predecessor->Connect(address, timeout)) {
+        return false;
+    }
+    predecessor->SetRecvTimeout(timeout);
+    std::vector<int> fds;
+    if (!predecessor->RecvFds(fds, kMaxHandoffFds)) {
+        LOG_CUSTOM_ERROR(sys_logger,
+                         "hot restart receive listeners fail errno = %d, "
+                         "errstr = %s",
+                         errno, strerror(errno))
+        return false;
+    }
+    std::vector<Socket::ptr> sockets;
+    for (int fd : fds) {
+        Socket::ptr socket = m_ssl_ctx
+                                 ? SslSocket::CreateFromListenFd(fd, m_ssl_ctx)
+                                 : Socket::CreateFromListenFd(fd);
+        if (socket == nullptr) {
+            ::close(fd);
+            continue;
+        }
+        LOG_CUSTOM_INFO(sys_logger,
+                        "type = %s, name = %s, server inherit listener: %s",
+                        m_type.c_str(), m_name.c_str(),
+                        socket->ToString().c_str())
+        sockets.push_back(std::move(socket));
+    }
+    if (sockets.empty()) {
+        return false;
+    }
+    m_sockets.insert(m_sockets.end(), sockets.begin(), sockets.end());
+    m_predecessor = predecessor;
     return true;
 }
 
 void TcpServer::StartAccept(const Socket::ptr &socket) {
-    while (!m_is_stop) {
+    // 先占名额再accept：达到上限时不再accept，由内核的backlog承担背压
+    while (AcquireSlot()) {
         Socket::ptr client = socket->Accept();
-        if (client != nullptr) {
+        if (client == nullptr) {
+            ReleaseSlot();
+            if (!m_is_stop) {
+                LOG_CUSTOM_ERROR(sys_logger, "accept error = %d, errstr = %s",
+                                 errno, strerror(errno))
+            }
+            continue;
+        }
+        size_t index = SelectWorker();
+        if (!AddConnection(client, index)) {
+            ReleaseSlot();
+            client->Close();
+            continue;
+        }
+        m_profile.ApplyToConnection(client);
+        // 开启空闲回收时由时间轮代替每次阻塞读都要创建的超时定时器
+        if (m_idle_timeout == 0) {
             client->SetRecvTimeout(m_recv_timeout);
-            m_worker->Schedule([capture0 = shared_from_this(), client] {
-                capture0->HandleClient(client);
+        }
+        // 连接的协程在IO事件就绪后由挂起时的调度器恢复，因此一直留在这个worker上
+        ++m_worker_connections[index];
+        m_workers[index]->Schedule(
+            [capture0 = shared_from_this(), client, index] {
+                if (capture0->Handshake(client)) {
+                    capture0->HandleClient(client);
+                } else {
+                    client->Close();
+                }
+                --capture0->m_worker_connections[index];
+                capture0->RemoveConnection(client);
             });
-        } else {
-            LOG_CUSTOM_ERROR(sys_logger, "accept error = %d, errstr = %s",
-                             errno, strerror(errno))
+    }
+}
+
+auto TcpServer::SelectWorker() -> size_t {
+    size_t count = m_workers.size();
+    if (count == 1) {
+        return 0;
+    }
+    size_t start = m_next_worker++ % count;
+    size_t best = start;
+    size_t best_load = m_worker_connections[start].load();
+    for (size_t i = 1; i < count && best_load != 0; ++i) {
+        size_t index = (start + i) % count;
+        size_t load = m_worker_connections[index].load();
+        if (load < best_load) {
+            best = index;
+            best_load = load;
         }
     }
+    return best;
+}
+
+auto TcpServer::Handshake(const Socket::ptr &client) -> bool {
+    auto ssl_client = std::dynamic_pointer_cast<SslSocket>(client);
+    if (ssl_client == nullptr ||
+        ssl_client->Handshake(m_ssl_handshake_timeout)) {
+        return true;
+    }
+    LOG_CUSTOM_INFO(sys_logger, "ssl handshake fail errno = %d, client = %s",
+                    errno, client->ToString().c_str())
+    return false;
 }
 
 void TcpServer::HandleClient(const Socket::ptr &client) {
@@ -105,23 +411,181 @@ void TcpServer::HandleClient(const Socket::ptr &client) {
 }
 
 void TcpServer::Stop() {
-    m_is_stop = true;
+    std::list<AcceptWaiter> waiters;
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        m_is_stop = true;
+        waiters.swap(m_accept_waiters);
+    }
+    for (auto &waiter : waiters) {
+        waiter.scheduler->Schedule(std::move(waiter.fiber), waiter.thread_id);
+    }
     auto self = shared_from_this();
     m_acceptor->Schedule([this, self]() {
+        CloseHotRestartListener();
         for (auto &socket : m_sockets) {
             socket->CancelAll();
             socket->Close();
         }
         m_sockets.clear();
+        for (auto &wheel : m_idle_wheels) {
+            wheel->Stop();
+        }
+        StartDrain();
     });
 }
 
+auto TcpServer::AcquireSlot() -> bool {
+    while (true) {
+        {
+            ScopedLock<MutexType> lock(m_mutex);
+            if (m_is_stop) {
+                return false;
+            }
+            if (m_max_connections == 0 || m_slot_count < m_max_connections) {
+                ++m_slot_count;
+                return true;
+            }
+            m_accept_waiters.push_back({Fiber::GetCurFiber(),
+                                        Scheduler::GetThisThreadScheduler(),
+                                        GetThreadId()});
+        }
+        Fiber::GetCurFiber()->Yield();
+    }
+}
+
+void TcpServer::ReleaseSlot() {
+    AcceptWaiter waiter{};
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        --m_slot_count;
+        if (m_accept_waiters.empty()) {
+            return;
+        }
+        waiter = std::move(m_accept_waiters.front());
+        m_accept_waiters.pop_front();
+    }
+    // 绑定回挂起的线程恢复，保证恢复时协程已经完成Yield
+    waiter.scheduler->Schedule(std::move(waiter.fiber), waiter.thread_id);
+}
+
+auto TcpServer::AddConnection(const Socket::ptr &client, size_t worker)
+    -> bool {
+    std::string ip = PeerIp(client);
+    ScopedLock<MutexType> lock(m_mutex);
+    size_t &count = m_ip_connections[ip];
+    if (m_max_connections_per_ip != 0 && count >= m_max_connections_per_ip) {
+        if (count == 0) {
+            m_ip_connections.erase(ip);
+        }
+        LOG_CUSTOM_WARN(sys_logger, "too many connections from %s, limit = %zu",
+                        ip.c_str(), m_max_connections_per_ip)
+        return false;
+    }
+    ++count;
+    ConnectionInfo &info = m_clients[client];
+    info.ip = std::move(ip);
+    if (!m_idle_wheels.empty()) {
+        uint64_t timeout = m_idle_timeout;
+        std::weak_ptr<Socket> weak_client = client;
+        info.idle_entry = m_idle_wheels[worker]->Add(
+            timeout, [weak_client, timeout]() -> uint64_t {
+                auto client = weak_client.lock();
+                if (!client || !client->IsConnected()) {
+                    return 0;
+                }
+                uint64_t idle = GetIdleTime(client);
+                if (idle < timeout) {
+                    // 期间有过收发，按最后一次收发的时间重新计算到期时间
+                    return timeout - idle;
+                }
+                LOG_CUSTOM_INFO(sys_logger, "reap idle connection %s",
+                                client->ToString().c_str())
+                ::shutdown(client->GetSocket(), SHUT_RDWR);
+                return 0;
+            });
+    }
+    return true;
+}
+
+void TcpServer::RemoveConnection(const Socket::ptr &client) {
+    Timer::ptr drain_timer{};
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        auto iter = m_clients.find(client);
+        if (iter == m_clients.end()) {
+            return;
+        }
+        if (iter->second.idle_entry) {
+            iter->second.idle_entry->Cancel();
+        }
+        auto ip_iter = m_ip_connections.find(iter->second.ip);
+        if (--ip_iter->second == 0) {
+            m_ip_connections.erase(ip_iter);
+        }
+        m_clients.erase(iter);
+        if (m_clients.empty() && m_drain_timer) {
+            // 排空完成，不必再等超时
+            drain_timer = std::move(m_drain_timer);
+        }
+    }
+    if (drain_timer) {
+        drain_timer->Cancel();
+    }
+    ReleaseSlot();
+}
+
+void TcpServer::StartDrain() {
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        if (m_clients.empty()) {
+            return;
+        }
+        LOG_CUSTOM_INFO(sys_logger, "server %s draining %zu connections",
+                        m_name.c_str(), m_clients.size())
+        if (m_drain_timeout != 0) {
+            std::weak_ptr<TcpServer> weak_self = shared_from_this();
+            m_drain_timer = m_acceptor->AddTimer(m_drain_timeout, [weak_self]() {
+                if (auto self = weak_self.lock()) {
+                    self->ShutdownConnections();
+                }
+            });
+            return;
+        }
+    }
+    ShutdownConnections();
+}
+
+void TcpServer::ShutdownConnections() {
+    std::vector<Socket::ptr> clients;
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        m_drain_timer.reset();
+        clients.reserve(m_clients.size());
+        for (auto &[client, info] : m_clients) {
+            clients.push_back(client);
+        }
+    }
+    if (!clients.empty()) {
+        LOG_CUSTOM_WARN(sys_logger, "server %s shutdown %zu connections",
+                        m_name.c_str(), clients.size())
+    }
+    // shutdown而不是close：阻塞在连接上的协程被唤醒后读到EOF，由它自己关闭fd
+    for (auto &client : clients) {
+        ::shutdown(client->GetSocket(), SHUT_RDWR);
+    }
+}
+
 auto TcpServer::ToString(const std::string &prefix) -> std::string {
     std::stringstream ss;
     ss << prefix << "[type=" << m_type << " name=" << m_name
        << " io_worker=" << (m_worker != nullptr ? m_worker->GetName() : "")
+       << " workers=" << m_workers.size()
        << " accept=" << (m_acceptor != nullptr ? m_acceptor->GetName() : "")
-       << " recv_timeout=" << m_recv_timeout << "]" << std::endl;
+       << " recv_timeout=" << m_recv_timeout
+       << " reuseport_listeners=" << m_reuseport_listeners
+       << " profile=" << m_profile_name << " ssl=" << IsSsl() << "]"
+       << std::endl;
     std::string pfx = prefix.empty() ? "    " : prefix;
     for (auto &i : m_sockets) {
         ss << pfx << i->ToString() << std::endl;
@@ -147,4 +611,79 @@ void TcpServer::SetRecvTimeout(uint64_t recv_timeout) {
     m_recv_timeout = recv_timeout;
 }
 
+auto TcpServer::GetWorkerCount() const -> size_t { return m_workers.size(); }
+
+auto TcpServer::GetWorkerConnections(size_t index) const -> size_t {
+    return m_worker_connections[index].load();
+}
+
+auto TcpServer::GetMaxConnections() const -> size_t {
+    return m_max_connections;
+}
+
+void TcpServer::SetMaxConnections(size_t count) {
+    std::list<AcceptWaiter> waiters;
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        m_max_connections = count;
+        waiters.swap(m_accept_waiters);
+    }
+    // 上限可能提高了，让等待的accept协程重新检查
+    for (auto &waiter : waiters) {
+        waiter.scheduler->Schedule(std::move(waiter.fiber), waiter.thread_id);
+    }
+}
+
+auto TcpServer::GetMaxConnectionsPerIp() const -> size_t {
+    return m_max_connections_per_ip;
+}
+
+void TcpServer::SetMaxConnectionsPerIp(size_t count) {
+    m_max_connections_per_ip = count;
+}
+
+auto TcpServer::GetDrainTimeout() const -> uint64_t { return m_drain_timeout; }
+
+void TcpServer::SetDrainTimeout(uint64_t timeout) { m_drain_timeout = timeout; }
+
+auto TcpServer::GetIdleTimeout() const -> uint64_t { return m_idle_timeout; }
+
+void TcpServer::SetIdleTimeout(uint64_t timeout) { m_idle_timeout = timeout; }
+
+auto TcpServer::GetActiveConnections() -> size_t {
+    ScopedLock<MutexType> lock(m_mutex);
+    return m_clients.size();
+}
+
+auto TcpServer::GetProfile() const -> const std::string & {
+    return m_profile_name;
+}
+
+void TcpServer::SetProfile(const std::string &name) {
+    m_profile_name = name;
+    m_profile = SocketProfile::Get(name);
+}
+
+auto TcpServer::LoadCertificates(const std::string &cert_file,
+                                 const std::string &key_file) -> bool {
+    m_ssl_ctx = SslSocket::CreateServerContext(cert_file, key_file);
+    return m_ssl_ctx != nullptr;
+}
+
+auto TcpServer::IsSsl() const -> bool { return m_ssl_ctx != nullptr; }
+
+auto TcpServer::GetSslSessionStats() const -> SslSessionStats {
+    SslSessionManager *manager =
+        m_ssl_ctx ? SslSessionManager::Get(m_ssl_ctx.get()) : nullptr;
+    return manager != nullptr ? manager->GetStats() : SslSessionStats{};
+}
+
+auto TcpServer::GetReusePortListeners() const -> size_t {
+    return m_reuseport_listeners;
+}
+
+void TcpServer::SetReusePortListeners(size_t count) {
+    m_reuseport_listeners = count;
+}
+
 }  // namespace wtsclwq
\ No newline at end of file
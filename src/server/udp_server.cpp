@@ -0,0 +1,298 @@
+//
+// 批量收发的UDP服务器
+//
+#include "../include/server/udp_server.h"
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "../include/config/config.h"
+#include "../include/io/fd_manager.h"
+#include "../include/io/hook.h"
+#include "../include/log/log_manager.h"
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace wtsclwq {
+static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+static ConfigVar<size_t>::ptr g_udp_server_batch_size =
+    Config::Lookup("udp_server.batch_size", (size_t)64,
+                   "udp server max datagrams per recvmmsg/sendmmsg");
+static ConfigVar<size_t>::ptr g_udp_server_max_datagram_size =
+    Config::Lookup("udp_server.max_datagram_size", (size_t)2048,
+                   "udp server receive buffer per datagram, longer datagrams "
+                   "are dropped");
+static ConfigVar<bool>::ptr g_udp_server_gso = Config::Lookup(
+    "udp_server.gso", true, "udp server coalesce replies with UDP_SEGMENT");
+
+// 内核限制一条GSO消息最多64个分段，总长度不超过一个UDP数据报
+static constexpr size_t kMaxGsoSegments = 64;
+static constexpr size_t kMaxGsoBytes = 65507;
+
+UdpServer::UdpServer(IOManager *worker, IOManager *receiver)
+    : m_worker(worker), m_receiver(receiver),
+      m_batch_size(std::max<size_t>(g_udp_server_batch_size->GetValue(), 1)),
+      m_max_size(
+          std::max<size_t>(g_udp_server_max_datagram_size->GetValue(), 1)) {}
+
+UdpServer::~UdpServer() {
+    if (m_socket) {
+        m_socket->Close();
+    }
+}
+
+auto UdpServer::Bind(const Address::ptr &address) -> bool {
+    Socket::ptr socket = Socket::CreateUdpSocket(address);
+    if (!socket->Bind(address)) {
+        LOG_CUSTOM_ERROR(sys_logger,
+                         "udp bind fail errno = %d, errstr = %s, addr = [%s]",
+                         errno, strerror(errno), address->ToString().c_str())
+        return false;
+    }
+    // 和TcpServer一样，在未开启hook的线程上创建的socket需要补登记
+    FileDescriptorManager::GetInstancePtr()->Get(socket->GetSocket(), true);
+    // 用per-socket的UDP_SEGMENT=0探测内核是否支持GSO，实际分段大小随消息设置
+    m_gso = g_udp_server_gso->GetValue() &&
+            socket->SetOption(SOL_UDP, UDP_SEGMENT, 0);
+    m_socket = socket;
+    LOG_CUSTOM_INFO(sys_logger, "udp server bind success: %s, gso = %d",
+                    m_socket->ToString().c_str(), m_gso.load())
+    return true;
+}
+
+auto UdpServer::Start() -> bool {
+    if (!m_is_stop) {
+        return true;
+    }
+    if (!m_socket) {
+        return false;
+    }
+    m_is_stop = false;
+    m_receiver->Schedule(
+        [capture0 = shared_from_this()] { capture0->RecvLoop(); });
+    return true;
+}
+
+void UdpServer::Stop() {
+    m_is_stop = true;
+    auto self = shared_from_this();
+    m_receiver->Schedule([this, self]() {
+        if (m_socket) {
+            m_socket->CancelAll();
+            m_socket->Close();
+        }
+    });
+}
+
+auto UdpServer::GetSocket() const -> Socket::ptr { return m_socket; }
+
+auto UdpServer::IsGsoEnabled() const -> bool { return m_gso; }
+
+auto UdpServer::GetRecvCount() const -> uint64_t { return m_recv_count; }
+
+auto UdpServer::GetSendCount() const -> uint64_t { return m_send_count; }
+
+auto UdpServer::HandleDatagram(const Datagram &request, std::string &reply)
+    -> bool {
+    // 默认原样回显
+    reply.assign(request.data, request.length);
+    return true;
+}
+
+void UdpServer::RecvLoop() {
+    int fd = m_socket->GetSocket();
+    while (!m_is_stop) {
+        Batch::ptr batch = AcquireBatch();
+        // 没有数据时由hook挂起协程；MSG_WAITFORONE在读到第一个数据报后不再等待，
+        // 只带走已经到达的部分
+        int count = recvmmsg(fd, batch->recv_msgs.data(),
+                             static_cast<unsigned int>(m_batch_size),
+                             MSG_WAITFORONE, nullptr);
+        if (count <= 0) {
+            ReleaseBatch(std::move(batch));
+            if (m_is_stop || errno == EBADF) {
+                break;
+            }
+            LOG_CUSTOM_ERROR(sys_logger, "recvmmsg error = %d, errstr = %s",
+                             errno, strerror(errno))
+            continue;
+        }
+        batch->count = static_cast<size_t>(count);
+        m_recv_count += batch->count;
+        // 整批交给一个协程，调度开销按批摊薄
+        m_worker->Schedule([capture0 = shared_from_this(), batch] {
+            capture0->HandleBatch(batch);
+        });
+    }
+}
+
+void UdpServer::HandleBatch(const Batch::ptr &batch) {
+    batch->reply_count = 0;
+    for (size_t i = 0; i < batch->count; ++i) {
+        const msghdr &hdr = batch->recv_msgs[i].msg_hdr;
+        if ((hdr.msg_flags & MSG_TRUNC) != 0) {
+            LOG_CUSTOM_WARN(sys_logger,
+                            "drop truncated datagram, max_datagram_size = %zu",
+                            m_max_size)
+            continue;
+        }
+        Datagram request{};
+        request.data = static_cast<const char *>(batch->recv_iovs[i].iov_base);
+        request.length = batch->recv_msgs[i].msg_len;
+        request.peer = reinterpret_cast<const sockaddr *>(&batch->peers[i]);
+        request.peer_len = hdr.msg_namelen;
+        Reply &reply = batch->replies[batch->reply_count];
+        reply.data.clear();
+        if (HandleDatagram(request, reply.data)) {
+            reply.peer = request.peer;
+            reply.peer_len = request.peer_len;
+            ++batch->reply_count;
+        }
+    }
+    if (batch->reply_count != 0) {
+        SendReplies(*batch);
+    }
+    ReleaseBatch(batch);
+}
+
+void UdpServer::SendReplies(Batch &batch) {
+    int fd = m_socket->GetSocket();
+    size_t count = BuildMessages(batch, 0, m_gso);
+    size_t sent = 0;
+    while (sent < count) {
+        int result = sendmmsg(fd, batch.send_msgs.data() + sent,
+                              static_cast<unsigned int>(count - sent), 0);
+        if (result > 0) {
+            for (int i = 0; i < result; ++i, ++sent) {
+                size_t end = sent + 1 < count ? batch.first_reply[sent + 1]
+                                              : batch.reply_count;
+                m_send_count += end - batch.first_reply[sent];
+            }
+            continue;
+        }
+        if (m_is_stop || errno == EBADF) {
+            return;
+        }
+        const msghdr &failed = batch.send_msgs[sent].msg_hdr;
+        if (failed.msg_controllen != 0) {
+            // 网卡不支持校验和卸载时返回EIO，此后不再使用GSO；
+            // 分段超过路径MTU时返回EINVAL，只对这一批退回逐个发送
+            if (errno == EIO) {
+                LOG_CUSTOM_WARN(sys_logger,
+                                "udp gso send error = %d, disable gso", errno)
+                m_gso = false;
+            }
+            size_t from = batch.first_reply[sent];
+            count = sent + BuildMessages(batch, from, false, sent);
+            continue;
+        }
+        LOG_CUSTOM_ERROR(sys_logger, "sendmmsg error = %d, errstr = %s", errno,
+                         strerror(errno))
+        // 跳过发送失败的这条消息
+        ++sent;
+    }
+}
+
+auto UdpServer::BuildMessages(Batch &batch, size_t from, bool gso,
+                              size_t offset) -> size_t {
+    size_t msg = offset;
+    size_t i = from;
+    while (i < batch.reply_count) {
+        const Reply &first = batch.replies[i];
+        size_t segment = first.data.size();
+        size_t end = i + 1;
+        size_t total = segment;
+        if (gso && segment != 0) {
+            // 同一对端的连续回复，除最后一个外长度都必须等于分段大小
+            while (end < batch.reply_count && end - i < kMaxGsoSegments) {
+                const Reply &next = batch.replies[end];
+                if (next.peer_len != first.peer_len ||
+                    memcmp(next.peer, first.peer, first.peer_len) != 0 ||
+                    next.data.size() > segment || next.data.empty() ||
+                    total + next.data.size() > kMaxGsoBytes) {
+                    break;
+                }
+                total += next.data.size();
+                ++end;
+                if (next.data.size() < segment) {
+                    break;
+                }
+            }
+        }
+        for (size_t j = i; j < end; ++j) {
+            batch.send_iovs[j].iov_base =
+                const_cast<char *>(batch.replies[j].data.data());
+            batch.send_iovs[j].iov_len = batch.replies[j].data.size();
+        }
+        msghdr &hdr = batch.send_msgs[msg].msg_hdr;
+        hdr.msg_name = const_cast<sockaddr *>(first.peer);
+        hdr.msg_namelen = first.peer_len;
+        hdr.msg_iov = &batch.send_iovs[i];
+        hdr.msg_iovlen = end - i;
+        hdr.msg_control = nullptr;
+        hdr.msg_controllen = 0;
+        hdr.msg_flags = 0;
+        if (end - i > 1) {
+            hdr.msg_control = batch.controls[msg].buf;
+            hdr.msg_controllen = sizeof(batch.controls[msg].buf);
+            cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            auto gso_size = static_cast<uint16_t>(segment);
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+        batch.first_reply[msg] = i;
+        ++msg;
+        i = end;
+    }
+    return msg - offset;
+}
+
+auto UdpServer::AcquireBatch() -> Batch::ptr {
+    Batch::ptr batch{};
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        if (!m_free_batches.empty()) {
+            batch = std::move(m_free_batches.back());
+            m_free_batches.pop_back();
+        }
+    }
+    if (!batch) {
+        batch = std::make_shared<Batch>();
+        batch->buffer = std::make_unique<char[]>(m_batch_size * m_max_size);
+        batch->recv_msgs.resize(m_batch_size);
+        batch->recv_iovs.resize(m_batch_size);
+        batch->peers.resize(m_batch_size);
+        batch->replies.resize(m_batch_size);
+        batch->send_msgs.resize(m_batch_size);
+        batch->send_iovs.resize(m_batch_size);
+        batch->controls.resize(m_batch_size);
+        batch->first_reply.resize(m_batch_size);
+    }
+    // recvmmsg会改写地址长度和标志，每次使用前重置
+    for (size_t i = 0; i < m_batch_size; ++i) {
+        batch->recv_iovs[i].iov_base = batch->buffer.get() + i * m_max_size;
+        batch->recv_iovs[i].iov_len = m_max_size;
+        msghdr &hdr = batch->recv_msgs[i].msg_hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_name = &batch->peers[i];
+        hdr.msg_namelen = sizeof(sockaddr_storage);
+        hdr.msg_iov = &batch->recv_iovs[i];
+        hdr.msg_iovlen = 1;
+        batch->recv_msgs[i].msg_len = 0;
+    }
+    batch->count = 0;
+    return batch;
+}
+
+void UdpServer::ReleaseBatch(Batch::ptr batch) {
+    ScopedLock<MutexType> lock(m_mutex);
+    m_free_batches.push_back(std::move(batch));
+}
+}  // namespace wtsclwq
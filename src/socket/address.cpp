@@ -8,6 +8,7 @@
 #include <libnet.h>
 
 #include "../include/log/log_manager.h"
+#include "../include/socket/dns_resolver.h"
 #include "../include/socket/ipv4_address.h"
 #include "../include/socket/ipv6_address.h"
 #include "../include/socket/unix_address.h"
@@ -38,6 +39,29 @@ auto Address::Create(const sockaddr *addr, socklen_t addrlen) -> Address::ptr {
     return result;
 }
 
+/**
+ * @brief node是否是数字形式的IPv4/IPv6地址
+ */
+static auto IsNumericHost(const std::string &node) -> bool {
+    in6_addr buf{};
+    // IPv6地址可能带有%scope后缀，这里只用于区分域名，不需要精确
+    return inet_pton(AF_INET, node.c_str(), &buf) == 1 ||
+           inet_pton(AF_INET6, node.c_str(), &buf) == 1 ||
+           node.find(':') != std::string::npos;
+}
+
+static auto IsNumericService(const char *service) -> bool {
+    if (*service == '\0') {
+        return false;
+    }
+    for (const char *chr = service; *chr != '\0'; ++chr) {
+        if (isdigit(static_cast<unsigned char>(*chr)) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 auto Address::Lookup(std::vector<Address::ptr> &result, const std::string &host,
                      int family, int type, int protocol) -> bool {
     addrinfo hints{};
@@ -85,12 +109,36 @@ auto Address::Lookup(std::vector<Address::ptr> &result, const std::string &host,
         node = host;
     }
 
+    // 域名交给协程友好的解析器，只挂起当前协程且结果按TTL缓存；
+    // 数字地址、服务名以及解析器无法处理的情况仍然使用getaddrinfo
+    if (!IsNumericHost(node) &&
+        (service == nullptr || IsNumericService(service))) {
+        std::vector<IPAddress::ptr> addrs;
+        auto status =
+            DnsResolver::GetInstancePtr()->Resolve(addrs, node, family);
+        if (status == DnsResolverImpl::Status::OK) {
+            auto port = static_cast<uint16_t>(
+                service == nullptr ? 0 : strtoul(service, nullptr, 10));
+            for (auto &addr : addrs) {
+                addr->SetPort(port);
+                result.push_back(addr);
+            }
+            return true;
+        }
+        if (status == DnsResolverImpl::Status::NOT_FOUND) {
+            LOG_CUSTOM_ERROR(sys_logger, "Address::Lookup(%s, %d) not found",
+                             host.c_str(), family);
+            return false;
+        }
+    }
+
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if (error != 0) {
         LOG_CUSTOM_ERROR(
             sys_logger,
             "Address::Lookup getaddress(%s, %d, %d) err = %d, errstr = %s",
             host.c_str(), family, type, error, gai_strerror(error));
+        return false;
     }
 
     // 同一个域名可能会包含多个服务器地址信息
@@ -0,0 +1,606 @@
+//
+// 协程友好的DNS解析器
+//
+#include "../include/socket/dns_resolver.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+
+#include "../include/concurrency/lock.h"
+#include "../include/config/config.h"
+#include "../include/log/log_manager.h"
+#include "../include/socket/ipv4_address.h"
+#include "../include/socket/ipv6_address.h"
+#include "../include/util/time_util.h"
+
+namespace wtsclwq {
+static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+
+static ConfigVar<bool>::ptr g_dns_enable = Config::Lookup(
+    "dns.resolver.enable", false,
+    "是否使用协程友好的DNS解析器,关闭后Address::Lookup直接使用getaddrinfo");
+
+static ConfigVar<std::vector<std::string>>::ptr g_dns_servers =
+    Config::Lookup("dns.resolver.servers", std::vector<std::string>{},
+                   "nameserver列表(ip[:port]),为空时读取/etc/resolv.conf");
+
+static ConfigVar<int>::ptr g_dns_timeout = Config::Lookup(
+    "dns.resolver.timeout", 2000, "等待单个nameserver应答的超时时间(ms)");
+
+static ConfigVar<int>::ptr g_dns_max_ttl = Config::Lookup(
+    "dns.cache.max_ttl", 3600, "正缓存记录的最长有效期(s)");
+
+static ConfigVar<int>::ptr g_dns_negative_ttl = Config::Lookup(
+    "dns.cache.negative_ttl", 30,
+    "应答中没有SOA记录时,负缓存记录的有效期(s)");
+
+static ConfigVar<int>::ptr g_dns_max_entries =
+    Config::Lookup("dns.cache.max_entries", 10000, "缓存记录数上限");
+
+static const uint16_t DNS_PORT = 53;
+static const uint16_t DNS_TYPE_A = 1;
+static const uint16_t DNS_TYPE_SOA = 6;
+static const uint16_t DNS_TYPE_AAAA = 28;
+static const uint16_t DNS_CLASS_IN = 1;
+static const uint16_t DNS_FLAG_QR = 0x8000;
+static const uint16_t DNS_FLAG_TC = 0x0200;
+static const uint16_t DNS_FLAG_RD = 0x0100;
+static const uint16_t DNS_RCODE_MASK = 0x000f;
+static const uint16_t DNS_RCODE_NXDOMAIN = 3;
+static const size_t DNS_HEADER_SIZE = 12;
+static const size_t DNS_MAX_UDP_SIZE = 512;
+static const size_t DNS_MAX_NAME_SIZE = 255;
+static const size_t DNS_MAX_LABEL_SIZE = 63;
+
+static auto ReadUint16(const uint8_t *data) -> uint16_t {
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+static auto ReadUint32(const uint8_t *data) -> uint32_t {
+    return (static_cast<uint32_t>(data[0]) << 24) |
+           (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+static void WriteUint16(std::string &out, uint16_t val) {
+    out.push_back(static_cast<char>(val >> 8));
+    out.push_back(static_cast<char>(val & 0xff));
+}
+
+/**
+ * @brief 构造一个查询报文
+ * @return 域名不合法时返回false
+ */
+static auto EncodeQuery(std::string &out, uint16_t id, const std::string &name,
+                        uint16_t qtype) -> bool {
+    out.clear();
+    WriteUint16(out, id);
+    WriteUint16(out, DNS_FLAG_RD);
+    WriteUint16(out, 1);  // QDCOUNT
+    WriteUint16(out, 0);  // ANCOUNT
+    WriteUint16(out, 0);  // NSCOUNT
+    WriteUint16(out, 0);  // ARCOUNT
+    size_t begin = 0;
+    while (begin < name.size()) {
+        size_t end = name.find('.', begin);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        size_t label_size = end - begin;
+        if (label_size == 0 || label_size > DNS_MAX_LABEL_SIZE) {
+            return false;
+        }
+        out.push_back(static_cast<char>(label_size));
+        out.append(name, begin, label_size);
+        begin = end + 1;
+    }
+    out.push_back('\0');
+    if (out.size() - DNS_HEADER_SIZE > DNS_MAX_NAME_SIZE) {
+        return false;
+    }
+    WriteUint16(out, qtype);
+    WriteUint16(out, DNS_CLASS_IN);
+    return true;
+}
+
+/**
+ * @brief 跳过报文中pos处的一个域名(可能包含压缩指针)
+ */
+static auto SkipName(const uint8_t *msg, size_t len, size_t &pos) -> bool {
+    while (pos < len) {
+        uint8_t label = msg[pos];
+        if (label == 0) {
+            ++pos;
+            return true;
+        }
+        // 压缩指针占两个字节，且总是域名的结尾
+        if ((label & 0xc0) == 0xc0) {
+            pos += 2;
+            return pos <= len;
+        }
+        pos += label + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief 读出报文中pos处的域名并转成小写，pos移动到域名之后
+ */
+static auto ReadName(const uint8_t *msg, size_t len, size_t &pos,
+                     std::string &name) -> bool {
+    name.clear();
+    size_t cursor = pos;
+    bool jumped = false;
+    // 限制跳转次数，防止压缩指针成环
+    for (int jumps = 0; cursor < len && jumps < 32;) {
+        uint8_t label = msg[cursor];
+        if (label == 0) {
+            if (!jumped) {
+                pos = cursor + 1;
+            }
+            return true;
+        }
+        if ((label & 0xc0) == 0xc0) {
+            if (cursor + 2 > len) {
+                return false;
+            }
+            if (!jumped) {
+                pos = cursor + 2;
+            }
+            jumped = true;
+            cursor = ((label & 0x3f) << 8) | msg[cursor + 1];
+            ++jumps;
+            continue;
+        }
+        if (label > DNS_MAX_LABEL_SIZE || cursor + 1 + label > len ||
+            name.size() + label + 1 > DNS_MAX_NAME_SIZE) {
+            return false;
+        }
+        if (!name.empty()) {
+            name.push_back('.');
+        }
+        for (size_t i = cursor + 1; i <= cursor + label; ++i) {
+            name.push_back(static_cast<char>(std::tolower(msg[i])));
+        }
+        cursor += label + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief 解析应答报文，填充question的状态、地址和TTL
+ * @param[in] name 查询的域名(小写，不带结尾的'.')
+ * @return 报文不属于该问题或格式错误时返回false
+ */
+static auto ParseResponse(const uint8_t *msg, size_t len,
+                          const std::string &name, uint16_t qtype,
+                          std::vector<IPAddress::ptr> &addrs, uint32_t &ttl,
+                          DnsResolverImpl::Status &status) -> bool {
+    if (len < DNS_HEADER_SIZE) {
+        return false;
+    }
+    uint16_t flags = ReadUint16(msg + 2);
+    uint16_t qdcount = ReadUint16(msg + 4);
+    uint16_t ancount = ReadUint16(msg + 6);
+    uint16_t nscount = ReadUint16(msg + 8);
+    if ((flags & DNS_FLAG_QR) == 0) {
+        return false;
+    }
+    // 查询只带一个问题，应答回显的问题必须与之一致(服务器可能改变大小写)
+    if (qdcount != 1) {
+        return false;
+    }
+    size_t pos = DNS_HEADER_SIZE;
+    std::string qname;
+    if (!ReadName(msg, len, pos, qname) || pos + 4 > len ||
+        qname != name || ReadUint16(msg + pos) != qtype ||
+        ReadUint16(msg + pos + 2) != DNS_CLASS_IN) {
+        return false;
+    }
+    pos += 4;
+    // 应答被截断需要改用TCP查询，交给getaddrinfo处理
+    if ((flags & DNS_FLAG_TC) != 0) {
+        status = DnsResolverImpl::Status::FAILED;
+        return true;
+    }
+    uint16_t rcode = flags & DNS_RCODE_MASK;
+    if (rcode != 0 && rcode != DNS_RCODE_NXDOMAIN) {
+        status = DnsResolverImpl::Status::FAILED;
+        return true;
+    }
+
+    uint32_t min_ttl = UINT32_MAX;
+    uint32_t negative_ttl = UINT32_MAX;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(ancount) + nscount; ++i) {
+        if (!SkipName(msg, len, pos) || pos + 10 > len) {
+            return false;
+        }
+        uint16_t type = ReadUint16(msg + pos);
+        uint16_t rclass = ReadUint16(msg + pos + 2);
+        uint32_t record_ttl = ReadUint32(msg + pos + 4);
+        uint16_t rdlength = ReadUint16(msg + pos + 8);
+        pos += 10;
+        if (pos + rdlength > len) {
+            return false;
+        }
+        bool is_answer = i < ancount;
+        if (is_answer && rclass == DNS_CLASS_IN && type == qtype) {
+            // CNAME链上的记录一并出现在应答中，只取请求的类型
+            if (type == DNS_TYPE_A && rdlength == 4) {
+                sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                memcpy(&addr.sin_addr, msg + pos, 4);
+                addrs.push_back(std::make_shared<IPv4Address>(addr));
+                min_ttl = std::min(min_ttl, record_ttl);
+            } else if (type == DNS_TYPE_AAAA && rdlength == 16) {
+                sockaddr_in6 addr{};
+                addr.sin6_family = AF_INET6;
+                memcpy(&addr.sin6_addr, msg + pos, 16);
+                addrs.push_back(std::make_shared<IPv6Address>(addr));
+                min_ttl = std::min(min_ttl, record_ttl);
+            }
+        } else if (!is_answer && type == DNS_TYPE_SOA) {
+            // 负缓存的有效期取SOA记录本身的TTL与MINIMUM字段中的较小者
+            size_t soa_pos = pos;
+            if (SkipName(msg, len, soa_pos) && SkipName(msg, len, soa_pos) &&
+                soa_pos + 20 <= pos + rdlength) {
+                negative_ttl =
+                    std::min(record_ttl, ReadUint32(msg + soa_pos + 16));
+            }
+        }
+        pos += rdlength;
+    }
+    if (!addrs.empty()) {
+        status = DnsResolverImpl::Status::OK;
+        ttl = min_ttl;
+    } else {
+        status = DnsResolverImpl::Status::NOT_FOUND;
+        ttl = negative_ttl != UINT32_MAX
+                  ? negative_ttl
+                  : static_cast<uint32_t>(g_dns_negative_ttl->GetValue());
+    }
+    return true;
+}
+
+static auto ToLower(const std::string &str) -> std::string {
+    std::string result(str);
+    std::transform(result.begin(), result.end(), result.begin(),
+                   [](unsigned char chr) { return std::tolower(chr); });
+    return result;
+}
+
+/**
+ * @brief 拷贝一份地址，缓存中的对象不能交给会修改端口的调用者
+ */
+static auto CloneAddress(const IPAddress::ptr &addr) -> IPAddress::ptr {
+    return std::dynamic_pointer_cast<IPAddress>(
+        Address::Create(addr->GetConstAddr(), addr->GetAddrLen()));
+}
+
+static auto NextQueryId() -> uint16_t {
+    static thread_local std::mt19937 s_engine{std::random_device{}()};
+    return static_cast<uint16_t>(s_engine());
+}
+
+/* ****************************************************************** */
+/* ****************************************************************** */
+/* ****************************************************************** */
+
+DnsResolverImpl::DnsResolverImpl() {
+    LoadHosts("/etc/hosts");
+    LoadResolvConf("/etc/resolv.conf");
+}
+
+auto DnsResolverImpl::Resolve(std::vector<IPAddress::ptr> &result,
+                              const std::string &name, int family) -> Status {
+    if (!g_dns_enable->GetValue() ||
+        (family != AF_INET && family != AF_INET6 && family != AF_UNSPEC)) {
+        return Status::FAILED;
+    }
+    std::string lower_name = ToLower(name);
+    if (!lower_name.empty() && lower_name.back() == '.') {
+        lower_name.pop_back();
+    }
+    // hosts文件优先
+    auto range = m_hosts.equal_range(lower_name);
+    if (range.first != range.second) {
+        for (auto iter = range.first; iter != range.second; ++iter) {
+            if (family == AF_UNSPEC || iter->second->GetFamily() == family) {
+                result.push_back(CloneAddress(iter->second));
+            }
+        }
+        return result.empty() ? Status::NOT_FOUND : Status::OK;
+    }
+    // 单标签的名字需要按search域补全，交给getaddrinfo
+    if (lower_name.find('.') == std::string::npos) {
+        return Status::FAILED;
+    }
+
+    std::vector<Question> questions;
+    if (family == AF_INET || family == AF_UNSPEC) {
+        questions.emplace_back();
+        questions.back().qtype = DNS_TYPE_A;
+    }
+    if (family == AF_INET6 || family == AF_UNSPEC) {
+        questions.emplace_back();
+        questions.back().qtype = DNS_TYPE_AAAA;
+    }
+    // 先查缓存，只把未命中的问题发给nameserver
+    bool all_cached = true;
+    for (auto &question : questions) {
+        std::string key = lower_name + "|" + std::to_string(question.qtype);
+        std::vector<IPAddress::ptr> cached;
+        if (LookupCache(key, cached, question.status)) {
+            question.answered = true;
+            question.addrs = std::move(cached);
+        } else {
+            all_cached = false;
+        }
+    }
+    if (!all_cached) {
+        Query(lower_name, questions);
+        for (auto &question : questions) {
+            if (question.answered && question.status != Status::FAILED) {
+                InsertCache(
+                    lower_name + "|" + std::to_string(question.qtype),
+                    question);
+            }
+        }
+    }
+
+    bool has_failed = false;
+    for (auto &question : questions) {
+        if (question.status == Status::FAILED) {
+            has_failed = true;
+        }
+        for (auto &addr : question.addrs) {
+            result.push_back(CloneAddress(addr));
+        }
+    }
+    if (!result.empty()) {
+        return Status::OK;
+    }
+    return has_failed ? Status::FAILED : Status::NOT_FOUND;
+}
+
+void DnsResolverImpl::ClearCache() {
+    for (auto &shard : m_shards) {
+        ScopedLock<std::mutex> lock(shard.mutex);
+        shard.entries.clear();
+    }
+}
+
+auto DnsResolverImpl::GetCacheSize() -> size_t {
+    size_t size = 0;
+    for (auto &shard : m_shards) {
+        ScopedLock<std::mutex> lock(shard.mutex);
+        size += shard.entries.size();
+    }
+    return size;
+}
+
+auto DnsResolverImpl::GetShard(const std::string &key) -> CacheShard & {
+    return m_shards[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
+
+auto DnsResolverImpl::LookupCache(const std::string &key,
+                                  std::vector<IPAddress::ptr> &result,
+                                  Status &status) -> bool {
+    CacheShard &shard = GetShard(key);
+    ScopedLock<std::mutex> lock(shard.mutex);
+    auto iter = shard.entries.find(key);
+    if (iter == shard.entries.end()) {
+        return false;
+    }
+    if (iter->second.expire_ms <= GetCurrentMS()) {
+        shard.entries.erase(iter);
+        return false;
+    }
+    result = iter->second.addrs;
+    status = result.empty() ? Status::NOT_FOUND : Status::OK;
+    return true;
+}
+
+void DnsResolverImpl::InsertCache(const std::string &key,
+                                  const Question &question) {
+    uint32_t ttl = question.ttl;
+    if (question.status == Status::OK) {
+        ttl = std::min(ttl, static_cast<uint32_t>(g_dns_max_ttl->GetValue()));
+    }
+    if (ttl == 0) {
+        return;
+    }
+    uint64_t now = GetCurrentMS();
+    size_t shard_limit =
+        std::max<size_t>(1, g_dns_max_entries->GetValue() / SHARD_COUNT);
+    CacheShard &shard = GetShard(key);
+    ScopedLock<std::mutex> lock(shard.mutex);
+    // 分片满了先清理过期记录，仍然不够就随便淘汰一条
+    if (shard.entries.size() >= shard_limit &&
+        shard.entries.find(key) == shard.entries.end()) {
+        for (auto iter = shard.entries.begin(); iter != shard.entries.end();) {
+            if (iter->second.expire_ms <= now) {
+                iter = shard.entries.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        if (shard.entries.size() >= shard_limit) {
+            shard.entries.erase(shard.entries.begin());
+        }
+    }
+    CacheEntry &entry = shard.entries[key];
+    entry.addrs = question.addrs;
+    entry.expire_ms = now + static_cast<uint64_t>(ttl) * BASE_NUMBER_OF_SECONDS;
+}
+
+void DnsResolverImpl::Query(const std::string &name,
+                            std::vector<Question> &questions) {
+    for (auto &server : GetNameServers()) {
+        QueryServer(server, name, questions);
+        bool done = std::all_of(
+            questions.begin(), questions.end(), [](const Question &question) {
+                return question.answered && question.status != Status::FAILED;
+            });
+        if (done) {
+            return;
+        }
+    }
+}
+
+void DnsResolverImpl::QueryServer(const IPAddress::ptr &server,
+                                  const std::string &name,
+                                  std::vector<Question> &questions) {
+    // 在协程中socket会被hook接管，等待应答时只挂起当前协程
+    int sock = socket(server->GetFamily(), SOCK_DGRAM, 0);
+    if (sock == -1) {
+        LOG_CUSTOM_ERROR(sys_logger, "DnsResolver socket() errno = %d", errno);
+        return;
+    }
+    int timeout_ms = g_dns_timeout->GetValue();
+    timeval tv{timeout_ms / BASE_NUMBER_OF_SECONDS,
+               timeout_ms % BASE_NUMBER_OF_SECONDS * BASE_NUMBER_OF_SECONDS};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(sock, server->GetConstAddr(), server->GetAddrLen()) != 0) {
+        LOG_CUSTOM_ERROR(sys_logger, "DnsResolver connect(%s) errno = %d",
+                         server->ToString().c_str(), errno);
+        close(sock);
+        return;
+    }
+
+    std::string packet;
+    size_t waiting = 0;
+    for (auto &question : questions) {
+        if (question.answered && question.status != Status::FAILED) {
+            continue;
+        }
+        question.answered = false;
+        question.id = NextQueryId();
+        if (!EncodeQuery(packet, question.id, name, question.qtype)) {
+            question.answered = true;
+            question.status = Status::NOT_FOUND;
+            continue;
+        }
+        if (send(sock, packet.data(), packet.size(), 0) < 0) {
+            continue;
+        }
+        ++waiting;
+    }
+
+    uint8_t buffer[DNS_MAX_UDP_SIZE];
+    uint64_t deadline = GetCurrentMS() + timeout_ms;
+    while (waiting > 0 && GetCurrentMS() < deadline) {
+        ssize_t len = recv(sock, buffer, sizeof(buffer), 0);
+        if (len < 0) {
+            // 超时或者对端不可达(ICMP port unreachable)
+            break;
+        }
+        if (static_cast<size_t>(len) < DNS_HEADER_SIZE) {
+            continue;
+        }
+        uint16_t id = ReadUint16(buffer);
+        for (auto &question : questions) {
+            if (question.answered || question.id != id) {
+                continue;
+            }
+            std::vector<IPAddress::ptr> addrs;
+            uint32_t ttl = 0;
+            Status status = Status::FAILED;
+            if (ParseResponse(buffer, static_cast<size_t>(len), name,
+                              question.qtype, addrs, ttl, status)) {
+                question.answered = true;
+                question.addrs = std::move(addrs);
+                question.ttl = ttl;
+                question.status = status;
+                --waiting;
+            }
+            break;
+        }
+    }
+    close(sock);
+}
+
+auto DnsResolverImpl::GetNameServers() -> std::vector<IPAddress::ptr> {
+    auto config_servers = g_dns_servers->GetValue();
+    if (config_servers.empty()) {
+        return m_system_servers;
+    }
+    std::vector<IPAddress::ptr> servers;
+    for (auto &item : config_servers) {
+        // 只接受数字地址，避免解析nameserver时递归进入解析器
+        std::string host = item;
+        uint16_t port = DNS_PORT;
+        size_t colon = item.rfind(':');
+        if (!item.empty() && item[0] == '[') {
+            size_t end = item.find(']');
+            host = item.substr(1, end == std::string::npos ? end : end - 1);
+            if (end != std::string::npos && colon > end) {
+                port = static_cast<uint16_t>(
+                    std::strtoul(item.c_str() + colon + 1, nullptr, 10));
+            }
+        } else if (colon != std::string::npos && item.find(':') == colon) {
+            host = item.substr(0, colon);
+            port = static_cast<uint16_t>(
+                std::strtoul(item.c_str() + colon + 1, nullptr, 10));
+        }
+        IPAddress::ptr addr = IPAddress::Create(host.c_str(), port);
+        if (addr == nullptr) {
+            LOG_CUSTOM_ERROR(sys_logger, "invalid dns server %s", item.c_str());
+            continue;
+        }
+        servers.push_back(addr);
+    }
+    return servers;
+}
+
+void DnsResolverImpl::LoadHosts(const std::string &path) {
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream iss(line);
+        std::string ip;
+        if (!(iss >> ip)) {
+            continue;
+        }
+        IPAddress::ptr addr = IPAddress::Create(ip.c_str());
+        if (addr == nullptr) {
+            continue;
+        }
+        std::string host;
+        while (iss >> host) {
+            m_hosts.emplace(ToLower(host), addr);
+        }
+    }
+}
+
+void DnsResolverImpl::LoadResolvConf(const std::string &path) {
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        std::string key;
+        std::string value;
+        if (!(iss >> key >> value) || key != "nameserver") {
+            continue;
+        }
+        IPAddress::ptr addr = IPAddress::Create(value.c_str(), DNS_PORT);
+        if (addr != nullptr) {
+            m_system_servers.push_back(addr);
+        }
+    }
+    // 与glibc一致，没有配置时使用本机
+    if (m_system_servers.empty()) {
+        m_system_servers.push_back(IPAddress::Create("127.0.0.1", DNS_PORT));
+    }
+}
+}  // namespace wtsclwq
@@ -4,11 +4,16 @@
 
 #include "../include/socket/socket.h"
 
+#include <linux/errqueue.h>
 #include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 
+#include "../include/config/config.h"
 #include "../include/io/fd_manager.h"
 #include "../include/io/hook.h"
+#include "../include/io/io_manager.h"
 #include "../include/log/log_manager.h"
 #include "../include/socket/ipv4_address.h"
 #include "../include/socket/ipv6_address.h"
@@ -20,6 +25,10 @@
 namespace wtsclwq {
 static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
 
+static ConfigVar<uint64_t>::ptr g_zerocopy_threshold =
+    Config::Lookup("socket.zerocopy.threshold", (uint64_t)(256 * 1024),
+                   "socket MSG_ZEROCOPY min send size");
+
 Socket::Socket(int family, int type, int protocol)
     : m_family(family), m_type(type), m_protocol(protocol) {}
 
@@ -27,6 +36,7 @@ Socket::~Socket() {
     if (m_socket != -1) {
         ::close(m_socket);
     }
+    CloseZeroCopyWaitFd();
 }
 
 auto Socket::CreateTcpSocket(const Address::ptr &address) -> Socket::ptr {
@@ -64,6 +74,14 @@ auto Socket::CreateUnixUdpSocket() -> Socket::ptr {
     return std::make_shared<Socket>(UNIX, UDP, 0);
 }
 
+auto Socket::CreateFromListenFd(int fd) -> Socket::ptr {
+    Socket::ptr socket = std::make_shared<Socket>();
+    if (!socket->InitListenFd(fd)) {
+        return nullptr;
+    }
+    return socket;
+}
+
 auto Socket::GetSendTimeout() const -> uint64_t {
     FileDescriptor::ptr fdp =
         FileDescriptorManager ::GetInstancePtr()->Get(m_socket);
@@ -117,6 +135,21 @@ auto Socket::GetOptionWithLen(int level, int option, void *result,
     return true;
 }
 
+auto Socket::Open() -> bool {
+    if (!IsValid()) {
+        NewSocket();
+    }
+    return IsValid();
+}
+
+auto Socket::SetReusePort(bool enable) -> bool {
+    if (!Open()) {
+        return false;
+    }
+    int val = enable ? 1 : 0;
+    return SetOption(SOL_SOCKET, SO_REUSEPORT, val);
+}
+
 auto Socket::SetOptionWithLen(int level, int option, const void *result,
                               socklen_t socklen) -> bool {
     int flag = setsockopt(m_socket, level, option, result, socklen);
@@ -254,6 +287,7 @@ auto Socket::Close() -> bool {
         return true;
     }
     m_is_connected = false;
+    CloseZeroCopyWaitFd();
     if (m_socket != -1) {
         int flag = ::close(m_socket);
         if (flag != 0) {
@@ -268,6 +302,13 @@ auto Socket::Send(const void *buffer, size_t length, int flags) -> ssize_t {
     if (!IsConnected()) {
         return -1;
     }
+    if (m_is_zerocopy && length >= g_zerocopy_threshold->GetValue()) {
+        iovec iov{const_cast<void *>(buffer), length};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        return SendZeroCopy(&msg, flags);
+    }
     return ::send(m_socket, buffer, length, flags);
 }
 
@@ -278,9 +319,204 @@ auto Socket::SendIovec(iovec *buffers, size_t length, int flags) -> ssize_t {
     msghdr msg{};
     msg.msg_iov = buffers;
     msg.msg_iovlen = length;
+    if (m_is_zerocopy) {
+        size_t total = 0;
+        for (size_t i = 0; i < length; ++i) {
+            total += buffers[i].iov_len;
+        }
+        if (total >= g_zerocopy_threshold->GetValue()) {
+            return SendZeroCopy(&msg, flags);
+        }
+    }
     return ::sendmsg(m_socket, &msg, flags);
 }
 
+auto Socket::SendFile(int file_fd, off_t offset, size_t count) -> ssize_t {
+    if (!IsConnected()) {
+        return -1;
+    }
+    return ::sendfile(m_socket, file_fd, &offset, count);
+}
+
+auto Socket::SendFds(const std::vector<int> &fds) -> bool {
+    if (m_family != AF_UNIX || fds.empty()) {
+        return false;
+    }
+    // 至少要带一个字节的数据，控制消息才会被发送
+    char tag = 'F';
+    iovec iov{&tag, 1};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    return ::sendmsg(m_socket, &msg, 0) == 1;
+}
+
+auto Socket::RecvFds(std::vector<int> &fds, size_t max_count) -> bool {
+    fds.clear();
+    char tag = 0;
+    iovec iov{&tag, 1};
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * max_count));
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    if (::recvmsg(m_socket, &msg, MSG_CMSG_CLOEXEC) <= 0) {
+        return false;
+    }
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        size_t offset = fds.size();
+        fds.resize(offset + count);
+        memcpy(fds.data() + offset, CMSG_DATA(cmsg), sizeof(int) * count);
+    }
+    if ((msg.msg_flags & MSG_CTRUNC) != 0) {
+        // 放不下的fd已经被内核关闭，只收到一部分的fd也没有意义
+        LOG_CUSTOM_ERROR(sys_logger, "RecvFds truncated, max_count = %zu",
+                         max_count)
+        for (int fd : fds) {
+            ::close(fd);
+        }
+        fds.clear();
+        return false;
+    }
+    return !fds.empty();
+}
+
+auto Socket::SetZeroCopy(bool enable) -> bool {
+    if (enable && m_type != SOCK_STREAM) {
+        return false;
+    }
+    if (enable && (!Open() || !SetOption(SOL_SOCKET, SO_ZEROCOPY, 1))) {
+        return false;
+    }
+    m_is_zerocopy = enable;
+    return true;
+}
+
+auto Socket::IsZeroCopy() const -> bool { return m_is_zerocopy; }
+
+auto Socket::SendZeroCopy(const msghdr *msg, int flags) -> ssize_t {
+    // hook后的sendmsg会在发送缓冲区满时挂起协程
+    ssize_t ret = ::sendmsg(m_socket, msg, flags | MSG_ZEROCOPY);
+    if (ret < 0) {
+        return ret;
+    }
+    ++m_zerocopy_sent;
+    // 内核还在引用用户缓冲区，收到完成通知后才能返回
+    IOManager *iom = IOManager::GetThisThreadIOManager();
+    while (m_zerocopy_done != m_zerocopy_sent) {
+        // 完成通知不在socket自己的读事件上等待，那通常被读协程占着，
+        // 而是等待只关心错误队列的epoll。先取走它上面已有的边沿再读错误队列，
+        // 之后到达的通知一定会让它重新就绪；连接挂断这类持续的状态不会反复唤醒
+        int wait_fd = iom != nullptr ? GetZeroCopyWaitFd() : -1;
+        if (wait_fd != -1) {
+            epoll_event event{};
+            epoll_wait_f(wait_fd, &event, 1, 0);
+        }
+        if (ReadZeroCopyCompletions() > 0) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG_CUSTOM_ERROR(sys_logger,
+                             "read zerocopy completion errno = %d, errstr = %s",
+                             errno, strerror(errno))
+            break;
+        }
+        if (wait_fd != -1 && iom->AddEvent(wait_fd, EventType::READ) == 0) {
+            Fiber::GetCurFiber()->Yield();
+        } else {
+            pollfd pfd{m_socket, 0, 0};
+            poll_f(&pfd, 1, 100);
+        }
+    }
+    return ret;
+}
+
+auto Socket::GetZeroCopyWaitFd() -> int {
+    if (m_zerocopy_wait_fd != -1) {
+        return m_zerocopy_wait_fd;
+    }
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        return -1;
+    }
+    // 不关心读写，epoll总会报告EPOLLERR，即错误队列中有完成通知；
+    // 边沿触发，被epoll_wait取走后只有新的通知才会让它再次就绪
+    epoll_event event{};
+    event.events = EPOLLET;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, m_socket, &event) != 0) {
+        ::close(epfd);
+        return -1;
+    }
+    m_zerocopy_wait_fd = epfd;
+    return epfd;
+}
+
+void Socket::CloseZeroCopyWaitFd() {
+    if (m_zerocopy_wait_fd == -1) {
+        return;
+    }
+    // 这个fd不在fd管理器中，hook的close()不会取消它上面的事件：
+    // 先唤醒等待完成通知的协程，也不给复用这个fd号的新fd留下过时的事件
+    IOManager *iom = IOManager::GetThisThreadIOManager();
+    if (iom != nullptr) {
+        iom->CancelAll(m_zerocopy_wait_fd);
+    }
+    ::close(m_zerocopy_wait_fd);
+    m_zerocopy_wait_fd = -1;
+}
+
+auto Socket::ReadZeroCopyCompletions() -> int {
+    char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+    int count = 0;
+    while (true) {
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        // 错误队列的读取从不阻塞，直接调用原始的recvmsg
+        if (recvmsg_f(m_socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            return count > 0 ? count : -1;
+        }
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+                  (cmsg->cmsg_level == SOL_IPV6 &&
+                   cmsg->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            auto *err = reinterpret_cast<sock_extended_err *>(CMSG_DATA(cmsg));
+            if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // [ee_info, ee_data]区间内的发送都已完成
+            m_zerocopy_done += err->ee_data - err->ee_info + 1;
+            ++count;
+            if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0 &&
+                m_is_zerocopy) {
+                // 内核最终还是做了拷贝(比如回环网卡)，零拷贝只剩额外开销
+                LOG_CUSTOM_INFO(sys_logger,
+                                "zerocopy fell back to copy on socket %d, "
+                                "disable it",
+                                m_socket)
+                m_is_zerocopy = false;
+            }
+        }
+    }
+}
+
 auto Socket::SendTo(const void *buffer, size_t length, const Address::ptr &to,
                     int flags) -> ssize_t {
     if (!IsConnected()) {
@@ -469,7 +705,7 @@ auto Socket::CancelAll() -> bool {
 void Socket::InitSocket() {
     int val = 1;
     SetOption(SOL_SOCKET, SO_REUSEADDR, val);
-    if (m_type == SOCK_STREAM) {
+    if (m_type == SOCK_STREAM && m_family != AF_UNIX) {
         // 禁用 Nagle 算法，即开启了数据无延迟发送模式。
         SetOption(IPPROTO_TCP, TCP_NODELAY, val);
     }
@@ -485,6 +721,22 @@ void Socket::NewSocket() {
     }
 }
 
+auto Socket::InitListenFd(int fd) -> bool {
+    socklen_t len = sizeof(int);
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &m_family, &len) != 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_TYPE, &m_type, &len) != 0 ||
+        getsockopt(fd, SOL_SOCKET, SO_PROTOCOL, &m_protocol, &len) != 0) {
+        LOG_CUSTOM_ERROR(sys_logger, "fd %d is not a socket, errno = %d", fd,
+                         errno)
+        return false;
+    }
+    // 重新登记到fd管理器，之后的accept走hook；同号fd可能残留已关闭的旧登记
+    FileDescriptorManager::GetInstancePtr()->Reset(fd);
+    m_socket = fd;
+    GetLocalAddress();
+    return true;
+}
+
 auto Socket::Init(int sock) -> bool {
     FileDescriptor::ptr fdp =
         FileDescriptorManager ::GetInstancePtr()->Get(sock);
@@ -0,0 +1,332 @@
+//
+// 客户端连接池
+//
+#include "../include/socket/socket_pool.h"
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+#include <vector>
+
+#include "../include/io/hook.h"
+#include "../include/log/log_manager.h"
+#include "../include/util/thread_util.h"
+#include "../include/util/time_util.h"
+
+namespace wtsclwq {
+static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+
+/**
+ * @brief 空闲连接是否还能使用：对端没有关闭，也没有残留的未读数据
+ */
+static auto IsHealthy(const Socket::ptr &sock) -> bool {
+    if (!sock->IsConnected()) {
+        return false;
+    }
+    char chr;
+    // 直接调用原始的recv，hook后的recv会在EAGAIN时挂起协程
+    ssize_t ret =
+        recv_f(sock->GetSocket(), &chr, 1, MSG_PEEK | MSG_DONTWAIT);
+    return ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+SocketPool::SocketPool(size_t max_idle_per_host, size_t max_per_host,
+                       uint64_t idle_timeout_ms, uint64_t connect_timeout_ms)
+    : m_max_idle_per_host(max_idle_per_host),
+      m_max_per_host(std::max<size_t>(max_per_host, 1)),
+      m_idle_timeout_ms(idle_timeout_ms),
+      m_connect_timeout_ms(connect_timeout_ms) {}
+
+SocketPool::~SocketPool() { Close(); }
+
+auto SocketPool::Create(size_t max_idle_per_host, size_t max_per_host,
+                        uint64_t idle_timeout_ms, uint64_t connect_timeout_ms,
+                        IOManager *iom) -> SocketPool::ptr {
+    auto pool = std::make_shared<SocketPool>(
+        max_idle_per_host, max_per_host, idle_timeout_ms, connect_timeout_ms);
+    if (iom != nullptr) {
+        std::weak_ptr<SocketPool> weak_pool = pool;
+        uint64_t interval = std::max<uint64_t>(idle_timeout_ms / 2, 10);
+        pool->m_evict_timer = iom->AddTimer(
+            interval,
+            [weak_pool]() {
+                if (auto pool = weak_pool.lock()) {
+                    pool->EvictIdle();
+                }
+            },
+            true);
+    }
+    return pool;
+}
+
+auto SocketPool::Acquire(const Address::ptr &address, uint64_t wait_timeout_ms)
+    -> Socket::ptr {
+    std::string key = address->ToString();
+    Socket::ptr candidate{};
+    Waiter::ptr waiter{};
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        if (m_is_closed) {
+            return nullptr;
+        }
+        HostPool &host = m_hosts[key];
+        if (!host.idle.empty()) {
+            // 后进先出，最近归还的连接最可能还活着
+            candidate = std::move(host.idle.back().sock);
+            host.idle.pop_back();
+            ++host.active;
+        } else if (host.active < m_max_per_host) {
+            ++host.active;
+        } else {
+            auto *iom = IOManager::GetThisThreadIOManager();
+            if (wait_timeout_ms == 0 || iom == nullptr) {
+                return nullptr;
+            }
+            waiter = std::make_shared<Waiter>();
+            waiter->fiber = Fiber::GetCurFiber();
+            waiter->scheduler = iom;
+            waiter->thread_id = GetThreadId();
+            host.waiters.push_back(waiter);
+        }
+    }
+    // 健康检查是一次系统调用，放在锁外；检查期间候选连接占着一个名额，
+    // 不健康时用同一个名额继续取下一个空闲连接，取完了就新建连接
+    while (candidate != nullptr) {
+        if (IsHealthy(candidate)) {
+            return candidate;
+        }
+        candidate->Close();
+        candidate.reset();
+        ScopedLock<MutexType> lock(m_mutex);
+        auto &idle = m_hosts[key].idle;
+        if (!idle.empty()) {
+            candidate = std::move(idle.back().sock);
+            idle.pop_back();
+        }
+    }
+    if (waiter == nullptr) {
+        return Connect(address, key);
+    }
+
+    // 连接数已满，挂起等待其他协程归还连接或者名额
+    Timer::ptr timer{};
+    if (wait_timeout_ms != UINT64_MAX) {
+        std::weak_ptr<Waiter> weak_waiter = waiter;
+        std::weak_ptr<SocketPool> weak_pool = shared_from_this();
+        timer = IOManager::GetThisThreadIOManager()->AddTimer(
+            wait_timeout_ms, [weak_waiter, weak_pool, key]() {
+                auto waiter = weak_waiter.lock();
+                auto pool = weak_pool.lock();
+                if (!waiter || !pool) {
+                    return;
+                }
+                ScopedLock<MutexType> lock(pool->m_mutex);
+                if (waiter->done) {
+                    return;
+                }
+                pool->m_hosts[key].waiters.remove(waiter);
+                waiter->done = true;
+                waiter->timed_out = true;
+                waiter->scheduler->Schedule(waiter->fiber, waiter->thread_id);
+            });
+    }
+    Fiber::GetCurFiber()->Yield();
+    if (timer) {
+        timer->Cancel();
+    }
+    if (waiter->timed_out) {
+        return nullptr;
+    }
+    if (waiter->sock) {
+        return std::move(waiter->sock);
+    }
+    return Connect(address, key);
+}
+
+void SocketPool::Release(const Socket::ptr &sock, bool reusable) {
+    Address::ptr remote = sock->GetRemoteAddress();
+    if (remote == nullptr) {
+        sock->Close();
+        return;
+    }
+    std::string key = remote->ToString();
+    bool need_close = true;
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        auto iter = m_hosts.find(key);
+        if (iter == m_hosts.end()) {
+            // 不是从本池借出的连接
+            sock->Close();
+            return;
+        }
+        HostPool &host = iter->second;
+        reusable = reusable && !m_is_closed && sock->IsConnected();
+        if (!host.waiters.empty()) {
+            // 有协程在等待，直接转交连接；连接不能复用时转交新建连接的名额
+            WakeWaiter(host, reusable ? sock : nullptr);
+            need_close = !reusable;
+        } else {
+            --host.active;
+            if (reusable && host.idle.size() < m_max_idle_per_host) {
+                host.idle.push_back({sock, GetCurrentMS()});
+                need_close = false;
+            }
+        }
+    }
+    if (need_close) {
+        sock->Close();
+    }
+}
+
+void SocketPool::Close() {
+    std::vector<Socket::ptr> to_close;
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        m_is_closed = true;
+        if (m_evict_timer) {
+            m_evict_timer->Cancel();
+            m_evict_timer.reset();
+        }
+        for (auto &[key, host] : m_hosts) {
+            for (auto &item : host.idle) {
+                to_close.push_back(std::move(item.sock));
+            }
+            host.idle.clear();
+            // 等待者按超时处理，Acquire()返回nullptr
+            for (auto &waiter : host.waiters) {
+                waiter->done = true;
+                waiter->timed_out = true;
+                waiter->scheduler->Schedule(waiter->fiber, waiter->thread_id);
+            }
+            host.waiters.clear();
+        }
+    }
+    for (auto &sock : to_close) {
+        sock->Close();
+    }
+}
+
+void SocketPool::EvictIdle() {
+    struct Candidate {
+        std::string key;
+        Socket::ptr sock;
+        uint64_t idle_since;
+    };
+    std::vector<Socket::ptr> to_close;
+    std::vector<Candidate> candidates;
+    uint64_t now = GetCurrentMS();
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        for (auto iter = m_hosts.begin(); iter != m_hosts.end();) {
+            HostPool &host = iter->second;
+            auto &idle = host.idle;
+            auto keep = std::remove_if(
+                idle.begin(), idle.end(),
+                [&](HostPool::IdleSocket &item) {
+                    if (now - item.idle_since < m_idle_timeout_ms) {
+                        candidates.push_back(
+                            {iter->first, item.sock, item.idle_since});
+                        return false;
+                    }
+                    to_close.push_back(std::move(item.sock));
+                    return true;
+                });
+            idle.erase(keep, idle.end());
+            if (idle.empty() && host.active == 0 && host.waiters.empty()) {
+                iter = m_hosts.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+
+    // 未超时的连接在锁外做健康检查，期间仍然可以被借出
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [](const Candidate &item) {
+                                        return IsHealthy(item.sock);
+                                    }),
+                     candidates.end());
+    if (!candidates.empty()) {
+        ScopedLock<MutexType> lock(m_mutex);
+        for (auto &item : candidates) {
+            auto host_iter = m_hosts.find(item.key);
+            if (host_iter == m_hosts.end()) {
+                continue;
+            }
+            // 只移除检查之后没有被借出再归还过的连接
+            auto &idle = host_iter->second.idle;
+            auto pos = std::find_if(
+                idle.begin(), idle.end(),
+                [&item](const HostPool::IdleSocket &idle_item) {
+                    return idle_item.sock == item.sock &&
+                           idle_item.idle_since == item.idle_since;
+                });
+            if (pos != idle.end()) {
+                to_close.push_back(std::move(pos->sock));
+                idle.erase(pos);
+            }
+        }
+    }
+    for (auto &sock : to_close) {
+        sock->Close();
+    }
+}
+
+auto SocketPool::GetIdleCount() -> size_t {
+    ScopedLock<MutexType> lock(m_mutex);
+    size_t count = 0;
+    for (auto &[key, host] : m_hosts) {
+        count += host.idle.size();
+    }
+    return count;
+}
+
+auto SocketPool::GetActiveCount() -> size_t {
+    ScopedLock<MutexType> lock(m_mutex);
+    size_t count = 0;
+    for (auto &[key, host] : m_hosts) {
+        count += host.active;
+    }
+    return count;
+}
+
+void SocketPool::WakeWaiter(HostPool &host, const Socket::ptr &sock) {
+    Waiter::ptr waiter = host.waiters.front();
+    host.waiters.pop_front();
+    waiter->done = true;
+    waiter->sock = sock;
+    // 绑定回挂起的线程恢复，保证恢复时协程已经完成Yield
+    waiter->scheduler->Schedule(waiter->fiber, waiter->thread_id);
+}
+
+auto SocketPool::Connect(const Address::ptr &address, const std::string &key)
+    -> Socket::ptr {
+    bool is_closed;
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        is_closed = m_is_closed;
+    }
+    Socket::ptr sock{};
+    if (!is_closed) {
+        sock = Socket::CreateTcpSocket(address);
+        if (!sock->Connect(address, m_connect_timeout_ms)) {
+            LOG_CUSTOM_ERROR(sys_logger, "SocketPool connect %s failed",
+                             key.c_str());
+            sock.reset();
+        }
+    }
+    if (sock == nullptr) {
+        // 归还名额，让等待者自己尝试
+        ScopedLock<MutexType> lock(m_mutex);
+        HostPool &host = m_hosts[key];
+        if (!host.waiters.empty()) {
+            WakeWaiter(host, nullptr);
+        } else {
+            --host.active;
+        }
+    }
+    return sock;
+}
+}  // namespace wtsclwq
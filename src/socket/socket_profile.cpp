@@ -0,0 +1,94 @@
+//
+// socket调优配置
+//
+#include "../include/socket/socket_profile.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <map>
+
+#include "../include/config/config.h"
+
+namespace wtsclwq {
+
+/**
+ * @brief 内置的几套配置，可以在配置文件中覆盖或增加
+ */
+static auto DefaultProfiles() -> std::map<std::string, SocketProfile> {
+    std::map<std::string, SocketProfile> profiles;
+    profiles["default"] = SocketProfile{};
+
+    SocketProfile low_latency;
+    low_latency.fastopen = 256;
+    low_latency.fastopen_connect = true;
+    low_latency.defer_accept = 1;
+    low_latency.busy_poll = 50;
+    low_latency.quickack = true;
+    low_latency.notsent_lowat = 16 * 1024;
+    profiles["low_latency"] = low_latency;
+
+    SocketProfile throughput;
+    throughput.sndbuf = 4 * 1024 * 1024;
+    throughput.rcvbuf = 4 * 1024 * 1024;
+    profiles["throughput"] = throughput;
+    return profiles;
+}
+
+static ConfigVar<std::map<std::string, SocketProfile>>::ptr g_socket_profiles =
+    Config::Lookup("socket.profiles", DefaultProfiles(),
+                   "named tcp socket option profiles");
+
+/**
+ * @brief 设置大于0的int选项
+ */
+static auto SetIfPositive(const Socket::ptr &sock, int level, int option,
+                          int value) -> bool {
+    return value <= 0 || sock->SetOption(level, option, value);
+}
+
+auto SocketProfile::Get(const std::string &name) -> SocketProfile {
+    auto profiles = g_socket_profiles->GetValue();
+    auto iter = profiles.find(name);
+    return iter == profiles.end() ? SocketProfile{} : iter->second;
+}
+
+auto SocketProfile::ApplyToListener(const Socket::ptr &sock) const -> bool {
+    bool result = SetIfPositive(sock, SOL_SOCKET, SO_SNDBUF, sndbuf);
+    result = SetIfPositive(sock, SOL_SOCKET, SO_RCVBUF, rcvbuf) && result;
+    result = SetIfPositive(sock, IPPROTO_TCP, TCP_FASTOPEN, fastopen) && result;
+    result =
+        SetIfPositive(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, defer_accept) &&
+        result;
+    if (incoming_cpu >= 0) {
+        result = sock->SetOption(SOL_SOCKET, SO_INCOMING_CPU, incoming_cpu) &&
+                 result;
+    }
+    return result;
+}
+
+auto SocketProfile::ApplyToConnection(const Socket::ptr &sock) const -> bool {
+    bool result = SetIfPositive(sock, SOL_SOCKET, SO_BUSY_POLL, busy_poll);
+    result =
+        SetIfPositive(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, notsent_lowat) &&
+        result;
+    // TCP_QUICKACK不是持久的，内核之后可能重新进入延迟确认
+    if (quickack) {
+        result = sock->SetOption(IPPROTO_TCP, TCP_QUICKACK, 1) && result;
+    }
+    return result;
+}
+
+auto SocketProfile::ApplyToClient(const Socket::ptr &sock) const -> bool {
+    if (!sock->Open()) {
+        return false;
+    }
+    bool result = SetIfPositive(sock, SOL_SOCKET, SO_SNDBUF, sndbuf);
+    result = SetIfPositive(sock, SOL_SOCKET, SO_RCVBUF, rcvbuf) && result;
+    if (fastopen_connect) {
+        result = sock->SetOption(IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1) && result;
+    }
+    return ApplyToConnection(sock) && result;
+}
+}  // namespace wtsclwq
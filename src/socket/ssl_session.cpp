@@ -0,0 +1,482 @@
+//
+// TLS会话复用：服务端的分片会话缓存和轮换的会话票据密钥，客户端按目标地址保存会话
+//
+#include "../include/socket/ssl_session.h"
+
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <list>
+
+#include "../include/config/config.h"
+#include "../include/log/log_manager.h"
+#include "../include/util/time_util.h"
+
+namespace wtsclwq {
+static Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+static ConfigVar<size_t>::ptr g_ssl_session_cache_shards =
+    Config::Lookup("ssl.session_cache.shards", (size_t)16,
+                   "tls server session cache shards");
+static ConfigVar<size_t>::ptr g_ssl_session_cache_capacity =
+    Config::Lookup("ssl.session_cache.capacity", (size_t)(20 * 1024),
+                   "tls server session cache capacity");
+static ConfigVar<uint64_t>::ptr g_ssl_session_timeout =
+    Config::Lookup("ssl.session_timeout", (uint64_t)(2 * 60 * 60),
+                   "tls session lifetime in seconds");
+static ConfigVar<bool>::ptr g_ssl_session_tickets = Config::Lookup(
+    "ssl.session_tickets", true,
+    "tls server issues stateless session tickets, false to resume from the "
+    "session cache only");
+static ConfigVar<uint64_t>::ptr g_ssl_ticket_key_rotation =
+    Config::Lookup("ssl.ticket_key_rotation", (uint64_t)(12 * 60 * 60 * 1000),
+                   "tls session ticket key rotation interval in ms");
+static ConfigVar<size_t>::ptr g_ssl_ticket_key_count =
+    Config::Lookup("ssl.ticket_key_count", (size_t)3,
+                   "tls session ticket keys kept for decryption");
+static ConfigVar<size_t>::ptr g_ssl_client_session_capacity =
+    Config::Lookup("ssl.client_session_capacity", (size_t)1024,
+                   "tls client saved sessions, one per target");
+
+static auto SessionId(const SSL_SESSION *session) -> std::string {
+    unsigned int len = 0;
+    const unsigned char *id = SSL_SESSION_get_id(session, &len);
+    return {reinterpret_cast<const char *>(id), len};
+}
+
+SslSessionCache::SslSessionCache(size_t shard_count, size_t capacity)
+    : m_shards(std::max<size_t>(shard_count, 1)),
+      m_shard_capacity(std::max<size_t>(capacity / m_shards.size(), 1)) {}
+
+SslSessionCache::~SslSessionCache() {
+    for (auto &shard : m_shards) {
+        for (auto &[id, session] : shard.sessions) {
+            SSL_SESSION_free(session);
+        }
+    }
+}
+
+auto SslSessionCache::GetShard(const std::string &id) -> Shard & {
+    return m_shards[std::hash<std::string>()(id) % m_shards.size()];
+}
+
+void SslSessionCache::Add(SSL_SESSION *session) {
+    std::string id = SessionId(session);
+    Shard &shard = GetShard(id);
+    std::vector<SSL_SESSION *> evicted;
+    {
+        ScopedLock<MutexType> lock(shard.mutex);
+        auto [iter, inserted] = shard.sessions.emplace(id, session);
+        if (!inserted) {
+            evicted.push_back(iter->second);
+            iter->second = session;
+        } else {
+            shard.order.push_back(std::move(id));
+        }
+        // order中可能有已经被Remove()的ID，淘汰时跳过
+        while (shard.sessions.size() > m_shard_capacity &&
+               !shard.order.empty()) {
+            auto old = shard.sessions.find(shard.order.front());
+            if (old != shard.sessions.end()) {
+                evicted.push_back(old->second);
+                shard.sessions.erase(old);
+            }
+            shard.order.pop_front();
+        }
+        if (shard.order.size() > 2 * m_shard_capacity) {
+            // 被Remove()的ID积累过多时重建顺序队列
+            std::deque<std::string> order;
+            for (auto &item : shard.order) {
+                if (shard.sessions.count(item) != 0) {
+                    order.push_back(item);
+                }
+            }
+            shard.order.swap(order);
+        }
+    }
+    // 释放会话不需要持有分片的锁
+    for (auto *old : evicted) {
+        SSL_SESSION_free(old);
+    }
+}
+
+auto SslSessionCache::Get(const unsigned char *id, size_t len)
+    -> SSL_SESSION * {
+    std::string key(reinterpret_cast<const char *>(id), len);
+    Shard &shard = GetShard(key);
+    SSL_SESSION *expired = nullptr;
+    {
+        ScopedLock<MutexType> lock(shard.mutex);
+        auto iter = shard.sessions.find(key);
+        if (iter == shard.sessions.end()) {
+            return nullptr;
+        }
+        SSL_SESSION *session = iter->second;
+        uint64_t now = GetCurrentMS() / 1000;
+        if (static_cast<uint64_t>(SSL_SESSION_get_time(session) +
+                                  SSL_SESSION_get_timeout(session)) > now) {
+            // 解锁后其他线程可能淘汰并释放这个会话，先在锁内增加引用
+            SSL_SESSION_up_ref(session);
+            return session;
+        }
+        expired = session;
+        shard.sessions.erase(iter);
+    }
+    SSL_SESSION_free(expired);
+    return nullptr;
+}
+
+void SslSessionCache::Remove(SSL_SESSION *session) {
+    std::string id = SessionId(session);
+    Shard &shard = GetShard(id);
+    SSL_SESSION *removed = nullptr;
+    {
+        ScopedLock<MutexType> lock(shard.mutex);
+        auto iter = shard.sessions.find(id);
+        if (iter == shard.sessions.end() || iter->second != session) {
+            return;
+        }
+        removed = iter->second;
+        shard.sessions.erase(iter);
+    }
+    SSL_SESSION_free(removed);
+}
+
+auto SslSessionCache::GetSize() -> size_t {
+    size_t size = 0;
+    for (auto &shard : m_shards) {
+        ScopedLock<MutexType> lock(shard.mutex);
+        size += shard.sessions.size();
+    }
+    return size;
+}
+
+SslTicketKeyRing::SslTicketKeyRing(uint64_t rotation, size_t key_count)
+    : m_rotation(rotation), m_key_count(std::max<size_t>(key_count, 1)) {
+    Rotate();
+}
+
+void SslTicketKeyRing::Rotate() {
+    Key key{};
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+        RAND_priv_bytes(key.aes_key, sizeof(key.aes_key)) != 1 ||
+        RAND_priv_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1) {
+        LOG_CUSTOM_ERROR(sys_logger, "generate ticket key fail, keys = %zu",
+                         m_keys.size())
+        return;
+    }
+    key.created = GetCurrentMS();
+    ScopedWriteLock lock(m_rwlock);
+    m_keys.push_front(key);
+    while (m_keys.size() > m_key_count) {
+        m_keys.pop_back();
+    }
+}
+
+/**
+ * @brief 用密钥初始化票据的加密(AES-256-CBC)和认证(HMAC-SHA256)
+ */
+static auto InitTicketCrypto(const unsigned char *aes_key,
+                             const unsigned char *hmac_key,
+                             const unsigned char *iv,
+                             EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx,
+                             bool encrypt) -> bool {
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()};
+    if (EVP_MAC_init(mac_ctx, hmac_key, 32, params) != 1) {
+        return false;
+    }
+    return encrypt ? EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr,
+                                        aes_key, iv) == 1
+                   : EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr,
+                                        aes_key, iv) == 1;
+}
+
+auto SslTicketKeyRing::Process(unsigned char *key_name, unsigned char *iv,
+                               EVP_CIPHER_CTX *cipher_ctx,
+                               EVP_MAC_CTX *mac_ctx, bool encrypt) -> int {
+    if (encrypt) {
+        bool expired = false;
+        {
+            ScopedReadLock lock(m_rwlock);
+            expired = m_keys.empty() ||
+                      GetCurrentMS() - m_keys.front().created >= m_rotation;
+        }
+        if (expired) {
+            Rotate();
+        }
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+            return -1;
+        }
+        ScopedReadLock lock(m_rwlock);
+        if (m_keys.empty()) {
+            return -1;
+        }
+        const Key &key = m_keys.front();
+        memcpy(key_name, key.name, sizeof(key.name));
+        return InitTicketCrypto(key.aes_key, key.hmac_key, iv, cipher_ctx,
+                                mac_ctx, true)
+                   ? 1
+                   : -1;
+    }
+    ScopedReadLock lock(m_rwlock);
+    for (size_t i = 0; i < m_keys.size(); ++i) {
+        const Key &key = m_keys[i];
+        if (memcmp(key_name, key.name, sizeof(key.name)) != 0) {
+            continue;
+        }
+        if (!InitTicketCrypto(key.aes_key, key.hmac_key, iv, cipher_ctx,
+                              mac_ctx, false)) {
+            return -1;
+        }
+        // 旧密钥解开的票据仍然有效，但要用当前密钥换发
+        return i == 0 ? 1 : 2;
+    }
+    return 0;
+}
+
+// SSL_CTX上保存SslSessionManager的ex_data下标，SSL_CTX释放时一起释放
+static auto ManagerIndex() -> int {
+    static int index = SSL_CTX_get_ex_new_index(
+        0, nullptr, nullptr, nullptr,
+        [](void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+            delete static_cast<SslSessionManager *>(ptr);
+        });
+    return index;
+}
+
+static auto ManagerOf(SSL *ssl) -> SslSessionManager * {
+    return SslSessionManager::Get(SSL_get_SSL_CTX(ssl));
+}
+
+static auto OnNewServerSession(SSL *ssl, SSL_SESSION *session) -> int {
+    SslSessionManager *manager = ManagerOf(ssl);
+    if (manager == nullptr) {
+        return 0;
+    }
+    manager->GetCache().Add(session);
+    // 返回1表示缓存接管了这个引用
+    return 1;
+}
+
+static auto OnGetServerSession(SSL *ssl, const unsigned char *id, int len,
+                               int *copy) -> SSL_SESSION * {
+    SslSessionManager *manager = ManagerOf(ssl);
+    if (manager == nullptr) {
+        return nullptr;
+    }
+    SSL_SESSION *session =
+        manager->GetCache().Get(id, static_cast<size_t>(len));
+    manager->OnCacheLookup(session != nullptr);
+    // Get()已经为OpenSSL增加了引用，缓存仍然持有自己的引用
+    *copy = 0;
+    return session;
+}
+
+static void OnRemoveServerSession(SSL_CTX *ctx, SSL_SESSION *session) {
+    SslSessionManager *manager = SslSessionManager::Get(ctx);
+    if (manager != nullptr) {
+        manager->GetCache().Remove(session);
+    }
+}
+
+static auto OnTicketKey(SSL *ssl, unsigned char *key_name, unsigned char *iv,
+                        EVP_CIPHER_CTX *cipher_ctx, EVP_MAC_CTX *mac_ctx,
+                        int enc) -> int {
+    SslSessionManager *manager = ManagerOf(ssl);
+    if (manager == nullptr) {
+        return -1;
+    }
+    int result = manager->GetTicketKeys().Process(key_name, iv, cipher_ctx,
+                                                  mac_ctx, enc == 1);
+    if (result == 2) {
+        manager->OnTicketRenewed();
+    }
+    return result;
+}
+
+SslSessionManager::SslSessionManager()
+    : m_cache(g_ssl_session_cache_shards->GetValue(),
+              g_ssl_session_cache_capacity->GetValue()),
+      m_ticket_keys(g_ssl_ticket_key_rotation->GetValue(),
+                    g_ssl_ticket_key_count->GetValue()) {}
+
+void SslSessionManager::Install(SSL_CTX *ctx) {
+    if (Get(ctx) != nullptr) {
+        return;
+    }
+    SSL_CTX_set_ex_data(ctx, ManagerIndex(), new SslSessionManager());
+    static const unsigned char kSessionIdContext[] = "wtsclwq";
+    SSL_CTX_set_session_id_context(ctx, kSessionIdContext,
+                                   sizeof(kSessionIdContext) - 1);
+    SSL_CTX_set_timeout(ctx, static_cast<long>(g_ssl_session_timeout->GetValue()));
+    // 只用外部的分片缓存，不再用OpenSSL内部一把锁的缓存
+    SSL_CTX_set_session_cache_mode(
+        ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL |
+                 SSL_SESS_CACHE_NO_AUTO_CLEAR);
+    SSL_CTX_sess_set_new_cb(ctx, OnNewServerSession);
+    SSL_CTX_sess_set_get_cb(ctx, OnGetServerSession);
+    SSL_CTX_sess_set_remove_cb(ctx, OnRemoveServerSession);
+    if (g_ssl_session_tickets->GetValue()) {
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, OnTicketKey);
+    } else {
+        // TLS1.3下不发无状态票据时，票据里只带会话ID，从缓存中复用
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    }
+}
+
+auto SslSessionManager::Get(SSL_CTX *ctx) -> SslSessionManager * {
+    return static_cast<SslSessionManager *>(
+        SSL_CTX_get_ex_data(ctx, ManagerIndex()));
+}
+
+void SslSessionManager::OnHandshake(bool resumed) {
+    ++m_handshakes;
+    if (resumed) {
+        ++m_resumed;
+    }
+}
+
+void SslSessionManager::OnCacheLookup(bool hit) {
+    if (hit) {
+        ++m_cache_hits;
+    } else {
+        ++m_cache_misses;
+    }
+}
+
+void SslSessionManager::OnTicketRenewed() { ++m_ticket_renewed; }
+
+auto SslSessionManager::GetStats() const -> SslSessionStats {
+    SslSessionStats stats;
+    stats.handshakes = m_handshakes;
+    stats.resumed = m_resumed;
+    stats.cache_hits = m_cache_hits;
+    stats.cache_misses = m_cache_misses;
+    stats.ticket_renewed = m_ticket_renewed;
+    return stats;
+}
+
+/**
+ * @brief 客户端保存的会话，按目标LRU淘汰
+ */
+class ClientSessionStore {
+  public:
+    using MutexType = std::mutex;
+
+    ~ClientSessionStore() {
+        for (auto &[target, session] : m_sessions) {
+            SSL_SESSION_free(session);
+        }
+    }
+
+    void Put(const std::string &target, SSL_SESSION *session) {
+        std::vector<SSL_SESSION *> freed;
+        {
+            ScopedLock<MutexType> lock(m_mutex);
+            auto iter = m_index.find(target);
+            if (iter != m_index.end()) {
+                freed.push_back(iter->second->second);
+                m_sessions.erase(iter->second);
+            }
+            m_sessions.emplace_front(target, session);
+            m_index[target] = m_sessions.begin();
+            size_t capacity = g_ssl_client_session_capacity->GetValue();
+            while (m_sessions.size() > capacity) {
+                freed.push_back(m_sessions.back().second);
+                m_index.erase(m_sessions.back().first);
+                m_sessions.pop_back();
+            }
+        }
+        for (auto *old : freed) {
+            SSL_SESSION_free(old);
+        }
+    }
+
+    /**
+     * @return 增加了引用的会话，没有时返回nullptr
+     */
+    auto Take(const std::string &target) -> SSL_SESSION * {
+        ScopedLock<MutexType> lock(m_mutex);
+        auto iter = m_index.find(target);
+        if (iter == m_index.end()) {
+            return nullptr;
+        }
+        m_sessions.splice(m_sessions.begin(), m_sessions, iter->second);
+        SSL_SESSION *session = iter->second->second;
+        SSL_SESSION_up_ref(session);
+        return session;
+    }
+
+    void Remove(const std::string &target) {
+        SSL_SESSION *session = nullptr;
+        {
+            ScopedLock<MutexType> lock(m_mutex);
+            auto iter = m_index.find(target);
+            if (iter == m_index.end()) {
+                return;
+            }
+            session = iter->second->second;
+            m_sessions.erase(iter->second);
+            m_index.erase(iter);
+        }
+        SSL_SESSION_free(session);
+    }
+
+  private:
+    using Entry = std::pair<std::string, SSL_SESSION *>;
+    std::list<Entry> m_sessions{};  // 最近使用的在前
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index{};
+    MutexType m_mutex{};
+};
+
+static auto GetClientStore() -> ClientSessionStore & {
+    static ClientSessionStore store;
+    return store;
+}
+
+// SSL上保存连接目标的ex_data下标
+static auto TargetIndex() -> int {
+    static int index = SSL_get_ex_new_index(
+        0, nullptr, nullptr, nullptr,
+        [](void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *) {
+            delete static_cast<std::string *>(ptr);
+        });
+    return index;
+}
+
+static auto OnNewClientSession(SSL *ssl, SSL_SESSION *session) -> int {
+    auto *target = static_cast<std::string *>(SSL_get_ex_data(ssl, TargetIndex()));
+    if (target == nullptr || SSL_SESSION_is_resumable(session) != 1) {
+        return 0;
+    }
+    GetClientStore().Put(*target, session);
+    return 1;
+}
+
+void SslClientSessions::Install(SSL_CTX *ctx) {
+    // TLS1.3的票据在握手之后才到达，由回调保存，不使用OpenSSL内部的缓存
+    SSL_CTX_set_session_cache_mode(
+        ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, OnNewClientSession);
+}
+
+void SslClientSessions::Apply(SSL *ssl, const std::string &target) {
+    SSL_set_ex_data(ssl, TargetIndex(), new std::string(target));
+    SSL_SESSION *session = GetClientStore().Take(target);
+    if (session != nullptr) {
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+}
+
+void SslClientSessions::Remove(const std::string &target) {
+    GetClientStore().Remove(target);
+}
+}  // namespace wtsclwq
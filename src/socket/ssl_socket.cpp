@@ -4,11 +4,25 @@
 
 #include "../include/socket/ssl_socket.h"
 
+#include <poll.h>
+
+#include <algorithm>
+
+#include "../include/config/config.h"
+#include "../include/io/hook.h"
+#include "../include/io/io_manager.h"
 #include "../include/log/log_manager.h"
+#include "../include/socket/ssl_session.h"
+#include "../include/util/time_util.h"
+#include "openssl/err.h"
 #include "openssl/ssl.h"
 
 namespace wtsclwq {
 Logger::ptr sys_logger = GET_LOGGER_BY_NAME("system");
+static ConfigVar<bool>::ptr g_ssl_ktls = Config::Lookup(
+    "ssl.ktls", false,
+    "hand tls record encryption to the kernel (ktls) after the handshake, "
+    "falls back to openssl when the kernel or openssl does not support it");
 
 struct SslIniter {
     SslIniter() {
@@ -20,6 +34,71 @@ struct SslIniter {
 
 static SslIniter s_ssl_inter{};
 
+/**
+ * @brief 调用OpenSSL期间关闭当前线程的hook，底层socket读写在未就绪时直接返回EAGAIN，
+ * 变成SSL_ERROR_WANT_READ/WANT_WRITE交给SslSocket等待；等待前必须恢复hook
+ */
+class HookPause {
+  public:
+    HookPause(const HookPause &) = delete;
+    HookPause(HookPause &&) = delete;
+    auto operator=(const HookPause &) -> HookPause & = delete;
+    auto operator=(HookPause &&) -> HookPause & = delete;
+
+    HookPause() : m_enabled(IsHookEnabled()) { SetHookEnable(false); }
+
+    ~HookPause() { SetHookEnable(m_enabled); }
+
+  private:
+    bool m_enabled;
+};
+
+template <typename Op>
+static auto CallSsl(Op op) -> decltype(op()) {
+    HookPause pause;
+    ERR_clear_error();
+    return op();
+}
+
+static ConfigVar<bool>::ptr g_ssl_release_buffers = Config::Lookup(
+    "ssl.release_buffers", true,
+    "free openssl read/write buffers while a tls connection is idle");
+
+/**
+ * @brief 按配置ssl.release_buffers设置上下文的模式
+ */
+static void ApplyContextMode(SSL_CTX *ctx) {
+    if (g_ssl_release_buffers->GetValue()) {
+        // 每个连接的读写缓冲区(各约17KB)在空闲时释放，大量长连接时省内存
+        SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+    }
+}
+
+/**
+ * @brief 按配置ssl.ktls请求kTLS，必须在握手之前设置
+ */
+static void ApplyKtlsOption(SSL *ssl) {
+    if (g_ssl_ktls->GetValue()) {
+        // 握手完成后OpenSSL把密钥交给内核(TCP_ULP "tls")，之后的记录由内核加解密；
+        // 内核没有tls模块、OpenSSL编译时没有kTLS或套件不支持时静默使用用户态加密
+        SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+    }
+}
+
+/**
+ * @brief 所有客户端连接共享的SSL上下文，保存的会话按目标复用
+ */
+static auto GetClientContext() -> std::shared_ptr<SSL_CTX> {
+    static std::shared_ptr<SSL_CTX> s_ctx = [] {
+        std::shared_ptr<SSL_CTX> ctx(SSL_CTX_new(SSLv23_client_method()),
+                                     SSL_CTX_free);
+        ApplyContextMode(ctx.get());
+        SslClientSessions::Install(ctx.get());
+        return ctx;
+    }();
+    return s_ctx;
+}
+
 SslSocket::SslSocket(int family, int type, int protocol)
     : Socket(family, type, protocol) {}
 
@@ -36,6 +115,16 @@ auto SslSocket::CreateIpv6TcpSslSocket() -> SslSocket::ptr {
     return std::make_shared<SslSocket>(IPV6, TCP, 0);
 }
 
+auto SslSocket::CreateFromListenFd(int fd, std::shared_ptr<SSL_CTX> ctx)
+    -> SslSocket::ptr {
+    SslSocket::ptr socket = std::make_shared<SslSocket>();
+    if (!socket->InitListenFd(fd)) {
+        return nullptr;
+    }
+    socket->m_ctx = std::move(ctx);
+    return socket;
+}
+
 auto SslSocket::Bind(const Address::ptr &address) -> bool {
     return Socket::Bind(address);
 }
@@ -63,10 +152,111 @@ auto SslSocket::Connect(const Address::ptr &address, uint64_t timeout) -> bool {
     if (!Socket::Connect(address, timeout)) {
         return false;
     }
-    m_ctx.reset(SSL_CTX_new(SSLv23_client_method()), SSL_CTX_free);
+    m_ctx = GetClientContext();
     m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
     SSL_set_fd(m_ssl.get(), m_socket);
-    return SSL_connect(m_ssl.get()) == 1;
+    SSL_set_connect_state(m_ssl.get());
+    ApplyKtlsOption(m_ssl.get());
+    // 同一个目标上次的会话可以跳过完整握手
+    std::string target = address->ToString();
+    SslClientSessions::Apply(m_ssl.get(), target);
+    if (!Handshake(timeout)) {
+        SslClientSessions::Remove(target);
+        return false;
+    }
+    return true;
+}
+
+auto SslSocket::Handshake(uint64_t timeout) -> bool {
+    if (m_ssl == nullptr) {
+        return false;
+    }
+    uint64_t deadline =
+        timeout == static_cast<uint64_t>(-1) ? timeout : GetCurrentMS() + timeout;
+    while (true) {
+        int ret = CallSsl([this] { return SSL_do_handshake(m_ssl.get()); });
+        if (ret == 1) {
+            if (g_ssl_ktls->GetValue()) {
+                LOG_CUSTOM_DEBUG(sys_logger,
+                                 "SslSocket::Handshake sock = %d, ktls send = %d, "
+                                 "recv = %d",
+                                 m_socket, IsKtlsSend(), IsKtlsRecv())
+            }
+            if (SSL_is_server(m_ssl.get()) == 1) {
+                SslSessionManager *manager = SslSessionManager::Get(m_ctx.get());
+                bool resumed = SSL_session_reused(m_ssl.get()) == 1;
+                if (manager != nullptr) {
+                    manager->OnHandshake(resumed);
+                }
+                if (resumed && SSL_version(m_ssl.get()) == TLS1_3_VERSION) {
+                    // TLS1.3的客户端每张票据只用一次，复用的握手默认不发新票据，
+                    // 这里补发一张，客户端下次连接才能继续复用。
+                    // 发不完的部分随下一次写出去
+                    SSL_new_session_ticket(m_ssl.get());
+                    CallSsl([this] { return SSL_do_handshake(m_ssl.get()); });
+                }
+            }
+            return true;
+        }
+        uint64_t remain = deadline;
+        if (deadline != static_cast<uint64_t>(-1)) {
+            uint64_t now = GetCurrentMS();
+            if (now >= deadline) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+            remain = deadline - now;
+        }
+        if (!WaitForRetry(ret, remain)) {
+            LOG_CUSTOM_DEBUG(sys_logger,
+                             "SslSocket::Handshake fail sock = %d, errno = %d",
+                             m_socket, errno)
+            return false;
+        }
+    }
+}
+
+auto SslSocket::WaitForRetry(int ret, uint64_t timeout) -> bool {
+    EventType event = NONE;
+    switch (SSL_get_error(m_ssl.get(), ret)) {
+        case SSL_ERROR_WANT_READ:
+            event = READ;
+            break;
+        case SSL_ERROR_WANT_WRITE:
+            event = WRITE;
+            break;
+        default:
+            return false;
+    }
+    auto *iom = IOManager::GetThisThreadIOManager();
+    if (iom == nullptr) {
+        // 不在IOManager的线程上(比如main线程)，socket又是非阻塞的，退回poll
+        pollfd pfd{m_socket, static_cast<int16_t>(event == READ ? POLLIN : POLLOUT),
+                   0};
+        int wait = timeout == static_cast<uint64_t>(-1)
+                       ? -1
+                       : static_cast<int>(timeout);
+        int result = ::poll(&pfd, 1, wait);
+        if (result == 0) {
+            errno = ETIMEDOUT;
+        }
+        return result > 0;
+    }
+    // 和hook一样，超时后由IOManager写入ETIMEDOUT
+    int timeout_result = 0;
+    int result = timeout == static_cast<uint64_t>(-1)
+                     ? iom->AddEvent(m_socket, event)
+                     : iom->AddTimedEvent(m_socket, event, timeout,
+                                          &timeout_result);
+    if (result != 0) {
+        return false;
+    }
+    Fiber::GetCurFiber()->Yield();
+    if (timeout_result != 0) {
+        errno = timeout_result;
+        return false;
+    }
+    return true;
 }
 
 auto SslSocket::Reconnect(uint64_t timeout) -> bool {
@@ -77,34 +267,113 @@ auto SslSocket::Reconnect(uint64_t timeout) -> bool {
     return Connect(m_remote_address, timeout);
 }
 
-auto SslSocket::Close() -> bool { return Socket::Close(); }
+auto SslSocket::Close() -> bool {
+    if (m_ssl != nullptr && SSL_is_init_finished(m_ssl.get()) == 1) {
+        // 只发出close_notify，不等对端回复。没有正常关闭就释放的连接，
+        // OpenSSL会把它的会话作废，之后不能再复用
+        CallSsl([this] { return SSL_shutdown(m_ssl.get()); });
+    }
+    return Socket::Close();
+}
 
 auto SslSocket::Send(const void *buffer, size_t length, int flags) -> ssize_t {
     if (m_ssl == nullptr) {
         return -1;
     }
-    return SSL_write(m_ssl.get(), buffer, static_cast<int>(length));
+    uint64_t timeout = GetSendTimeout();
+    while (true) {
+        int ret = CallSsl([&] {
+            return SSL_write(m_ssl.get(), buffer, static_cast<int>(length));
+        });
+        if (ret > 0 || !WaitForRetry(ret, timeout)) {
+            return ret;
+        }
+    }
 }
 
 auto SslSocket::SendIovec(iovec *buffers, size_t length, int flags) -> ssize_t {
     if (m_ssl == nullptr) {
         return -1;
     }
-    int total = 0;
-    for (auto i = 0; i < length; ++i) {
-        int tmp =
-            SSL_write(m_ssl.get(), buffers[i].iov_base, buffers[i].iov_len);
+    if (IsKtlsSend()) {
+        // 由内核分记录加密，iovec直接交给sendmsg，不经过OpenSSL的记录缓冲区
+        msghdr msg{};
+        msg.msg_iov = buffers;
+        msg.msg_iovlen = length;
+        return ::sendmsg(m_socket, &msg, flags);
+    }
+    // 每次SSL_write至少产生一个TLS记录，逐个iovec写时头部和正文各占一个记录。
+    // 这里把连续的iovec拼成满的记录(16KB明文)再写；
+    // 本身就能填满记录的部分直接写，只有不足一个记录的零头经过缓冲区
+    ssize_t total = 0;
+    size_t index = 0;
+    size_t offset = 0;  // buffers[index]中已经处理的字节数
+    while (index < length) {
+        const char *base = static_cast<const char *>(buffers[index].iov_base);
+        size_t remain = buffers[index].iov_len - offset;
+        if (remain == 0) {
+            ++index;
+            offset = 0;
+            continue;
+        }
+        const char *data = base + offset;
+        size_t size = remain / kMaxRecordSize * kMaxRecordSize;
+        if (size != 0) {
+            offset += size;
+        } else {
+            if (m_record_buffer == nullptr) {
+                m_record_buffer = std::make_unique<char[]>(kMaxRecordSize);
+            }
+            while (index < length && size < kMaxRecordSize) {
+                size_t copy = std::min(buffers[index].iov_len - offset,
+                                       kMaxRecordSize - size);
+                memcpy(m_record_buffer.get() + size,
+                       static_cast<const char *>(buffers[index].iov_base) +
+                           offset,
+                       copy);
+                size += copy;
+                offset += copy;
+                if (offset == buffers[index].iov_len) {
+                    ++index;
+                    offset = 0;
+                }
+            }
+            data = m_record_buffer.get();
+        }
+        ssize_t tmp = Send(data, size, flags);
         if (tmp <= 0) {
-            return tmp;
+            return total == 0 ? tmp : total;
         }
         total += tmp;
-        if (tmp != static_cast<int>(buffers[i].iov_len)) {
-            break;
-        }
     }
     return total;
 }
 
+auto SslSocket::SendFile(int file_fd, off_t offset, size_t count) -> ssize_t {
+    if (m_ssl == nullptr) {
+        return -1;
+    }
+    if (IsKtlsSend()) {
+        // 内核从页缓存读出后直接加密发送，数据不经过用户态
+        uint64_t timeout = GetSendTimeout();
+        while (true) {
+            ossl_ssize_t ret = CallSsl([&] {
+                return SSL_sendfile(m_ssl.get(), file_fd, offset, count, 0);
+            });
+            if (ret >= 0 || !WaitForRetry(static_cast<int>(ret), timeout)) {
+                return ret;
+            }
+        }
+    }
+    // 没有kTLS时只能读到用户态加密，一次最多一个TLS记录的明文
+    char buffer[16 * 1024];
+    ssize_t len = ::pread(file_fd, buffer, std::min(count, sizeof(buffer)), offset);
+    if (len <= 0) {
+        return len;
+    }
+    return Send(buffer, len, 0);
+}
+
 auto SslSocket::SendTo(const void *buffer, size_t length,
                        const Address::ptr &to, int flags) -> ssize_t {
     return -1;
@@ -119,22 +388,29 @@ auto SslSocket::Recv(void *buffer, size_t length, int flags) -> ssize_t {
     if (m_ssl == nullptr) {
         return -1;
     }
-    return SSL_read(m_ssl.get(), buffer, length);
+    uint64_t timeout = GetRecvTimeout();
+    while (true) {
+        int ret = CallSsl([&] {
+            return SSL_read(m_ssl.get(), buffer, static_cast<int>(length));
+        });
+        if (ret > 0 || !WaitForRetry(ret, timeout)) {
+            return ret;
+        }
+    }
 }
 
 auto SslSocket::RecvIovec(iovec *buffers, size_t length, int flags) -> ssize_t {
     if (m_ssl == nullptr) {
         return -1;
     }
-    int total = 0;
-    for (auto i = 0; i < length; ++i) {
-        int tmp =
-            SSL_read(m_ssl.get(), buffers[i].iov_base, buffers[i].iov_len);
+    ssize_t total = 0;
+    for (size_t i = 0; i < length; ++i) {
+        ssize_t tmp = Recv(buffers[i].iov_base, buffers[i].iov_len, flags);
         if (tmp <= 0) {
-            return tmp;
+            return total == 0 ? tmp : total;
         }
         total += tmp;
-        if (tmp != static_cast<int>(buffers[i].iov_len)) {
+        if (tmp != static_cast<ssize_t>(buffers[i].iov_len)) {
             break;
         }
     }
@@ -171,37 +447,67 @@ auto SslSocket::ToString() const -> std::string {
     return ss.str();
 }
 
-auto SslSocket::LoadCertificates(const std::string &cert_file,
-                                 const std::string &key_file) -> bool {
-    m_ctx.reset(SSL_CTX_new(SSLv23_server_method()), SSL_CTX_free);
-    if (SSL_CTX_use_certificate_chain_file(m_ctx.get(), cert_file.c_str()) !=
-        1) {
+auto SslSocket::CreateServerContext(const std::string &cert_file,
+                                    const std::string &key_file)
+    -> std::shared_ptr<SSL_CTX> {
+    std::shared_ptr<SSL_CTX> ctx(SSL_CTX_new(SSLv23_server_method()),
+                                 SSL_CTX_free);
+    if (SSL_CTX_use_certificate_chain_file(ctx.get(), cert_file.c_str()) != 1) {
         LOG_CUSTOM_ERROR(sys_logger,
                          "SSL_CTX_use_certificate_chain_file(%s) error",
                          cert_file.c_str())
-        return false;
+        return nullptr;
     }
-    if (SSL_CTX_use_PrivateKey_file(m_ctx.get(), key_file.c_str(),
+    if (SSL_CTX_use_PrivateKey_file(ctx.get(), key_file.c_str(),
                                     SSL_FILETYPE_PEM) != 1) {
         LOG_CUSTOM_ERROR(sys_logger, "SSL_CTX_use_PrivateKey_file(%s) error",
                          cert_file.c_str())
-        return false;
+        return nullptr;
     }
-    if (SSL_CTX_check_private_key(m_ctx.get()) != 1) {
+    if (SSL_CTX_check_private_key(ctx.get()) != 1) {
         LOG_CUSTOM_ERROR(sys_logger,
                          "SSL_CTX_check_private_key cert_file=%s, key_file=%s",
                          cert_file.c_str(), key_file.c_str())
-        return false;
+        return nullptr;
     }
-    return true;
+    ApplyContextMode(ctx.get());
+    SslSessionManager::Install(ctx.get());
+    return ctx;
+}
+
+auto SslSocket::IsKtlsSend() const -> bool {
+    return m_ssl != nullptr && BIO_get_ktls_send(SSL_get_wbio(m_ssl.get()));
+}
+
+auto SslSocket::IsKtlsRecv() const -> bool {
+    return m_ssl != nullptr && BIO_get_ktls_recv(SSL_get_rbio(m_ssl.get()));
+}
+
+auto SslSocket::IsSessionReused() const -> bool {
+    return m_ssl != nullptr && SSL_session_reused(m_ssl.get()) == 1;
+}
+
+auto SslSocket::LoadCertificates(const std::string &cert_file,
+                                 const std::string &key_file) -> bool {
+    m_ctx = CreateServerContext(cert_file, key_file);
+    return m_ctx != nullptr;
+}
+
+auto SslSocket::GetContext() const -> std::shared_ptr<SSL_CTX> { return m_ctx; }
+
+void SslSocket::SetContext(std::shared_ptr<SSL_CTX> ctx) {
+    m_ctx = std::move(ctx);
 }
 
 auto SslSocket::Init(int sock) -> bool {
-    if (!Socket::Init(sock)) {
+    if (!Socket::Init(sock) || m_ctx == nullptr) {
         return false;
     }
+    // 只创建SSL对象，握手由处理连接的协程调用Handshake()完成，不阻塞accept
     m_ssl.reset(SSL_new(m_ctx.get()), SSL_free);
     SSL_set_fd(m_ssl.get(), m_socket);
-    return SSL_accept(m_ssl.get()) == 1;
+    SSL_set_accept_state(m_ssl.get());
+    ApplyKtlsOption(m_ssl.get());
+    return true;
 }
-}  // namespace wtsclwq
\ No newline at end of file
+}  // namespace wtsclwq
@@ -0,0 +1,85 @@
+//
+// 粗粒度时间轮
+//
+#include "../include/timer/timing_wheel.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace wtsclwq {
+
+TimingWheel::TimingWheel(uint64_t tick_ms, size_t slot_count)
+    : m_tick_ms(std::max<uint64_t>(tick_ms, 1)),
+      m_slots(std::max<size_t>(slot_count, 1)) {}
+
+TimingWheel::~TimingWheel() { Stop(); }
+
+void TimingWheel::Start(TimerManager *manager) {
+    std::weak_ptr<TimingWheel> weak_wheel = shared_from_this();
+    Timer::ptr timer = manager->AddTimer(
+        m_tick_ms,
+        [weak_wheel]() {
+            if (auto wheel = weak_wheel.lock()) {
+                wheel->Tick();
+            }
+        },
+        true);
+    ScopedLock<MutexType> lock(m_mutex);
+    m_timer = std::move(timer);
+}
+
+void TimingWheel::Stop() {
+    Timer::ptr timer{};
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        timer = std::move(m_timer);
+        for (auto &slot : m_slots) {
+            slot.clear();
+        }
+        m_size = 0;
+    }
+    if (timer) {
+        timer->Cancel();
+    }
+}
+
+auto TimingWheel::Add(uint64_t delay_ms, Callback callback) -> Entry::ptr {
+    auto entry = std::make_shared<Entry>(std::move(callback));
+    AddEntry(delay_ms, entry);
+    return entry;
+}
+
+auto TimingWheel::GetSize() -> size_t {
+    ScopedLock<MutexType> lock(m_mutex);
+    return m_size;
+}
+
+void TimingWheel::AddEntry(uint64_t delay_ms, Entry::ptr entry) {
+    // 向上取整到tick，至少在下一格到期，最多转一圈
+    uint64_t ticks = (delay_ms + m_tick_ms - 1) / m_tick_ms;
+    ticks = std::clamp<uint64_t>(ticks, 1, m_slots.size());
+    ScopedLock<MutexType> lock(m_mutex);
+    m_slots[(m_current + ticks) % m_slots.size()].push_back(std::move(entry));
+    ++m_size;
+}
+
+void TimingWheel::Tick() {
+    std::vector<Entry::ptr> expired;
+    {
+        ScopedLock<MutexType> lock(m_mutex);
+        m_current = (m_current + 1) % m_slots.size();
+        expired.swap(m_slots[m_current]);
+        m_size -= expired.size();
+    }
+    // 回调在锁外执行，回调中可以再向时间轮加入任务
+    for (auto &entry : expired) {
+        if (entry->m_is_cancelled) {
+            continue;
+        }
+        uint64_t next = entry->m_callback();
+        if (next != 0 && !entry->m_is_cancelled) {
+            AddEntry(next, std::move(entry));
+        }
+    }
+}
+}  // namespace wtsclwq
@@ -3,7 +3,13 @@
 //
 #include "../src/include/socket/address.h"
 
+#include <cassert>
+#include <cctype>
+
+#include "../src/include/config/config.h"
+#include "../src/include/io/io_manager.h"
 #include "../src/include/log/log_manager.h"
+#include "../src/include/socket/dns_resolver.h"
 #include "../src/include/socket/ip_address.h"
 #include "../src/include/socket/ipv4_address.h"
 #include "../src/include/socket/ipv6_address.h"
@@ -45,4 +51,106 @@ void TestIpv4() {
         LOG_INFO(logger, addr->ToString().c_str());
     }
 }
-int main() { TestIpv4(); }
+static int s_dns_queries = 0;
+
+/**
+ * @brief 本地的DNS桩服务器：svc.test有一条TTL为1s的A记录，
+ * nx.test返回NXDOMAIN，spoof.test的应答回显了别的域名，其余返回没有记录的NOERROR。
+ * 回显的问题一律改成大写，模拟会改变大小写的服务器
+ */
+void RunStubDnsServer(int sock) {
+    uint8_t buf[512];
+    sockaddr_in peer{};
+    socklen_t peer_len = sizeof(peer);
+    ssize_t len;
+    while ((len = recvfrom(sock, buf, sizeof(buf), 0,
+                           reinterpret_cast<sockaddr *>(&peer), &peer_len)) >
+           12) {
+        ++s_dns_queries;
+        // 解析问题中的域名和类型
+        std::string name;
+        size_t pos = 12;
+        while (buf[pos] != 0) {
+            if (!name.empty()) {
+                name += ".";
+            }
+            name.append(reinterpret_cast<char *>(buf + pos + 1), buf[pos]);
+            pos += buf[pos] + 1;
+        }
+        uint16_t qtype = (buf[pos + 1] << 8) | buf[pos + 2];
+        std::string resp(reinterpret_cast<char *>(buf), pos + 5);
+        resp[2] = static_cast<char>(0x81);
+        resp[3] = static_cast<char>(name == "nx.test" ? 0x83 : 0x80);
+        for (size_t i = 12; i < pos; ++i) {
+            resp[i] = static_cast<char>(toupper(resp[i]));
+        }
+        if (name == "spoof.test") {
+            resp[13] = 'R';
+        }
+        if ((name == "svc.test" || name == "spoof.test") && qtype == 1) {
+            resp[7] = 1;  // ANCOUNT
+            const uint8_t answer[] = {0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 1,
+                                      0,    4,    10, 1, 2, 3};
+            resp.append(reinterpret_cast<const char *>(answer),
+                        sizeof(answer));
+        } else if (name == "nx.test") {
+            resp[9] = 1;  // NSCOUNT，SOA的MINIMUM为60s
+            const uint8_t soa[] = {0xc0, 0x0c, 0, 6, 0, 1, 0, 0, 0x0e, 0x10,
+                                   0,    22,   0, 0, 0, 0, 0, 0, 0,    1,
+                                   0,    0,    0, 1, 0, 0, 0, 1, 0,    0,
+                                   0,    1,    0, 0, 0, 60};
+            resp.append(reinterpret_cast<const char *>(soa), sizeof(soa));
+        }
+        sendto(sock, resp.data(), resp.size(), 0,
+               reinterpret_cast<sockaddr *>(&peer), peer_len);
+    }
+}
+
+void TestDnsResolver() {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    auto server = wtsclwq::IPv4Address::Create("127.0.0.1", 0);
+    bind(sock, server->GetConstAddr(), server->GetAddrLen());
+    sockaddr_in local{};
+    socklen_t local_len = sizeof(local);
+    getsockname(sock, reinterpret_cast<sockaddr *>(&local), &local_len);
+    wtsclwq::Config::LookupByName<bool>("dns.resolver.enable")->SetValue(true);
+    wtsclwq::Config::LookupByName<int>("dns.resolver.timeout")->SetValue(200);
+    wtsclwq::Config::LookupByName<std::vector<std::string>>(
+        "dns.resolver.servers")
+        ->SetValue({"127.0.0.1:" + std::to_string(ntohs(local.sin_port))});
+    wtsclwq::IOManager::GetThisThreadIOManager()->Schedule(
+        [sock] { RunStubDnsServer(sock); });
+
+    // 单线程的IOManager中，解析器等待应答时桩服务器所在的协程照常运行
+    auto addr = wtsclwq::IPAddress::LookupAnyAddress("svc.test:80");
+    assert(addr && addr->ToString() == "10.1.2.3:80");
+    assert(s_dns_queries == 1);
+    addr = wtsclwq::IPAddress::LookupAnyAddress("SVC.test:8080");
+    assert(addr && addr->ToString() == "10.1.2.3:8080" && s_dns_queries == 1);
+
+    std::vector<wtsclwq::Address::ptr> addrs;
+    assert(!wtsclwq::Address::Lookup(addrs, "nx.test"));
+    assert(!wtsclwq::Address::Lookup(addrs, "nx.test") && s_dns_queries == 2);
+
+    // 回显的问题与查询不符的应答被丢弃，等到超时
+    std::vector<wtsclwq::IPAddress::ptr> spoofed;
+    assert(wtsclwq::DnsResolver::GetInstancePtr()->Resolve(
+               spoofed, "spoof.test", AF_INET) ==
+           wtsclwq::DnsResolverImpl::Status::FAILED);
+    assert(spoofed.empty() && s_dns_queries == 3);
+
+    // 正缓存的TTL只有1s
+    sleep(2);
+    addr = wtsclwq::IPAddress::LookupAnyAddress("svc.test:80");
+    assert(addr && s_dns_queries == 4);
+    LOG_CUSTOM_INFO(logger, "dns queries = %d, cache size = %zu",
+                    s_dns_queries,
+                    wtsclwq::DnsResolver::GetInstancePtr()->GetCacheSize());
+    close(sock);
+}
+
+int main() {
+    TestIpv4();
+    wtsclwq::IOManager iom(1, false, "dns");
+    iom.Schedule(TestDnsResolver);
+}
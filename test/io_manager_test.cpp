@@ -6,16 +6,32 @@
 
 #include <arpa/inet.h>
 #include <asm-generic/errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "../src/include/io/fd_manager.h"
 #include "../src/include/io/hook.h"
 #include "../src/include/log/log_manager.h"
+#include "../src/include/util/time_util.h"
 
 auto logger = ROOT_LOGGER;
 
@@ -119,11 +135,443 @@ void TestSock() {
     LOG_INFO(logger, buff);
     LOG_INFO(logger, "test hook end");
 }
+void TestRecvTimeout() {
+    // 对端不发送数据，recv应当在设置的超时时间后返回ETIMEDOUT
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    wtsclwq::FileDescriptorManager::GetInstancePtr()->Get(fds[0], true);
+    timeval tv{0, 200 * 1000};
+    setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char buf[16];
+    uint64_t begin = wtsclwq::GetCurrentMS();
+    ssize_t ret = recv(fds[0], buf, sizeof(buf), 0);
+    uint64_t cost = wtsclwq::GetCurrentMS() - begin;
+    LOG_CUSTOM_INFO(logger, "recv ret = %ld, errno = %d, cost = %lu ms", ret,
+                    errno, cost);
+    assert(ret == -1 && errno == ETIMEDOUT);
+    // 有数据时正常返回
+    send(fds[1], "hi", 2, 0);
+    ret = recv(fds[0], buf, sizeof(buf), 0);
+    assert(ret == 2);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void TestFileOffload() {
+    // 协程中打开的普通文件，读写交给卸载线程池执行，协程恢复后得到正确结果
+    const char *path = "/tmp/io_manager_test_offload";
+    int filedesc = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    assert(filedesc >= 0);
+    ssize_t ret = pwrite(filedesc, "offload", 7, 0);
+    assert(ret == 7);
+    assert(fdatasync(filedesc) == 0);
+    char buf[16]{};
+    ret = pread(filedesc, buf, sizeof(buf), 0);
+    LOG_CUSTOM_INFO(logger, "pread ret = %ld, buf = %s", ret, buf);
+    assert(ret == 7 && memcmp(buf, "offload", 7) == 0);
+    // preadv/pwritev同样走卸载线程池，FileStream按块读写快照依赖这两个调用
+    iovec wiov[2]{{const_cast<char *>("off"), 3}, {const_cast<char *>("load"), 4}};
+    ret = pwritev(filedesc, wiov, 2, 7);
+    assert(ret == 7);
+    char head[7]{};
+    char tail[7]{};
+    iovec riov[2]{{head, sizeof(head)}, {tail, sizeof(tail)}};
+    ret = preadv(filedesc, riov, 2, 0);
+    assert(ret == 14 && memcmp(head, "offload", 7) == 0 &&
+           memcmp(tail, "offload", 7) == 0);
+    close(filedesc);
+    unlink(path);
+}
+
+void TestStaleFd() {
+    // 文件fd被未经hook的close关闭后，同一个fd号被socket复用，不能沿用旧的文件登记
+    const char *path = "/tmp/io_manager_test_stale";
+    int filedesc = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    assert(filedesc >= 0);
+    unlink(path);
+    auto fd_manager = wtsclwq::FileDescriptorManager::GetInstancePtr();
+    assert(fd_manager->Get(filedesc)->IsFile());
+    wtsclwq::SetHookEnable(false);
+    close(filedesc);
+    wtsclwq::SetHookEnable(true);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    assert(sock == filedesc);
+    auto fdp = fd_manager->Get(sock);
+    assert(fdp && fdp->IsSocket() && !fdp->IsFile() &&
+           fdp->GetSystemNonBlock());
+    close(sock);
+}
+
+void TestPoll() {
+    // poll/select/epoll_wait挂起的是协程，等待期间同线程的其他协程照常运行
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
+    iom->Schedule([fds] {
+        usleep(100 * 1000);
+        send(fds[1], "x", 1, 0);
+    });
+    pollfd pfd{fds[0], POLLIN, 0};
+    uint64_t begin = wtsclwq::GetCurrentMS();
+    int ret = poll(&pfd, 1, 1000);
+    LOG_CUSTOM_INFO(logger, "poll ret = %d, revents = %d, cost = %lu ms", ret,
+                    pfd.revents, wtsclwq::GetCurrentMS() - begin);
+    assert(ret == 1 && (pfd.revents & POLLIN) != 0);
+
+    // 已经可读的fd立即返回，可写的fd只在超时后返回0
+    fd_set read_set;
+    FD_ZERO(&read_set);
+    FD_SET(fds[0], &read_set);
+    timeval tv{1, 0};
+    ret = select(fds[0] + 1, &read_set, nullptr, nullptr, &tv);
+    assert(ret == 1 && FD_ISSET(fds[0], &read_set));
+    char buf[4];
+    recv(fds[0], buf, sizeof(buf), 0);
+    pfd.revents = 0;
+    begin = wtsclwq::GetCurrentMS();
+    ret = poll(&pfd, 1, 100);
+    LOG_CUSTOM_INFO(logger, "poll timeout ret = %d, cost = %lu ms", ret,
+                    wtsclwq::GetCurrentMS() - begin);
+    assert(ret == 0);
+
+    int epfd = epoll_create1(0);
+    epoll_event ep_event{};
+    ep_event.events = EPOLLIN;
+    ep_event.data.fd = fds[0];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fds[0], &ep_event);
+    iom->Schedule([fds] {
+        usleep(100 * 1000);
+        send(fds[1], "y", 1, 0);
+    });
+    ret = epoll_wait(epfd, &ep_event, 1, 1000);
+    LOG_CUSTOM_INFO(logger, "epoll_wait ret = %d, fd = %d", ret,
+                    ep_event.data.fd);
+    assert(ret == 1 && ep_event.data.fd == fds[0]);
+    close(epfd);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void TestPollFallback() {
+    // select当作sleep用：没有fd时只挂起协程，同线程的其他协程照常运行
+    auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
+    auto ticks = std::make_shared<std::atomic_int>(0);
+    iom->Schedule([ticks] {
+        for (int i = 0; i < 10; ++i) {
+            usleep(10 * 1000);
+            ++*ticks;
+        }
+    });
+    timeval tv{0, 200 * 1000};
+    uint64_t begin = wtsclwq::GetCurrentMS();
+    int ret = select(0, nullptr, nullptr, nullptr, &tv);
+    uint64_t cost = wtsclwq::GetCurrentMS() - begin;
+    LOG_CUSTOM_INFO(logger, "select sleep ret = %d, cost = %lu ms, ticks = %d",
+                    ret, cost, ticks->load());
+    assert(ret == 0 && cost >= 190 && *ticks == 10);
+
+    // 两个协程poll同一个fd：后来的协程不能注册同一事件，改为定时重试，
+    // 也不阻塞线程，发送数据的协程照常运行，两个poll都在数据到达后返回
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    auto other_ret = std::make_shared<std::atomic_int>(-2);
+    iom->Schedule([fds, other_ret] {
+        pollfd pfd{fds[0], POLLIN, 0};
+        *other_ret = poll(&pfd, 1, 1000);
+    });
+    iom->Schedule([fds] {
+        usleep(100 * 1000);
+        send(fds[1], "x", 1, 0);
+    });
+    pollfd pfd{fds[0], POLLIN, 0};
+    begin = wtsclwq::GetCurrentMS();
+    ret = poll(&pfd, 1, 1000);
+    while (*other_ret == -2) {
+        usleep(1000);
+    }
+    cost = wtsclwq::GetCurrentMS() - begin;
+    LOG_CUSTOM_INFO(logger, "shared poll ret = %d/%d, cost = %lu ms", ret,
+                    other_ret->load(), cost);
+    assert(ret == 1 && *other_ret == 1 && cost < 500);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * @brief 注册给hook的socketpair，发送缓冲区尽量小，便于写满
+ */
+static void HookedSocketPair(int fds[2]) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    for (int i = 0; i < 2; ++i) {
+        wtsclwq::FileDescriptorManager::GetInstancePtr()->Get(fds[i], true);
+        int size = 4096;
+        setsockopt(fds[i], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+}
+
+/**
+ * @brief 在另一个协程中读完len字节，写到out
+ */
+static void DrainLater(int fd, size_t len,
+                       const std::shared_ptr<std::string> &out) {
+    wtsclwq::IOManager::GetThisThreadIOManager()->Schedule([fd, len, out] {
+        usleep(50 * 1000);
+        char buf[4096];
+        while (out->size() < len) {
+            ssize_t ret = recv(fd, buf, sizeof(buf), 0);
+            assert(ret > 0);
+            out->append(buf, ret);
+        }
+    });
+}
+
+void TestExtendedHooks() {
+    // 每个调用先遇到EAGAIN挂起，由同线程的另一个协程让它就绪后恢复
+    auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
+    const std::string payload(256 * 1024, 'p');
+
+    // accept4：监听socket上还没有连接
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    listen(listen_fd, 8);
+    socklen_t addr_len = sizeof(addr);
+    getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+    auto client = std::make_shared<int>(-1);
+    iom->Schedule([addr, client] {
+        usleep(50 * 1000);
+        *client = socket(AF_INET, SOCK_STREAM, 0);
+        connect(*client, reinterpret_cast<const sockaddr *>(&addr),
+                sizeof(addr));
+    });
+    uint64_t begin = wtsclwq::GetCurrentMS();
+    int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    LOG_CUSTOM_INFO(logger, "accept4 ret = %d, cost = %lu ms", conn,
+                    wtsclwq::GetCurrentMS() - begin);
+    assert(conn >= 0 && wtsclwq::GetCurrentMS() - begin >= 40);
+    close(conn);
+    close(*client);
+    close(listen_fd);
+
+    // preadv2：socket上还没有数据
+    int fds[2];
+    HookedSocketPair(fds);
+    iom->Schedule([fds] {
+        usleep(50 * 1000);
+        send(fds[1], "abc", 3, 0);
+    });
+    char buf[8]{};
+    iovec iov{buf, sizeof(buf)};
+    ssize_t ret = preadv2(fds[0], &iov, 1, -1, 0);
+    assert(ret == 3 && memcmp(buf, "abc", 3) == 0);
+
+    // pwritev2：发送缓冲区写满后等对端读走
+    auto received = std::make_shared<std::string>();
+    DrainLater(fds[1], payload.size(), received);
+    size_t sent = 0;
+    while (sent < payload.size()) {
+        iovec out{const_cast<char *>(payload.data()) + sent,
+                  payload.size() - sent};
+        ret = pwritev2(fds[0], &out, 1, -1, 0);
+        assert(ret > 0);
+        sent += ret;
+    }
+    while (received->size() < payload.size()) {
+        usleep(1000);
+    }
+    assert(*received == payload);
+    LOG_INFO(logger, "preadv2/pwritev2 resumed");
+
+    // sendfile：socket写满后等对端读走
+    const char *path = "/tmp/io_manager_test_sendfile";
+    int file = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    assert(pwrite(file, payload.data(), payload.size(), 0) ==
+           static_cast<ssize_t>(payload.size()));
+    received = std::make_shared<std::string>();
+    DrainLater(fds[1], payload.size(), received);
+    off_t offset = 0;
+    while (static_cast<size_t>(offset) < payload.size()) {
+        ret = sendfile(fds[0], file, &offset, payload.size() - offset);
+        assert(ret > 0);
+    }
+    while (received->size() < payload.size()) {
+        usleep(1000);
+    }
+    assert(*received == payload);
+    close(file);
+    unlink(path);
+    LOG_INFO(logger, "sendfile resumed");
+
+    // splice socket→管道：socket还没有数据，等socket可读
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0);
+    iom->Schedule([fds] {
+        usleep(50 * 1000);
+        send(fds[1], "xyz", 3, 0);
+    });
+    ret = splice(fds[0], nullptr, pipe_fds[1], nullptr, 4096, 0);
+    assert(ret == 3);
+    assert(read(pipe_fds[0], buf, sizeof(buf)) == 3);
+
+    // splice socket→管道：管道是满的(阻塞模式)，socket有数据，等管道可写。
+    // 旧实现会阻塞整个线程，读走管道数据的协程永远没有机会运行
+    int pipe_size = fcntl(pipe_fds[1], F_GETPIPE_SZ);
+    std::string fill(pipe_size, 'f');
+    assert(write(pipe_fds[1], fill.data(), fill.size()) ==
+           static_cast<ssize_t>(fill.size()));
+    send(fds[1], "xyz", 3, 0);
+    iom->Schedule([pipe_fds, pipe_size] {
+        usleep(50 * 1000);
+        std::string drained(pipe_size, '\0');
+        assert(read(pipe_fds[0], &drained[0], drained.size()) == pipe_size);
+    });
+    begin = wtsclwq::GetCurrentMS();
+    ret = splice(fds[0], nullptr, pipe_fds[1], nullptr, 4096, 0);
+    LOG_CUSTOM_INFO(logger, "splice into full pipe ret = %ld, cost = %lu ms",
+                    ret, wtsclwq::GetCurrentMS() - begin);
+    assert(ret == 3);
+    assert(read(pipe_fds[0], buf, sizeof(buf)) == 3);
+
+    // splice 管道→socket：socket写满，等socket可写
+    std::string chunk(4096, 'c');
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    while (send(fds[0], chunk.data(), chunk.size(), 0) > 0) {
+    }
+    fcntl(fds[0], F_SETFL, 0);
+    int queued = 0;
+    ioctl(fds[1], FIONREAD, &queued);
+    assert(write(pipe_fds[1], chunk.data(), chunk.size()) ==
+           static_cast<ssize_t>(chunk.size()));
+    received = std::make_shared<std::string>();
+    DrainLater(fds[1], queued + chunk.size(), received);
+    size_t spliced = 0;
+    while (spliced < chunk.size()) {
+        ret = splice(pipe_fds[0], nullptr, fds[0], nullptr,
+                     chunk.size() - spliced, 0);
+        assert(ret > 0);
+        spliced += ret;
+    }
+    while (received->size() < queued + chunk.size()) {
+        usleep(1000);
+    }
+    assert(received->substr(queued) == chunk);
+    LOG_INFO(logger, "splice resumed");
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+/**
+ * @brief 一个线程不停地关闭、重新创建fd，其他线程在FdEpochGuard中用GetRaw读取，
+ * 读到的对象必须是完整的；配合-fsanitize=address/thread可以发现释放后使用和数据竞争
+ */
+void TestFdManagerStress() {
+    const int fd_count = 64;
+    const int reader_count = 3;
+    auto fd_manager = wtsclwq::FileDescriptorManager::GetInstancePtr();
+    std::vector<int> fds(fd_count);
+    int max_fd = 0;
+    for (auto &fd : fds) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        fd_manager->Get(fd, true);
+        max_fd = std::max(max_fd, fd);
+    }
+
+    std::atomic_bool stop{false};
+    std::atomic_uint64_t hits{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < reader_count; ++i) {
+        readers.emplace_back([&, i] {
+            std::mt19937 engine(i);
+            std::uniform_int_distribution<int> dist(0, max_fd);
+            uint64_t local_hits = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                wtsclwq::FdEpochGuard guard;
+                wtsclwq::FileDescriptor *fdp = fd_manager->GetRaw(dist(engine));
+                // 构造时确定的状态在发布前就已写好，读者总能看到
+                if (fdp != nullptr) {
+                    assert(fdp->IsInit() && fdp->IsSocket() &&
+                           !fdp->IsClosed());
+                    ++local_hits;
+                }
+            }
+            hits += local_hits;
+        });
+    }
+
+    // 模拟hook后的close和socket：先删除登记再关闭，新fd复用同一个号
+    uint64_t reopened = 0;
+    uint64_t deadline = wtsclwq::GetCurrentMS() + 1000;
+    std::mt19937 engine(reader_count);
+    while (wtsclwq::GetCurrentMS() < deadline) {
+        int &fd = fds[engine() % fd_count];
+        fd_manager->Remove(fd);
+        close(fd);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        assert(fd >= 0);
+        fd_manager->Reset(fd);
+        ++reopened;
+    }
+    stop = true;
+    for (auto &reader : readers) {
+        reader.join();
+    }
+    for (int fd : fds) {
+        fd_manager->Remove(fd);
+        close(fd);
+    }
+    LOG_CUSTOM_INFO(logger, "fd manager stress: reopened %lu fds, %lu hits",
+                    reopened, hits.load());
+    assert(reopened > 0 && hits > 0);
+}
+
+/**
+ * @brief hook不处理的fd(这里是未登记的管道)直接执行系统调用，阻塞期间不能占住epoch，
+ * 否则其他线程删除的FileDescriptor都无法回收
+ */
+void TestBlockingPassThrough() {
+    auto fd_manager = wtsclwq::FileDescriptorManager::GetInstancePtr();
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0);
+    {
+        wtsclwq::IOManager iom(1, false, "pass_through");
+        iom.Schedule([&] {
+            char chr;
+            assert(read(pipe_fds[0], &chr, 1) == 1);
+        });
+        usleep(50 * 1000);
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        std::weak_ptr<wtsclwq::FileDescriptor> weak = fd_manager->Get(fd, true);
+        fd_manager->Remove(fd);
+        close(fd);
+        assert(weak.expired());
+        assert(write(pipe_fds[1], "x", 1) == 1);
+    }
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    LOG_INFO(logger, "TestBlockingPassThrough passed");
+}
+
 auto main() -> int {
     // test1();
     // test_timer();
     // test_hook();
     //    TestTimer();
+    TestFdManagerStress();
+    TestBlockingPassThrough();
+    {
+        wtsclwq::IOManager iom(1, false, "timeout");
+        iom.Schedule(TestRecvTimeout);
+        iom.Schedule(TestFileOffload);
+        iom.Schedule(TestStaleFd);
+        iom.Schedule(TestPoll);
+        iom.Schedule(TestPollFallback);
+        iom.Schedule(TestExtendedHooks);
+    }
     wtsclwq::IOManager iom(2, false,"aaa");
     std::this_thread::sleep_for(std::chrono::seconds (10));
     return 0;
@@ -2,8 +2,19 @@
 // Created by wtsclwq on 23-4-2.
 //
 
+#include <fcntl.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+
 #include "../src/include/log/log_manager.h"
+#include "../src/include/serialize/array_codec.h"
 #include "../src/include/serialize/byte_array.h"
+#include "../src/include/serialize/file_stream.h"
+#include "../src/include/serialize/serializer.h"
 #include "../src/include/util/macro.h"
 
 static wtsclwq::Logger::ptr logger = ROOT_LOGGER;
@@ -53,9 +64,56 @@ void test() {
 
     TEST_BYTE_ARR(uint64_t, 100, WriteUint64, ReadUint64, 1);
 
+    TEST_BYTE_ARR(float, 100, WriteFixedFloat, ReadFixedFloat, 3);
+
+    TEST_BYTE_ARR(double, 100, WriteFixedDouble, ReadFixedDouble, 3);
+
 #undef TEST_BYTE_ARR
 }
 
+/**
+ * @brief 值跨越内存块边界、varint取极值、带长度的字符串
+ */
+void test_boundary() {
+    const uint64_t values[] = {0, 1, 127, 128, UINT32_MAX, UINT64_MAX};
+    for (size_t base_size : {1, 3, 7, 16}) {
+        for (bool little : {false, true}) {
+            wtsclwq::ByteArray ba(base_size);
+            ba.SetIsLittleEndian(little);
+            for (uint64_t value : values) {
+                ba.WriteUint64(value);
+                ba.WriteUint32(static_cast<uint32_t>(value));
+                ba.WriteInt64(static_cast<int64_t>(value));
+                ba.WriteFixedUint64(value);
+                ba.WriteFixedUint16(static_cast<uint16_t>(value));
+            }
+            ba.WriteStringFixedUint16("abc");
+            ba.WriteStringFixedUint32(std::string(300, 'x'));
+            ba.WriteStringFixedUint64("hello");
+            ba.WriteStringVint("world");
+            ba.SetPosition(0);
+            for (uint64_t value : values) {
+                WTSCLWQ_ASSERT(ba.ReadUint64() == value, "varint64");
+                WTSCLWQ_ASSERT(ba.ReadUint32() == static_cast<uint32_t>(value),
+                               "varint32");
+                WTSCLWQ_ASSERT(ba.ReadInt64() == static_cast<int64_t>(value),
+                               "zigzag64");
+                WTSCLWQ_ASSERT(ba.ReadFixedUint64() == value, "fixed64");
+                WTSCLWQ_ASSERT(
+                    ba.ReadFixedUint16() == static_cast<uint16_t>(value),
+                    "fixed16");
+            }
+            WTSCLWQ_ASSERT(ba.ReadStringFixedUint16() == "abc", "string16");
+            WTSCLWQ_ASSERT(ba.ReadStringFixedUint32() == std::string(300, 'x'),
+                           "string32");
+            WTSCLWQ_ASSERT(ba.ReadStringFixedUint64() == "hello", "string64");
+            WTSCLWQ_ASSERT(ba.ReadStringVint64() == "world", "string varint");
+            WTSCLWQ_ASSERT(ba.GetReadableSize() == 0, "readable size");
+        }
+    }
+    LOG_INFO(logger, "test_boundary passed");
+}
+
 void test_file() {
 #define TEST_BYTE_ARR(type, len, write_fun, read_fun, base_len)              \
     {                                                                        \
@@ -120,7 +178,935 @@ void test_file() {
 //    TEST_BYTE_ARR(uint64_t, 100, WriteUint64, ReadUint64, 1);
 #undef TEST_BYTE_ARR
 }
+/**
+ * @brief 构造并解析100MB的消息：每条记录是定长的序号、varint和带长度的字符串
+ */
+void bench_large_message() {
+    const size_t message_size = 100 * 1024 * 1024;
+    const std::string payload(100, 'p');
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        wtsclwq::ByteArray::ptr ba(new wtsclwq::ByteArray());
+        uint32_t count = 0;
+        while (ba->GetSize() < message_size) {
+            ba->WriteFixedUint32(count);
+            ba->WriteUint64(count * 2654435761ULL);
+            ba->WriteStringVint(payload);
+            ++count;
+        }
+        auto built = std::chrono::steady_clock::now();
+        ba->SetPosition(0);
+        for (uint32_t i = 0; i < count; ++i) {
+            WTSCLWQ_ASSERT(ba->ReadFixedUint32() == i, "value not equal");
+            WTSCLWQ_ASSERT(ba->ReadUint64() == i * 2654435761ULL,
+                           "value not equal");
+            WTSCLWQ_ASSERT(ba->ReadStringVint64() == payload,
+                           "value not equal");
+        }
+        WTSCLWQ_ASSERT(ba->GetReadableSize() == 0,
+                       "readable size is not zero");
+        auto parsed = std::chrono::steady_clock::now();
+        ba.reset();
+        auto freed = std::chrono::steady_clock::now();
+        auto ms = [](auto from, auto to) {
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        };
+        LOG_CUSTOM_INFO(logger,
+                        "100MB message, %u records: build %.0f ms, parse %.0f "
+                        "ms, free %.0f ms",
+                        count, ms(start, built), ms(built, parsed),
+                        ms(parsed, freed))
+    }
+}
+
+static auto BlockAddresses(const wtsclwq::ByteArray &ba)
+    -> std::set<const void *> {
+    std::vector<iovec> buffers;
+    ba.GetReadBuffers(buffers, ba.GetSize(), 0);
+    std::set<const void *> addresses;
+    for (const auto &buffer : buffers) {
+        addresses.insert(buffer.iov_base);
+    }
+    return addresses;
+}
+
+void test_cross_thread_free() {
+    using wtsclwq::ByteArray;
+    // 在新线程中分配，本线程池里缓存的块不会影响结果
+    std::thread producer([] {
+        const size_t base_size = 1000;
+        const std::string data(64 * base_size, 'x');
+        auto ba = std::make_shared<ByteArray>(base_size);
+        ba->WriteStringWithoutLength(data);
+        auto freed = BlockAddresses(*ba);
+        WTSCLWQ_ASSERT(freed.size() == 64, "block count");
+
+        // 另一个线程释放后保持存活，块要回到分配它们的线程，而不是留在释放线程的池里
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool released = false;
+        bool done = false;
+        std::thread consumer([&] {
+            ba.reset();
+            std::unique_lock<std::mutex> lock(mutex);
+            released = true;
+            cond.notify_all();
+            cond.wait(lock, [&] { return done; });
+        });
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&] { return released; });
+        }
+        ByteArray again(base_size);
+        again.WriteStringWithoutLength(data);
+        auto reused = BlockAddresses(again);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            cond.notify_all();
+        }
+        consumer.join();
+        WTSCLWQ_ASSERT(reused == freed, "blocks not returned to owner thread");
+    });
+    producer.join();
+}
+
+/**
+ * @brief 逐个写入、读出count个值，统计每个值的耗时
+ */
+template <class T, class Write, class Read>
+static void BenchValues(const char *name, Write write, Read read) {
+    const uint64_t count = 10 * 1000 * 1000;
+    wtsclwq::ByteArray ba;
+    uint64_t expected = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < count; ++i) {
+        // 值的位数在1到64之间变化，varint的长度也随之变化
+        auto value = static_cast<T>((i * 0x9E3779B97F4A7C15ULL) >> (i % 64));
+        write(ba, value);
+        expected += static_cast<uint64_t>(value);
+    }
+    auto written = std::chrono::steady_clock::now();
+    ba.SetPosition(0);
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        sum += static_cast<uint64_t>(read(ba));
+    }
+    auto parsed = std::chrono::steady_clock::now();
+    WTSCLWQ_ASSERT(sum == expected, "value not equal");
+    auto ns = [count](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() /
+               count;
+    };
+    LOG_CUSTOM_INFO(logger, "%s: write %.2f ns, read %.2f ns per value", name,
+                    ns(start, written), ns(written, parsed))
+}
+
+void bench_values() {
+    using wtsclwq::ByteArray;
+    BenchValues<uint32_t>(
+        "fixed uint32",
+        [](ByteArray &ba, uint32_t v) { ba.WriteFixedUint32(v); },
+        [](ByteArray &ba) { return ba.ReadFixedUint32(); });
+    BenchValues<uint64_t>(
+        "fixed uint64",
+        [](ByteArray &ba, uint64_t v) { ba.WriteFixedUint64(v); },
+        [](ByteArray &ba) { return ba.ReadFixedUint64(); });
+    BenchValues<uint32_t>(
+        "varint uint32", [](ByteArray &ba, uint32_t v) { ba.WriteUint32(v); },
+        [](ByteArray &ba) { return ba.ReadUint32(); });
+    BenchValues<uint64_t>(
+        "varint uint64", [](ByteArray &ba, uint64_t v) { ba.WriteUint64(v); },
+        [](ByteArray &ba) { return ba.ReadUint64(); });
+    BenchValues<int64_t>(
+        "zigzag int64", [](ByteArray &ba, int64_t v) { ba.WriteInt64(v); },
+        [](ByteArray &ba) { return ba.ReadInt64(); });
+}
+
+/**
+ * @brief iov是否指向ba的某个节点，用来确认切片没有复制数据
+ */
+static auto SharesMemory(const wtsclwq::ByteArray &ba, const iovec &iov)
+    -> bool {
+    std::vector<iovec> buffers;
+    ba.GetReadBuffers(buffers, ba.GetSize(), 0);
+    const char *ptr = static_cast<const char *>(iov.iov_base);
+    for (const auto &buffer : buffers) {
+        const char *begin = static_cast<const char *>(buffer.iov_base);
+        if (ptr >= begin && ptr + iov.iov_len <= begin + buffer.iov_len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_slices() {
+    using wtsclwq::ByteArray;
+    std::string data;
+    for (int i = 0; i < 1000; ++i) {
+        data.push_back(static_cast<char>('a' + i % 26));
+    }
+    auto ba = std::make_shared<ByteArray>(16);
+    ba->WriteStringWithoutLength(data);
+    ba->SetPosition(0);
+
+    // 切片和原数据共享内存
+    auto slice = ba->Slice(5, 300);
+    WTSCLWQ_ASSERT(slice->GetSize() == 300 && slice->GetPosition() == 0,
+                   "slice size");
+    WTSCLWQ_ASSERT(slice->ToString() == data.substr(5, 300), "slice data");
+    std::vector<iovec> iovs;
+    slice->GetReadBuffers(iovs);
+    for (const auto &iov : iovs) {
+        WTSCLWQ_ASSERT(SharesMemory(*ba, iov), "slice copied");
+    }
+    // 切片的切片，按不等长的节点定位
+    auto sub = slice->Slice(7, 100);
+    WTSCLWQ_ASSERT(sub->ToString() == data.substr(12, 100), "sub slice");
+    sub->SetPosition(50);
+    WTSCLWQ_ASSERT(sub->ReadFixedUint8() == static_cast<uint8_t>(data[62]),
+                   "sub slice read");
+
+    // 写入共享的数据时先复制，另一方不受影响
+    ba->SetPosition(10);
+    ba->WriteFixedUint32(0xFFFFFFFF);
+    WTSCLWQ_ASSERT(slice->ToString() == data.substr(5, 300), "slice changed");
+    slice->SetPosition(0);
+    slice->WriteStringWithoutLength("XYZ");
+    ba->SetPosition(5);
+    WTSCLWQ_ASSERT(ba->ReadFixedUint8() == static_cast<uint8_t>(data[5]),
+                   "source changed");
+    WTSCLWQ_ASSERT(sub->ToString() == data.substr(63, 49), "sub changed");
+
+    // 多个线程同时切片同一个const ByteArray；切片不改动源，
+    // 源在当前位置继续写入时按引用计数发现块被共享，先复制
+    {
+        auto source = std::make_shared<ByteArray>(16);
+        source->WriteStringWithoutLength(data.substr(0, 64));
+        source->SetPosition(20);
+        const ByteArray &shared = *source;
+        std::vector<ByteArray::ptr> slices[2];
+        std::thread slicers[2];
+        for (int i = 0; i < 2; ++i) {
+            slicers[i] = std::thread([&shared, &out = slices[i]] {
+                for (int round = 0; round < 1000; ++round) {
+                    out.push_back(shared.Slice(16, 16));
+                }
+            });
+        }
+        for (auto &slicer : slicers) {
+            slicer.join();
+        }
+        char *before = source->GetContiguousWriteBuffer(4);
+        WTSCLWQ_ASSERT(before == nullptr, "shared block writable");
+        source->WriteFixedUint32(0xFFFFFFFF);
+        for (const auto &out : slices) {
+            WTSCLWQ_ASSERT(out.back()->ToString() == data.substr(16, 16),
+                           "concurrent slice changed");
+        }
+        // 切片都释放后，复制出的块只有源在用，又能原地写入
+        slices[0].clear();
+        slices[1].clear();
+        WTSCLWQ_ASSERT(source->GetContiguousWriteBuffer(4) != nullptr,
+                       "exclusive block not writable");
+    }
+
+    // 拼接：只移动节点，被拼接的一方变为空
+    auto rope = std::make_shared<ByteArray>(16);
+    rope->WriteStringWithoutLength("head");
+    rope->Append(std::move(*ba->Slice(100, 200)));
+    auto tail = ba->Slice(500, 10);
+    rope->Append(std::move(*tail));
+    WTSCLWQ_ASSERT(tail->GetSize() == 0, "appended not empty");
+    rope->SetPosition(rope->GetSize());
+    rope->WriteFixedUint32(42);
+    rope->SetPosition(0);
+    std::string expected = "head" + data.substr(100, 200) + data.substr(500, 10);
+    std::string head(expected.size(), '\0');
+    rope->Read(head.data(), head.size());
+    WTSCLWQ_ASSERT(head == expected, "rope data");
+    WTSCLWQ_ASSERT(rope->ReadFixedUint32() == 42, "rope tail");
+
+    // 克隆保留位置，原数据释放后切片和克隆仍然有效
+    rope->SetPosition(4);
+    auto clone = rope->Clone();
+    WTSCLWQ_ASSERT(clone->GetPosition() == 4 &&
+                       clone->GetSize() == rope->GetSize(),
+                   "clone");
+    ba.reset();
+    rope.reset();
+    WTSCLWQ_ASSERT(clone->ToString() ==
+                       expected.substr(4) + std::string("\0\0\0\x2a", 4),
+                   "clone data");
+    slice->SetPosition(0);
+    WTSCLWQ_ASSERT(slice->ToString() == "XYZ" + data.substr(8, 297),
+                   "slice data after free");
+    clone->Clear();
+    clone->WriteFixedUint64(7);
+    clone->SetPosition(0);
+    WTSCLWQ_ASSERT(clone->ReadFixedUint64() == 7, "clear");
+    LOG_INFO(logger, "test_slices passed");
+}
+
+/**
+ * @brief 把100MB消息中的每条记录转发出去：读出到新的ByteArray和切片对比
+ */
+void bench_forward() {
+    using wtsclwq::ByteArray;
+    const size_t record_size = 64 * 1024;
+    const size_t count = 1600;
+    ByteArray message;
+    const std::string record(record_size, 'r');
+    for (size_t i = 0; i < count; ++i) {
+        message.WriteStringWithoutLength(record);
+    }
+    auto ms = [](auto from, auto to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+    std::string buffer(record_size, '\0');
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        message.Read(buffer.data(), record_size, i * record_size);
+        ByteArray copy(record_size);
+        copy.Write(buffer.data(), record_size);
+        total += copy.GetSize();
+    }
+    auto copied = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        total += message.Slice(i * record_size, record_size)->GetSize();
+    }
+    auto sliced = std::chrono::steady_clock::now();
+    WTSCLWQ_ASSERT(total == 2 * count * record_size, "forward size");
+    LOG_CUSTOM_INFO(logger,
+                    "forward %zu x %zu bytes: copy %.0f ms, slice %.0f ms",
+                    count, record_size, ms(start, copied), ms(copied, sliced))
+}
+
+static const wtsclwq::SimdLevel::Level kSimdLevels[] = {
+    wtsclwq::SimdLevel::SCALAR, wtsclwq::SimdLevel::SSE4_1,
+    wtsclwq::SimdLevel::AVX2};
+
+/**
+ * @brief 批量写入的字节和逐个写入相同，批量读出的值和写入的相同
+ */
+template <class T, class WriteOne, class WriteArray, class ReadArray>
+static void CheckArray(const std::vector<T> &values, size_t base_size,
+                       bool little, WriteOne write_one, WriteArray write_array,
+                       ReadArray read_array) {
+    wtsclwq::ByteArray one(base_size);
+    wtsclwq::ByteArray bulk(base_size);
+    one.SetIsLittleEndian(little);
+    bulk.SetIsLittleEndian(little);
+    // 先写一个字节，让数组从内存块中间开始
+    one.WriteFixedUint8(1);
+    bulk.WriteFixedUint8(1);
+    for (const T &value : values) {
+        write_one(one, value);
+    }
+    write_array(bulk, values.data(), values.size());
+    WTSCLWQ_ASSERT(one.GetSize() == bulk.GetSize(), "array size");
+    one.SetPosition(0);
+    bulk.SetPosition(0);
+    WTSCLWQ_ASSERT(one.ToString() == bulk.ToString(), "array bytes");
+    std::vector<T> result(values.size());
+    bulk.ReadFixedUint8();
+    read_array(bulk, result.data(), result.size());
+    WTSCLWQ_ASSERT(result == values, "array values");
+    WTSCLWQ_ASSERT(bulk.GetReadableSize() == 0, "readable size");
+}
+
+void test_arrays() {
+    using wtsclwq::ByteArray;
+    const size_t count = 1003;
+    // 小于2^7、在[2^7, 2^14)之间、长短混合、取满位宽的值
+    std::vector<std::vector<uint64_t>> samples(4);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t random = (i + 1) * 0x9E3779B97F4A7C15ULL;
+        samples[0].push_back(random % 128);
+        samples[1].push_back(128 + random % (16384 - 128));
+        samples[2].push_back(random >> (i % 64));
+        samples[3].push_back(random);
+    }
+    for (auto level : kSimdLevels) {
+        wtsclwq::SetSimdLevel(level);
+        for (size_t base_size : {7, 4096}) {
+            for (bool little : {false, true}) {
+                for (const auto &sample : samples) {
+                    std::vector<uint64_t> u64(sample);
+                    std::vector<uint32_t> u32(sample.begin(), sample.end());
+                    std::vector<int64_t> i64(sample.begin(), sample.end());
+                    std::vector<int32_t> i32(sample.begin(), sample.end());
+                    std::vector<uint16_t> u16(sample.begin(), sample.end());
+                    std::vector<double> f64(sample.begin(), sample.end());
+                    CheckArray(
+                        u16, base_size, little,
+                        [](ByteArray &ba, uint16_t v) {
+                            ba.WriteFixedUint16(v);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.WriteFixedUint16Array(v, n);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.ReadFixedUint16Array(v, n);
+                        });
+                    CheckArray(
+                        u32, base_size, little,
+                        [](ByteArray &ba, uint32_t v) {
+                            ba.WriteFixedUint32(v);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.WriteFixedUint32Array(v, n);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.ReadFixedUint32Array(v, n);
+                        });
+                    CheckArray(
+                        f64, base_size, little,
+                        [](ByteArray &ba, double v) {
+                            ba.WriteFixedDouble(v);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.WriteFixedDoubleArray(v, n);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.ReadFixedDoubleArray(v, n);
+                        });
+                    CheckArray(
+                        u32, base_size, little,
+                        [](ByteArray &ba, uint32_t v) { ba.WriteUint32(v); },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.WriteUint32Array(v, n);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.ReadUint32Array(v, n);
+                        });
+                    CheckArray(
+                        i32, base_size, little,
+                        [](ByteArray &ba, int32_t v) { ba.WriteInt32(v); },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.WriteInt32Array(v, n);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.ReadInt32Array(v, n);
+                        });
+                    CheckArray(
+                        u64, base_size, little,
+                        [](ByteArray &ba, uint64_t v) { ba.WriteUint64(v); },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.WriteUint64Array(v, n);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.ReadUint64Array(v, n);
+                        });
+                    CheckArray(
+                        i64, base_size, little,
+                        [](ByteArray &ba, int64_t v) { ba.WriteInt64(v); },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.WriteInt64Array(v, n);
+                        },
+                        [](ByteArray &ba, auto *v, size_t n) {
+                            ba.ReadInt64Array(v, n);
+                        });
+                }
+            }
+        }
+    }
+    // 数据不足时抛出异常
+    ByteArray ba;
+    ba.WriteUint32(1);
+    ba.WriteFixedUint8(0x80);
+    ba.SetPosition(0);
+    uint32_t values[2];
+    bool thrown = false;
+    try {
+        ba.ReadUint32Array(values, 2);
+    } catch (const std::out_of_range &) {
+        thrown = true;
+    }
+    WTSCLWQ_ASSERT(thrown && values[0] == 1, "truncated array");
+    wtsclwq::SetSimdLevel(wtsclwq::SimdLevel::AVX2);
+    LOG_CUSTOM_INFO(logger, "test_arrays passed, simd = %s",
+                    wtsclwq::SimdLevel::ToString(wtsclwq::GetSimdLevel()))
+}
+
+/**
+ * @brief 逐个写入读出和批量写入读出count个值的耗时对比
+ */
+template <class T, class WriteOne, class ReadOne, class WriteArray,
+          class ReadArray>
+static void BenchArray(const char *name, const std::vector<T> &values,
+                       WriteOne write_one, ReadOne read_one,
+                       WriteArray write_array, ReadArray read_array) {
+    auto ns = [&values](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() /
+               values.size();
+    };
+    std::vector<T> result(values.size());
+    auto start = std::chrono::steady_clock::now();
+    wtsclwq::ByteArray one;
+    for (const T &value : values) {
+        write_one(one, value);
+    }
+    auto written = std::chrono::steady_clock::now();
+    one.SetPosition(0);
+    for (T &value : result) {
+        value = read_one(one);
+    }
+    auto parsed = std::chrono::steady_clock::now();
+    WTSCLWQ_ASSERT(result == values, "value not equal");
+    LOG_CUSTOM_INFO(logger, "%s: one by one write %.2f ns, read %.2f ns", name,
+                    ns(start, written), ns(written, parsed))
+    for (auto level : kSimdLevels) {
+        wtsclwq::SetSimdLevel(level);
+        if (wtsclwq::GetSimdLevel() != level) {
+            continue;
+        }
+        start = std::chrono::steady_clock::now();
+        wtsclwq::ByteArray bulk;
+        write_array(bulk, values.data(), values.size());
+        written = std::chrono::steady_clock::now();
+        bulk.SetPosition(0);
+        read_array(bulk, result.data(), result.size());
+        parsed = std::chrono::steady_clock::now();
+        WTSCLWQ_ASSERT(result == values, "value not equal");
+        LOG_CUSTOM_INFO(logger, "%s: %s array write %.2f ns, read %.2f ns",
+                        name, wtsclwq::SimdLevel::ToString(level),
+                        ns(start, written), ns(written, parsed))
+    }
+}
+
+void bench_arrays() {
+    using wtsclwq::ByteArray;
+    const size_t count = 10 * 1000 * 1000;
+    std::vector<uint32_t> fixed(count);
+    std::vector<uint32_t> small(count);
+    std::vector<uint32_t> medium(count);
+    std::vector<uint64_t> large(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t random = (i + 1) * 0x9E3779B97F4A7C15ULL;
+        fixed[i] = static_cast<uint32_t>(random >> 32);
+        small[i] = random % 128;
+        medium[i] = 128 + random % (16384 - 128);
+        large[i] = random >> (i % 64);
+    }
+    auto write_fixed = [](ByteArray &ba, uint32_t v) { ba.WriteFixedUint32(v); };
+    auto read_fixed = [](ByteArray &ba) { return ba.ReadFixedUint32(); };
+    auto write_u32 = [](ByteArray &ba, uint32_t v) { ba.WriteUint32(v); };
+    auto read_u32 = [](ByteArray &ba) { return ba.ReadUint32(); };
+    auto write_u32s = [](ByteArray &ba, auto *v, size_t n) {
+        ba.WriteUint32Array(v, n);
+    };
+    auto read_u32s = [](ByteArray &ba, auto *v, size_t n) {
+        ba.ReadUint32Array(v, n);
+    };
+    BenchArray(
+        "fixed uint32 big endian", fixed, write_fixed, read_fixed,
+        [](ByteArray &ba, auto *v, size_t n) { ba.WriteFixedUint32Array(v, n); },
+        [](ByteArray &ba, auto *v, size_t n) { ba.ReadFixedUint32Array(v, n); });
+    BenchArray("varint uint32 < 2^7", small, write_u32, read_u32, write_u32s,
+               read_u32s);
+    BenchArray("varint uint32 < 2^14", medium, write_u32, read_u32, write_u32s,
+               read_u32s);
+    BenchArray(
+        "varint uint64 mixed", large,
+        [](ByteArray &ba, uint64_t v) { ba.WriteUint64(v); },
+        [](ByteArray &ba) { return ba.ReadUint64(); },
+        [](ByteArray &ba, auto *v, size_t n) { ba.WriteUint64Array(v, n); },
+        [](ByteArray &ba, auto *v, size_t n) { ba.ReadUint64Array(v, n); });
+    wtsclwq::SetSimdLevel(wtsclwq::SimdLevel::AVX2);
+}
+
+/**
+ * @brief 映射文件：内容和ReadFromFile一致，写入映射的部分不影响文件；
+ * FileStream把多个ByteArray直接写进同一个文件
+ */
+void test_mapped_file() {
+    using wtsclwq::ByteArray;
+    const char *name = "/tmp/serialize_test_mapped.dat";
+    ByteArray::ptr ba(new ByteArray(1000));
+    for (uint32_t i = 0; i < 1000000; ++i) {
+        ba->WriteFixedUint32(i * 2654435761U);
+    }
+    ba->SetPosition(0);
+    WTSCLWQ_ASSERT(ba->WriteToFile(name), "write to file error");
+
+    ByteArray::ptr read(new ByteArray());
+    WTSCLWQ_ASSERT(read->ReadFromFile(name), "read from file error");
+    WTSCLWQ_ASSERT(read->GetPosition() == ba->GetSize(), "position error");
+    read->SetPosition(0);
+
+    // 映射的数据接在已有数据之后，当前位置不变
+    ByteArray::ptr mapped(new ByteArray());
+    mapped->WriteStringFixedUint16("head");
+    WTSCLWQ_ASSERT(mapped->MapFile(name), "map file error");
+    WTSCLWQ_ASSERT(mapped->GetSize() == ba->GetSize() + 6, "size error");
+    WTSCLWQ_ASSERT(mapped->GetPosition() == 6, "position error");
+    mapped->SetPosition(0);
+    WTSCLWQ_ASSERT(mapped->ReadStringFixedUint16() == "head", "value not equal");
+    std::vector<uint32_t> values(1000000);
+    mapped->ReadFixedUint32Array(values.data(), values.size());
+    for (uint32_t i = 0; i < values.size(); ++i) {
+        WTSCLWQ_ASSERT(values[i] == i * 2654435761U, "value not equal");
+    }
+    WTSCLWQ_ASSERT(ba->ToString() == read->ToString(), "tostring error");
+    mapped->SetPosition(6);
+    WTSCLWQ_ASSERT(ba->ToString() == mapped->ToString(), "tostring error");
+
+    // 切片共享映射；写入先复制被写的节点，文件和切片都不变
+    auto slice = mapped->Slice(6, 4096);
+    mapped->SetPosition(6 + 2 * 1024 * 1024 + 10);
+    mapped->WriteFixedUint64(0);
+    mapped->SetPosition(10);
+    mapped->WriteFixedUint32(0);
+    slice->SetPosition(4);
+    WTSCLWQ_ASSERT(slice->ReadFixedUint32() == 2654435761U, "slice changed");
+    ByteArray::ptr remapped(new ByteArray());
+    WTSCLWQ_ASSERT(remapped->MapFile(name), "map file error");
+    WTSCLWQ_ASSERT(ba->ToString() == remapped->ToString(), "file changed");
+
+    // 把映射和普通数据写进另一个文件，再读回来。映射的文件不能被截短
+    const char *copy_name = "/tmp/serialize_test_mapped_copy.dat";
+    {
+        wtsclwq::FileStream out(copy_name, O_WRONLY | O_CREAT | O_TRUNC);
+        WTSCLWQ_ASSERT(out.IsOpen(), "open error");
+        remapped->SetPosition(0);
+        read->SetPosition(0);
+        WTSCLWQ_ASSERT(out.WriteFixSizeFromArray(remapped, remapped->GetSize()) ==
+                           static_cast<int>(ba->GetSize()),
+                       "write error");
+        WTSCLWQ_ASSERT(out.WriteFixSizeFromArray(read, read->GetSize()) ==
+                           static_cast<int>(ba->GetSize()),
+                       "write error");
+        WTSCLWQ_ASSERT(out.GetOffset() == static_cast<off_t>(ba->GetSize() * 2),
+                       "offset error");
+    }
+    wtsclwq::FileStream in(copy_name, O_RDONLY);
+    ByteArray::ptr first(new ByteArray());
+    WTSCLWQ_ASSERT(in.ReadFixSizeToArray(first, ba->GetSize()) ==
+                       static_cast<int>(ba->GetSize()),
+                   "read error");
+    first->SetPosition(0);
+    WTSCLWQ_ASSERT(ba->ToString() == first->ToString(), "tostring error");
+    ByteArray::ptr both(new ByteArray());
+    WTSCLWQ_ASSERT(both->MapFile(copy_name), "map file error");
+    WTSCLWQ_ASSERT(both->ToString() == ba->ToString() + ba->ToString(),
+                   "tostring error");
+
+    ByteArray::ptr missing(new ByteArray());
+    WTSCLWQ_ASSERT(!missing->MapFile("/tmp/serialize_test_missing/none.dat"),
+                   "map missing file");
+    remove(name);
+    remove(copy_name);
+    LOG_INFO(logger, "test_mapped_file passed");
+}
+
+/**
+ * @brief 加载大文件：ReadFromFile复制一遍，MapFile只建立映射，按需读入
+ */
+void bench_load_file() {
+    using wtsclwq::ByteArray;
+    const char *name = "/tmp/serialize_test_snapshot.dat";
+    const size_t file_size = 256 * 1024 * 1024;
+    {
+        ByteArray::ptr ba(new ByteArray());
+        std::vector<uint64_t> values(1024 * 1024);
+        for (size_t i = 0; i < values.size(); ++i) {
+            values[i] = i * 0x9E3779B97F4A7C15ULL;
+        }
+        while (ba->GetSize() < file_size) {
+            ba->WriteFixedUint64Array(values.data(), values.size());
+        }
+        ba->SetPosition(0);
+        auto start = std::chrono::steady_clock::now();
+        WTSCLWQ_ASSERT(ba->WriteToFile(name), "write to file error");
+        auto end = std::chrono::steady_clock::now();
+        LOG_CUSTOM_INFO(
+            logger, "write 256MB snapshot: %.0f ms",
+            std::chrono::duration<double, std::milli>(end - start).count())
+    }
+    auto ms = [](auto from, auto to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    };
+    // 加载后顺序扫一遍，统计加载和扫描的耗时
+    auto scan = [](ByteArray &ba) {
+        uint64_t sum = 0;
+        ba.SetPosition(0);
+        while (ba.GetReadableSize() > 0) {
+            sum += ba.ReadFixedUint64();
+        }
+        return sum;
+    };
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        ByteArray::ptr read(new ByteArray());
+        WTSCLWQ_ASSERT(read->ReadFromFile(name), "read from file error");
+        auto read_loaded = std::chrono::steady_clock::now();
+        uint64_t read_sum = scan(*read);
+        auto read_scanned = std::chrono::steady_clock::now();
+        read.reset();
+
+        auto map_start = std::chrono::steady_clock::now();
+        ByteArray::ptr mapped(new ByteArray());
+        WTSCLWQ_ASSERT(mapped->MapFile(name), "map file error");
+        auto map_loaded = std::chrono::steady_clock::now();
+        uint64_t map_sum = scan(*mapped);
+        auto map_scanned = std::chrono::steady_clock::now();
+        WTSCLWQ_ASSERT(read_sum == map_sum, "value not equal");
+        LOG_CUSTOM_INFO(logger,
+                        "load 256MB snapshot: ReadFromFile %.0f ms + scan %.0f "
+                        "ms, MapFile %.2f ms + scan %.0f ms",
+                        ms(start, read_loaded), ms(read_loaded, read_scanned),
+                        ms(map_start, map_loaded), ms(map_loaded, map_scanned))
+    }
+    remove(name);
+}
+
+enum class Side : uint8_t { BUY = 0, SELL = 1 };
+
+struct Fill {
+    uint64_t id{0};
+    int64_t price{0};
+    uint32_t quantity{0};
+
+    auto operator==(const Fill &other) const -> bool {
+        return id == other.id && price == other.price &&
+               quantity == other.quantity;
+    }
+
+    WTSCLWQ_SERIALIZE_FIELDS(wtsclwq::FixedField(&Fill::id),
+                             wtsclwq::Field(&Fill::price),
+                             wtsclwq::Field(&Fill::quantity))
+};
+
+struct Order {
+    uint64_t id{0};
+    Side side{Side::BUY};
+    int32_t offset{0};
+    double ratio{0};
+    bool urgent{false};
+    std::string symbol;
+    std::vector<Fill> fills;
+    std::vector<uint32_t> levels;
+    std::vector<int64_t> deltas;
+    std::vector<float> weights;
+    std::map<std::string, uint32_t> tags;
+    std::optional<std::string> note;
+    std::optional<Fill> parent;
+
+    auto operator==(const Order &other) const -> bool {
+        return id == other.id && side == other.side && offset == other.offset &&
+               ratio == other.ratio && urgent == other.urgent &&
+               symbol == other.symbol && fills == other.fills &&
+               levels == other.levels && deltas == other.deltas &&
+               weights == other.weights && tags == other.tags &&
+               note == other.note && parent == other.parent;
+    }
+
+    WTSCLWQ_SERIALIZE_FIELDS(
+        wtsclwq::FixedField(&Order::id), wtsclwq::Field(&Order::side),
+        wtsclwq::Field(&Order::offset), wtsclwq::Field(&Order::ratio),
+        wtsclwq::Field(&Order::urgent), wtsclwq::Field(&Order::symbol),
+        wtsclwq::Field(&Order::fills), wtsclwq::Field(&Order::levels),
+        wtsclwq::FixedField(&Order::deltas), wtsclwq::Field(&Order::weights),
+        wtsclwq::VarintField(&Order::tags), wtsclwq::Field(&Order::note),
+        wtsclwq::Field(&Order::parent))
+};
+
+static auto MakeOrder(uint64_t id, size_t fills) -> Order {
+    Order order;
+    order.id = id;
+    order.side = id % 2 == 0 ? Side::BUY : Side::SELL;
+    order.offset = -static_cast<int32_t>(id * 7);
+    order.ratio = 0.25 * static_cast<double>(id);
+    order.urgent = id % 3 == 0;
+    order.symbol = "SYM" + std::to_string(id);
+    for (size_t i = 0; i < fills; ++i) {
+        order.fills.push_back({id * 100 + i,
+                               -static_cast<int64_t>(i * 1000003),
+                               static_cast<uint32_t>(i)});
+        order.levels.push_back(static_cast<uint32_t>(i * i * 131));
+        order.deltas.push_back(static_cast<int64_t>(i) - 5);
+        order.weights.push_back(static_cast<float>(i) / 3);
+    }
+    order.tags["venue"] = static_cast<uint32_t>(id);
+    order.tags["account"] = 1U << 30;
+    if (id % 2 == 1) {
+        order.note = "note " + std::to_string(id);
+        order.parent = Fill{id, 42, 7};
+    }
+    return order;
+}
+
+/**
+ * @brief 反射序列化：编码和逐个调用ByteArray接口的结果一致，能原样解码，
+ * 内存块边界和字节序都不影响结果
+ */
+void test_serializer() {
+    using wtsclwq::ByteArray;
+    Fill fill{0x0102030405060708ULL, -3, 300};
+    ByteArray::ptr manual(new ByteArray());
+    manual->WriteFixedUint64(fill.id);
+    manual->WriteInt64(fill.price);
+    manual->WriteUint32(fill.quantity);
+    ByteArray::ptr reflected(new ByteArray());
+    wtsclwq::Serialize(*reflected, fill);
+    WTSCLWQ_ASSERT(reflected->GetSize() == wtsclwq::SerializedSize(fill),
+                   "size error");
+    reflected->SetPosition(0);
+    manual->SetPosition(0);
+    WTSCLWQ_ASSERT(reflected->ToString() == manual->ToString(),
+                   "encoding error");
+
+    for (size_t base_size : {1, 7, 64, 4096}) {
+        for (bool little : {false, true}) {
+            ByteArray::ptr ba(new ByteArray(base_size));
+            ba->SetIsLittleEndian(little);
+            std::vector<Order> orders;
+            size_t size = 0;
+            for (uint64_t i = 0; i < 50; ++i) {
+                orders.push_back(MakeOrder(i, i % 7 * 5));
+                wtsclwq::Serialize(*ba, orders.back());
+                size += wtsclwq::SerializedSize(orders.back());
+                WTSCLWQ_ASSERT(ba->GetSize() == size, "size error");
+            }
+            ba->SetPosition(0);
+            for (const auto &order : orders) {
+                Order decoded;
+                decoded.note = "stale";
+                wtsclwq::Deserialize(*ba, decoded);
+                WTSCLWQ_ASSERT(decoded == order, "value not equal");
+            }
+            WTSCLWQ_ASSERT(ba->GetReadableSize() == 0,
+                           "readable size is not zero");
+        }
+    }
+
+    // 截断的数据抛出异常
+    ByteArray::ptr full(new ByteArray());
+    wtsclwq::Serialize(*full, MakeOrder(3, 10));
+    auto truncated = full->Slice(0, full->GetSize() - 1);
+    bool thrown = false;
+    try {
+        Order decoded;
+        wtsclwq::Deserialize(*truncated, decoded);
+    } catch (std::out_of_range &) {
+        thrown = true;
+    }
+    WTSCLWQ_ASSERT(thrown, "truncated message decoded");
+    LOG_INFO(logger, "test_serializer passed");
+}
+
+/**
+ * @brief 同一个消息分别用手写的ByteArray调用和反射序列化编码、解码
+ */
+void bench_serializer() {
+    using wtsclwq::ByteArray;
+    std::vector<Order> orders;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        orders.push_back(MakeOrder(i, 4));
+    }
+    auto write_manual = [](ByteArray &ba, const Order &order) {
+        ba.WriteFixedUint64(order.id);
+        ba.WriteFixedUint8(static_cast<uint8_t>(order.side));
+        ba.WriteInt32(order.offset);
+        ba.WriteFixedDouble(order.ratio);
+        ba.WriteFixedUint8(order.urgent);
+        ba.WriteStringVint(order.symbol);
+        ba.WriteUint64(order.fills.size());
+        for (const auto &fill : order.fills) {
+            ba.WriteFixedUint64(fill.id);
+            ba.WriteInt64(fill.price);
+            ba.WriteUint32(fill.quantity);
+        }
+        ba.WriteUint64(order.levels.size());
+        for (auto level : order.levels) {
+            ba.WriteUint32(level);
+        }
+        ba.WriteUint64(order.deltas.size());
+        for (auto delta : order.deltas) {
+            ba.WriteFixedInt64(delta);
+        }
+        ba.WriteUint64(order.weights.size());
+        for (auto weight : order.weights) {
+            ba.WriteFixedFloat(weight);
+        }
+        ba.WriteUint64(order.tags.size());
+        for (const auto &[key, value] : order.tags) {
+            ba.WriteStringVint(key);
+            ba.WriteUint32(value);
+        }
+        ba.WriteFixedUint8(order.note.has_value());
+        if (order.note) {
+            ba.WriteStringVint(*order.note);
+        }
+        ba.WriteFixedUint8(order.parent.has_value());
+        if (order.parent) {
+            ba.WriteFixedUint64(order.parent->id);
+            ba.WriteInt64(order.parent->price);
+            ba.WriteUint32(order.parent->quantity);
+        }
+    };
+    const int rounds = 200;
+    auto ns_per_message = [&](auto from, auto to) {
+        return std::chrono::duration<double, std::nano>(to - from).count() /
+               (rounds * orders.size());
+    };
+    for (int trial = 0; trial < 3; ++trial) {
+        ByteArray::ptr manual(new ByteArray());
+        ByteArray::ptr reflected(new ByteArray());
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            manual->Clear();
+            for (const auto &order : orders) {
+                write_manual(*manual, order);
+            }
+        }
+        auto manual_done = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; ++round) {
+            reflected->Clear();
+            for (const auto &order : orders) {
+                wtsclwq::Serialize(*reflected, order);
+            }
+        }
+        auto reflected_done = std::chrono::steady_clock::now();
+        manual->SetPosition(0);
+        reflected->SetPosition(0);
+        WTSCLWQ_ASSERT(manual->ToString() == reflected->ToString(),
+                       "encoding error");
+        Order decoded;
+        for (int round = 0; round < rounds; ++round) {
+            reflected->SetPosition(0);
+            for (size_t i = 0; i < orders.size(); ++i) {
+                wtsclwq::Deserialize(*reflected, decoded);
+            }
+        }
+        auto decoded_done = std::chrono::steady_clock::now();
+        WTSCLWQ_ASSERT(decoded == orders.back(), "value not equal");
+        LOG_CUSTOM_INFO(logger,
+                        "order message (%lu bytes): manual write %.0f ns, "
+                        "reflected write %.0f ns, reflected read %.0f ns",
+                        wtsclwq::SerializedSize(orders[1]),
+                        ns_per_message(start, manual_done),
+                        ns_per_message(manual_done, reflected_done),
+                        ns_per_message(reflected_done, decoded_done))
+    }
+}
+
 auto main() -> int {
+    test();
+    test_boundary();
     test_file();
+    bench_large_message();
+    test_cross_thread_free();
+    test_arrays();
+    test_slices();
+    bench_values();
+    bench_arrays();
+    bench_forward();
+    test_mapped_file();
+    bench_load_file();
+    test_serializer();
+    bench_serializer();
     return 0;
 }
\ No newline at end of file
@@ -3,9 +3,28 @@
 //
 #include "../src/include/socket/socket.h"
 
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../src/include/config/config.h"
+#include "../src/include/io/fd_manager.h"
+#include "../src/include/io/hook.h"
 #include "../src/include/io/io_manager.h"
 #include "../src/include/log/log_manager.h"
 #include "../src/include/socket/ip_address.h"
+#include "../src/include/socket/socket_pool.h"
+#include "../src/include/socket/socket_profile.h"
+#include "../src/include/util/time_util.h"
 
 wtsclwq::Logger::ptr logger = GET_LOGGER_BY_NAME("system");
 void TestSocket() {
@@ -48,7 +67,407 @@ void TestSocket() {
     buffers.resize(ret);
     LOG_INFO(logger, buffers);
 }
+
+void TestListenFdReset() {
+    // 继承的监听fd号上残留着旧的文件登记，接管时要重新登记成socket
+    const char *path = "/tmp/socket_test_listen_fd";
+    int filedesc = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    assert(filedesc >= 0);
+    unlink(path);
+    auto fd_manager = wtsclwq::FileDescriptorManager::GetInstancePtr();
+    assert(fd_manager->Get(filedesc)->IsFile());
+    wtsclwq::SetHookEnable(false);
+    close(filedesc);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    wtsclwq::SetHookEnable(true);
+    assert(listen_fd == filedesc);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(listen_fd, reinterpret_cast<sockaddr *>(&addr),
+                sizeof(addr)) == 0);
+    assert(listen(listen_fd, 8) == 0);
+
+    auto listener = wtsclwq::Socket::CreateFromListenFd(listen_fd);
+    assert(listener != nullptr);
+    auto fdp = fd_manager->Get(listen_fd);
+    assert(fdp && fdp->IsSocket() && !fdp->IsFile() &&
+           fdp->GetSystemNonBlock());
+
+    auto client = wtsclwq::Socket::CreateTcpSocket(listener->GetLocalAddress());
+    assert(client->Connect(listener->GetLocalAddress(), UINT64_MAX));
+    auto conn = listener->Accept();
+    assert(conn != nullptr);
+    LOG_CUSTOM_INFO(logger, "accepted on inherited fd %d", listen_fd)
+}
+
+void TestSocketPool() {
+    // 本地回显服务器
+    auto listen_addr = wtsclwq::IPAddress::Create("127.0.0.1", 0);
+    auto listener = wtsclwq::Socket::CreateTcpSocket(listen_addr);
+    assert(listener->Bind(listen_addr) && listener->Listen(128));
+    auto addr = listener->GetLocalAddress();
+    auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
+    iom->Schedule([listener, iom] {
+        while (auto client = listener->Accept()) {
+            iom->Schedule([client] {
+                char buf[64];
+                ssize_t len;
+                // 收到quit时关闭连接，模拟对端关闭的空闲连接
+                while ((len = client->Recv(buf, sizeof(buf), 0)) > 0 &&
+                       buf[0] != 'q') {
+                    client->Send(buf, len, 0);
+                }
+                client->Close();
+            });
+        }
+    });
+    auto echo = [](const wtsclwq::Socket::ptr& sock) {
+        char buf[4]{};
+        return sock->Send("ping", 4, 0) == 4 && sock->Recv(buf, 4, 0) == 4;
+    };
+
+    // 每个地址最多1个空闲连接、2个连接，空闲200ms后淘汰
+    auto pool = wtsclwq::SocketPool::Create(1, 2, 200, 1000);
+    auto first = pool->Acquire(addr);
+    assert(first && echo(first));
+    int first_fd = first->GetSocket();
+    pool->Release(first);
+    auto second = pool->Acquire(addr);
+    assert(second && second->GetSocket() == first_fd && echo(second));
+
+    // 连接数达到上限后，等待者拿到别的协程归还的连接
+    auto third = pool->Acquire(addr);
+    assert(third && echo(third));
+    int third_fd = third->GetSocket();
+    assert(pool->Acquire(addr, 50) == nullptr);
+    int waiter_fd = -1;
+    iom->Schedule([&] {
+        auto sock = pool->Acquire(addr);
+        waiter_fd = sock->GetSocket();
+        pool->Release(sock);
+    });
+    usleep(20 * 1000);
+    pool->Release(third);
+    usleep(20 * 1000);
+    assert(waiter_fd == third_fd);
+    pool->Release(second);
+    LOG_CUSTOM_INFO(logger, "pool idle = %zu, active = %zu",
+                    pool->GetIdleCount(), pool->GetActiveCount());
+    assert(pool->GetIdleCount() == 1 && pool->GetActiveCount() == 0);
+
+    // 空闲超时的连接由定时器淘汰
+    usleep(500 * 1000);
+    assert(pool->GetIdleCount() == 0);
+    pool.reset();
+
+    // 对端已关闭的空闲连接：Acquire跳过它取下一个，EvictIdle不等超时就淘汰
+    auto manual_pool = wtsclwq::SocketPool::Create(2, 4, 10000, 1000, nullptr);
+    auto alive = manual_pool->Acquire(addr);
+    auto dead = manual_pool->Acquire(addr);
+    assert(alive && dead && echo(alive) && echo(dead));
+    assert(dead->Send("quit", 4, 0) == 4);
+    manual_pool->Release(alive);
+    manual_pool->Release(dead);
+    usleep(20 * 1000);
+    auto reused = manual_pool->Acquire(addr);
+    assert(reused.get() == alive.get() && echo(reused));
+    assert(manual_pool->GetIdleCount() == 0 &&
+           manual_pool->GetActiveCount() == 1);
+    assert(reused->Send("quit", 4, 0) == 4);
+    manual_pool->Release(reused);
+    usleep(20 * 1000);
+    assert(manual_pool->GetIdleCount() == 1);
+    manual_pool->EvictIdle();
+    assert(manual_pool->GetIdleCount() == 0 &&
+           manual_pool->GetActiveCount() == 0);
+    listener->Close();
+}
+
+/**
+ * @brief 回环上建立一对已连接的TCP socket
+ */
+static auto ConnectedPair()
+    -> std::pair<wtsclwq::Socket::ptr, wtsclwq::Socket::ptr> {
+    auto listen_addr = wtsclwq::IPAddress::Create("127.0.0.1", 0);
+    auto listener = wtsclwq::Socket::CreateTcpSocket(listen_addr);
+    assert(listener->Bind(listen_addr) && listener->Listen(1));
+    auto client = wtsclwq::Socket::CreateTcpSocket(listen_addr);
+    assert(client->Connect(listener->GetLocalAddress(), UINT64_MAX));
+    auto server = listener->Accept();
+    assert(server != nullptr);
+    return {client, server};
+}
+
+/**
+ * @brief 在另一个协程中从sock读够len字节
+ * @param[out] done 读完后置为true
+ */
+static void DrainSocket(const wtsclwq::Socket::ptr &sock, size_t len,
+                        const std::shared_ptr<std::atomic_bool> &done) {
+    wtsclwq::IOManager::GetThisThreadIOManager()->Schedule(
+        [sock, len, done] {
+            std::vector<char> buf(256 * 1024);
+            size_t total = 0;
+            while (total < len) {
+                ssize_t ret = sock->Recv(buf.data(), buf.size(), 0);
+                assert(ret > 0);
+                total += ret;
+            }
+            *done = true;
+        });
+}
+
+void TestZeroCopy() {
+    auto udp = wtsclwq::Socket::CreateUdpSocket(
+        wtsclwq::IPAddress::Create("127.0.0.1", 0));
+    assert(!udp->SetZeroCopy(true));
+    auto [client, server] = ConnectedPair();
+    if (!client->SetZeroCopy(true)) {
+        LOG_INFO(logger, "SO_ZEROCOPY is not supported, skip TestZeroCopy");
+        return;
+    }
+    auto threshold =
+        wtsclwq::Config::LookupByName<uint64_t>("socket.zerocopy.threshold");
+    uint64_t old_threshold = threshold->GetValue();
+    threshold->SetValue(64 * 1024);
+
+    // 小于阈值的发送走普通的send，不会收到回环上的COPIED通知
+    std::string small(1024, 's');
+    auto done = std::make_shared<std::atomic_bool>(false);
+    DrainSocket(server, small.size(), done);
+    assert(client->Send(small.data(), small.size(), 0) ==
+           static_cast<ssize_t>(small.size()));
+    while (!*done) {
+        usleep(1000);
+    }
+    assert(client->IsZeroCopy());
+
+    // 全双工：读协程占着client的读事件，零拷贝发送仍然能等到完成通知
+    auto reply = std::make_shared<std::atomic_int>(0);
+    auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
+    iom->Schedule([client = client, reply] {
+        char buf[4];
+        *reply = static_cast<int>(client->Recv(buf, sizeof(buf), 0));
+    });
+    usleep(10 * 1000);
+    std::string large(4 * 1024 * 1024, 'l');
+    done = std::make_shared<std::atomic_bool>(false);
+    DrainSocket(server, large.size(), done);
+    uint64_t begin = wtsclwq::GetCurrentMS();
+    size_t sent = 0;
+    while (sent < large.size()) {
+        ssize_t ret = client->Send(large.data() + sent, large.size() - sent, 0);
+        assert(ret > 0);
+        sent += ret;
+    }
+    uint64_t cost = wtsclwq::GetCurrentMS() - begin;
+    while (!*done) {
+        usleep(1000);
+    }
+    // 回环网卡总是拷贝数据，收到COPIED通知后自动关闭零拷贝
+    LOG_CUSTOM_INFO(logger, "zerocopy send 4MB with a reader: %lu ms, "
+                    "zerocopy after COPIED = %d", cost, client->IsZeroCopy())
+    assert(!client->IsZeroCopy());
+    assert(server->Send("done", 4, 0) == 4);
+    while (*reply == 0) {
+        usleep(1000);
+    }
+    assert(*reply == 4);
+    threshold->SetValue(old_threshold);
+    LOG_INFO(logger, "TestZeroCopy passed");
+}
+
+/**
+ * @brief 不同大小的发送分别用拷贝和零拷贝，比较吞吐。
+ * 回环上的零拷贝最终还是拷贝，只能看出额外开销；真实网卡上大块发送才有收益
+ */
+void BenchZeroCopy() {
+    auto [client, server] = ConnectedPair();
+    if (!client->SetZeroCopy(true)) {
+        LOG_INFO(logger, "SO_ZEROCOPY is not supported, skip BenchZeroCopy");
+        return;
+    }
+    auto threshold =
+        wtsclwq::Config::LookupByName<uint64_t>("socket.zerocopy.threshold");
+    uint64_t old_threshold = threshold->GetValue();
+    threshold->SetValue(0);
+    const size_t total = 64 * 1024 * 1024;
+    std::string payload(4 * 1024 * 1024, 'b');
+    for (size_t size : {16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024,
+                        4 * 1024 * 1024}) {
+        double mbps[2];
+        for (int zerocopy = 0; zerocopy < 2; ++zerocopy) {
+            auto done = std::make_shared<std::atomic_bool>(false);
+            DrainSocket(server, total, done);
+            uint64_t begin = wtsclwq::GetCurrentUS();
+            size_t sent = 0;
+            while (sent < total) {
+                // 回环上的COPIED通知会关闭零拷贝，每次发送前重新打开
+                client->SetZeroCopy(zerocopy != 0);
+                ssize_t ret = client->Send(payload.data(),
+                                           std::min(size, total - sent), 0);
+                assert(ret > 0);
+                sent += ret;
+            }
+            while (!*done) {
+                usleep(1000);
+            }
+            uint64_t cost = wtsclwq::GetCurrentUS() - begin;
+            mbps[zerocopy] = static_cast<double>(total) / cost;
+        }
+        LOG_CUSTOM_INFO(logger,
+                        "send %7zu bytes: copy %.0f MB/s, zerocopy %.0f MB/s",
+                        size, mbps[0], mbps[1])
+    }
+    threshold->SetValue(old_threshold);
+}
+
+static auto GetIntOption(const wtsclwq::Socket::ptr &sock, int level,
+                         int option) -> int {
+    int value = 0;
+    assert(sock->GetOption(level, option, value));
+    return value;
+}
+
+void TestSocketProfile() {
+    // socket.profiles整张表序列化后能原样加载回来
+    auto profiles_var = wtsclwq::Config::LookupBase("socket.profiles");
+    assert(profiles_var != nullptr);
+    std::string saved = profiles_var->ToString();
+    wtsclwq::Config::LoadFromYaml(YAML::Load(
+        "socket:\n"
+        "  profiles:\n"
+        "    test:\n"
+        "      fastopen: 16\n"
+        "      fastopen_connect: true\n"
+        "      defer_accept: 1\n"
+        "      busy_poll: 20\n"
+        "      quickack: true\n"
+        "      notsent_lowat: 8192\n"
+        "      sndbuf: 65536\n"
+        "      rcvbuf: 65536\n"
+        "      incoming_cpu: 0\n"));
+    auto profile = wtsclwq::SocketProfile::Get("test");
+    assert(profile.fastopen == 16 && profile.fastopen_connect &&
+           profile.defer_accept == 1 && profile.busy_poll == 20 &&
+           profile.quickack && profile.notsent_lowat == 8192 &&
+           profile.sndbuf == 65536 && profile.rcvbuf == 65536 &&
+           profile.incoming_cpu == 0);
+    assert(wtsclwq::SocketProfile::Get("missing") == wtsclwq::SocketProfile{});
+    std::string dumped = profiles_var->ToString();
+    // FromString的返回值不表示成败，用再次序列化的结果判断
+    profiles_var->FromString(dumped);
+    assert(profiles_var->ToString() == dumped);
+    assert(wtsclwq::SocketProfile::Get("test") == profile);
+
+    // 逐项用getsockopt确认选项已经设置，内核返回的缓冲区大小是设置值的两倍
+    auto listen_addr = wtsclwq::IPAddress::Create("127.0.0.1", 0);
+    auto listener = wtsclwq::Socket::CreateTcpSocket(listen_addr);
+    assert(listener->Bind(listen_addr));
+    assert(profile.ApplyToListener(listener));
+    assert(listener->Listen(1));
+    assert(GetIntOption(listener, SOL_SOCKET, SO_SNDBUF) == 2 * 65536);
+    assert(GetIntOption(listener, SOL_SOCKET, SO_RCVBUF) == 2 * 65536);
+    assert(GetIntOption(listener, IPPROTO_TCP, TCP_FASTOPEN) == 16);
+    // TCP_DEFER_ACCEPT按重传次数存储，读回的秒数会向上取整
+    assert(GetIntOption(listener, IPPROTO_TCP, TCP_DEFER_ACCEPT) >= 1);
+    assert(GetIntOption(listener, SOL_SOCKET, SO_INCOMING_CPU) == 0);
+
+    auto client = wtsclwq::Socket::CreateTcpSocket(listen_addr);
+    assert(profile.ApplyToClient(client));
+    assert(GetIntOption(client, SOL_SOCKET, SO_SNDBUF) == 2 * 65536);
+    assert(GetIntOption(client, SOL_SOCKET, SO_RCVBUF) == 2 * 65536);
+    assert(GetIntOption(client, IPPROTO_TCP, TCP_FASTOPEN_CONNECT) == 1);
+    assert(GetIntOption(client, SOL_SOCKET, SO_BUSY_POLL) == 20);
+    assert(GetIntOption(client, IPPROTO_TCP, TCP_NOTSENT_LOWAT) == 8192);
+
+    // fastopen_connect的Connect要等第一次写才发SYN，defer_accept要等到数据
+    assert(client->Connect(listener->GetLocalAddress(), UINT64_MAX));
+    assert(client->Send("ping", 4, 0) == 4);
+    auto conn = listener->Accept();
+    assert(conn != nullptr);
+    assert(profile.ApplyToConnection(conn));
+    assert(GetIntOption(conn, SOL_SOCKET, SO_BUSY_POLL) == 20);
+    assert(GetIntOption(conn, IPPROTO_TCP, TCP_NOTSENT_LOWAT) == 8192);
+    assert(GetIntOption(conn, IPPROTO_TCP, TCP_QUICKACK) == 1);
+    assert(GetIntOption(conn, SOL_SOCKET, SO_SNDBUF) == 2 * 65536);
+
+    profiles_var->FromString(saved);
+    assert(profiles_var->ToString() == saved);
+    assert(wtsclwq::SocketProfile::Get("test") == wtsclwq::SocketProfile{});
+    LOG_INFO(logger, "TestSocketProfile passed");
+}
+
+/**
+ * @brief 用各套配置在回环上做小包请求响应，比较往返延迟
+ */
+void BenchSocketProfile() {
+    const int rounds = 20000;
+    for (const char *name : {"default", "low_latency", "throughput"}) {
+        auto profile = wtsclwq::SocketProfile::Get(name);
+        auto listen_addr = wtsclwq::IPAddress::Create("127.0.0.1", 0);
+        auto listener = wtsclwq::Socket::CreateTcpSocket(listen_addr);
+        assert(listener->Bind(listen_addr));
+        profile.ApplyToListener(listener);
+        assert(listener->Listen(1));
+        auto client = wtsclwq::Socket::CreateTcpSocket(listen_addr);
+        profile.ApplyToClient(client);
+        assert(client->Connect(listener->GetLocalAddress(), UINT64_MAX));
+
+        wtsclwq::IOManager::GetThisThreadIOManager()->Schedule(
+            [listener, profile, rounds] {
+                auto conn = listener->Accept();
+                assert(conn != nullptr);
+                profile.ApplyToConnection(conn);
+                char buf[64];
+                for (int i = 0; i < rounds; ++i) {
+                    size_t got = 0;
+                    while (got < sizeof(buf)) {
+                        ssize_t ret =
+                            conn->Recv(buf + got, sizeof(buf) - got, 0);
+                        assert(ret > 0);
+                        got += ret;
+                    }
+                    assert(conn->Send(buf, sizeof(buf), 0) ==
+                           static_cast<ssize_t>(sizeof(buf)));
+                }
+            });
+
+        char buf[64] = {0};
+        uint64_t begin = wtsclwq::GetCurrentUS();
+        for (int i = 0; i < rounds; ++i) {
+            assert(client->Send(buf, sizeof(buf), 0) ==
+                   static_cast<ssize_t>(sizeof(buf)));
+            size_t got = 0;
+            while (got < sizeof(buf)) {
+                ssize_t ret = client->Recv(buf + got, sizeof(buf) - got, 0);
+                assert(ret > 0);
+                got += ret;
+            }
+        }
+        double avg = static_cast<double>(wtsclwq::GetCurrentUS() - begin) /
+                     rounds;
+        LOG_CUSTOM_INFO(logger, "profile %-12s round trip %.2f us", name, avg)
+    }
+}
+
 auto main() -> int {
+    {
+        wtsclwq::IOManager iom(1, false, "pool");
+        iom.Schedule(TestListenFdReset);
+        iom.Schedule(TestSocketPool);
+    }
+    {
+        // 零拷贝和socket配置的测试、压测依次执行，避免互相干扰
+        wtsclwq::IOManager iom(1, false, "zerocopy");
+        iom.Schedule([] {
+            TestZeroCopy();
+            BenchZeroCopy();
+            TestSocketProfile();
+            BenchSocketProfile();
+        });
+    }
     wtsclwq::IOManager iom;
     iom.Schedule(TestSocket);
     return 0;
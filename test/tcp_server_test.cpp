@@ -7,11 +7,515 @@
 
 #include "../src/include/server/tcp_server.h"
 
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../src/include/config/config.h"
+#include "../src/include/io/hook.h"
 #include "../src/include/log/log_manager.h"
 #include "../src/include/socket/ip_address.h"
+#include "../src/include/socket/ssl_socket.h"
 
 static wtsclwq::Logger::ptr g_logger = ROOT_LOGGER;
 
+/**
+ * @brief 读到EOF为止才结束的服务器
+ */
+class HoldServer : public wtsclwq::TcpServer {
+  public:
+    using TcpServer::TcpServer;
+
+  protected:
+    void HandleClient(const wtsclwq::Socket::ptr &client) override {
+        char buf[64];
+        while (client->Recv(buf, sizeof(buf), 0) > 0) {
+        }
+        client->Close();
+    }
+};
+
+/**
+ * @brief 每收到一次数据就回复处理它的worker的下标，并记录连接是否换过worker
+ */
+class WorkerServer : public wtsclwq::TcpServer {
+  public:
+    WorkerServer(const std::vector<wtsclwq::IOManager *> &workers,
+                 wtsclwq::IOManager *acceptor)
+        : TcpServer(workers, acceptor), m_workers(workers) {}
+
+    auto GetMoves() const -> int { return m_moves; }
+
+  protected:
+    void HandleClient(const wtsclwq::Socket::ptr &client) override {
+        char index = WorkerIndex();
+        char buf[64];
+        while (client->Recv(buf, sizeof(buf), 0) > 0) {
+            if (WorkerIndex() != index) {
+                ++m_moves;
+            }
+            client->Send(&index, 1, 0);
+        }
+        client->Close();
+    }
+
+  private:
+    auto WorkerIndex() const -> char {
+        auto *iom = wtsclwq::IOManager::GetThisThreadIOManager();
+        return static_cast<char>(
+            std::find(m_workers.begin(), m_workers.end(), iom) -
+            m_workers.begin());
+    }
+
+    std::vector<wtsclwq::IOManager *> m_workers;
+    std::atomic_int m_moves{0};
+};
+
+/**
+ * @brief 给每个连接回复一个标记字节，用来区分是哪个服务器accept的
+ */
+class TagServer : public wtsclwq::TcpServer {
+  public:
+    TagServer(char tag, wtsclwq::IOManager *worker,
+              wtsclwq::IOManager *acceptor)
+        : TcpServer(worker, acceptor), m_tag(tag) {}
+
+  protected:
+    void HandleClient(const wtsclwq::Socket::ptr &client) override {
+        client->Send(&m_tag, 1, 0);
+        client->Close();
+    }
+
+  private:
+    char m_tag;
+};
+
+/**
+ * @brief 统计每个监听socket各accept了多少连接，回复一个字节后关闭
+ */
+class ListenerServer : public wtsclwq::TcpServer {
+  public:
+    using TcpServer::TcpServer;
+
+    auto GetListeners() -> size_t {
+        wtsclwq::ScopedLock<std::mutex> lock(m_mutex);
+        return m_listeners;
+    }
+
+    auto GetAccepts(size_t index) const -> int { return m_accepts[index]; }
+
+  protected:
+    void StartAccept(const wtsclwq::Socket::ptr &socket) override {
+        size_t index = 0;
+        {
+            wtsclwq::ScopedLock<std::mutex> lock(m_mutex);
+            index = m_listeners++;
+        }
+        while (auto client = socket->Accept()) {
+            ++m_accepts[index];
+            client->Send("L", 1, 0);
+            client->Close();
+        }
+    }
+
+  private:
+    size_t m_listeners{0};
+    std::atomic_int m_accepts[8]{};
+    std::mutex m_mutex{};
+};
+
+/**
+ * @brief 读到EOF为止，保存收到的数据和读的次数。
+ * TLS连接上每次Recv()最多返回一个记录，读的次数就是记录数
+ */
+class RecordServer : public wtsclwq::TcpServer {
+  public:
+    using TcpServer::TcpServer;
+
+    auto GetData() -> std::string {
+        wtsclwq::ScopedLock<std::mutex> lock(m_mutex);
+        return m_data;
+    }
+
+    auto GetReads() const -> int { return m_reads; }
+
+    auto IsDone() const -> bool { return m_done; }
+
+  protected:
+    void HandleClient(const wtsclwq::Socket::ptr &client) override {
+        std::string buf(64 * 1024, 0);
+        ssize_t len = 0;
+        while ((len = client->Recv(buf.data(), buf.size(), 0)) > 0) {
+            wtsclwq::ScopedLock<std::mutex> lock(m_mutex);
+            m_data.append(buf.data(), len);
+            ++m_reads;
+        }
+        client->Close();
+        m_done = true;
+    }
+
+  private:
+    std::string m_data{};
+    std::atomic_int m_reads{0};
+    std::atomic_bool m_done{false};
+    std::mutex m_mutex{};
+};
+
+/**
+ * @brief 先用SendFile()发出整个文件，再用SendIovec()发出一段(头+体)重复的数据后关闭
+ */
+class BulkServer : public wtsclwq::TcpServer {
+  public:
+    BulkServer(int file_fd, size_t file_size, size_t extra,
+               wtsclwq::IOManager *worker, wtsclwq::IOManager *acceptor)
+        : TcpServer(worker, acceptor), m_file_fd(file_fd),
+          m_file_size(file_size), m_extra(extra) {}
+
+    auto IsKtlsSend() const -> bool { return m_ktls_send; }
+
+  protected:
+    void HandleClient(const wtsclwq::Socket::ptr &client) override {
+        // TcpServer在调用HandleClient()之前已经完成了握手
+        m_ktls_send =
+            std::dynamic_pointer_cast<wtsclwq::SslSocket>(client)->IsKtlsSend();
+        size_t offset = 0;
+        while (offset < m_file_size) {
+            ssize_t len =
+                client->SendFile(m_file_fd, static_cast<off_t>(offset),
+                                 m_file_size - offset);
+            if (len <= 0) {
+                client->Close();
+                return;
+            }
+            offset += len;
+        }
+        char header[16];
+        memset(header, 'h', sizeof(header));
+        std::string body(64 * 1024, 'b');
+        size_t sent = 0;
+        while (sent < m_extra) {
+            iovec iovs[2] = {{header, sizeof(header)}, {body.data(), body.size()}};
+            ssize_t len = client->SendIovec(iovs, 2, 0);
+            if (len <= 0) {
+                break;
+            }
+            sent += len;
+        }
+        client->Close();
+    }
+
+  private:
+    int m_file_fd;
+    size_t m_file_size;
+    size_t m_extra;
+    std::atomic_bool m_ktls_send{false};
+};
+
+/**
+ * @brief 回显一次后关闭的服务器
+ */
+class EchoServer : public wtsclwq::TcpServer {
+  public:
+    using TcpServer::TcpServer;
+
+  protected:
+    void HandleClient(const wtsclwq::Socket::ptr &client) override {
+        char buf[64];
+        ssize_t len = client->Recv(buf, sizeof(buf), 0);
+        if (len > 0) {
+            client->Send(buf, len, 0);
+        }
+        client->Close();
+    }
+};
+
+/**
+ * @brief 生成测试用的自签名证书和私钥
+ */
+static void WriteSelfSignedCert(const std::string &cert_file,
+                                const std::string &key_file) {
+    EVP_PKEY *pkey = EVP_EC_gen("prime256v1");
+    X509 *x509 = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+    X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+    X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600);
+    X509_set_pubkey(x509, pkey);
+    X509_NAME *name = X509_get_subject_name(x509);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                               reinterpret_cast<const unsigned char *>("localhost"),
+                               -1, -1, 0);
+    X509_set_issuer_name(x509, name);
+    X509_sign(x509, pkey, EVP_sha256());
+    FILE *file = fopen(cert_file.c_str(), "w");
+    PEM_write_X509(file, x509);
+    fclose(file);
+    file = fopen(key_file.c_str(), "w");
+    PEM_write_PrivateKey(file, pkey, nullptr, nullptr, 0, nullptr, nullptr);
+    fclose(file);
+    X509_free(x509);
+    EVP_PKEY_free(pkey);
+}
+
+static auto ConnectTo(int port) -> int {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int ret = connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    assert(ret == 0);
+    return fd;
+}
+
+void test_connection_limits() {
+    // 客户端用阻塞的原始调用，和服务器运行在不同的线程上
+    wtsclwq::IOManager acceptor(1, false, "acceptor");
+    wtsclwq::IOManager worker(1, false, "worker");
+    auto server = std::make_shared<HoldServer>(&worker, &acceptor);
+    server->SetMaxConnections(4);
+    server->SetDrainTimeout(200);
+    auto addr = wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0");
+    assert(server->Bind(addr));
+    assert(server->Start());
+    std::string info = server->ToString("");
+    int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+    // 达到上限后暂停accept，多出来的连接留在backlog中
+    std::vector<int> fds;
+    for (int i = 0; i < 6; ++i) {
+        fds.push_back(ConnectTo(port));
+    }
+    usleep(100 * 1000);
+    assert(server->GetActiveConnections() == 4);
+    close(fds[0]);
+    close(fds[1]);
+    usleep(100 * 1000);
+    assert(server->GetActiveConnections() == 4);
+
+    // 单IP上限：超出的连接被关闭
+    server->SetMaxConnections(0);
+    server->SetMaxConnectionsPerIp(5);
+    fds.push_back(ConnectTo(port));
+    fds.push_back(ConnectTo(port));
+    usleep(100 * 1000);
+    assert(server->GetActiveConnections() == 5);
+    char chr;
+    assert(read(fds.back(), &chr, 1) == 0);
+
+    // 停止后等待排空，超时后服务器shutdown剩余连接
+    server->Stop();
+    usleep(50 * 1000);
+    assert(server->GetActiveConnections() == 5);
+    usleep(300 * 1000);
+    assert(server->GetActiveConnections() == 0);
+    for (size_t i = 2; i < fds.size(); ++i) {
+        close(fds[i]);
+    }
+    LOG_INFO(g_logger, "test_connection_limits passed");
+}
+
+/**
+ * @brief 发一个字节，返回WorkerServer回复的worker下标
+ */
+static auto PingWorker(int fd) -> int {
+    char index = -1;
+    assert(write(fd, "p", 1) == 1);
+    assert(read(fd, &index, 1) == 1);
+    return index;
+}
+
+void test_worker_distribution() {
+    const int per_worker = 4;
+    wtsclwq::IOManager acceptor(1, false, "acceptor");
+    wtsclwq::IOManager worker0(2, false, "worker0");
+    wtsclwq::IOManager worker1(2, false, "worker1");
+    wtsclwq::IOManager worker2(2, false, "worker2");
+    auto server = std::make_shared<WorkerServer>(
+        std::vector<wtsclwq::IOManager *>{&worker0, &worker1, &worker2},
+        &acceptor);
+    assert(server->GetWorkerCount() == 3);
+    assert(server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+    assert(server->Start());
+    std::string info = server->ToString("");
+    int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+    // 新连接交给连接数最少的worker，3*N个连接平均分到3个worker上
+    std::vector<int> fds;
+    std::vector<int> assigned;
+    int counts[3] = {0, 0, 0};
+    for (int i = 0; i < 3 * per_worker; ++i) {
+        fds.push_back(ConnectTo(port));
+        assigned.push_back(PingWorker(fds.back()));
+        assert(assigned.back() >= 0 && assigned.back() < 3);
+        ++counts[assigned.back()];
+    }
+    for (size_t i = 0; i < 3; ++i) {
+        assert(counts[i] == per_worker);
+        assert(server->GetWorkerConnections(i) == per_worker);
+    }
+
+    // 关闭worker1上的连接后，新连接都交给worker1
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (assigned[i] == 1) {
+            close(fds[i]);
+            fds[i] = -1;
+        }
+    }
+    for (int i = 0; i < 100 && server->GetWorkerConnections(1) != 0; ++i) {
+        usleep(10 * 1000);
+    }
+    assert(server->GetWorkerConnections(1) == 0);
+    for (int i = 0; i < per_worker; ++i) {
+        fds.push_back(ConnectTo(port));
+        assigned.push_back(PingWorker(fds.back()));
+        assert(assigned.back() == 1);
+    }
+    for (size_t i = 0; i < 3; ++i) {
+        assert(server->GetWorkerConnections(i) == per_worker);
+    }
+
+    // 连接的处理协程每次挂起后都在分配到的worker上恢复
+    for (int round = 0; round < 5; ++round) {
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i] != -1) {
+                assert(PingWorker(fds[i]) == assigned[i]);
+            }
+        }
+        usleep(10 * 1000);
+    }
+    assert(server->GetMoves() == 0);
+
+    for (int fd : fds) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    server->Stop();
+    for (int i = 0; i < 100 && server->GetActiveConnections() != 0; ++i) {
+        usleep(10 * 1000);
+    }
+    assert(server->GetActiveConnections() == 0);
+    LOG_INFO(g_logger, "test_worker_distribution passed");
+}
+
+/**
+ * @brief 连接、读到服务器的回复和EOF后关闭，由服务器一方进入TIME_WAIT
+ */
+static auto ConnectAndRead(int port) -> bool {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    char buf[8];
+    bool ok = connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ==
+                  0 &&
+              read(fd, buf, sizeof(buf)) == 1 && read(fd, buf, sizeof(buf)) == 0;
+    close(fd);
+    return ok;
+}
+
+void test_reuseport_listeners() {
+    wtsclwq::IOManager acceptor(4, false, "acceptor");
+    auto server = std::make_shared<ListenerServer>(&acceptor, &acceptor);
+    server->SetReusePortListeners(4);
+    assert(server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+
+    // 4个监听socket绑定同一个端口
+    std::string info = server->ToString("");
+    std::vector<int> ports;
+    for (size_t pos = info.find("127.0.0.1:"); pos != std::string::npos;
+         pos = info.find("127.0.0.1:", pos + 1)) {
+        ports.push_back(atoi(info.c_str() + pos + 10));
+    }
+    assert(ports.size() == 4);
+    for (int port : ports) {
+        assert(port != 0 && port == ports[0]);
+    }
+
+    // 内核按四元组把连接分散到各个监听socket上，每个socket都accept到连接
+    assert(server->Start());
+    for (int i = 0; i < 200; ++i) {
+        assert(ConnectAndRead(ports[0]));
+    }
+    assert(server->GetListeners() == 4);
+    int total = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        assert(server->GetAccepts(i) > 0);
+        total += server->GetAccepts(i);
+    }
+    assert(total == 200);
+    server->Stop();
+    LOG_INFO(g_logger, "test_reuseport_listeners passed");
+}
+
+/**
+ * @brief 多线程acceptor上分别用1个和每个线程一个SO_REUSEPORT监听socket，
+ * 测量回环上每秒完成的连接数
+ */
+void bench_accept_rate() {
+    const int client_threads = 4;
+    const double duration = 2.0;
+    auto sys_logger = GET_LOGGER_BY_NAME("system");
+    auto old_level = sys_logger->GetLevel();
+    sys_logger->SetLevel(wtsclwq::LogLevel::Level::ERROR);
+    double rates[2] = {0, 0};
+    wtsclwq::IOManager acceptor(4, false, "acceptor");
+    wtsclwq::IOManager worker(4, false, "worker");
+    // 0表示acceptor的每个线程一个监听socket
+    for (size_t listeners : {1, 0}) {
+        auto server = std::make_shared<TagServer>('B', &worker, &acceptor);
+        server->SetReusePortListeners(listeners);
+        assert(
+            server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+        assert(server->Start());
+        std::string info = server->ToString("");
+        int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+        std::atomic_int connections{0};
+        std::atomic_int failures{0};
+        auto start = std::chrono::steady_clock::now();
+        auto stop_at = start + std::chrono::duration<double>(duration);
+        std::vector<std::thread> clients;
+        for (int i = 0; i < client_threads; ++i) {
+            clients.emplace_back([&]() {
+                while (std::chrono::steady_clock::now() < stop_at) {
+                    if (ConnectAndRead(port)) {
+                        ++connections;
+                    } else {
+                        ++failures;
+                    }
+                }
+            });
+        }
+        for (auto &client : clients) {
+            client.join();
+        }
+        double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        assert(connections > 0);
+        assert(failures == 0);
+        rates[listeners == 1 ? 0 : 1] = connections / elapsed;
+        server->Stop();
+    }
+    sys_logger->SetLevel(old_level);
+    LOG_CUSTOM_INFO(g_logger,
+                    "accept rate with 4 acceptor threads on loopback: "
+                    "1 listener %.0f conn/s, 4 listeners %.0f conn/s",
+                    rates[0], rates[1])
+}
+
 void test_tcp_server() {
     int ret;
 
@@ -41,7 +545,306 @@ void test_tcp_server() {
     }
 }
 
+void test_idle_reaping() {
+    wtsclwq::Config::LookupByName<uint64_t>("tcp_server.idle_check_interval")
+        ->SetValue(50);
+    wtsclwq::IOManager acceptor(1, false, "acceptor");
+    wtsclwq::IOManager worker(1, false, "worker");
+    auto server = std::make_shared<HoldServer>(&worker, &acceptor);
+    server->SetIdleTimeout(300);
+    auto addr = wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0");
+    assert(server->Bind(addr));
+    assert(server->Start());
+    std::string info = server->ToString("");
+    int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+    int idle_fd = ConnectTo(port);
+    int busy_fd = ConnectTo(port);
+    // 一直有数据的连接不会被回收，不发数据的连接超时后被服务器shutdown
+    for (int i = 0; i < 10; ++i) {
+        assert(write(busy_fd, "x", 1) == 1);
+        usleep(100 * 1000);
+    }
+    char chr;
+    assert(read(idle_fd, &chr, 1) == 0);
+    assert(server->GetActiveConnections() == 1);
+    close(idle_fd);
+    close(busy_fd);
+    server->Stop();
+    usleep(100 * 1000);
+    assert(server->GetActiveConnections() == 0);
+    LOG_INFO(g_logger, "test_idle_reaping passed");
+}
+
+void test_hot_restart() {
+    const std::string path = "/tmp/tcp_server_test_hot_restart.sock";
+    wtsclwq::IOManager old_iom(1, false, "old");
+    wtsclwq::IOManager new_iom(1, false, "new");
+    auto old_server = std::make_shared<TagServer>('O', &old_iom, &old_iom);
+    auto new_server = std::make_shared<TagServer>('N', &new_iom, &new_iom);
+    assert(!new_server->InheritListeners(path));
+    assert(old_server->Bind(
+        wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+    assert(old_server->Start());
+    assert(old_server->ServeHotRestart(path));
+    std::string info = old_server->ToString("");
+    int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+    // 交接期间客户端一直在连，不应该出现连接被拒绝
+    std::atomic_bool stop{false};
+    std::atomic_int failures{0};
+    std::atomic_char last_tag{0};
+    std::thread client([&]() {
+        while (!stop) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            char tag = 0;
+            if (connect(fd, reinterpret_cast<sockaddr *>(&addr),
+                        sizeof(addr)) != 0 ||
+                read(fd, &tag, 1) != 1) {
+                ++failures;
+            } else {
+                last_tag = tag;
+            }
+            close(fd);
+        }
+    });
+    usleep(100 * 1000);
+    assert(last_tag == 'O');
+
+    assert(new_server->InheritListeners(path));
+    assert(new_server->Start());
+    for (int i = 0; i < 100 && !old_server->IsStop(); ++i) {
+        usleep(10 * 1000);
+    }
+    assert(old_server->IsStop());
+    usleep(100 * 1000);
+    stop = true;
+    client.join();
+    assert(failures == 0);
+    assert(last_tag == 'N');
+    // 新进程可以在同一路径上等待下一次重启
+    assert(new_server->ServeHotRestart(path));
+    new_server->Stop();
+    LOG_INFO(g_logger, "test_hot_restart passed");
+}
+
+void test_ssl_handshake() {
+    const std::string cert_file = "/tmp/tcp_server_test_cert.pem";
+    const std::string key_file = "/tmp/tcp_server_test_key.pem";
+    WriteSelfSignedCert(cert_file, key_file);
+    wtsclwq::Config::LookupByName<uint64_t>("tcp_server.ssl_handshake_timeout")
+        ->SetValue(300);
+    wtsclwq::IOManager acceptor(1, false, "acceptor");
+    wtsclwq::IOManager worker(1, false, "worker");
+    auto server = std::make_shared<EchoServer>(&worker, &acceptor);
+    assert(server->LoadCertificates(cert_file, key_file));
+    assert(server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+    assert(server->Start());
+    std::string info = server->ToString("");
+    int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+    // 不发ClientHello的连接只占住自己的worker协程，不影响后面的accept和握手
+    int slow_fd = ConnectTo(port);
+    auto addr = wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1");
+    std::dynamic_pointer_cast<wtsclwq::IPAddress>(addr)->SetPort(port);
+    auto client = wtsclwq::SslSocket::CreateTcpSslSocket(addr);
+    assert(client->Connect(addr, 1000));
+    assert(client->Send("ping", 4, 0) == 4);
+    char buf[8];
+    assert(client->Recv(buf, sizeof(buf), 0) == 4);
+    assert(memcmp(buf, "ping", 4) == 0);
+    client->Close();
+
+    // 握手超时后服务器关闭连接
+    char chr;
+    assert(read(slow_fd, &chr, 1) == 0);
+    close(slow_fd);
+    server->Stop();
+    usleep(100 * 1000);
+    assert(server->GetActiveConnections() == 0);
+    LOG_INFO(g_logger, "test_ssl_handshake passed");
+}
+
+/**
+ * @brief TLS连接发一次ping并读回显
+ * @return 这次握手是否复用了会话
+ */
+static auto SslPing(int port) -> bool {
+    auto addr = wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1");
+    std::dynamic_pointer_cast<wtsclwq::IPAddress>(addr)->SetPort(port);
+    auto client = wtsclwq::SslSocket::CreateTcpSslSocket(addr);
+    assert(client->Connect(addr, 1000));
+    assert(client->Send("ping", 4, 0) == 4);
+    char buf[8];
+    // TLS1.3的会话票据在握手之后到达，在这次读中被客户端保存
+    assert(client->Recv(buf, sizeof(buf), 0) == 4);
+    bool reused = client->IsSessionReused();
+    client->Close();
+    return reused;
+}
+
+void test_ssl_resumption() {
+    const std::string cert_file = "/tmp/tcp_server_test_cert.pem";
+    const std::string key_file = "/tmp/tcp_server_test_key.pem";
+    wtsclwq::IOManager iom(1, false, "ssl");
+    for (bool tickets : {true, false}) {
+        wtsclwq::Config::LookupByName<bool>("ssl.session_tickets")
+            ->SetValue(tickets);
+        auto server = std::make_shared<EchoServer>(&iom, &iom);
+        assert(server->LoadCertificates(cert_file, key_file));
+        assert(
+            server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+        assert(server->Start());
+        std::string info = server->ToString("");
+        int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+        // 第一次完整握手，之后按目标复用保存的会话
+        assert(!SslPing(port));
+        for (int i = 0; i < 4; ++i) {
+            assert(SslPing(port));
+        }
+        usleep(50 * 1000);
+        wtsclwq::SslSessionStats stats = server->GetSslSessionStats();
+        assert(stats.handshakes == 5);
+        assert(stats.resumed == 4);
+        if (tickets) {
+            assert(stats.cache_hits == 0);
+        } else {
+            // 不发无状态票据时从分片缓存中复用
+            assert(stats.cache_hits == 4);
+        }
+        server->Stop();
+        LOG_CUSTOM_INFO(g_logger,
+                        "tickets = %d, handshakes = %lu, resumed = %lu, "
+                        "resumption rate = %.2f",
+                        tickets, stats.handshakes, stats.resumed,
+                        stats.GetResumptionRate())
+    }
+    LOG_INFO(g_logger, "test_ssl_resumption passed");
+}
+
+void test_ssl_coalesce() {
+    const std::string cert_file = "/tmp/tcp_server_test_cert.pem";
+    const std::string key_file = "/tmp/tcp_server_test_key.pem";
+    wtsclwq::IOManager iom(1, false, "coalesce");
+    auto server = std::make_shared<RecordServer>(&iom, &iom);
+    assert(server->LoadCertificates(cert_file, key_file));
+    assert(server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+    assert(server->Start());
+    std::string info = server->ToString("");
+    int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+    // 64个100字节的小块，再加一个跨越两个记录的40000字节的块
+    std::vector<std::string> parts;
+    std::vector<iovec> iovs;
+    std::string expected;
+    for (int i = 0; i < 64; ++i) {
+        parts.emplace_back(100, static_cast<char>('a' + i % 26));
+    }
+    parts.emplace_back(40000, 'z');
+    for (auto &part : parts) {
+        iovs.push_back({part.data(), part.size()});
+        expected += part;
+    }
+    auto addr = wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1");
+    std::dynamic_pointer_cast<wtsclwq::IPAddress>(addr)->SetPort(port);
+    auto client = wtsclwq::SslSocket::CreateTcpSslSocket(addr);
+    assert(client->Connect(addr, 1000));
+    assert(client->SendIovec(iovs.data(), iovs.size(), 0) ==
+           static_cast<ssize_t>(expected.size()));
+    client->Close();
+    for (int i = 0; i < 100 && !server->IsDone(); ++i) {
+        usleep(10 * 1000);
+    }
+    assert(server->GetData() == expected);
+    // 46400字节拼成16KB、16KB、13632字节三个记录，逐个写时是65个
+    assert(server->GetReads() == 3);
+    server->Stop();
+    LOG_INFO(g_logger, "test_ssl_coalesce passed");
+}
+
+/**
+ * @brief 分别关闭、开启ssl.ktls，校验SendFile()发出的文件内容，并测量TLS回环上的吞吐。
+ * 内核没有tls模块时开启ssl.ktls也退回用户态加密，两次结果相当
+ */
+void test_ssl_ktls() {
+    const std::string cert_file = "/tmp/tcp_server_test_cert.pem";
+    const std::string key_file = "/tmp/tcp_server_test_key.pem";
+    const std::string data_file = "/tmp/tcp_server_test_data";
+    const size_t file_size = 1024 * 1024 + 123;
+    const size_t extra = 128 * 1024 * 1024;
+    std::string content(file_size, 0);
+    for (size_t i = 0; i < file_size; ++i) {
+        content[i] = static_cast<char>(i * 7 % 251);
+    }
+    int file_fd = open(data_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(file_fd >= 0);
+    assert(write(file_fd, content.data(), file_size) ==
+           static_cast<ssize_t>(file_size));
+
+    wtsclwq::IOManager iom(1, false, "ktls");
+    for (bool ktls : {false, true}) {
+        wtsclwq::Config::LookupByName<bool>("ssl.ktls")->SetValue(ktls);
+        auto server =
+            std::make_shared<BulkServer>(file_fd, file_size, extra, &iom, &iom);
+        assert(server->LoadCertificates(cert_file, key_file));
+        assert(
+            server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+        assert(server->Start());
+        std::string info = server->ToString("");
+        int port = atoi(info.c_str() + info.find("127.0.0.1:") + 10);
+
+        auto addr = wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1");
+        std::dynamic_pointer_cast<wtsclwq::IPAddress>(addr)->SetPort(port);
+        auto client = wtsclwq::SslSocket::CreateTcpSslSocket(addr);
+        auto start = std::chrono::steady_clock::now();
+        assert(client->Connect(addr, 1000));
+        std::string received;
+        received.reserve(file_size);
+        std::string buf(64 * 1024, 0);
+        size_t total = 0;
+        ssize_t len = 0;
+        while ((len = client->Recv(buf.data(), buf.size(), 0)) > 0) {
+            if (received.size() < file_size) {
+                received.append(buf.data(),
+                                std::min<size_t>(len, file_size - received.size()));
+            }
+            total += len;
+        }
+        double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+        assert(received == content);
+        assert(total >= file_size + extra);
+        LOG_CUSTOM_INFO(g_logger,
+                        "ssl.ktls = %d, ktls send = %d, throughput = %.0f MB/s",
+                        ktls, server->IsKtlsSend(),
+                        static_cast<double>(total) / elapsed / 1024 / 1024)
+        client->Close();
+        server->Stop();
+    }
+    wtsclwq::Config::LookupByName<bool>("ssl.ktls")->SetValue(false);
+    close(file_fd);
+    unlink(data_file.c_str());
+    LOG_INFO(g_logger, "test_ssl_ktls passed");
+}
+
 int main(int argc, char *argv[]) {
+    test_connection_limits();
+    test_worker_distribution();
+    test_reuseport_listeners();
+    bench_accept_rate();
+    test_idle_reaping();
+    test_hot_restart();
+    test_ssl_handshake();
+    test_ssl_resumption();
+    test_ssl_coalesce();
+    test_ssl_ktls();
+
     wtsclwq::IOManager iom(2);
     iom.Schedule(&test_tcp_server);
 
@@ -0,0 +1,223 @@
+/**
+ * @file udp_server_test.cpp
+ * @brief 测试UdpServer，以及和逐个收发的回显循环对比回环上的包速率
+ */
+
+#include "../src/include/server/udp_server.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../src/include/io/fd_manager.h"
+#include "../src/include/io/hook.h"
+#include "../src/include/log/log_manager.h"
+#include "../src/include/socket/ip_address.h"
+#include "../src/include/socket/ipv4_address.h"
+
+static wtsclwq::Logger::ptr g_logger = ROOT_LOGGER;
+
+static auto ServerPort(const wtsclwq::UdpServer::ptr &server) -> int {
+    auto addr = std::dynamic_pointer_cast<wtsclwq::IPAddress>(
+        server->GetSocket()->GetLocalAddress());
+    return addr->GetPort();
+}
+
+static auto LoopbackAddr(int port) -> sockaddr_in {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+/**
+ * @brief 客户端用阻塞的原始调用，带接收超时
+ */
+static auto ClientSocket(int port) -> int {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = LoopbackAddr(port);
+    int ret = connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    assert(ret == 0);
+    timeval tv{0, 200 * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int buf_size = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+    return fd;
+}
+
+void test_echo() {
+    wtsclwq::IOManager iom(1, false, "udp");
+    auto server = std::make_shared<wtsclwq::UdpServer>(&iom, &iom);
+    assert(server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+    assert(server->Start());
+    int fd = ClientSocket(ServerPort(server));
+
+    char buf[4096];
+    assert(send(fd, "hello", 5, 0) == 5);
+    assert(recv(fd, buf, sizeof(buf), 0) == 5);
+    assert(memcmp(buf, "hello", 5) == 0);
+
+    // 超过max_datagram_size的数据报被丢弃，不回复
+    memset(buf, 'x', sizeof(buf));
+    assert(send(fd, buf, sizeof(buf), 0) == sizeof(buf));
+    assert(recv(fd, buf, sizeof(buf), 0) == -1);
+
+    // 一次发出一批等长数据报，回复可能被GSO合并，但客户端收到的仍是一个个数据报
+    const int count = 64;
+    mmsghdr msgs[count]{};
+    iovec iovs[count]{};
+    char payload[count][100];
+    for (int i = 0; i < count; ++i) {
+        memset(payload[i], 'a' + i % 26, sizeof(payload[i]));
+        iovs[i] = {payload[i], sizeof(payload[i])};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    assert(sendmmsg(fd, msgs, count, 0) == count);
+    int received = 0;
+    ssize_t len = 0;
+    while ((len = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        assert(len == 100);
+        ++received;
+    }
+    assert(received == count);
+    assert(server->GetSendCount() == count + 1);
+    close(fd);
+    server->Stop();
+    LOG_CUSTOM_INFO(g_logger, "test_echo passed, gso = %d",
+                    server->IsGsoEnabled())
+}
+
+/**
+ * @brief 逐个RecvFrom/SendTo的回显循环，作为对比基线
+ */
+static void NaiveEcho(const wtsclwq::Socket::ptr &sock) {
+    wtsclwq::Address::ptr from = std::make_shared<wtsclwq::IPv4Address>();
+    char buf[2048];
+    while (true) {
+        int len = static_cast<int>(sock->RecvFrom(buf, sizeof(buf), from, 0));
+        if (len < 0) {
+            break;
+        }
+        sock->SendTo(buf, len, from, 0);
+    }
+}
+
+/**
+ * @brief 客户端两个线程，一个用sendmmsg批量发送，一个统计回复，
+ * 未回复的数据报不超过window，丢包时补发窗口
+ * @return 每秒收到的回复数
+ */
+static auto MeasurePps(int port, int seconds) -> double {
+    int fd = ClientSocket(port);
+    const int window = 1024;
+    const int burst = 64;
+    std::atomic_int64_t sent{0};
+    std::atomic_int64_t received{0};
+    std::atomic_bool stop{false};
+    std::thread receiver([&]() {
+        mmsghdr msgs[burst]{};
+        iovec iovs[burst]{};
+        char bufs[burst][64];
+        for (int i = 0; i < burst; ++i) {
+            iovs[i] = {bufs[i], sizeof(bufs[i])};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        while (!stop) {
+            int n = recvmmsg(fd, msgs, burst, MSG_WAITFORONE, nullptr);
+            if (n > 0) {
+                received += n;
+            }
+        }
+    });
+
+    mmsghdr msgs[burst]{};
+    iovec iovs[burst]{};
+    char payload[32] = "ping";
+    for (int i = 0; i < burst; ++i) {
+        iovs[i] = {payload, sizeof(payload)};
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::seconds(seconds);
+    auto last_progress = start;
+    int64_t last_received = 0;
+    int64_t lost = 0;
+    while (std::chrono::steady_clock::now() < end) {
+        if (sent - lost - received > window - burst) {
+            auto now = std::chrono::steady_clock::now();
+            if (received != last_received) {
+                last_received = received;
+                last_progress = now;
+            } else if (now - last_progress > std::chrono::milliseconds(20)) {
+                // 窗口内的数据报已经丢失
+                lost = sent - received;
+                last_progress = now;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        int n = sendmmsg(fd, msgs, burst, 0);
+        if (n > 0) {
+            sent += n;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    stop = true;
+    receiver.join();
+    close(fd);
+    return static_cast<double>(received) / elapsed;
+}
+
+void bench_pps() {
+    // 服务端和客户端不共享线程，压测期间日志只保留错误
+    auto sys_logger = GET_LOGGER_BY_NAME("system");
+    auto old_level = sys_logger->GetLevel();
+    sys_logger->SetLevel(wtsclwq::LogLevel::Level::ERROR);
+    double batched = 0;
+    double naive = 0;
+    {
+        wtsclwq::IOManager iom(1, false, "udp");
+        auto server = std::make_shared<wtsclwq::UdpServer>(&iom, &iom);
+        assert(
+            server->Bind(wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0")));
+        server->Start();
+        batched = MeasurePps(ServerPort(server), 2);
+        server->Stop();
+    }
+    {
+        wtsclwq::IOManager iom(1, false, "udp");
+        auto addr = wtsclwq::IPAddress::LookupAnyAddress("127.0.0.1:0");
+        auto sock = wtsclwq::Socket::CreateUdpSocket(addr);
+        assert(sock->Bind(addr));
+        wtsclwq::FileDescriptorManager::GetInstancePtr()->Get(
+            sock->GetSocket(), true);
+        iom.Schedule([sock]() { NaiveEcho(sock); });
+        auto local = std::dynamic_pointer_cast<wtsclwq::IPAddress>(
+            sock->GetLocalAddress());
+        naive = MeasurePps(local->GetPort(), 2);
+        iom.Schedule([sock]() {
+            sock->CancelAll();
+            sock->Close();
+        });
+    }
+    sys_logger->SetLevel(old_level);
+    LOG_CUSTOM_INFO(g_logger,
+                    "udp echo on loopback: batched %.0f pps, naive %.0f pps",
+                    batched, naive)
+}
+
+int main() {
+    test_echo();
+    bench_pps();
+    return 0;
+}
@@ -89,6 +89,12 @@ target("tcp_server_test")
     set_kind("binary")
     add_files("test/tcp_server_test.cpp")
     add_deps("server","http","serialize","socket","log","util","config","concurrency","timer","io")
+    add_packages("openssl")
+
+target("udp_server_test")
+    set_kind("binary")
+    add_files("test/udp_server_test.cpp")
+    add_deps("server","http","serialize","socket","log","util","config","concurrency","timer","io")
 
 target("tcp_client_test")
     set_kind("binary")